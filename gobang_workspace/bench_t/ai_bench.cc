@@ -0,0 +1,66 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#include "../server/ai.hpp"
+
+/*
+* 人机对战搜索性能测试
+* 对几个固定局面各搜索100ms，统计每秒搜索的节点数以及达到的搜索深度
+*/
+
+#define BENCH_TIME 100
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 按行列坐标依次落子构造局面，白棋先行
+static std::vector<std::vector<int>> make_board(const std::vector<std::pair<int, int>> &moves)
+{
+    std::vector<std::vector<int>> board(AI_SIZE, std::vector<int>(AI_SIZE, 0));
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        board[moves[i].first][moves[i].second] = (i % 2 == 0) ? AI_WHITE : AI_BLACK;
+    }
+    return board;
+}
+
+int main()
+{
+    std::vector<std::vector<std::pair<int, int>>> suite = {
+        {{7, 7}},
+        {{7, 7}, {7, 8}, {8, 8}, {6, 6}, {8, 7}},
+        {{7, 7}, {8, 8}, {6, 8}, {8, 6}, {8, 7}, {9, 7}, {6, 6}, {5, 5}, {6, 7}, {5, 7}},
+        {{7, 7}, {7, 8}, {6, 7}, {8, 7}, {6, 8}, {8, 9}, {5, 9}, {6, 6}, {4, 10}, {3, 11}, {5, 7}, {4, 7}, {5, 8}, {5, 6}},
+    };
+    ai_engine engine;
+    uint64_t total_nodes = 0;
+    int64_t total_us = 0;
+    for (size_t i = 0; i < suite.size(); ++i)
+    {
+        ai_board board;
+        board.load(make_board(suite[i]), suite[i].size() % 2 == 0 ? AI_WHITE : AI_BLACK);
+        ai_result res;
+        // res.ms是毫秒，短搜索会是0，节点速度按微秒计时
+        bench_clock::time_point start = bench_clock::now();
+        engine.search(board, BENCH_TIME, res);
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count();
+        total_nodes += res.nodes;
+        total_us += us;
+        std::cout << "position " << i << " stones:" << suite[i].size()
+                  << " best:(" << res.row << "," << res.col << ")"
+                  << " depth:" << res.depth
+                  << " nodes:" << res.nodes
+                  << " nps:";
+        if (us > 0)
+            std::cout << res.nodes * 1000000 / us;
+        else
+            std::cout << "n/a";
+        std::cout << " time:" << us << "us" << std::endl;
+    }
+    std::cout << "total nps: ";
+    if (total_us > 0)
+        std::cout << total_nodes * 1000000 / total_us << std::endl;
+    else
+        std::cout << "n/a" << std::endl;
+    return 0;
+}
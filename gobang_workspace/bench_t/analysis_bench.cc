@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#include "../server/analysis.hpp"
+
+/*
+* 复盘分析并行搜索性能测试
+* 分别使用1到16个线程，对固定的局面集合搜索到固定深度，统计总耗时以及相对单线程的加速比
+*/
+
+#define BENCH_DEPTH 8
+#define BENCH_TIME 60000
+
+// 按行列坐标依次落子构造局面，白棋先行
+static std::vector<std::vector<int>> make_board(const std::vector<std::pair<int, int>> &moves)
+{
+    std::vector<std::vector<int>> board(AI_SIZE, std::vector<int>(AI_SIZE, 0));
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        board[moves[i].first][moves[i].second] = (i % 2 == 0) ? AI_WHITE : AI_BLACK;
+    }
+    return board;
+}
+
+int main()
+{
+    std::vector<std::vector<std::pair<int, int>>> suite = {
+        {{7, 7}, {7, 8}},
+        {{7, 7}, {7, 8}, {8, 8}, {6, 6}, {8, 7}, {6, 7}},
+        {{7, 7}, {8, 6}, {6, 8}, {9, 5}, {7, 9}, {6, 6}, {5, 7}, {8, 8}},
+        {{7, 7}, {6, 8}, {8, 8}, {6, 6}, {6, 7}, {8, 6}, {7, 6}, {7, 8}, {9, 9}, {5, 5}},
+    };
+    int threads[] = {1, 2, 4, 8, 16};
+    long base_ms = 0;
+    for (int t : threads)
+    {
+        analysis_service as(t);
+        uint64_t nodes = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < suite.size(); ++i)
+        {
+            ai_board board;
+            board.load(make_board(suite[i]), suite[i].size() % 2 == 0 ? AI_WHITE : AI_BLACK);
+            ai_result res;
+            as.search_position(board, BENCH_DEPTH, BENCH_TIME, res);
+            nodes += res.nodes;
+        }
+        long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if (t == 1)
+            base_ms = ms;
+        std::cout << "threads:" << t << " depth:" << BENCH_DEPTH << " time:" << ms << "ms"
+                  << " main thread nodes:" << nodes
+                  << " speedup:" << (ms > 0 ? (double)base_ms / ms : 0) << std::endl;
+    }
+    return 0;
+}
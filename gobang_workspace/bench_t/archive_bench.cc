@@ -0,0 +1,276 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "../server/archive.hpp"
+
+/*
+* 对局归档测试
+* 1. 编解码：随机生成的对局编码后解码一致，统计每局的字节数（含长度和校验）
+* 2. 恢复：小段文件写入BENCH_CHECK_GAMES局（封存多个段），关闭后在最后一个段尾部写入半条记录、删除一个封存段的索引文件，
+*    重新打开后尾部被截断、索引重建，按id和按玩家查询的结果不变，新的对局id接着分配
+* 3. 性能：写入BENCH_GAMES局的吞吐，之后随机按id读取、按玩家查询最近的对局的延迟分布
+*
+* 对局按常见的走法生成：第一步在中心附近，之后落在已有棋子的两格以内，15~60步，每步间隔1~20秒
+*/
+
+#define BENCH_DIR "./archive_bench.dir"
+#define BENCH_GAMES 1000000
+#define BENCH_CHECK_GAMES 20000
+#define BENCH_LOOKUPS 100000
+#define BENCH_PLAYERS 100000
+#define BENCH_AI_UID ((uint64_t)1 << 32)
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void remove_dir(const std::string &dir)
+{
+    DIR *dp = opendir(dir.c_str());
+    if (dp == nullptr)
+        return;
+    struct dirent *de;
+    while ((de = readdir(dp)) != nullptr)
+    {
+        std::string name = de->d_name;
+        if (name != "." && name != "..")
+            unlink((dir + "/" + name).c_str());
+    }
+    closedir(dp);
+    rmdir(dir.c_str());
+}
+
+static void random_game(std::mt19937_64 &rng, uint64_t room_id, archive_game &g)
+{
+    g.room_id = room_id;
+    g.white_id = 1 + rng() % BENCH_PLAYERS;
+    g.black_id = rng() % 10 == 0 ? BENCH_AI_UID : 1 + rng() % BENCH_PLAYERS;
+    g.white_rating = 1200 + rng() % 1000;
+    g.black_rating = 1200 + rng() % 1000;
+    g.result = (archive_result)(rng() % 3);
+    g.rule = rng() % 3;
+    g.variant = 0;
+    g.cols = 15;
+    g.start_ms = 1760000000000ULL + rng() % 100000000000ULL;
+    g.squares.clear();
+    g.times.clear();
+    std::vector<bool> taken(225, false);
+    int n = 15 + rng() % 46;
+    uint64_t elapsed = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        int row, col;
+        do
+        {
+            if (i == 0)
+            {
+                row = 7 + (int)(rng() % 3) - 1;
+                col = 7 + (int)(rng() % 3) - 1;
+            }
+            else
+            {
+                int base = g.squares[rng() % g.squares.size()];
+                row = base / 15 + (int)(rng() % 5) - 2;
+                col = base % 15 + (int)(rng() % 5) - 2;
+            }
+        } while (row < 0 || row >= 15 || col < 0 || col >= 15 || taken[row * 15 + col]);
+        taken[row * 15 + col] = true;
+        g.squares.push_back(row * 15 + col);
+        // 大多数落子在几秒内，偶尔长考
+        uint32_t ms = rng() % 8 == 0 ? 5000 + rng() % 15000 : 1000 + rng() % 5000;
+        g.times.push_back(ms);
+        elapsed += ms;
+    }
+    g.end_ms = g.start_ms + elapsed + 500;
+}
+
+static bool same(const archive_game &a, const archive_game &b)
+{
+    return a.room_id == b.room_id && a.white_id == b.white_id && a.black_id == b.black_id && a.white_rating == b.white_rating &&
+           a.black_rating == b.black_rating && a.result == b.result && a.rule == b.rule && a.variant == b.variant &&
+           a.cols == b.cols && a.start_ms == b.start_ms && a.end_ms == b.end_ms && a.squares == b.squares && a.times == b.times;
+}
+
+static bool check_codec()
+{
+    std::mt19937_64 rng(1);
+    std::vector<size_t> sizes;
+    bool ok = true;
+    for (int i = 0; i < 100000 && ok; ++i)
+    {
+        archive_game g, d;
+        random_game(rng, i + 1, g);
+        std::string body;
+        archive_codec::encode(g, body);
+        ok = archive_codec::decode(body.data(), body.data() + body.size(), d) && same(g, d);
+        // 截断的编码不能被解码
+        ok = ok && archive_codec::decode(body.data(), body.data() + body.size() - 1, d) == false;
+        sizes.push_back(body.size() + 5); // 长度1字节和crc32
+    }
+    std::sort(sizes.begin(), sizes.end());
+    double avg = 0;
+    for (size_t s : sizes)
+        avg += s;
+    avg /= sizes.size();
+    printf("bytes per game (15~60 moves, framed): avg %.1f p50 %lu p99 %lu max %lu\n", avg, (unsigned long)sizes[sizes.size() / 2],
+           (unsigned long)sizes[sizes.size() * 99 / 100], (unsigned long)sizes.back());
+    return ok && sizes[sizes.size() / 2] < 200;
+}
+
+// 文件的大小
+static off_t file_size(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static bool check_recovery()
+{
+    remove_dir(BENCH_DIR);
+    std::mt19937_64 rng(2);
+    std::vector<archive_game> games;
+    std::unordered_map<uint64_t, std::vector<uint64_t>> by_uid;
+    size_t segments;
+    {
+        game_archive ga(BENCH_DIR, 256 << 10);
+        if (ga.open() == false)
+            return false;
+        for (uint64_t i = 1; i <= BENCH_CHECK_GAMES; ++i)
+        {
+            archive_game g;
+            random_game(rng, i, g);
+            uint64_t gid = ga.append(g);
+            if (gid != i)
+                return false;
+            games.push_back(g);
+            by_uid[g.white_id].push_back(gid);
+            if (g.black_id != g.white_id)
+                by_uid[g.black_id].push_back(gid);
+        }
+        ga.flush();
+        segments = ga.segments();
+        if (segments < 3 || ga.count() != BENCH_CHECK_GAMES)
+            return false;
+    }
+    // 最后一个段写入半条记录，删除第一个段的索引文件
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%016lu.seg", BENCH_DIR, 1UL);
+    unlink((std::string(name) + ".idx").c_str());
+    DIR *dp = opendir(BENCH_DIR);
+    std::string last;
+    struct dirent *de;
+    while ((de = readdir(dp)) != nullptr)
+    {
+        std::string n = de->d_name;
+        if (n.size() == 20 && n > last)
+            last = n;
+    }
+    closedir(dp);
+    last = std::string(BENCH_DIR) + "/" + last;
+    off_t size = file_size(last);
+    FILE *fp = fopen(last.c_str(), "ab");
+    fwrite("\x90\x01garbage", 1, 9, fp);
+    fclose(fp);
+
+    game_archive ga(BENCH_DIR, 256 << 10);
+    bool ok = ga.open() && ga.count() == BENCH_CHECK_GAMES && ga.segments() == segments && file_size(last) == size;
+    for (int i = 0; i < 2000 && ok; ++i)
+    {
+        uint64_t gid = 1 + rng() % BENCH_CHECK_GAMES;
+        archive_game g;
+        ok = ga.get(gid, g) && g.game_id == gid && same(g, games[gid - 1]);
+    }
+    archive_game g;
+    ok = ok && ga.get(0, g) == false && ga.get(BENCH_CHECK_GAMES + 1, g) == false;
+    for (auto it = by_uid.begin(); it != by_uid.end() && ok; ++it)
+    {
+        std::vector<uint64_t> got, expect(it->second.rbegin(), it->second.rend());
+        ga.games_of(it->first, expect.size() + 10, got);
+        ok = got == expect;
+    }
+    random_game(rng, 0, g);
+    ok = ok && ga.append(g) == BENCH_CHECK_GAMES + 1;
+    ga.flush();
+    archive_game back;
+    return ok && ga.get(BENCH_CHECK_GAMES + 1, back) && same(g, back);
+}
+
+static void latency(const char *what, std::vector<double> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    printf("%s: p50 %6.1fus p99 %6.1fus max %7.1fus\n", what, lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back());
+}
+
+static bool bench(uint64_t count)
+{
+    remove_dir(BENCH_DIR);
+    std::mt19937_64 rng(3);
+    // 先生成好对局，只统计编码和写入的时间
+    std::vector<archive_game> pool(1000);
+    for (size_t i = 0; i < pool.size(); ++i)
+        random_game(rng, i + 1, pool[i]);
+    game_archive ga(BENCH_DIR);
+    if (ga.open() == false)
+        return false;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        archive_game &g = pool[i % pool.size()];
+        g.white_id = 1 + rng() % BENCH_PLAYERS;
+        ga.append(g);
+    }
+    ga.flush();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("%lu games written in %.2fs: %.0f games/s, %.1f MB/s, %.1f bytes per game, %lu segments\n", (unsigned long)count, seconds,
+           count / seconds, ga.bytes() / seconds / 1048576, (double)ga.bytes() / ga.count(), (unsigned long)ga.segments());
+    std::vector<double> lat;
+    bool ok = ga.count() == count;
+    for (int i = 0; i < BENCH_LOOKUPS && ok; ++i)
+    {
+        uint64_t gid = 1 + rng() % count;
+        archive_game g;
+        bench_clock::time_point begin = bench_clock::now();
+        ok = ga.get(gid, g);
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+        ok = ok && g.room_id == pool[(gid - 1) % pool.size()].room_id;
+    }
+    if (ok)
+        latency("random get by game id", lat);
+    lat.clear();
+    uint64_t found = 0;
+    for (int i = 0; i < BENCH_LOOKUPS && ok; ++i)
+    {
+        std::vector<uint64_t> gids;
+        uint64_t uid = 1 + rng() % BENCH_PLAYERS;
+        bench_clock::time_point begin = bench_clock::now();
+        found += ga.games_of(uid, 20, gids);
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+    }
+    if (ok)
+    {
+        printf("%.1f games per player on average\n", (double)found / BENCH_LOOKUPS);
+        latency("latest 20 game ids of a player", lat);
+    }
+    return ok && found > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : BENCH_GAMES;
+    bool ok = check_codec();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "codec round trip, typical game under 200 bytes" << std::endl;
+    bool ret = check_recovery();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "torn tail truncated and missing index rebuilt on reopen" << std::endl;
+    ok = ok && ret;
+    ret = bench(count);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "archive of " << count << " games" << std::endl;
+    remove_dir(BENCH_DIR);
+    return ok && ret ? 0 : 1;
+}
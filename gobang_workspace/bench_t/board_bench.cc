@@ -0,0 +1,196 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+#include "../server/board.hpp"
+
+/*
+* 棋盘模块性能测试
+* 对每种棋盘随机生成若干盘棋，逐步落子并判断胜负：
+*   手写的15x15路径：原room的做法，二维数组占用判断后用five()向四个方向扫描
+*   模板棋盘：通过board_base接口调用place（与房间中的调用方式一致）
+* 同时用带越界判断的四方向扫描校验每盘棋的结束步数一致
+*/
+
+#define BENCH_GAMES 20000
+
+// 带越界判断的四方向扫描，作为胜负判断的参照
+static bool scan_five(const std::vector<std::vector<int>> &board, int row, int col, int color, int win)
+{
+    static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    int rows = board.size(), cols = board[0].size();
+    for (int d = 0; d < 4; ++d)
+    {
+        int count = 1;
+        for (int s = -1; s <= 1; s += 2)
+        {
+            int r = row + s * dirs[d][0], c = col + s * dirs[d][1];
+            while (r >= 0 && r < rows && c >= 0 && c < cols && board[r][c] == color)
+            {
+                count++;
+                r += s * dirs[d][0];
+                c += s * dirs[d][1];
+            }
+        }
+        if (count >= win)
+            return true;
+    }
+    return false;
+}
+
+static std::vector<std::vector<int>> make_games(int rows, int cols, std::mt19937 &rng)
+{
+    std::vector<std::vector<int>> games(BENCH_GAMES);
+    std::vector<int> cells(rows * cols);
+    for (int i = 0; i < (int)cells.size(); ++i)
+        cells[i] = i;
+    int len = std::min((int)cells.size(), 120);
+    for (auto &g : games)
+    {
+        std::shuffle(cells.begin(), cells.end(), rng);
+        g.assign(cells.begin(), cells.begin() + len);
+    }
+    return games;
+}
+
+// 参照结果：每盘棋在第几步结束，-1表示没有结束
+static std::vector<int> reference(const std::vector<std::vector<int>> &games, int rows, int cols, int win)
+{
+    std::vector<int> end(games.size(), -1);
+    for (size_t i = 0; i < games.size(); ++i)
+    {
+        std::vector<std::vector<int>> board(rows, std::vector<int>(cols, 0));
+        for (int k = 0; k < (int)games[i].size(); ++k)
+        {
+            int r = games[i][k] / cols, c = games[i][k] % cols, color = k % 2 + 1;
+            board[r][c] = color;
+            if (scan_five(board, r, c, color, win))
+            {
+                end[i] = k;
+                break;
+            }
+        }
+    }
+    return end;
+}
+
+// 原room::five()，逐格判断越界
+static bool five(const std::vector<std::vector<int>> &board, int row, int col, int row_off, int col_off, int color)
+{
+    int count = 1;
+    int search_row = row + row_off;
+    int search_col = col + col_off;
+    while (search_row >= 0 && search_row < 15 &&
+           search_col >= 0 && search_col < 15 &&
+           board[search_row][search_col] == color)
+    {
+        count++;
+        search_row += row_off;
+        search_col += col_off;
+    }
+    search_row = row - row_off;
+    search_col = col - col_off;
+    while (search_row >= 0 && search_row < 15 &&
+           search_col >= 0 && search_col < 15 &&
+           board[search_row][search_col] == color)
+    {
+        count++;
+        search_row -= row_off;
+        search_col -= col_off;
+    }
+    return (count >= 5);
+}
+
+// 原room中15x15的落子路径：handle_chess的占用判断、落子和check_win
+static double bench_handwritten(const std::vector<std::vector<int>> &games, std::vector<int> &end)
+{
+    uint64_t moves = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < games.size(); ++i)
+    {
+        std::vector<std::vector<int>> board(15, std::vector<int>(15, 0));
+        end[i] = -1;
+        for (int k = 0; k < (int)games[i].size(); ++k)
+        {
+            int r = games[i][k] / 15, c = games[i][k] % 15, color = k % 2 + 1;
+            moves++;
+            if (board[r][c] != 0)
+                continue;
+            board[r][c] = color;
+            if (five(board, r, c, 0, 1, color) ||
+                five(board, r, c, 1, 0, color) ||
+                five(board, r, c, -1, 1, color) ||
+                five(board, r, c, -1, -1, color))
+            {
+                end[i] = k;
+                break;
+            }
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / (double)moves;
+}
+
+static double bench_template(board_variant variant, const std::vector<std::vector<int>> &games, std::vector<int> &end)
+{
+    uint64_t moves = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < games.size(); ++i)
+    {
+        std::unique_ptr<board_base> board(create_board(variant));
+        int cols = board->cols();
+        end[i] = -1;
+        for (int k = 0; k < (int)games[i].size(); ++k)
+        {
+            int r = games[i][k] / cols, c = games[i][k] % cols, color = k % 2 + 1;
+            bool win = false;
+            moves++;
+            if (board->place(r, c, color, RULE_FREESTYLE, win) == MOVE_OK && win)
+            {
+                end[i] = k;
+                break;
+            }
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / (double)moves;
+}
+
+int main()
+{
+    std::mt19937 rng(2023);
+    int mismatch = 0;
+
+    std::vector<std::vector<int>> games = make_games(15, 15, rng);
+    std::vector<int> ref = reference(games, 15, 15, 5), end(games.size());
+    double base = bench_handwritten(games, end);
+    mismatch += ref != end;
+    std::cout << "handwritten 15x15: " << base << " ns/move" << std::endl;
+
+    struct
+    {
+        const char *name;
+        board_variant variant;
+        int rows, cols, win;
+    } variants[] = {
+        {"standard 15x15:   ", BOARD_STANDARD, 15, 15, 5},
+        {"large 19x19:      ", BOARD_LARGE, 19, 19, 5},
+        {"blitz 9x9:        ", BOARD_BLITZ, 9, 9, 5},
+    };
+    for (auto &v : variants)
+    {
+        if (v.rows != 15)
+        {
+            games = make_games(v.rows, v.cols, rng);
+            ref = reference(games, v.rows, v.cols, v.win);
+        }
+        double ns = bench_template(v.variant, games, end);
+        bool ok = ref == end;
+        mismatch += !ok;
+        std::cout << v.name << ns << " ns/move (" << (ns <= base ? "faster" : "slower") << " than handwritten)"
+                  << (ok ? "" : " [MISMATCH]") << std::endl;
+    }
+    std::cout << "mismatch:" << mismatch << std::endl;
+    return mismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+#include "../server/challenge.hpp"
+
+/*
+* 挑战邀请测试
+* 1. 同一对玩家不能重复邀请，每个玩家收到的邀请有上限；接受后邀请消失
+* 2. 超时的邀请被删除并回调一次，已经接受的邀请不会再超时
+* 3. 吞吐：先放入BENCH_PENDING个待处理的邀请，多个线程同时发起并接受邀请，
+*    比较只有一把锁和按被挑战者分段时每秒处理的邀请数
+*/
+
+#define BENCH_USERS 100000
+#define BENCH_PENDING 200000
+#define BENCH_THREADS 4
+#define BENCH_OPS 200000 // 每个线程发起并处理的邀请数
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bool check_rules()
+{
+    timer_wheel tw;
+    invite_table it(&tw);
+    bool ok = it.create(1, 2) == CHALLENGE_OK && it.create(1, 2) == CHALLENGE_DUPLICATE && it.create(2, 1) == CHALLENGE_OK;
+    for (uint64_t from = 100; from < 100 + CHALLENGE_MAX_PENDING - 1; ++from)
+        ok = ok && it.create(from, 2) == CHALLENGE_OK;
+    ok = ok && it.create(999, 2) == CHALLENGE_FULL;
+    ok = ok && it.take(1, 2) && it.take(1, 2) == false && it.take(3, 2) == false;
+    ok = ok && it.create(999, 2) == CHALLENGE_OK && it.size() == CHALLENGE_MAX_PENDING + 1;
+    return ok;
+}
+
+static bool check_expire()
+{
+    timer_wheel tw;
+    invite_table it(&tw);
+    std::vector<invite> expired;
+    it.on_expire([&expired](const invite &inv) { expired.push_back(inv); });
+    it.create(1, 2);
+    it.create(3, 4);
+    it.take(3, 4);
+    tw.advance_to(CHALLENGE_TIMEOUT - 1000);
+    bool ok = expired.empty();
+    tw.advance_to(CHALLENGE_TIMEOUT + 100);
+    ok = ok && expired.size() == 1 && expired[0].from == 1 && expired[0].to == 2 && it.size() == 0;
+    // 超时后重新邀请，旧的超时任务不影响新的邀请
+    ok = ok && it.take(1, 2) == false && it.create(1, 2) == CHALLENGE_OK && it.size() == 1;
+    return ok;
+}
+
+static bool bench(size_t shards)
+{
+    timer_wheel tw;
+    invite_table it(&tw, shards);
+    std::mt19937_64 rng(1);
+    while (it.size() < BENCH_PENDING)
+        it.create(rng() % BENCH_USERS, rng() % BENCH_USERS);
+    std::atomic<uint64_t> accepted(0);
+    std::vector<std::thread> threads;
+    bench_clock::time_point start = bench_clock::now();
+    for (int t = 0; t < BENCH_THREADS; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 r(t + 100);
+            uint64_t n = 0;
+            for (int i = 0; i < BENCH_OPS; ++i)
+            {
+                // 挑战者使用不与预置邀请重叠的uid
+                uint64_t from = BENCH_USERS + t * BENCH_OPS + i, to = r() % BENCH_USERS;
+                if (it.create(from, to) == CHALLENGE_OK && it.take(from, to))
+                    n++;
+            }
+            accepted += n;
+        });
+    }
+    for (std::thread &th : threads)
+        th.join();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("%2lu shards: %9.0f invites/s (create + accept) with %lu pending, %lu accepted, %lu rejected as full\n",
+           (unsigned long)shards, BENCH_THREADS * BENCH_OPS / seconds, (unsigned long)it.size(), (unsigned long)accepted.load(),
+           (unsigned long)(BENCH_THREADS * BENCH_OPS - accepted));
+    return it.size() == BENCH_PENDING && accepted > 0;
+}
+
+int main()
+{
+    printf("%ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+    bool ok = check_rules();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "duplicate and over-limit invites are rejected" << std::endl;
+    bool ret = check_expire();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "unanswered invites expire once, accepted ones never" << std::endl;
+    ok = ok && ret;
+    ret = bench(1) && bench(CHALLENGE_SHARDS);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "pending invites are unaffected by concurrent traffic" << std::endl;
+    return ok && ret ? 0 : 1;
+}
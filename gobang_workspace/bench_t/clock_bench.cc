@@ -0,0 +1,240 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <map>
+
+#include "../server/timer.hpp"
+#include "../server/clock.hpp"
+
+/*
+* 棋钟和分层时间轮测试
+* 1. 分层时间轮：随机添加（0毫秒到10天）和取消定时任务，按随机步长推进，校验每个任务只执行一次、
+*    不早于到期时间且最多晚一个刻度加一个步长，取消的任务不执行
+* 2. 棋钟：总时间、Fischer加秒、每步限时的计算
+* 3. 20万个房间同时对局：玩家的思考时间随机，少数玩家长时间不走棋被判超时，超时后重新开局。
+*    统计推进时间轮和每步重新挂超时任务的cpu时间、每秒唤醒次数；
+*    与每个房间一个定时器的做法对比（std::multimap代替asio的定时器堆，
+*    asio取消定时器时会以operation_aborted调用一次回调，每步都会多一次唤醒）
+*/
+
+#define WHEEL_TIMERS 200000
+#define BENCH_ROOMS 200000
+#define BENCH_SECONDS 120
+#define STALL_PERCENT 5 // 长时间不走棋的比例
+
+static double thread_cpu_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool check_wheel()
+{
+    timer_wheel wheel;
+    std::mt19937_64 rng(2023);
+    uint64_t now = 0;
+    const uint64_t step_max = 5000;
+    std::vector<uint64_t> deadline(WHEEL_TIMERS);
+    std::vector<int> fired(WHEEL_TIMERS, 0);
+    std::vector<uint64_t> ids(WHEEL_TIMERS);
+    std::vector<bool> cancelled(WHEEL_TIMERS, false);
+    bool ok = true;
+    uint64_t horizon = 0;
+    for (int i = 0; i < WHEEL_TIMERS; ++i)
+    {
+        // 一部分很近（棋钟），一部分几十秒到几小时（宽限期、会话），少数超过时间轮的范围
+        uint64_t ms;
+        int kind = rng() % 10;
+        if (kind < 5)
+            ms = rng() % 3000;
+        else if (kind < 8)
+            ms = rng() % 200000;
+        else if (kind < 9)
+            ms = rng() % (4ULL * 3600 * 1000);
+        else
+            ms = rng() % (10ULL * 24 * 3600 * 1000);
+        deadline[i] = now + ms;
+        horizon = std::max(horizon, deadline[i]);
+        ids[i] = wheel.add(ms, [i, &fired, &deadline, &now, &ok, step_max]() {
+            fired[i]++;
+            ok = ok && now >= deadline[i] && now < deadline[i] + TW_TICK_MS + step_max;
+        });
+        if (rng() % 8 == 0)
+        {
+            int j = rng() % (i + 1);
+            if (!cancelled[j] && fired[j] == 0)
+            {
+                ok = ok && wheel.cancel(ids[j]);
+                cancelled[j] = true;
+            }
+        }
+        if (i % 50 == 0)
+        {
+            now += rng() % step_max;
+            wheel.advance_to(now);
+        }
+    }
+    while (now <= horizon + TW_TICK_MS)
+    {
+        now += 1 + rng() % step_max;
+        wheel.advance_to(now);
+    }
+    for (int i = 0; i < WHEEL_TIMERS && ok; ++i)
+        ok = fired[i] == (cancelled[i] ? 0 : 1);
+    return ok && wheel.size() == 0;
+}
+
+static bool check_clock()
+{
+    game_clock c(clock_config{60000, 2000, 20000});
+    c.start(1, 0);
+    bool ok = c.turn() == 1 && c.budget(0) == 20000;
+    ok = ok && c.move(5000) && c.turn() == 2 && c.remaining(1, 5000) == 57000; // 白方用5秒加2秒
+    ok = ok && c.budget(10000) == 15000 && c.remaining(2, 10000) == 55000;
+    ok = ok && c.move(24000) && c.remaining(2, 24000) == 43000;                 // 黑方用19秒加2秒
+    ok = ok && !c.flagged(43999) && c.flagged(44000) && c.move(44000) == false; // 每步限时20秒
+    // 只有总时间：用完即超时
+    game_clock b(clock_config{3000, 0, 0});
+    b.start(1, 0);
+    ok = ok && b.move(2000) && b.move(2500) && b.budget(2500) == 1000 && b.flagged(3500);
+    // 不限时
+    game_clock u;
+    u.start(1, 0);
+    ok = ok && !u.enabled() && !u.flagged(1ULL << 40) && u.move(1ULL << 40) && u.turn() == 2;
+    return ok;
+}
+
+struct sim_room
+{
+    game_clock clock;
+    uint64_t timer;
+    uint32_t moves;
+    std::multimap<uint64_t, uint32_t>::iterator heap_it;
+};
+
+// 下一步的思考时间
+static uint64_t think_ms(std::mt19937 &rng)
+{
+    if ((int)(rng() % 100) < STALL_PERCENT)
+        return CLOCK_MOVE_MS + 10000;
+    return 1000 + rng() % 14000;
+}
+
+// 用时间轮或每房间一个定时器（heap为true）驱动20万个房间的棋钟
+static void bench_rooms(bool heap)
+{
+    std::mt19937 rng(7);
+    timer_wheel wheel;
+    std::multimap<uint64_t, uint32_t> timers; // 到期时间 房间
+    std::vector<sim_room> rooms(BENCH_ROOMS);
+    // 模拟玩家：按刻度分桶记录哪些房间该走棋了
+    const uint64_t ring = 16384;
+    std::vector<std::vector<uint32_t>> due(ring);
+    uint64_t now = 0, moves = 0, timeouts = 0, wakeups = 0;
+    double cpu = 0;
+
+    // 超时任务到期：判负并重新开局
+    std::function<void(uint32_t)> arm;
+    auto on_timeout = [&](uint32_t r, uint32_t moves_then) {
+        sim_room &room = rooms[r];
+        if (room.moves != moves_then)
+            return;
+        if (room.clock.flagged(now) == false)
+            return arm(r);
+        timeouts++;
+        room.clock = game_clock(default_clock());
+        room.clock.start(1, now);
+        room.moves++;
+        arm(r);
+        due[(now / TW_TICK_MS + think_ms(rng) / TW_TICK_MS) % ring].push_back(r);
+    };
+    arm = [&](uint32_t r) {
+        sim_room &room = rooms[r];
+        uint64_t budget = room.clock.budget(now);
+        if (heap)
+        {
+            if (room.heap_it != timers.end())
+            {
+                timers.erase(room.heap_it);
+                wakeups++; // 取消的定时器也会调用一次回调
+            }
+            room.heap_it = timers.insert(std::make_pair(now + budget, r));
+        }
+        else
+        {
+            if (room.timer != 0)
+                wheel.cancel(room.timer);
+            uint32_t m = room.moves;
+            room.timer = wheel.add(budget, [r, m, &on_timeout]() { on_timeout(r, m); });
+        }
+    };
+
+    double start = thread_cpu_ms();
+    for (uint32_t r = 0; r < BENCH_ROOMS; ++r)
+    {
+        rooms[r].clock = game_clock(default_clock());
+        rooms[r].clock.start(1, 0);
+        rooms[r].timer = 0;
+        rooms[r].moves = 0;
+        rooms[r].heap_it = timers.end();
+        arm(r);
+        due[(think_ms(rng) / TW_TICK_MS) % ring].push_back(r);
+    }
+    cpu += thread_cpu_ms() - start;
+
+    for (uint64_t tick = 0; tick < BENCH_SECONDS * 1000 / TW_TICK_MS; ++tick)
+    {
+        now = tick * TW_TICK_MS;
+        std::vector<uint32_t> movers;
+        movers.swap(due[tick % ring]);
+        start = thread_cpu_ms();
+        // 定时器到期
+        if (heap)
+        {
+            while (!timers.empty() && timers.begin()->first <= now)
+            {
+                uint32_t r = timers.begin()->second;
+                timers.erase(timers.begin());
+                rooms[r].heap_it = timers.end();
+                wakeups++;
+                on_timeout(r, rooms[r].moves);
+            }
+        }
+        else
+        {
+            wheel.advance_to(now);
+            wakeups++;
+        }
+        // 玩家落子：停表加秒，重新挂超时任务
+        for (uint32_t r : movers)
+        {
+            sim_room &room = rooms[r];
+            if (room.clock.move(now) == false)
+                continue; // 已经超时，等超时任务判负
+            room.moves++;
+            moves++;
+            arm(r);
+            due[(tick + think_ms(rng) / TW_TICK_MS) % ring].push_back(r);
+        }
+        cpu += thread_cpu_ms() - start;
+    }
+    printf("%s %d rooms %ds: %7.0f moves/s %5.0f timeouts/s  cpu %6.1f ms per second (%.2f%% of a core)  wakeups %7.0f/s\n",
+           heap ? "per-room timers" : "timer wheel    ", BENCH_ROOMS, BENCH_SECONDS, (double)moves / BENCH_SECONDS,
+           (double)timeouts / BENCH_SECONDS, cpu / BENCH_SECONDS, cpu / BENCH_SECONDS / 10, (double)wakeups / BENCH_SECONDS);
+}
+
+int main()
+{
+    bool ok = check_wheel();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "hierarchical wheel fires every timer once, never early" << std::endl;
+    bool ret = check_clock();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "base time, Fischer increment and per-move limit" << std::endl;
+    ok = ok && ret;
+    bench_rooms(false);
+    bench_rooms(true);
+    return ok ? 0 : 1;
+}
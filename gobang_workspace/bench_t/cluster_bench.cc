@@ -0,0 +1,273 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../server/cluster.hpp"
+
+/*
+* 集群测试
+* 1. 哈希环：各节点分到的键数量均衡；加入一个节点时只有约1/(n+1)的键换了所有者且都换到新节点上，
+*    移除一个节点时只有该节点的键换了所有者
+* 2. RPC：并发调用时每个响应对应自己的请求，对方重启后自动重连；密钥不对的客户端握手失败，请求不会被处理
+* 3. 成员变化：只知道一个节点的新节点也能加入，各节点的环保持一致；离开后其他节点收到成员变化的回调
+* 4. 转发：N个节点进程各自持有一部分房间，客户端（网关）按房间id找到所有者转发落子消息，
+*    所有者按顺序处理并回复步数；统计1~N个节点时转发的延迟和总吞吐
+*/
+
+#define BENCH_RPC_PORT 29000
+#define BENCH_KEYS 200000
+#define BENCH_GATEWAYS 8   // 网关上同时转发消息的线程数
+#define BENCH_ROOMS 64     // 每个网关线程负责的房间数
+#define BENCH_MOVES 20000  // 每个网关线程转发的消息数
+#define HOST_LOOPBACK "127.0.0.1"
+#define BENCH_SECRET "bench-secret"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bool check_ring()
+{
+    hash_ring ring;
+    for (uint32_t n = 0; n < 4; ++n)
+        ring.add(n);
+    std::vector<uint32_t> before(BENCH_KEYS);
+    std::vector<int> load(5, 0);
+    for (uint64_t k = 0; k < BENCH_KEYS; ++k)
+        load[before[k] = ring.owner(k)]++;
+    bool ok = true;
+    for (int n = 0; n < 4; ++n)
+        ok = ok && load[n] > BENCH_KEYS / 4 * 0.8 && load[n] < BENCH_KEYS / 4 * 1.2;
+    // 加入节点4
+    ring.add(4);
+    int moved = 0;
+    for (uint64_t k = 0; k < BENCH_KEYS; ++k)
+    {
+        uint32_t o = ring.owner(k);
+        if (o != before[k])
+        {
+            moved++;
+            ok = ok && o == 4;
+        }
+    }
+    printf("4 nodes load: %d %d %d %d, adding a node moves %.1f%% of keys\n", load[0], load[1], load[2], load[3], 100.0 * moved / BENCH_KEYS);
+    ok = ok && moved > BENCH_KEYS / 5 * 0.8 && moved < BENCH_KEYS / 5 * 1.2;
+    // 移除节点2：只有节点2的键移动
+    std::vector<uint32_t> with4(BENCH_KEYS);
+    for (uint64_t k = 0; k < BENCH_KEYS; ++k)
+        with4[k] = ring.owner(k);
+    ring.remove(2);
+    for (uint64_t k = 0; k < BENCH_KEYS; ++k)
+        ok = ok && (ring.owner(k) == with4[k]) == (with4[k] != 2);
+    return ok;
+}
+
+static bool check_rpc()
+{
+    rpc_server *srv = new rpc_server();
+    rpc_server::handler echo = [](uint8_t, const std::string &req, std::string &resp) {
+        resp = req;
+        return true;
+    };
+    uint16_t port = srv->start(HOST_LOOPBACK, BENCH_RPC_PORT, BENCH_SECRET, echo);
+    if (port == 0)
+        return false;
+    rpc_client client(HOST_LOOPBACK, port, BENCH_SECRET);
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                std::string req(i % 7 == 0 ? 100000 : 16, 'a' + t), resp;
+                rpc_writer(req).put<int>(i);
+                if (client.call(RPC_ECHO, req, resp) == false || resp.size() != req.size() + 1 || resp.substr(1) != req)
+                    ok = false;
+            }
+        });
+    }
+    for (std::thread &th : threads)
+        th.join();
+    // 服务端重启，客户端的连接已经失效
+    delete srv;
+    srv = new rpc_server();
+    std::atomic<int> handled(0);
+    srv->start(HOST_LOOPBACK, port, BENCH_SECRET, [&handled, &echo](uint8_t type, const std::string &req, std::string &resp) {
+        handled++;
+        return echo(type, req, resp);
+    });
+    std::string resp;
+    ok = ok && client.call(RPC_ECHO, "again", resp) && resp.substr(1) == "again";
+    // 密钥不对的客户端不能调用
+    rpc_client intruder(HOST_LOOPBACK, port, "wrong-secret");
+    ok = ok && intruder.call(RPC_ECHO, "intruder", resp) == false && handled == 1;
+    delete srv;
+    return ok;
+}
+
+static bool check_membership()
+{
+    executor ex(2);
+    std::atomic<int> changes(0);
+    std::vector<std::unique_ptr<cluster>> nodes;
+    for (uint32_t n = 0; n < 3; ++n)
+    {
+        cluster_config cc;
+        cc.node = n;
+        cc.host = HOST_LOOPBACK;
+        cc.secret = BENCH_SECRET;
+        cc.port = BENCH_RPC_PORT + 10 + n;
+        nodes.emplace_back(new cluster(cc, &ex));
+        nodes[n]->on_change([&changes]() { changes++; });
+        if (nodes[n]->start() == false)
+            return false;
+    }
+    // 节点1只知道节点0，节点2只知道节点1
+    nodes[1]->join({std::make_tuple(0u, std::string(HOST_LOOPBACK), (uint16_t)(BENCH_RPC_PORT + 10))});
+    nodes[2]->join({std::make_tuple(1u, std::string(HOST_LOOPBACK), (uint16_t)(BENCH_RPC_PORT + 11))});
+    bool ok = true;
+    for (auto &c : nodes)
+        ok = ok && c->peers().size() == 2;
+    for (uint64_t k = 0; k < 1000; ++k)
+        ok = ok && nodes[0]->owner(k) == nodes[1]->owner(k) && nodes[1]->owner(k) == nodes[2]->owner(k);
+    nodes[2]->leave();
+    ok = ok && nodes[0]->peers().size() == 1 && nodes[1]->peers().size() == 1;
+    for (uint64_t k = 0; k < 1000; ++k)
+        ok = ok && nodes[0]->owner(k) != 2 && nodes[0]->owner(k) == nodes[1]->owner(k);
+    for (int i = 0; i < 100 && changes < 4; ++i)
+        usleep(1000);
+    return ok && changes >= 4;
+}
+
+// 节点进程：持有房间，按顺序处理转发来的落子，回复房间内的步数
+static void run_node(uint32_t node, int nodes)
+{
+    executor ex(2);
+    cluster_config cc;
+    cc.node = node;
+    cc.host = HOST_LOOPBACK;
+    cc.port = BENCH_RPC_PORT + 100 + node;
+    cc.secret = BENCH_SECRET;
+    for (int n = 0; n < nodes; ++n)
+        cc.peers.emplace_back(n, HOST_LOOPBACK, BENCH_RPC_PORT + 100 + n);
+    cluster c(cc, &ex);
+    std::mutex mutex;
+    std::unordered_map<uint64_t, uint32_t> moves;
+    c.on(RPC_ROOM_MSG, [&](uint8_t, const std::string &req, std::string &resp) {
+        rpc_reader r(req);
+        uint64_t rid = r.get<uint64_t>();
+        uint32_t step = r.get<uint32_t>();
+        if (r.good() == false || c.is_local(rid) == false)
+            return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        uint32_t &n = moves[rid];
+        if (step != n + 1) // 同一个房间的消息乱序
+            return false;
+        n = step;
+        rpc_writer(resp).put<uint32_t>(n);
+        return true;
+    });
+    c.start();
+    c.join(cc.peers);
+    pause();
+}
+
+static bool bench(int nodes)
+{
+    std::vector<pid_t> pids;
+    for (int n = 0; n < nodes; ++n)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run_node(n, nodes);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    // 网关：与节点使用相同的哈希环，每个节点一个RPC客户端
+    hash_ring ring;
+    std::vector<std::unique_ptr<rpc_client>> clients;
+    for (int n = 0; n < nodes; ++n)
+    {
+        ring.add(n);
+        clients.emplace_back(new rpc_client(HOST_LOOPBACK, BENCH_RPC_PORT + 100 + n, BENCH_SECRET));
+    }
+    // 等待所有节点启动
+    std::string resp;
+    for (int n = 0; n < nodes; ++n)
+    {
+        for (int i = 0; i < 1000 && clients[n]->call(RPC_ECHO, "", resp) == false; ++i)
+            usleep(1000);
+    }
+    std::atomic<bool> ok(true);
+    std::vector<std::vector<double>> latency(BENCH_GATEWAYS);
+    std::vector<std::thread> threads;
+    bench_clock::time_point start = bench_clock::now();
+    for (int t = 0; t < BENCH_GATEWAYS; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            std::vector<uint32_t> steps(BENCH_ROOMS, 0);
+            std::string req, resp;
+            for (int i = 0; i < BENCH_MOVES; ++i)
+            {
+                int room = i % BENCH_ROOMS;
+                uint64_t rid = (uint64_t)t << 32 | room;
+                req.clear();
+                rpc_writer(req).put<uint64_t>(rid).put<uint32_t>(++steps[room]);
+                bench_clock::time_point begin = bench_clock::now();
+                if (clients[ring.owner(rid)]->call(RPC_ROOM_MSG, req, resp) == false || resp.size() != 5 || resp[0] == 0)
+                {
+                    ok = false;
+                    return;
+                }
+                latency[t].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+                rpc_reader r(resp.substr(1));
+                if (r.get<uint32_t>() != steps[room])
+                    ok = false;
+            }
+        });
+    }
+    for (std::thread &th : threads)
+        th.join();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    for (pid_t pid : pids)
+        kill(pid, SIGKILL);
+    for (pid_t pid : pids)
+        waitpid(pid, nullptr, 0);
+    std::vector<double> all;
+    for (auto &l : latency)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    if (all.size() != (size_t)BENCH_GATEWAYS * BENCH_MOVES)
+        return false;
+    printf("%d nodes: %8.0f forwarded moves/s, latency p50 %6.1fus p99 %6.1fus\n", nodes, all.size() / seconds,
+           all[all.size() / 2], all[all.size() * 99 / 100]);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_nodes = argc > 1 ? atoi(argv[1]) : 4;
+    printf("%ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+    bool ok = check_ring();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "consistent hashing moves only the keys of the changed node" << std::endl;
+    bool ret = check_rpc();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "rpc replies match concurrent requests, reconnect after restart, reject a wrong secret" << std::endl;
+    ok = ok && ret;
+    ret = check_membership();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "nodes join through any member and agree on the ring" << std::endl;
+    ok = ok && ret;
+    ret = true;
+    for (int n = 1; n <= max_nodes; n *= 2)
+        ret = bench(n) && ret;
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "forwarded room messages reach the owner in order" << std::endl;
+    return ok && ret ? 0 : 1;
+}
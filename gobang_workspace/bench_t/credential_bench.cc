@@ -0,0 +1,180 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <boost/asio.hpp>
+
+#include "../server/credential.hpp"
+
+/*
+* 密码哈希测试
+* 1. 哈希后能验证，错误的密码验证失败；每次哈希的盐不同
+* 2. 旧的MySQL password()哈希可以验证，并提示需要换成新的哈希
+* 3. 排队的任务达到上限后拒绝新的任务
+* 4. 突发的登录：网络io线程上每1ms触发一次定时器，同时有BENCH_LOGINS个登录请求到达，
+*    分别在io线程中直接验证和投递到线程池中验证，统计每秒的登录数和定时器的延迟
+*    突发测试使用较低的代价参数，单次哈希的耗时单独统计
+*/
+
+#define BENCH_LOGINS 10000
+#define BENCH_LOGN 10 // 突发测试的scrypt代价参数
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bool check_hash()
+{
+    std::string h1, h2;
+    bool upgrade = false;
+    bool ok = credential::hash("secret", h1) && credential::hash("secret", h2) && h1 != h2 && h1.size() <= 128;
+    ok = ok && credential::verify("secret", h1, upgrade) && upgrade == false;
+    ok = ok && credential::verify("Secret", h1, upgrade) == false;
+    // 较低代价的哈希验证通过后需要升级
+    ok = ok && credential::hash("secret", h2, 10) && credential::verify("secret", h2, upgrade) && upgrade;
+    // 损坏的哈希
+    ok = ok && credential::verify("secret", h1.substr(0, h1.size() - 2), upgrade) == false;
+    ok = ok && credential::verify("secret", "$scrypt$40$8$1$00$00", upgrade) == false;
+    return ok;
+}
+
+static bool check_legacy()
+{
+    // select password('123');
+    const std::string stored = "*23AE809DDACAF96AF0FD78ED04B6A265E05AA257";
+    bool upgrade = false;
+    bool ok = credential::verify("123", stored, upgrade) && upgrade;
+    return ok && credential::verify("1234", stored, upgrade) == false;
+}
+
+static bool check_bound()
+{
+    credential_pool pool(1, 4);
+    std::atomic<bool> release(false);
+    int accepted = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        if (pool.submit([&release]() {
+                while (release == false)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }))
+            accepted++;
+    }
+    release = true;
+    while (pool.pending() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return accepted == 4 && pool.submit([]() {});
+}
+
+// 网络io线程：每1ms的定时器记录实际触发时间与预期时间的差
+class io_probe
+{
+private:
+    boost::asio::io_service &_io;
+    boost::asio::steady_timer _timer;
+    bench_clock::time_point _expect;
+    std::atomic<bool> _stop;
+
+public:
+    std::vector<double> lags;
+
+    io_probe(boost::asio::io_service &io) : _io(io), _timer(io), _stop(false) {}
+
+    void start()
+    {
+        _expect = bench_clock::now() + std::chrono::milliseconds(1);
+        _timer.expires_at(_expect);
+        _timer.async_wait([this](const boost::system::error_code &ec) {
+            if (ec || _stop)
+                return;
+            lags.push_back(std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - _expect).count() / 1000.0);
+            start();
+        });
+    }
+
+    void stop()
+    {
+        _io.post([this]() {
+            _stop = true;
+            _timer.cancel();
+        });
+    }
+};
+
+static bool burst(bool use_pool, const std::string &stored)
+{
+    boost::asio::io_service io;
+    boost::asio::io_service::work work(io);
+    std::thread io_thread([&io]() { io.run(); });
+    io_probe probe(io);
+    io.post([&probe]() { probe.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    credential_pool pool(CRED_THREADS, BENCH_LOGINS);
+    std::atomic<int> done(0), failed(0);
+    bench_clock::time_point start = bench_clock::now();
+    // 请求到达网络io线程
+    for (int i = 0; i < BENCH_LOGINS; ++i)
+    {
+        io.post([&, i]() {
+            std::string password = i % 10 == 0 ? "wrong" : "secret";
+            if (use_pool == false)
+            {
+                bool upgrade;
+                if (credential::verify(password, stored, upgrade) != (i % 10 != 0))
+                    failed++;
+                done++;
+                return;
+            }
+            bool ok = pool.submit([&, password, i]() {
+                bool upgrade;
+                bool ret = credential::verify(password, stored, upgrade);
+                // 结果回到io线程
+                io.post([&, ret, i]() {
+                    if (ret != (i % 10 != 0))
+                        failed++;
+                    done++;
+                });
+            });
+            if (ok == false)
+                failed++;
+        });
+    }
+    while (done + failed < BENCH_LOGINS)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    probe.stop();
+    io.stop();
+    io_thread.join();
+    std::vector<double> lags = probe.lags;
+    std::sort(lags.begin(), lags.end());
+    if (lags.empty())
+        lags.push_back(seconds * 1000);
+    printf("%-12s %6.0f logins/s, io timer lag p50 %7.2fms p99 %8.2fms max %8.2fms (%lu ticks)\n",
+           use_pool ? "worker pool:" : "io thread:", BENCH_LOGINS / seconds, lags[lags.size() / 2], lags[lags.size() * 99 / 100],
+           lags.back(), (unsigned long)lags.size());
+    return failed == 0;
+}
+
+int main()
+{
+    printf("%ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+    bool ok = check_hash();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "scrypt hashes are salted and verify only the right password" << std::endl;
+    bool ret = check_legacy();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "legacy MySQL password() hashes verify and request an upgrade" << std::endl;
+    ok = ok && ret;
+    ret = check_bound();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "pool rejects work beyond its queue bound" << std::endl;
+    ok = ok && ret;
+    std::string stored;
+    bench_clock::time_point start = bench_clock::now();
+    credential::hash("secret", stored);
+    printf("one hash at ln=%d: %.1fms\n", CRED_SCRYPT_LOGN,
+           std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1000.0);
+    credential::hash("secret", stored, BENCH_LOGN);
+    printf("%d logins at ln=%d:\n", BENCH_LOGINS, BENCH_LOGN);
+    ret = burst(false, stored) && burst(true, stored);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "every login in the burst verified correctly" << std::endl;
+    return ok && ret ? 0 : 1;
+}
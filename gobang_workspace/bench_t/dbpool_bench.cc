@@ -0,0 +1,178 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+#include "../server/dbpool.hpp"
+
+/*
+* 数据库线程池测试
+* 1. 排队的查询超过上限时拒绝；连接失败的线程退出，其余线程照常执行查询；所有线程都连接失败时立即拒绝查询
+* 2. 注入数据库延迟：一个io线程（io_service）每BENCH_MSG_US收到一条websocket消息，同时每BENCH_QUERY_MS收到一个需要查询数据库的请求（/info），
+*    查询耗时BENCH_DB_MS，每BENCH_SLOW_EVERY个查询中有一个慢查询耗时BENCH_SLOW_MS，统计websocket消息从到达到被处理的延迟：
+*    没有查询            基准
+*    在io线程中直接查询  改动之前user_table的做法，查询期间io线程上的所有消息都在排队
+*    交给数据库线程池    查询完成后投递回io线程，同时统计请求从到达到回复的延迟
+*/
+
+#define BENCH_SECONDS 5
+#define BENCH_MSG_US 1000     // websocket消息的间隔
+#define BENCH_QUERY_MS 50     // 查询请求的间隔
+#define BENCH_DB_MS 20        // 一次查询的耗时
+#define BENCH_SLOW_MS 1000    // 慢查询的耗时
+#define BENCH_SLOW_EVERY 20
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct fake_db
+{
+    std::atomic<int> *queries;
+};
+
+typedef enum
+{
+    MODE_NONE,
+    MODE_BLOCKING,
+    MODE_POOL
+} bench_mode;
+
+static double since_ms(bench_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - t).count() / 1000.0;
+}
+
+// 模拟一次查询
+static void query(fake_db *db, int n)
+{
+    (*db->queries)++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(n % BENCH_SLOW_EVERY == BENCH_SLOW_EVERY - 1 ? BENCH_SLOW_MS : BENCH_DB_MS));
+}
+
+static bool check_pool()
+{
+    std::atomic<int> queries(0);
+    std::atomic<int> connects(0);
+    // 第二个线程连接失败
+    db_pool<fake_db> pool([&]() { return ++connects == 2 ? nullptr : new fake_db{&queries}; }, [](fake_db *db) { delete db; }, 3, 8);
+    std::atomic<int> done(0);
+    int accepted = 0;
+    for (int i = 0; i < 20; ++i)
+    {
+        accepted += pool.submit([&](fake_db *) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            pool.complete([&]() { done++; });
+        });
+    }
+    while (pool.pending() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (accepted != 8 || done != 8 || pool.alive() != 2)
+        return false;
+    // 数据库不可用：查询不排队，调用方可以立即回复
+    db_pool<fake_db> down([]() { return (fake_db *)nullptr; }, [](fake_db *db) { delete db; }, 3, 8);
+    return down.alive() == 0 && down.submit([](fake_db *) {}) == false && down.pending() == 0;
+}
+
+struct run_result
+{
+    std::vector<double> msg;   // websocket消息的延迟
+    std::vector<double> reply; // 查询请求的回复延迟
+    int queries = 0;
+    int rejected = 0;
+};
+
+static void run(bench_mode mode, run_result &rr)
+{
+    boost::asio::io_service io;
+    std::unique_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io));
+    std::atomic<int> queries(0);
+    db_pool<fake_db> pool([&]() { return new fake_db{&queries}; }, [](fake_db *db) { delete db; });
+    pool.set_post([&io](const std::function<void()> &f) { io.post(f); });
+    fake_db inline_db{&queries};
+    std::thread io_thread([&io]() { io.run(); });
+
+    bench_clock::time_point start = bench_clock::now(), next_msg = start, next_query = start;
+    bench_clock::time_point end = start + std::chrono::seconds(BENCH_SECONDS);
+    int n = 0;
+    std::atomic<int> replies(0);
+    while (bench_clock::now() < end)
+    {
+        bench_clock::time_point now = bench_clock::now();
+        if (now >= next_msg)
+        {
+            io.post([&rr, now]() { rr.msg.push_back(since_ms(now)); });
+            next_msg += std::chrono::microseconds(BENCH_MSG_US);
+        }
+        if (mode != MODE_NONE && now >= next_query)
+        {
+            int id = n++;
+            io.post([&, now, id]() {
+                if (mode == MODE_BLOCKING)
+                {
+                    query(&inline_db, id);
+                    rr.reply.push_back(since_ms(now));
+                    replies++;
+                    return;
+                }
+                bool ok = pool.submit([&, now, id](fake_db *db) {
+                    query(db, id);
+                    pool.complete([&, now]() {
+                        rr.reply.push_back(since_ms(now));
+                        replies++;
+                    });
+                });
+                if (ok == false)
+                {
+                    rr.rejected++;
+                    replies++;
+                }
+            });
+            next_query += std::chrono::milliseconds(BENCH_QUERY_MS);
+        }
+        std::this_thread::sleep_until(std::min(next_msg, mode == MODE_NONE ? next_msg : next_query));
+    }
+    // 等待所有请求回复
+    while (replies < n)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    work.reset();
+    io_thread.join();
+    rr.queries = queries;
+}
+
+static void latency(const char *what, std::vector<double> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    printf("  %-22s p50 %7.2fms p99 %7.2fms max %7.1fms (%lu)\n", what, lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back(),
+           (unsigned long)lat.size());
+}
+
+int main()
+{
+    printf("%ld cpus, %d db threads, query %dms, 1 in %d queries %dms, one query every %dms, one websocket message every %dus\n",
+           sysconf(_SC_NPROCESSORS_ONLN), DB_THREADS, BENCH_DB_MS, BENCH_SLOW_EVERY, BENCH_SLOW_MS, BENCH_QUERY_MS, BENCH_MSG_US);
+    bool ok = check_pool();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "full queue rejects, failed connections leave the other threads running, no connection rejects at once" << std::endl;
+    run_result none, blocking, pooled;
+    run(MODE_NONE, none);
+    run(MODE_BLOCKING, blocking);
+    run(MODE_POOL, pooled);
+    printf("no queries:\n");
+    latency("websocket message", none.msg);
+    printf("queries on the io thread:\n");
+    latency("websocket message", blocking.msg);
+    latency("query reply", blocking.reply);
+    printf("queries on the db pool:\n");
+    latency("websocket message", pooled.msg);
+    latency("query reply", pooled.reply);
+    // 线程池模式下消息的延迟与没有查询时在同一量级，查询请求不受慢查询拖累
+    bool ret = pooled.rejected == 0 && pooled.queries == (int)pooled.reply.size() && pooled.msg[pooled.msg.size() * 99 / 100] < 5.0 &&
+               blocking.msg.back() >= BENCH_SLOW_MS && pooled.reply[pooled.reply.size() / 2] < BENCH_DB_MS * 2;
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "slow queries on the db pool leave websocket latency at baseline" << std::endl;
+    return ok && ret ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <zlib.h>
+#include <jsoncpp/json/json.h>
+
+/*
+* permessage-deflate 带宽/cpu测试
+* 按服务器的消息格式（jsoncpp序列化）重放若干局对局中一名玩家收到的全部消息：
+*   hall_ready、match_success、room_ready、每一步的put_chess、聊天、对局结束
+* 以permessage-deflate的方式压缩每个连接上的消息流（raw deflate + Z_SYNC_FLUSH，去掉末尾的00 00 ff ff），
+* 比较不同的窗口位数、是否保留上下文、压缩阈值下的压缩率和每条消息的压缩耗时，并校验解压结果一致
+*/
+
+#define BENCH_GAMES 2000
+
+// 与util_json::serialization相同的序列化方式
+static std::string to_json(const Json::Value &v)
+{
+    Json::StreamWriterBuilder swb;
+    std::unique_ptr<Json::StreamWriter> psw(swb.newStreamWriter());
+    std::stringstream ss;
+    psw->write(v, &ss);
+    return ss.str();
+}
+
+// 生成一名玩家在一局对局中收到的消息
+static std::vector<std::string> record_game(uint64_t room_id, uint64_t uid, uint64_t peer, std::mt19937 &rng)
+{
+    std::vector<std::string> msgs;
+    Json::Value v;
+    v["optype"] = "hall_ready";
+    v["result"] = true;
+    v["uid"] = (Json::UInt64)uid;
+    msgs.push_back(to_json(v));
+    v = Json::Value();
+    v["optype"] = "match_success";
+    v["result"] = true;
+    msgs.push_back(to_json(v));
+    v = Json::Value();
+    v["optype"] = "room_ready";
+    v["result"] = true;
+    v["room_id"] = (Json::UInt64)room_id;
+    v["uid"] = (Json::UInt64)uid;
+    v["white_id"] = (Json::UInt64)uid;
+    v["black_id"] = (Json::UInt64)peer;
+    v["rule"] = 0;
+    v["board_size"] = 15;
+    msgs.push_back(to_json(v));
+    int moves = 20 + rng() % 60;
+    for (int k = 0; k < moves; ++k)
+    {
+        v = Json::Value();
+        v["optype"] = "put_chess";
+        v["room_id"] = (Json::UInt64)room_id;
+        v["uid"] = (Json::UInt64)(k % 2 ? peer : uid);
+        v["row"] = (int)(rng() % 15);
+        v["col"] = (int)(rng() % 15);
+        v["result"] = true;
+        v["winner"] = (Json::UInt64)(k + 1 == moves ? uid : 0);
+        if (k + 1 == moves)
+            v["reason"] = "无双，万军取首！";
+        msgs.push_back(to_json(v));
+        if (rng() % 10 == 0)
+        {
+            v = Json::Value();
+            v["optype"] = "chat";
+            v["room_id"] = (Json::UInt64)room_id;
+            v["uid"] = (Json::UInt64)peer;
+            v["message"] = "你好！";
+            v["result"] = true;
+            msgs.push_back(to_json(v));
+        }
+    }
+    return msgs;
+}
+
+struct deflate_option
+{
+    const char *name;
+    int window_bits;
+    bool context_takeover;
+    size_t threshold;
+};
+
+// 在一个连接上按permessage-deflate压缩消息流，返回压缩后的总字节数，累加压缩耗时
+static size_t replay(const std::vector<std::string> &msgs, const deflate_option &opt, double &ns, bool &ok)
+{
+    z_stream ds, is;
+    memset(&ds, 0, sizeof(ds));
+    memset(&is, 0, sizeof(is));
+    deflateInit2(&ds, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -opt.window_bits, 4, Z_DEFAULT_STRATEGY);
+    inflateInit2(&is, -15);
+    size_t total = 0;
+    unsigned char out[16384], back[16384];
+    for (const std::string &msg : msgs)
+    {
+        if (msg.size() < opt.threshold)
+        {
+            total += msg.size();
+            continue;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ds.next_in = (unsigned char *)msg.data();
+        ds.avail_in = msg.size();
+        ds.next_out = out;
+        ds.avail_out = sizeof(out);
+        deflate(&ds, Z_SYNC_FLUSH);
+        size_t len = sizeof(out) - ds.avail_out - 4; // 去掉末尾的 00 00 ff ff
+        if (opt.context_takeover == false)
+            deflateReset(&ds);
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        total += len;
+
+        // 客户端解压，补回末尾的 00 00 ff ff
+        static const unsigned char tail[4] = {0x00, 0x00, 0xff, 0xff};
+        memcpy(out + len, tail, 4);
+        is.next_in = out;
+        is.avail_in = len + 4;
+        is.next_out = back;
+        is.avail_out = sizeof(back);
+        inflate(&is, Z_SYNC_FLUSH);
+        ok = ok && sizeof(back) - is.avail_out == msg.size() && memcmp(back, msg.data(), msg.size()) == 0;
+    }
+    deflateEnd(&ds);
+    inflateEnd(&is);
+    return total;
+}
+
+int main()
+{
+    std::mt19937 rng(2023);
+    std::vector<std::vector<std::string>> games;
+    size_t raw = 0, count = 0;
+    for (int i = 0; i < BENCH_GAMES; ++i)
+    {
+        games.push_back(record_game(i + 1, 1000 + 2 * i, 1001 + 2 * i, rng));
+        for (auto &m : games.back())
+            raw += m.size();
+        count += games.back().size();
+    }
+    std::cout << "games:" << BENCH_GAMES << " messages:" << count << " raw bytes:" << raw
+              << " avg:" << raw / count << " bytes/msg" << std::endl;
+
+    deflate_option options[] = {
+        {"window 15, takeover, threshold 0  ", 15, true, 0},
+        {"window 11, takeover, threshold 0  ", 11, true, 0},
+        {"window 11, takeover, threshold 64 ", 11, true, 64},
+        {"window 11, takeover, threshold 128", 11, true, 128},
+        {"window 9,  takeover, threshold 64 ", 9, true, 64},
+        {"window 11, no takeover, thresh 64 ", 11, false, 64},
+        {"window 15, no takeover, thresh 0  ", 15, false, 0},
+    };
+    bool ok = true;
+    for (auto &opt : options)
+    {
+        double ns = 0;
+        size_t total = 0;
+        for (auto &g : games)
+            total += replay(g, opt, ns, ok);
+        printf("%s  bytes: %5.1f%% of raw  cpu: %6.0f ns/msg\n", opt.name, 100.0 * total / raw, ns / count);
+    }
+    std::cout << (ok ? "round trip: OK" : "round trip: FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
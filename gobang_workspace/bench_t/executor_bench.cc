@@ -0,0 +1,185 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <algorithm>
+
+#include "../server/executor.hpp"
+#include "../server/board.hpp"
+
+/*
+* 任务执行模块测试
+* 模拟网络io线程收到玩家的落子和人机搜索线程返回的落子，按固定速率到达（开环），分发给房间处理：
+* 落子后判断胜负，对局结束时写数据库（以固定的阻塞时间模拟），然后重新开局
+* 1. 现有模型：在收到消息的线程中直接处理，房间加锁（网络io线程被房间逻辑和数据库阻塞）
+* 2. 执行器：消息投递到房间的mailbox，由工作线程处理
+* 统计每秒处理的消息数，以及从消息到达到处理完成的延迟分布；
+* 校验同一房间的消息不会被两个线程同时处理，且同一来源的消息按到达顺序处理
+*/
+
+#define BENCH_ROOMS 1000
+#define BENCH_SECONDS 3
+#define IO_RATE 20000 // 网络io线程每秒收到的落子
+#define AI_RATE 5000  // 人机搜索线程每秒返回的落子
+#define DB_STALL_US 1000 // 对局结束写数据库的阻塞时间
+#define WORKERS 4
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct sim_room
+{
+    std::mutex mutex; // 现有模型使用
+    std::unique_ptr<mailbox> box;
+    std::unique_ptr<board_base> board;
+    int color;
+    std::mt19937 rng;
+    std::atomic<int> busy;
+    uint64_t last_seq[2]; // 每个来源最后处理的消息序号
+};
+
+struct bench_state
+{
+    std::vector<std::unique_ptr<sim_room>> rooms;
+    std::vector<double> latency_us[2]; // 每个来源每条消息的延迟
+    std::atomic<uint64_t> done;
+    std::atomic<bool> ok;
+    bench_clock::time_point start;
+};
+
+// 房间处理一条落子：落子判胜负，结束时写数据库并重新开局
+static void handle_move(bench_state &st, uint32_t r, int source, uint64_t seq, double arrival_us)
+{
+    sim_room &room = *st.rooms[r];
+    if (room.busy.exchange(1) != 0)
+        st.ok = false;
+    if (seq <= room.last_seq[source] && room.last_seq[source] != UINT64_MAX)
+        st.ok = false;
+    room.last_seq[source] = seq;
+    bool over = false;
+    for (int tries = 0; tries < 1000; ++tries)
+    {
+        bool win = false;
+        move_result ret = room.board->place(room.rng() % 15, room.rng() % 15, room.color, RULE_FREESTYLE, win);
+        if (ret != MOVE_OK)
+            continue;
+        room.color = room.color == 1 ? 2 : 1;
+        over = win;
+        break;
+    }
+    if (over || room.rng() % 150 == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(DB_STALL_US));
+        room.board.reset(create_board(BOARD_STANDARD));
+        room.color = 1;
+    }
+    room.busy = 0;
+    double now_us = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - st.start).count() / 1e3;
+    st.latency_us[source][seq] = now_us - arrival_us;
+    st.done++;
+}
+
+// 按固定速率产生消息：rate为每秒消息数，到达时间按计划计算，处理不过来时积压的消息延迟随之增加
+static void produce(bench_state &st, int source, int rate, executor *ex)
+{
+    std::mt19937 rng(source + 1);
+    uint64_t total = (uint64_t)rate * BENCH_SECONDS;
+    for (uint64_t seq = 0; seq < total; ++seq)
+    {
+        double arrival_us = seq * 1e6 / rate;
+        bench_clock::time_point due = st.start + std::chrono::nanoseconds((uint64_t)(arrival_us * 1e3));
+        if (bench_clock::now() < due)
+            std::this_thread::sleep_until(due);
+        uint32_t r = rng() % BENCH_ROOMS;
+        if (ex == nullptr)
+        {
+            sim_room &room = *st.rooms[r];
+            std::unique_lock<std::mutex> lock(room.mutex);
+            handle_move(st, r, source, seq, arrival_us);
+        }
+        else
+        {
+            bench_state *sp = &st;
+            st.rooms[r]->box->post([sp, r, source, seq, arrival_us]() { handle_move(*sp, r, source, seq, arrival_us); });
+        }
+    }
+}
+
+static double percentile(std::vector<double> &v, double p)
+{
+    size_t k = std::min(v.size() - 1, (size_t)(v.size() * p));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static bool run(const char *name, executor *ex)
+{
+    bench_state st;
+    for (int i = 0; i < BENCH_ROOMS; ++i)
+    {
+        st.rooms.emplace_back(new sim_room);
+        sim_room &room = *st.rooms.back();
+        if (ex != nullptr)
+            room.box.reset(new mailbox(ex));
+        room.board.reset(create_board(BOARD_STANDARD));
+        room.color = 1;
+        room.rng.seed(i);
+        room.busy = 0;
+        room.last_seq[0] = room.last_seq[1] = UINT64_MAX;
+    }
+    st.latency_us[0].resize((size_t)IO_RATE * BENCH_SECONDS);
+    st.latency_us[1].resize((size_t)AI_RATE * BENCH_SECONDS);
+    uint64_t total = st.latency_us[0].size() + st.latency_us[1].size();
+    st.done = 0;
+    st.ok = true;
+    st.start = bench_clock::now();
+    std::thread io(produce, std::ref(st), 0, IO_RATE, ex);
+    std::thread ai(produce, std::ref(st), 1, AI_RATE, ex);
+    io.join();
+    ai.join();
+    while (st.done < total)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - st.start).count() / 1e6;
+    std::vector<double> all(st.latency_us[0]);
+    all.insert(all.end(), st.latency_us[1].begin(), st.latency_us[1].end());
+    printf("%s %7.0f msgs/s  latency p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", name, total / seconds,
+           percentile(all, 0.5), percentile(all, 0.99), percentile(all, 0.999), percentile(all, 1.0));
+    return st.ok;
+}
+
+// 不限速投递，测最大吞吐量：一个线程向随机房间投递空消息
+static void bench_throughput(executor &ex)
+{
+    const int msgs = 2000000;
+    std::vector<std::unique_ptr<mailbox>> boxes;
+    for (int i = 0; i < BENCH_ROOMS; ++i)
+        boxes.emplace_back(new mailbox(&ex));
+    std::atomic<int> done(0);
+    std::mt19937 rng(3);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < msgs; ++i)
+        boxes[rng() % BENCH_ROOMS]->post([&done]() { done++; });
+    while (done < msgs)
+        std::this_thread::yield();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("mailbox post+run: %.0f msgs/s, %lu steals\n", msgs / seconds, ex.steals());
+}
+
+int main()
+{
+    printf("%u cpus, %d rooms, %d+%d msgs/s for %ds, db stall %dus\n", std::thread::hardware_concurrency(), BENCH_ROOMS,
+           IO_RATE, AI_RATE, BENCH_SECONDS, DB_STALL_US);
+    bool ok = run("inline + room mutex   ", nullptr);
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "inline: rooms serialized, messages in order" << std::endl;
+    bool ret;
+    {
+        executor ex(WORKERS);
+        ret = run("executor + mailboxes  ", &ex);
+        bench_throughput(ex);
+    }
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "executor: one thread per room at a time, messages in order" << std::endl;
+    return ok && ret ? 0 : 1;
+}
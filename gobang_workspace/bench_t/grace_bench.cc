@@ -0,0 +1,166 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+#include "../server/grace.hpp"
+
+/*
+* 断线重连宽限测试
+* 1. 模拟1000名玩家反复断开重连（时间由测试推进），校验：
+*    宽限期内回来的玩家不会被判负；判负只发生在最近一次断开之后满宽限期且一直没有回来时，且只发生一次
+* 2. 10万个房间同时处于宽限期：统计断开登记、重连取消、空闲推进一个刻度、到期处理的耗时，
+*    与按到期时间排序的std::multimap定时器对比
+*/
+
+#define FLAP_USERS 1000
+#define FLAP_STEPS 50000
+#define BENCH_ROOMS 100000
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_since(bench_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+struct flap_user
+{
+    bool online;
+    bool forfeited;
+    uint64_t left_at; // 最近一次断开的时间
+    int forfeits;
+};
+
+static bool check_flapping()
+{
+    timer_wheel wheel;
+    grace_table grace(&wheel);
+    std::vector<flap_user> users(FLAP_USERS, flap_user{true, false, 0, 0});
+    std::mt19937 rng(2023);
+    uint64_t now = 0;
+    bool ok = true;
+    int leaves = 0, backs_in_grace = 0;
+    for (int step = 0; step < FLAP_STEPS && ok; ++step)
+    {
+        now += rng() % 20; // 每名玩家平均约10秒发生一次断开或重连，有的很快回来，有的超过宽限期
+        wheel.advance_to(now);
+        flap_user &u = users[rng() % FLAP_USERS];
+        uint64_t uid = &u - &users[0];
+        if (u.forfeited)
+            continue;
+        if (u.online)
+        {
+            u.online = false;
+            u.left_at = now;
+            leaves++;
+            grace.leave(uid, [&users, &ok, &now, uid]() {
+                flap_user &f = users[uid];
+                // 判负时玩家必须仍然掉线，且距离最近一次断开满宽限期，最多晚两个刻度（含推进的步长）
+                ok = ok && !f.online && !f.forfeited && now - f.left_at >= GRACE_MS && now - f.left_at < GRACE_MS + 2 * TW_TICK_MS + 20;
+                f.forfeited = true;
+                f.forfeits++;
+            });
+        }
+        else if (rng() % 4 != 0) // 掉线的玩家有时会继续掉线一段时间
+        {
+            u.online = true;
+            ok = ok && grace.back(uid);
+            backs_in_grace++;
+        }
+    }
+    // 推进到所有宽限期结束，仍然掉线的玩家都应当被判负
+    for (uint64_t end = now + GRACE_MS + 2 * TW_TICK_MS; now < end; now += 10)
+        wheel.advance_to(now);
+    int forfeits = 0;
+    for (auto &u : users)
+    {
+        ok = ok && u.forfeits == (u.online ? 0 : 1);
+        forfeits += u.forfeits;
+    }
+    ok = ok && grace.size() == 0 && wheel.size() == 0;
+    printf("flapping: %d disconnects, %d reconnects within grace, %d forfeits\n", leaves, backs_in_grace, forfeits);
+    return ok;
+}
+
+static void bench_wheel()
+{
+    timer_wheel wheel;
+    grace_table grace(&wheel);
+    std::mt19937 rng(7);
+    uint64_t now = 0;
+    int fired = 0;
+    // 10万个房间在20秒内陆续进入宽限期
+    bench_clock::time_point start = bench_clock::now();
+    double leave_ns = 0;
+    for (int i = 0; i < BENCH_ROOMS; ++i)
+    {
+        if (i % (BENCH_ROOMS / 200) == 0)
+        {
+            now += TW_TICK_MS;
+            wheel.advance_to(now);
+        }
+        start = bench_clock::now();
+        grace.leave(i, [&fired]() { fired++; });
+        leave_ns += ns_since(start);
+    }
+    printf("wheel: leave %.0f ns/op, %lu rooms in grace\n", leave_ns / BENCH_ROOMS, grace.size());
+
+    // 一半的玩家重连
+    start = bench_clock::now();
+    for (int i = 0; i < BENCH_ROOMS; i += 2)
+        grace.back(i);
+    printf("wheel: back %.0f ns/op\n", ns_since(start) / (BENCH_ROOMS / 2));
+
+    // 在还没有到期的时候推进：每个刻度只处理一个槽
+    int ticks = 0;
+    double tick_ns = 0;
+    while (now + TW_TICK_MS < GRACE_MS)
+    {
+        now += TW_TICK_MS;
+        start = bench_clock::now();
+        wheel.advance_to(now);
+        tick_ns += ns_since(start);
+        ticks++;
+    }
+    // 到期处理
+    start = bench_clock::now();
+    now += GRACE_MS;
+    wheel.advance_to(now);
+    double expire_ns = ns_since(start);
+    if (fired != BENCH_ROOMS / 2)
+        printf("wheel: expected %d timers to fire\n", BENCH_ROOMS / 2);
+    printf("wheel: idle tick %.0f ns (%d ticks with %d timers pending), expire %.0f ns/timer, fired %d\n",
+           tick_ns / ticks, ticks, BENCH_ROOMS / 2, expire_ns / (BENCH_ROOMS / 2), fired);
+
+    // 对照：按到期时间排序的定时器
+    std::multimap<uint64_t, std::function<void()>> timers;
+    std::vector<std::multimap<uint64_t, std::function<void()>>::iterator> handles(BENCH_ROOMS);
+    int fired2 = 0;
+    start = bench_clock::now();
+    for (int i = 0; i < BENCH_ROOMS; ++i)
+        handles[i] = timers.insert(std::make_pair((uint64_t)(rng() % 30000) + GRACE_MS, [&fired2]() { fired2++; }));
+    double add_ns = ns_since(start) / BENCH_ROOMS;
+    start = bench_clock::now();
+    for (int i = 0; i < BENCH_ROOMS; i += 2)
+        timers.erase(handles[i]);
+    double cancel_ns = ns_since(start) / (BENCH_ROOMS / 2);
+    start = bench_clock::now();
+    while (!timers.empty())
+    {
+        timers.begin()->second();
+        timers.erase(timers.begin());
+    }
+    printf("multimap: add %.0f ns/op, cancel %.0f ns/op, expire %.0f ns/timer\n", add_ns, cancel_ns,
+           ns_since(start) / (BENCH_ROOMS / 2));
+}
+
+int main()
+{
+    bool ok = check_flapping();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "flapping connections forfeit only after a full grace period" << std::endl;
+    bench_wheel();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "../server/journal.hpp"
+#include "../server/board.hpp"
+
+/*
+* 房间日志模块测试
+* 1. 模拟网络线程处理落子：随机选房间落子，对局结束后重新开局
+*    不记录日志 / 组提交（落盘后回调广播）/ 每步单独write+fdatasync，比较每秒处理的落子数和确认延迟
+* 2. 生成10万个未结束的房间（另有10万个已结束的房间）的日志，统计恢复并重建棋盘的耗时，校验恢复结果
+* 3. 日志尾部写了一半时丢弃尾部；压缩后再次恢复，最大房间id不变
+*/
+
+#define BENCH_ROOMS 10000
+#define BENCH_MOVES 300000
+#define SYNC_MOVES 3000 // 每步落盘太慢，只测少量
+#define RECOVER_ROOMS 100000
+#define RECOVER_MOVES 30
+#define BENCH_PATH "./journal_bench.journal"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_since(bench_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+enum bench_mode
+{
+    MODE_OFF,
+    MODE_GROUP,
+    MODE_SYNC
+};
+
+struct sim_room
+{
+    uint64_t rid;
+    std::unique_ptr<board_base> board;
+    int color;
+};
+
+// 在房间中随机落一子，返回是否分出胜负或下满
+static bool random_move(sim_room &r, std::mt19937 &rng, int &row, int &col)
+{
+    bool win = false;
+    for (int tries = 0; tries < 1000; ++tries)
+    {
+        row = rng() % 15;
+        col = rng() % 15;
+        if (r.board->place(row, col, r.color, RULE_FREESTYLE, win) == MOVE_OK)
+        {
+            r.color = r.color == 1 ? 2 : 1;
+            return win;
+        }
+    }
+    return true;
+}
+
+static void run(bench_mode mode, int moves)
+{
+    unlink(BENCH_PATH);
+    room_journal journal(BENCH_PATH);
+    std::vector<journal_room> rooms;
+    uint64_t max_rid;
+    journal.recover(rooms, max_rid);
+    int sync_fd = mode == MODE_SYNC ? ::open(BENCH_PATH, O_WRONLY | O_APPEND) : -1;
+
+    std::mt19937 rng(2023);
+    std::vector<sim_room> sims(BENCH_ROOMS);
+    uint64_t next_rid = 1;
+    for (auto &r : sims)
+    {
+        r.rid = next_rid++;
+        r.board.reset(create_board(BOARD_STANDARD));
+        r.color = 1;
+    }
+    // 广播回调中记录确认延迟，回调只在提交线程中执行
+    std::vector<double> latency;
+    latency.reserve(moves);
+    std::atomic<int> acked(0);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < moves; ++i)
+    {
+        sim_room &r = sims[rng() % BENCH_ROOMS];
+        int row, col, color = r.color;
+        bool over = random_move(r, rng, row, col);
+        std::string rec;
+        room_journal::encode_move(rec, r.rid, row, col, color);
+        if (over)
+            room_journal::encode_over(rec, r.rid, 1);
+        bench_clock::time_point t = bench_clock::now();
+        if (mode == MODE_GROUP)
+        {
+            journal.append(rec, [&latency, &acked, t]() {
+                latency.push_back(ns_since(t));
+                acked++;
+            });
+        }
+        else
+        {
+            if (mode == MODE_SYNC)
+            {
+                if (::write(sync_fd, rec.data(), rec.size()) != (ssize_t)rec.size() || fdatasync(sync_fd) != 0)
+                    std::cout << "write failed" << std::endl;
+            }
+            latency.push_back(ns_since(t));
+            acked++;
+        }
+        if (over)
+        {
+            r.rid = next_rid++;
+            r.board.reset(create_board(BOARD_STANDARD));
+            r.color = 1;
+            std::string create;
+            room_journal::encode_create(create, r.rid, 1, 2, RULE_FREESTYLE, BOARD_STANDARD);
+            if (mode == MODE_GROUP)
+                journal.append(create, nullptr);
+            else if (mode == MODE_SYNC)
+                ::write(sync_fd, create.data(), create.size());
+        }
+    }
+    while (acked < moves)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    double s = ns_since(start) / 1e9;
+    if (sync_fd >= 0)
+        ::close(sync_fd);
+    std::sort(latency.begin(), latency.end());
+    const char *names[] = {"journal off        ", "group commit       ", "fdatasync per move "};
+    printf("%s %7d moves %8.0f moves/s  ack p50 %8.1f us  p99 %8.1f us", names[mode], moves, moves / s,
+           latency[latency.size() / 2] / 1e3, latency[latency.size() * 99 / 100] / 1e3);
+    if (mode == MODE_GROUP)
+        printf("  fsync batches %lu (%.1f writes/batch)", journal.batches(), (double)journal.appends() / journal.batches());
+    printf("\n");
+}
+
+// 生成恢复测试用的日志：一半房间已经结束，另一半停在第RECOVER_MOVES步
+static void make_recover_file(std::vector<journal_room> &expect)
+{
+    std::mt19937 rng(7);
+    std::string buf;
+    int fd = ::open(BENCH_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (uint64_t rid = 1; rid <= 2 * RECOVER_ROOMS; ++rid)
+    {
+        room_journal::encode_create(buf, rid, rid * 2, rid * 2 + 1, RULE_FREESTYLE, BOARD_STANDARD);
+        sim_room r{rid, std::unique_ptr<board_base>(create_board(BOARD_STANDARD)), 1};
+        journal_room jr{rid, rid * 2, rid * 2 + 1, RULE_FREESTYLE, BOARD_STANDARD, {}, {}, {}};
+        for (int k = 0; k < RECOVER_MOVES; ++k)
+        {
+            int row, col, color = r.color;
+            if (random_move(r, rng, row, col))
+                break;
+            room_journal::encode_move(buf, rid, row, col, color);
+            jr.rows.push_back(row);
+            jr.cols.push_back(col);
+            jr.colors.push_back(color);
+        }
+        if (rid % 2 == 0)
+            room_journal::encode_over(buf, rid, rid * 2);
+        else
+            expect.push_back(jr);
+        if (buf.size() > (1 << 20))
+        {
+            ::write(fd, buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    ::write(fd, buf.data(), buf.size());
+    ::close(fd);
+}
+
+static bool check_recover()
+{
+    std::vector<journal_room> expect;
+    make_recover_file(expect);
+    struct stat st;
+    stat(BENCH_PATH, &st);
+
+    bench_clock::time_point start = bench_clock::now();
+    std::vector<journal_room> rooms;
+    uint64_t max_rid = 0;
+    bool ok;
+    {
+        room_journal journal(BENCH_PATH);
+        ok = journal.recover(rooms, max_rid);
+    }
+    double read_ms = ns_since(start) / 1e6;
+    // 与room_manager::restore一样为每个房间创建棋盘并重放
+    std::vector<std::unique_ptr<board_base>> boards;
+    boards.reserve(rooms.size());
+    for (journal_room &jr : rooms)
+    {
+        boards.emplace_back(create_board((board_variant)jr.variant));
+        for (size_t i = 0; i < jr.rows.size(); ++i)
+        {
+            bool win = false;
+            ok = ok && boards.back()->place(jr.rows[i], jr.cols[i], jr.colors[i], (game_rule)jr.rule, win) == MOVE_OK;
+        }
+    }
+    double total_ms = ns_since(start) / 1e6;
+    printf("recover %d open rooms (%lu MB journal with %d finished rooms): read+compact %.0f ms, total with rebuild %.0f ms\n",
+           RECOVER_ROOMS, (unsigned long)(st.st_size >> 20), RECOVER_ROOMS, read_ms, total_ms);
+
+    std::sort(rooms.begin(), rooms.end(), [](const journal_room &a, const journal_room &b) { return a.room_id < b.room_id; });
+    ok = ok && rooms.size() == expect.size() && max_rid == 2 * RECOVER_ROOMS;
+    for (size_t i = 0; i < rooms.size() && ok; ++i)
+        ok = rooms[i].room_id == expect[i].room_id && rooms[i].white_id == expect[i].white_id &&
+             rooms[i].black_id == expect[i].black_id && rooms[i].rows == expect[i].rows &&
+             rooms[i].cols == expect[i].cols && rooms[i].colors == expect[i].colors;
+    stat(BENCH_PATH, &st);
+    printf("compacted journal: %lu MB\n", (unsigned long)(st.st_size >> 20));
+    return ok;
+}
+
+static bool check_torn_tail()
+{
+    unlink(BENCH_PATH);
+    std::string buf;
+    room_journal::encode_create(buf, 5, 10, 11, RULE_FREESTYLE, BOARD_STANDARD);
+    room_journal::encode_move(buf, 5, 7, 7, 1);
+    room_journal::encode_create(buf, 9, 12, 13, RULE_FREESTYLE, BOARD_STANDARD);
+    room_journal::encode_over(buf, 9, 12);
+    std::string torn;
+    room_journal::encode_move(torn, 5, 7, 8, 2);
+    buf += torn.substr(0, torn.size() - 2); // 崩溃时只写了一半
+    int fd = ::open(BENCH_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ::write(fd, buf.data(), buf.size());
+    ::close(fd);
+
+    std::vector<journal_room> rooms;
+    uint64_t max_rid = 0;
+    bool ok;
+    {
+        room_journal journal(BENCH_PATH);
+        ok = journal.recover(rooms, max_rid);
+        ok = ok && rooms.size() == 1 && rooms[0].room_id == 5 && rooms[0].rows.size() == 1 && max_rid == 9;
+        // 恢复后继续追加
+        std::string rec;
+        room_journal::encode_move(rec, 5, 8, 8, 2);
+        journal.append(rec, nullptr);
+    }
+    // 压缩后的日志中已经没有房间9，最大房间id仍然是9
+    room_journal journal(BENCH_PATH);
+    ok = ok && journal.recover(rooms, max_rid);
+    ok = ok && rooms.size() == 1 && rooms[0].rows.size() == 2 && rooms[0].colors[1] == 2 && max_rid == 9;
+    return ok;
+}
+
+int main()
+{
+    bool ok = check_torn_tail();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "torn tail dropped, max room id kept after compaction" << std::endl;
+    run(MODE_OFF, BENCH_MOVES);
+    run(MODE_GROUP, BENCH_MOVES);
+    run(MODE_SYNC, SYNC_MOVES);
+    bool ret = check_recover();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "recovered rooms match the journal" << std::endl;
+    ok = ok && ret;
+    unlink(BENCH_PATH);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include "../server/leaderboard.hpp"
+
+/*
+* 排行榜模块测试
+* 1. 小规模随机更新后与排序结果逐项比对排名和分页
+* 2. 加载1000万用户，持续随机改分（模拟对局结束），同时查询排名和分页，统计每次操作的耗时
+*/
+
+#define CHECK_USERS 20000
+#define BENCH_USERS 10000000
+#define BENCH_OPS 2000000
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns_since(bench_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+}
+
+// bulk为true时用批量加载建表，否则逐个插入
+static bool check(std::mt19937 &rng, bool bulk)
+{
+    leaderboard lb;
+    std::vector<int64_t> scores(CHECK_USERS);
+    std::vector<lb_entry> entries;
+    for (int i = 0; i < CHECK_USERS; ++i)
+    {
+        scores[i] = rng() % 3000;
+        if (bulk)
+            entries.push_back(lb_entry{0, (uint64_t)i + 1, scores[i], ""});
+        else
+            lb.update(i + 1, "", scores[i]);
+    }
+    if (bulk)
+        lb.load(entries);
+    for (int i = 0; i < CHECK_USERS; ++i)
+    {
+        int u = rng() % CHECK_USERS;
+        scores[u] = std::max<int64_t>(0, scores[u] + (rng() % 2 ? 500 : -500));
+        lb.update(u + 1, scores[u]);
+    }
+    std::vector<std::pair<int64_t, uint64_t>> sorted;
+    for (int i = 0; i < CHECK_USERS; ++i)
+        sorted.push_back(std::make_pair(-scores[i], (uint64_t)i + 1));
+    std::sort(sorted.begin(), sorted.end());
+    bool ok = lb.size() == CHECK_USERS;
+    for (size_t r = 0; r < sorted.size() && ok; ++r)
+    {
+        lb_entry e;
+        ok = lb.rank(sorted[r].second, e) && e.rank == r + 1 && e.score == -sorted[r].first;
+    }
+    for (int k = 0; k < 1000 && ok; ++k)
+    {
+        uint64_t offset = rng() % (CHECK_USERS + 10);
+        std::vector<lb_entry> entries;
+        lb.range(offset, 50, entries);
+        size_t expect = offset >= CHECK_USERS ? 0 : std::min<size_t>(50, CHECK_USERS - offset);
+        ok = entries.size() == expect;
+        for (size_t i = 0; i < entries.size() && ok; ++i)
+            ok = entries[i].rank == offset + i + 1 && entries[i].uid == sorted[offset + i].second;
+    }
+    lb.remove(sorted[0].second);
+    lb_entry e;
+    ok = ok && lb.rank(sorted[0].second, e) == false && lb.rank(sorted[1].second, e) && e.rank == 1;
+    return ok;
+}
+
+int main()
+{
+    std::mt19937 rng(2023);
+    bool ok = true;
+    for (int bulk = 0; bulk < 2; ++bulk)
+    {
+        bool ret = check(rng, bulk);
+        std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "rank/range vs sort, " << CHECK_USERS << " users, "
+                  << (bulk ? "bulk load" : "incremental insert") << std::endl;
+        ok = ok && ret;
+    }
+
+    leaderboard lb;
+    std::vector<int64_t> scores(BENCH_USERS);
+    std::vector<lb_entry> entries;
+    for (int i = 0; i < BENCH_USERS; ++i)
+    {
+        scores[i] = 1000 + rng() % 20000;
+        entries.push_back(lb_entry{0, (uint64_t)i + 1, scores[i], ""});
+    }
+    bench_clock::time_point start = bench_clock::now();
+    lb.load(entries);
+    std::vector<lb_entry>().swap(entries);
+    std::cout << "load " << BENCH_USERS << " users: " << ns_since(start) / 1e6 << " ms" << std::endl;
+
+    // 每局结束两名玩家改分，穿插排名查询和分页查询
+    double update_ns = 0, rank_ns = 0, range_ns = 0;
+    uint64_t checksum = 0;
+    for (int i = 0; i < BENCH_OPS; ++i)
+    {
+        int w = rng() % BENCH_USERS, l = rng() % BENCH_USERS;
+        start = bench_clock::now();
+        scores[w] += 500;
+        lb.update(w + 1, scores[w]);
+        scores[l] = std::max<int64_t>(0, scores[l] - 500);
+        lb.update(l + 1, scores[l]);
+        update_ns += ns_since(start);
+
+        lb_entry e;
+        start = bench_clock::now();
+        lb.rank(rng() % BENCH_USERS + 1, e);
+        rank_ns += ns_since(start);
+        checksum += e.rank;
+
+        std::vector<lb_entry> entries;
+        start = bench_clock::now();
+        lb.range(rng() % BENCH_USERS, 20, entries);
+        range_ns += ns_since(start);
+        checksum += entries.size();
+    }
+    std::cout << "update: " << update_ns / (2.0 * BENCH_OPS) << " ns/op" << std::endl;
+    std::cout << "rank:   " << rank_ns / BENCH_OPS << " ns/op" << std::endl;
+    std::cout << "range(20): " << range_ns / BENCH_OPS << " ns/op" << std::endl;
+    std::cout << "checksum:" << checksum << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "../server/presence.hpp"
+#include "../server/lobby.hpp"
+
+/*
+* 大厅状态推送测试
+* 1. 在线状态表的人数统计和遍历与逐个查询的结果一致
+* 2. 随机变化的快照序列：客户端从完整快照开始依次合并增量，每一步都与服务器的完整快照一致；没有变化时不生成帧
+* 3. BENCH_CONNS个大厅连接，每个tick采集快照（扫描在线状态表）、编码增量并推送，统计每个tick的cpu时间：
+*    共用一个消息（只序列化一次，每个连接排队同一个消息）
+*    每个连接单独序列化并复制负载（ws_resp的做法）
+*    连接用带写锁和发送队列的对象模拟websocketpp的连接，每个tick之后清空发送队列（不计时）
+*/
+
+#define BENCH_CONNS 100000
+#define BENCH_TICKS 20
+#define BENCH_EVENTS 1000 // 每秒的状态变化次数，每次变化都广播时的开销按此估算
+
+struct fake_conn
+{
+    std::mutex write_lock;
+    std::vector<std::shared_ptr<const std::string>> send_queue;
+
+    void send(const std::shared_ptr<const std::string> &msg)
+    {
+        std::unique_lock<std::mutex> lock(write_lock);
+        send_queue.push_back(msg);
+    }
+};
+typedef std::shared_ptr<fake_conn> fake_ptr;
+
+static double cpu_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// 服务器发出的帧头：2字节，负载超过125字节时加2或8字节的长度
+static std::string frame_header(size_t len)
+{
+    std::string h(1, (char)0x81);
+    if (len < 126)
+        h += (char)len;
+    else if (len < 65536)
+    {
+        h += (char)126;
+        h += (char)(len >> 8);
+        h += (char)(len & 0xff);
+    }
+    else
+    {
+        h += (char)127;
+        for (int i = 7; i >= 0; --i)
+            h += (char)((uint64_t)len >> (i * 8));
+    }
+    return h;
+}
+
+static void random_snapshot(std::mt19937_64 &rng, lobby_snapshot &snap, uint64_t &next_rid)
+{
+    snap.hall = BENCH_CONNS + rng() % 100;
+    snap.room = 20000 + rng() % 100;
+    snap.rooms = snap.room / 2;
+    for (int i = 0; i < 3; ++i)
+        snap.queue[i] = rng() % 4 == 0 ? rng() % 50 : snap.queue[i];
+    // 每次有几局开始，列表保留房间id最大的LOBBY_GAMES局，偶尔有中间的对局结束
+    int started = rng() % 4;
+    for (int i = 0; i < started; ++i, ++next_rid)
+        snap.games.insert(snap.games.begin(), lobby_game{next_rid, next_rid * 2, next_rid * 2 + 1, "white" + std::to_string(next_rid), "black" + std::to_string(next_rid)});
+    if (snap.games.size() > 2 && rng() % 3 == 0)
+        snap.games.erase(snap.games.begin() + rng() % snap.games.size());
+    if (snap.games.size() > LOBBY_GAMES)
+        snap.games.resize(LOBBY_GAMES);
+}
+
+static bool parse(const std::string &s, Json::Value &v)
+{
+    Json::CharReaderBuilder crb;
+    std::unique_ptr<Json::CharReader> pcr(crb.newCharReader());
+    std::string err;
+    return pcr->parse(s.data(), s.data() + s.size(), &v, &err);
+}
+
+// 与game_hall.html中的合并方式相同
+static bool apply(Json::Value &state, const Json::Value &delta)
+{
+    if (delta["seq"].asUInt64() != state["seq"].asUInt64() + 1 || delta["full"].asBool())
+        return false;
+    state["seq"] = delta["seq"];
+    for (const char *key : {"hall", "room", "rooms", "queue"})
+    {
+        if (delta.isMember(key))
+            state[key] = delta[key];
+    }
+    Json::Value games(Json::arrayValue);
+    for (const Json::Value &g : state["games"])
+    {
+        bool deleted = false;
+        for (const Json::Value &d : delta["del"])
+            deleted = deleted || d == g["room_id"];
+        if (deleted == false)
+            games.append(g);
+    }
+    for (const Json::Value &g : delta["add"])
+        games.append(g);
+    std::vector<Json::Value> sorted(games.begin(), games.end());
+    std::sort(sorted.begin(), sorted.end(), [](const Json::Value &a, const Json::Value &b) {
+        return a["room_id"].asUInt64() > b["room_id"].asUInt64();
+    });
+    state["games"] = Json::Value(Json::arrayValue);
+    for (const Json::Value &g : sorted)
+        state["games"].append(g);
+    return true;
+}
+
+static bool check_presence()
+{
+    presence_table<int> pt(1 << 12);
+    for (uint64_t uid = 1; uid <= 1000; ++uid)
+        pt.enter(uid, uid % 3 == 0 ? PRESENCE_ROOM : PRESENCE_HALL, (int)uid);
+    for (uint64_t uid = 1; uid <= 1000; uid += 5)
+        pt.exit(uid, pt.state(uid));
+    pt.enter(1, PRESENCE_HALL, 1);
+    size_t hall = 0, room = 0;
+    for (uint64_t uid = 1; uid <= 1000; ++uid)
+    {
+        hall += pt.state(uid) == PRESENCE_HALL;
+        room += pt.state(uid) == PRESENCE_ROOM;
+    }
+    std::vector<int> conns;
+    bool ok = pt.collect(PRESENCE_HALL, conns) == hall && pt.count(PRESENCE_HALL) == hall && pt.count(PRESENCE_ROOM) == room;
+    for (int c : conns)
+        ok = ok && pt.state(c) == PRESENCE_HALL && pt.conn(c, PRESENCE_HALL) == c;
+    return ok && pt.enter(1, PRESENCE_ROOM, 1) == ENTER_ONLINE && pt.count(PRESENCE_HALL) == hall;
+}
+
+static bool check_delta()
+{
+    std::mt19937_64 rng(3);
+    lobby_feed feed;
+    lobby_snapshot snap;
+    uint64_t next_rid = 1;
+    Json::Value state;
+    bool ok = parse(feed.full(), state) && state["full"].asBool() && state["seq"].asUInt64() == 0;
+    std::string delta;
+    for (int i = 0; i < 2000 && ok; ++i)
+    {
+        random_snapshot(rng, snap, next_rid);
+        if (feed.update(snap, delta) == false)
+            continue;
+        Json::Value d, expect;
+        ok = parse(delta, d) && apply(state, d) && parse(feed.full(), expect);
+        expect["full"] = false;
+        state["full"] = false;
+        ok = ok && state == expect;
+    }
+    // 快照没有变化时不推送
+    return ok && feed.update(snap, delta) == false && feed.seq() > 1000;
+}
+
+static bool bench()
+{
+    std::mt19937_64 rng(11);
+    presence_table<fake_ptr> pt;
+    for (uint64_t uid = 1; uid <= BENCH_CONNS; ++uid)
+        pt.enter(uid * 7919, PRESENCE_HALL, fake_ptr(new fake_conn));
+    for (uint64_t uid = 1; uid <= BENCH_CONNS / 5; ++uid)
+        pt.enter(uid * 7919 + 1, PRESENCE_ROOM, fake_ptr(new fake_conn));
+    lobby_feed feed;
+    lobby_snapshot snap;
+    uint64_t next_rid = 1;
+    Json::StreamWriterBuilder swb; // util_json::serialization的默认配置
+    double collect = 0, shared = 0, each = 0;
+    size_t frame_bytes = 0, frames = 0;
+    std::vector<fake_ptr> conns;
+    for (int tick = 0; tick < BENCH_TICKS; ++tick)
+    {
+        // 采集：扫描在线状态表取出大厅连接，编码增量
+        double t0 = cpu_ms();
+        conns.clear();
+        pt.collect(PRESENCE_HALL, conns);
+        random_snapshot(rng, snap, next_rid);
+        snap.hall = pt.count(PRESENCE_HALL);
+        snap.room = pt.count(PRESENCE_ROOM);
+        std::string delta;
+        if (feed.update(snap, delta) == false)
+            continue;
+        double t1 = cpu_ms();
+        // 共用一个消息：帧头和负载只生成一次
+        std::shared_ptr<const std::string> msg(new std::string(frame_header(delta.size()) + delta));
+        for (fake_ptr &c : conns)
+            c->send(msg);
+        double t2 = cpu_ms();
+        msg.reset();
+        for (fake_ptr &c : conns)
+            c->send_queue.clear();
+        // 每个连接单独序列化，再复制到连接自己的消息中
+        Json::Value v;
+        parse(delta, v);
+        double t3 = cpu_ms();
+        for (fake_ptr &c : conns)
+        {
+            std::unique_ptr<Json::StreamWriter> psw(swb.newStreamWriter());
+            std::stringstream ss;
+            psw->write(v, &ss);
+            std::string body = ss.str();
+            c->send(std::shared_ptr<const std::string>(new std::string(frame_header(body.size()) + body)));
+        }
+        double t4 = cpu_ms();
+        for (fake_ptr &c : conns)
+            c->send_queue.clear();
+        collect += t1 - t0;
+        shared += t2 - t1;
+        each += t4 - t3;
+        frame_bytes += delta.size();
+        frames++;
+    }
+    if (frames == 0)
+        return false;
+    printf("%lu hall connections, %lu frames, %.0f bytes per delta frame, full snapshot %lu bytes\n", (unsigned long)conns.size(),
+           (unsigned long)frames, (double)frame_bytes / frames, (unsigned long)feed.full().size());
+    printf("collect + encode:                   %7.2f ms cpu per tick\n", collect / frames);
+    printf("push, shared frame:                 %7.2f ms cpu per tick (%.1f%% of a core at one tick per %dms)\n", shared / frames,
+           shared / frames / LOBBY_PUSH_MS * 100, LOBBY_PUSH_MS);
+    printf("push, per-connection serialization: %7.2f ms cpu per tick (%.1fx)\n", each / frames, each / shared);
+    printf("broadcasting every change instead (%d changes/s): ~%.1f cores\n", BENCH_EVENTS, each / frames * BENCH_EVENTS / 1000);
+    return conns.size() == BENCH_CONNS && shared < each;
+}
+
+int main()
+{
+    bool ok = check_presence();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "presence counts and hall scan match per-user lookups" << std::endl;
+    bool ret = check_delta();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "full snapshot plus deltas reproduces every snapshot" << std::endl;
+    ok = ok && ret;
+    ret = bench();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "lobby push to " << BENCH_CONNS << " hall connections" << std::endl;
+    return ok && ret ? 0 : 1;
+}
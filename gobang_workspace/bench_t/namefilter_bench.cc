@@ -0,0 +1,131 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+#include <cstdio>
+
+#include "../server/namefilter.hpp"
+
+/*
+* 用户名过滤器测试
+* 1. 加入的用户名一定能查到；容量以内未加入的用户名误判率低于0.1%
+* 2. 删除后查不到；大小写不同的用户名视为同一个
+* 3. 每百万用户名占用的内存
+* 4. 注册压力：BENCH_PROBE_RATIO的请求是探测已被占用的用户名，其余为新用户名，
+*    数据库用带固定延迟的集合模拟；过滤器命中时按用户名查询确认，没有命中的直接插入，
+*    校验没有一个新用户名被误判为已占用，比较有无过滤器时每秒处理的注册请求数和访问数据库的次数
+*/
+
+#define BENCH_NAMES 1000000
+#define BENCH_REQUESTS 20000
+#define BENCH_PROBE_RATIO 0.9
+#define BENCH_DB_US 100 // 模拟的数据库往返时间
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::string name_of(uint64_t i) { return "player_" + std::to_string(i); }
+
+static bool check_accuracy(name_filter &nf)
+{
+    for (uint64_t i = 0; i < BENCH_NAMES; ++i)
+        nf.add(name_of(i));
+    bool ok = true;
+    for (uint64_t i = 0; i < BENCH_NAMES; ++i)
+        ok = ok && nf.contains(name_of(i));
+    uint64_t fp = 0;
+    for (uint64_t i = BENCH_NAMES; i < 2 * BENCH_NAMES; ++i)
+        fp += nf.contains(name_of(i));
+    printf("%d names: %.1f MB (%.2f bytes per name), false positive rate %.3f%%\n", BENCH_NAMES, nf.memory() / 1048576.0,
+           (double)nf.memory() / BENCH_NAMES, 100.0 * fp / BENCH_NAMES);
+    return ok && fp < BENCH_NAMES / 1000;
+}
+
+static bool check_remove()
+{
+    name_filter nf;
+    nf.add("Alice");
+    bool ok = nf.contains("alice") && nf.contains("ALICE") && nf.contains("bob") == false;
+    nf.add("bob");
+    nf.remove("alice");
+    return ok && nf.contains("Alice") == false && nf.contains("bob") && nf.size() == 1;
+}
+
+// 模拟数据库：插入需要一次往返，用户名已存在时失败
+class fake_db
+{
+private:
+    std::unordered_set<std::string> _names;
+
+public:
+    uint64_t round_trips = 0;
+
+    fake_db(uint64_t n)
+    {
+        for (uint64_t i = 0; i < n; ++i)
+            _names.insert(name_of(i));
+    }
+
+    void round_trip()
+    {
+        round_trips++;
+        bench_clock::time_point end = bench_clock::now() + std::chrono::microseconds(BENCH_DB_US);
+        while (bench_clock::now() < end)
+            ;
+    }
+
+    bool insert(const std::string &name)
+    {
+        round_trip();
+        return _names.insert(name).second;
+    }
+
+    bool exists(const std::string &name)
+    {
+        round_trip();
+        return _names.count(name) != 0;
+    }
+};
+
+static bool registration(name_filter *nf)
+{
+    fake_db db(BENCH_NAMES);
+    uint64_t fresh = 2 * BENCH_NAMES, accepted = 0, wrong = 0, confirmed = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < BENCH_REQUESTS; ++i)
+    {
+        bool probe = (i % 10) < BENCH_PROBE_RATIO * 10;
+        std::string name = probe ? name_of((uint64_t)i * 7919 % BENCH_NAMES) : name_of(fresh++);
+        // 与gobang_server::reg相同：过滤器命中时由数据库确认，确实被占用才拒绝，否则插入数据库
+        bool ok;
+        if (nf != nullptr && nf->contains(name) && (confirmed++, db.exists(name)))
+            ok = false;
+        else
+        {
+            ok = db.insert(name);
+            if (ok && nf != nullptr)
+                nf->add(name);
+        }
+        accepted += ok;
+        wrong += ok == probe; // 探测应该失败，新用户名应该成功
+    }
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("%-16s %8.0f registrations/s, %5lu db round trips (%lu filter hits confirmed), %lu wrong answers\n",
+           nf == nullptr ? "without filter:" : "with filter:", BENCH_REQUESTS / seconds, (unsigned long)db.round_trips,
+           (unsigned long)confirmed, (unsigned long)wrong);
+    // 过滤器命中都经过数据库确认，误判不会把新用户名当作已占用
+    return wrong == 0;
+}
+
+int main()
+{
+    name_filter nf(BENCH_NAMES);
+    bool ok = check_accuracy(nf);
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "no false negatives and under 0.1% false positives at capacity" << std::endl;
+    bool ret = check_remove();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "removed names disappear and names compare case-insensitively" << std::endl;
+    ok = ok && ret;
+    ret = registration(nullptr) && registration(&nf);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "filter hits are confirmed, no free name is refused" << std::endl;
+    return ok && ret ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../server/nameindex.hpp"
+
+/*
+* 用户名前缀索引测试
+* 1. 与暴力扫描比较：随机前缀的前K名分数一致，返回的用户名都以前缀开头；更新分数后结果随之变化
+* 2. 大小写不敏感，前缀在边的中间结束也能找到
+* 3. 加入BENCH_NAMES个随机用户名后统计内存，以及随机1~4个字符前缀取前10名的延迟分布
+*/
+
+#define BENCH_NAMES 10000000
+#define BENCH_CHECK_NAMES 100000
+#define BENCH_QUERIES 100000
+#define BENCH_TOPK 10
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 由音节和数字组成的随机用户名，前缀分布接近真实的用户名
+static std::string random_name(std::mt19937_64 &rng)
+{
+    static const char *syllables[] = {"ka", "li", "mo", "ren", "xiao", "wang", "zhang", "chen", "yu", "fei", "long", "hu",
+                                      "dragon", "star", "night", "ice", "fire", "go", "bang", "qi", "sun", "moon", "jin", "ming"};
+    std::string name;
+    int parts = 1 + rng() % 3;
+    for (int i = 0; i < parts; ++i)
+        name += syllables[rng() % (sizeof(syllables) / sizeof(syllables[0]))];
+    if (rng() % 2)
+        name[0] = toupper(name[0]);
+    name += std::to_string(rng() % 100000);
+    return name;
+}
+
+static std::string lower(const std::string &s)
+{
+    std::string r(s);
+    for (char &c : r)
+        c = tolower((unsigned char)c);
+    return r;
+}
+
+static bool check_brute_force()
+{
+    std::mt19937_64 rng(7);
+    name_index ni;
+    std::vector<std::pair<std::string, int64_t>> all; // 小写用户名，分数
+    std::vector<std::string> names;
+    for (uint64_t uid = 1; uid <= BENCH_CHECK_NAMES; ++uid)
+    {
+        std::string name = random_name(rng);
+        names.push_back(name);
+        ni.insert(name, uid, 1000 + rng() % 2000);
+    }
+    // 重复的用户名以最后一次为准，之后更新一部分用户的分数
+    for (int i = 0; i < 10000; ++i)
+        ni.update(names[rng() % names.size()], 1000 + rng() % 2000);
+    std::vector<ni_entry> everything;
+    ni.search("", BENCH_CHECK_NAMES, everything);
+    bool ok = everything.size() == ni.size();
+    for (auto &e : everything)
+        all.emplace_back(e.name, e.score);
+    for (int q = 0; q < 2000 && ok; ++q)
+    {
+        std::string prefix = lower(names[rng() % names.size()]).substr(0, 1 + rng() % 5);
+        std::vector<int64_t> expect;
+        for (auto &a : all)
+        {
+            if (a.first.compare(0, prefix.size(), prefix) == 0)
+                expect.push_back(a.second);
+        }
+        std::sort(expect.rbegin(), expect.rend());
+        expect.resize(std::min<size_t>(expect.size(), BENCH_TOPK));
+        std::vector<ni_entry> got;
+        ni.search(prefix, BENCH_TOPK, got);
+        ok = got.size() == expect.size();
+        for (size_t i = 0; ok && i < got.size(); ++i)
+            ok = got[i].score == expect[i] && got[i].name.compare(0, prefix.size(), prefix) == 0;
+    }
+    return ok;
+}
+
+static bool check_edges()
+{
+    name_index ni;
+    ni.insert("Alice", 1, 1500);
+    ni.insert("alibaba", 2, 1600);
+    ni.insert("Al", 3, 1400);
+    std::vector<ni_entry> got;
+    ni.search("ALI", 10, got);
+    bool ok = got.size() == 2 && got[0].uid == 2 && got[1].uid == 1 && got[1].name == "alice";
+    got.clear();
+    ni.update("al", 2000);
+    ni.search("a", 10, got);
+    ok = ok && got.size() == 3 && got[0].uid == 3;
+    got.clear();
+    ni.search("alx", 10, got);
+    return ok && got.empty() && ni.update("bob", 1) == false;
+}
+
+static bool bench(uint64_t count)
+{
+    std::mt19937_64 rng(42);
+    name_index ni;
+    std::vector<std::string> sample;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint64_t uid = 1; uid <= count; ++uid)
+    {
+        std::string name = random_name(rng);
+        ni.insert(name, uid, 1000 + rng() % 2000);
+        if (uid % 100 == 0)
+            sample.push_back(name);
+    }
+    double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(bench_clock::now() - start).count() / 1e3;
+    printf("%lu names (%lu distinct) inserted in %.1fs, trie memory %.1f MB (%.1f bytes per name)\n", (unsigned long)count,
+           (unsigned long)ni.size(), seconds, ni.memory() / 1048576.0, (double)ni.memory() / ni.size());
+    for (int plen = 1; plen <= 4; ++plen)
+    {
+        std::vector<double> lat;
+        std::vector<ni_entry> got;
+        uint64_t found = 0;
+        for (int q = 0; q < BENCH_QUERIES / 4; ++q)
+        {
+            std::string prefix = sample[rng() % sample.size()].substr(0, plen);
+            got.clear();
+            bench_clock::time_point begin = bench_clock::now();
+            ni.search(prefix, BENCH_TOPK, got);
+            lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+            found += got.size();
+        }
+        std::sort(lat.begin(), lat.end());
+        printf("prefix length %d: top-%d p50 %6.1fus p99 %6.1fus max %7.1fus, %.1f results per query\n", plen, BENCH_TOPK,
+               lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back(), (double)found / lat.size());
+        if (found == 0)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : BENCH_NAMES;
+    bool ok = check_brute_force();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "top-k by prefix matches a brute-force scan after score updates" << std::endl;
+    bool ret = check_edges();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "case-insensitive prefixes ending inside an edge" << std::endl;
+    ok = ok && ret;
+    ret = bench(count);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "prefix search over " << count << " names" << std::endl;
+    return ok && ret ? 0 : 1;
+}
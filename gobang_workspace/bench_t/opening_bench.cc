@@ -0,0 +1,264 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "../server/opening.hpp"
+
+/*
+* 开局库测试
+* 1. 对称：一局棋经过8种对称变换后，每一步的增量哈希与整盘重新计算的一致，规范化后的键相同
+* 2. 计数：随机对局写入统计表，每个局面的计数与按整盘哈希统计的结果一致；
+*    空棋盘下各落点（对称的只算一个）的局数之和等于对局数；两个线程同时写入同一批对局计数翻倍
+* 3. 重新打开：已有文件按文件头中的容量映射，计数保留
+* 4. 性能：BENCH_POSITIONS个局面（容量为2^27个槽位的文件），统计写入吞吐，随机局面查询和查询一个局面所有落点的延迟
+*/
+
+#define BENCH_FILE "./opening_bench.tbl"
+#define BENCH_POSITIONS 100000000ULL
+#define BENCH_CAPACITY (1ULL << 27)
+#define BENCH_CHECK_GAMES 20000
+#define BENCH_LOOKUPS 1000000
+#define BENCH_EXPLORES 10000
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 随机的开局：第一步在中心附近，之后落在已有棋子的两格以内
+static void random_opening(std::mt19937_64 &rng, std::vector<uint16_t> &squares, int plies = OPENING_PLIES)
+{
+    squares.clear();
+    std::vector<bool> taken(OPENING_SQUARES, false);
+    for (int i = 0; i < plies; ++i)
+    {
+        int row, col;
+        do
+        {
+            int base = i == 0 ? 7 * OPENING_COLS + 7 : squares[rng() % squares.size()];
+            row = base / OPENING_COLS + (int)(rng() % 5) - 2;
+            col = base % OPENING_COLS + (int)(rng() % 5) - 2;
+        } while (row < 0 || row >= OPENING_COLS || col < 0 || col >= OPENING_COLS || taken[row * OPENING_COLS + col]);
+        taken[row * OPENING_COLS + col] = true;
+        squares.push_back(row * OPENING_COLS + col);
+    }
+}
+
+// 按整盘哈希计算的规范化键，与增量计算的结果比较
+static uint64_t full_key(const std::vector<uint16_t> &squares, int rule, int band)
+{
+    const opening_hasher &oh = opening_hasher::instance();
+    uint64_t h[8];
+    for (int k = 0; k < 8; ++k)
+        h[k] = oh.full(squares, k);
+    return oh.key(h, rule, band);
+}
+
+static bool check_symmetry()
+{
+    const opening_hasher &oh = opening_hasher::instance();
+    std::mt19937_64 rng(1);
+    bool ok = true;
+    for (int n = 0; n < 2000 && ok; ++n)
+    {
+        std::vector<uint16_t> squares;
+        random_opening(rng, squares);
+        std::vector<uint16_t> sym[8];
+        uint64_t h[8][8] = {};
+        for (int k = 0; k < 8; ++k)
+        {
+            for (uint16_t sq : squares)
+                sym[k].push_back(oh.transform(k, sq));
+        }
+        for (size_t i = 0; i < squares.size() && ok; ++i)
+        {
+            uint64_t key = 0;
+            for (int k = 0; k < 8 && ok; ++k)
+            {
+                oh.play(h[k], i, sym[k][i]);
+                std::vector<uint16_t> prefix(sym[k].begin(), sym[k].begin() + i + 1);
+                for (int j = 0; j < 8; ++j)
+                    ok = ok && h[k][j] == oh.full(prefix, j);
+                uint64_t kk = oh.key(h[k], 0, 0);
+                ok = ok && (k == 0 || kk == key);
+                key = kk;
+            }
+            // 规则和分段不同的局面键不同
+            ok = ok && oh.key(h[0], 1, 0) != key && oh.key(h[0], 0, 1) != key;
+        }
+    }
+    return ok;
+}
+
+static bool check_counts()
+{
+    unlink(BENCH_FILE);
+    std::mt19937_64 rng(2);
+    std::vector<std::vector<uint16_t>> games(BENCH_CHECK_GAMES);
+    std::vector<int> rules(BENCH_CHECK_GAMES), ratings(BENCH_CHECK_GAMES);
+    std::vector<opening_result> results(BENCH_CHECK_GAMES);
+    std::unordered_map<uint64_t, opening_stats> expect;
+    uint64_t per_rule[OPENING_RULES] = {0, 0, 0};
+    for (int i = 0; i < BENCH_CHECK_GAMES; ++i)
+    {
+        // 前几步集中在中心附近，较多对局共用开头的局面
+        random_opening(rng, games[i], 4 + rng() % (OPENING_PLIES + 4));
+        rules[i] = rng() % OPENING_RULES;
+        ratings[i] = 1100 + rng() % 1200;
+        results[i] = (opening_result)(rng() % 3);
+        per_rule[rules[i]]++;
+        for (size_t j = 1; j <= games[i].size() && j <= OPENING_PLIES; ++j)
+        {
+            std::vector<uint16_t> prefix(games[i].begin(), games[i].begin() + j);
+            expect[full_key(prefix, rules[i], opening_table::band_of(ratings[i]))].count[results[i]]++;
+        }
+    }
+    bool ok;
+    {
+        opening_table ot(BENCH_FILE, 1 << 20);
+        if (ot.open() == false)
+            return false;
+        // 两个线程各写入一遍
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; ++t)
+        {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < BENCH_CHECK_GAMES; ++i)
+                    ot.record(games[i], rules[i], ratings[i], results[i]);
+            });
+        }
+        for (std::thread &th : threads)
+            th.join();
+        ok = ot.size() == expect.size();
+        for (auto it = expect.begin(); it != expect.end() && ok; ++it)
+        {
+            opening_stats st;
+            ok = ot.lookup(it->first, st);
+            for (int r = 0; r < 3; ++r)
+                ok = ok && st.count[r] == it->second.count[r] * 2;
+        }
+        for (int rule = 0; rule < OPENING_RULES && ok; ++rule)
+        {
+            opening_stats here;
+            std::vector<opening_move> next;
+            ot.explore(std::vector<uint16_t>(), rule, -1, OPENING_SQUARES, here, next);
+            uint64_t total = 0;
+            for (const opening_move &m : next)
+                total += m.stats.games();
+            ok = total == per_rule[rule] * 2 && here.games() == 0;
+        }
+        // 某一局第2步之后的局面：局面本身与直接查询的计数相同，这一局的第3步（或与之对称的落点）在之后的落点中
+        int band = opening_table::band_of(ratings[0]);
+        opening_stats here;
+        std::vector<opening_move> next;
+        std::vector<uint16_t> prefix(games[0].begin(), games[0].begin() + 2);
+        ot.explore(prefix, rules[0], band, OPENING_SQUARES, here, next);
+        opening_stats direct;
+        ok = ok && ot.lookup(full_key(prefix, rules[0], band), direct) && direct.games() == here.games();
+        uint64_t third = full_key(std::vector<uint16_t>(games[0].begin(), games[0].begin() + 3), rules[0], band);
+        bool found = false;
+        for (const opening_move &m : next)
+        {
+            prefix.push_back(m.row * OPENING_COLS + m.col);
+            found = found || (full_key(prefix, rules[0], band) == third && m.stats.games() == expect[third].games() * 2);
+            prefix.pop_back();
+        }
+        ok = ok && found;
+    }
+    // 重新打开时容量以文件头为准
+    opening_table ot(BENCH_FILE, 1 << 10);
+    ok = ok && ot.open() && ot.capacity() == (1 << 20) && ot.size() == expect.size();
+    for (auto it = expect.begin(); it != expect.end() && ok; ++it)
+    {
+        opening_stats st;
+        ok = ot.lookup(it->first, st) && st.games() == it->second.games() * 2;
+    }
+    unlink(BENCH_FILE);
+    return ok;
+}
+
+static void latency(const char *what, std::vector<double> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    printf("%s: p50 %7.2fus p99 %7.2fus max %8.1fus\n", what, lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back());
+}
+
+static bool bench(uint64_t positions)
+{
+    unlink(BENCH_FILE);
+    uint64_t capacity = BENCH_CAPACITY;
+    while (capacity * 0.8 < positions)
+        capacity <<= 1;
+    opening_table ot(BENCH_FILE, capacity);
+    if (ot.open() == false)
+        return false;
+    std::mt19937_64 rng(3);
+    // 随机开局的前几步大多重复，局面数按表中实际的局面数计算
+    std::vector<uint16_t> squares;
+    uint64_t games = 0;
+    bench_clock::time_point start = bench_clock::now();
+    while (ot.size() < positions)
+    {
+        random_opening(rng, squares);
+        int rule = rng() % OPENING_RULES, rating = 1100 + rng() % 1200;
+        ot.record(squares, rule, rating, (opening_result)(rng() % 3));
+        games++;
+    }
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("%lu games recorded in %.1fs: %.0f games/s, %.0f position updates/s; %lu positions, %.0f%% of %lu slots, %.1f GB file\n",
+           (unsigned long)games, seconds, games / seconds, games * OPENING_PLIES / seconds, (unsigned long)ot.size(),
+           100.0 * ot.size() / ot.capacity(), (unsigned long)ot.capacity(), (sizeof(opening_header) + ot.capacity() * sizeof(opening_slot)) / 1e9);
+    // 随机查询：一半是已有的局面（重新生成同样的对局），一半是不存在的局面
+    std::mt19937_64 replay(3);
+    const opening_hasher &oh = opening_hasher::instance();
+    std::vector<double> lat;
+    uint64_t hits = 0;
+    for (int i = 0; i < BENCH_LOOKUPS; ++i)
+    {
+        std::mt19937_64 &r = i % 2 == 0 ? replay : rng;
+        random_opening(r, squares);
+        int rule = r() % OPENING_RULES, rating = 1100 + r() % 1200;
+        r();
+        uint64_t h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (size_t j = 0; j < squares.size(); ++j)
+            oh.play(h, j, squares[j]);
+        uint64_t key = oh.key(h, rule, opening_table::band_of(rating));
+        opening_stats st;
+        bench_clock::time_point begin = bench_clock::now();
+        hits += ot.lookup(key, st);
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+    }
+    latency("position lookup", lat);
+    printf("%lu of %d lookups found\n", (unsigned long)hits, BENCH_LOOKUPS);
+    lat.clear();
+    for (int i = 0; i < BENCH_EXPLORES; ++i)
+    {
+        random_opening(rng, squares, rng() % OPENING_PLIES);
+        opening_stats here;
+        std::vector<opening_move> next;
+        bench_clock::time_point begin = bench_clock::now();
+        ot.explore(squares, 0, -1, 20, here, next);
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - begin).count() / 1000.0);
+    }
+    latency("explore (all moves, all bands)", lat);
+    unlink(BENCH_FILE);
+    return hits >= std::min<uint64_t>(games, BENCH_LOOKUPS / 2);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t positions = argc > 1 ? strtoull(argv[1], nullptr, 10) : BENCH_POSITIONS;
+    bool ok = check_symmetry();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "incremental hashes match full hashes under all 8 symmetries" << std::endl;
+    bool ret = check_counts();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "concurrent counts match a reference and survive reopen" << std::endl;
+    ok = ok && ret;
+    ret = bench(positions);
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "opening table with " << positions << " positions" << std::endl;
+    return ok && ret ? 0 : 1;
+}
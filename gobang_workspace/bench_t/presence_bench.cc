@@ -0,0 +1,262 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdio>
+#include <unordered_map>
+
+#include "../server/presence.hpp"
+
+/*
+* 在线状态表测试
+* 1. 多个线程同时让同一批玩家进入大厅/房间，每轮每个玩家只有一个线程成功
+* 2. 读取方反复获取连接，同时写入方不停切换状态，读到的连接必须属于所查询的状态（连接中记录了uid和状态）
+* 3. 条目回收：容量很小的表上依次有远多于容量的玩家进出，同时读取方检查读到的连接属于所查询的玩家；
+*    同时在线的玩家占满探测范围后进入返回表满
+* 4. 多线程混合负载（查询状态、获取连接、进入退出），与原来一把锁保护两个unordered_map的做法对比
+*/
+
+#define BENCH_USERS 100000
+#define BENCH_OPS 2000000 // 每个线程
+#define WRITE_PERCENT 10
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 模拟连接：记录属于哪个玩家、哪种状态
+struct fake_conn
+{
+    uint64_t uid;
+    presence_state state;
+};
+typedef std::shared_ptr<fake_conn> conn_ptr;
+
+// 原来的做法
+class locked_presence
+{
+private:
+    std::mutex _mtx;
+    std::unordered_map<uint64_t, conn_ptr> _hall;
+    std::unordered_map<uint64_t, conn_ptr> _room;
+
+public:
+    enter_result enter(uint64_t uid, presence_state state, const conn_ptr &conn)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (_hall.count(uid) || _room.count(uid))
+            return ENTER_ONLINE;
+        (state == PRESENCE_HALL ? _hall : _room).insert(std::make_pair(uid, conn));
+        return ENTER_OK;
+    }
+    bool exit(uint64_t uid, presence_state state)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        return (state == PRESENCE_HALL ? _hall : _room).erase(uid) != 0;
+    }
+    presence_state state(uint64_t uid)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (_hall.count(uid))
+            return PRESENCE_HALL;
+        return _room.count(uid) ? PRESENCE_ROOM : PRESENCE_OFFLINE;
+    }
+    conn_ptr conn(uint64_t uid, presence_state state)
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        auto &m = state == PRESENCE_HALL ? _hall : _room;
+        auto it = m.find(uid);
+        return it == m.end() ? conn_ptr() : it->second;
+    }
+};
+
+static bool check_enter_race()
+{
+    presence_table<conn_ptr> table;
+    const int users = 1000, threads = 4, rounds = 50;
+    bool ok = true;
+    for (int round = 0; round < rounds && ok; ++round)
+    {
+        std::vector<std::atomic<int>> wins(users);
+        for (auto &w : wins)
+            w = 0;
+        std::vector<std::thread> ths;
+        for (int t = 0; t < threads; ++t)
+        {
+            ths.emplace_back([&table, &wins, t, users]() {
+                for (int u = 0; u < users; ++u)
+                {
+                    presence_state s = t % 2 ? PRESENCE_HALL : PRESENCE_ROOM;
+                    if (table.enter(u + 1, s, std::make_shared<fake_conn>(fake_conn{(uint64_t)u + 1, s})) == ENTER_OK)
+                        wins[u]++;
+                }
+            });
+        }
+        for (auto &th : ths)
+            th.join();
+        for (int u = 0; u < users && ok; ++u)
+        {
+            presence_state s = table.state(u + 1);
+            ok = wins[u] == 1 && s != PRESENCE_OFFLINE && table.exit(u + 1, s) && table.state(u + 1) == PRESENCE_OFFLINE;
+        }
+    }
+    return ok;
+}
+
+static bool check_conn_consistency()
+{
+    presence_table<conn_ptr> table;
+    const int users = 64;
+    std::atomic<bool> stop(false), ok(true);
+    std::atomic<uint64_t> hits(0);
+    std::vector<std::thread> ths;
+    for (int t = 0; t < 3; ++t)
+    {
+        ths.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            while (!stop)
+            {
+                uint64_t uid = rng() % users + 1;
+                presence_state s = rng() % 2 ? PRESENCE_HALL : PRESENCE_ROOM;
+                conn_ptr c = table.conn(uid, s);
+                if (c.get() != nullptr)
+                {
+                    hits++;
+                    if (c->uid != uid || c->state != s)
+                        ok = false;
+                }
+            }
+        });
+    }
+    std::mt19937 rng(99);
+    for (int i = 0; i < 2000000; ++i)
+    {
+        uint64_t uid = rng() % users + 1;
+        presence_state s = rng() % 2 ? PRESENCE_HALL : PRESENCE_ROOM;
+        if (table.enter(uid, s, std::make_shared<fake_conn>(fake_conn{uid, s})) != ENTER_OK)
+            table.exit(uid, table.state(uid));
+    }
+    stop = true;
+    for (auto &th : ths)
+        th.join();
+    printf("consistency: %lu connections read during 2000000 transitions\n", (unsigned long)hits.load());
+    return ok;
+}
+
+static bool check_reuse()
+{
+    const size_t capacity = 1024;
+    const int online = 256, users = 1000000;
+    presence_table<conn_ptr> table(capacity);
+    std::atomic<bool> stop(false), ok(true);
+    std::atomic<uint64_t> next(1); // 最早进入、还没有退出的玩家
+    std::atomic<uint64_t> last(0); // 最后进入的玩家
+    std::vector<std::thread> ths;
+    for (int t = 0; t < 2; ++t)
+    {
+        ths.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            while (!stop)
+            {
+                // 查询在线的和已经退出的玩家，读到的连接必须属于该玩家
+                uint64_t hi = last.load(), lo = hi > 2 * online ? hi - 2 * online : 1;
+                if (hi == 0)
+                    continue;
+                uint64_t uid = lo + rng() % (hi - lo + 1);
+                conn_ptr c = table.conn(uid, PRESENCE_HALL);
+                if (c.get() != nullptr && c->uid != uid)
+                    ok = false;
+                if (table.state(uid) == PRESENCE_ROOM)
+                    ok = false;
+            }
+        });
+    }
+    int full = 0;
+    for (uint64_t uid = 1; uid <= (uint64_t)users; ++uid)
+    {
+        if (uid > (uint64_t)online)
+        {
+            ok = ok && table.exit(next, PRESENCE_HALL);
+            next++;
+        }
+        full += table.enter(uid, PRESENCE_HALL, std::make_shared<fake_conn>(fake_conn{uid, PRESENCE_HALL})) != ENTER_OK;
+        last = uid;
+    }
+    stop = true;
+    for (auto &th : ths)
+        th.join();
+    ok = ok && full == 0 && table.count(PRESENCE_HALL) == (size_t)online;
+    // 小表占满后再进入的玩家得到表满
+    presence_table<conn_ptr> small(PRESENCE_PROBE);
+    for (uint64_t uid = 1; uid <= PRESENCE_PROBE; ++uid)
+        ok = ok && small.enter(uid, PRESENCE_HALL, conn_ptr()) == ENTER_OK;
+    ok = ok && small.enter(PRESENCE_PROBE + 1, PRESENCE_HALL, conn_ptr()) == ENTER_FULL &&
+         small.enter(1, PRESENCE_ROOM, conn_ptr()) == ENTER_ONLINE && small.exit(1, PRESENCE_HALL) &&
+         small.enter(PRESENCE_PROBE + 1, PRESENCE_HALL, conn_ptr()) == ENTER_OK && small.state(1) == PRESENCE_OFFLINE;
+    printf("reuse: %d players through a %zu-entry table with %d online, %d failed enters\n", users, capacity, online, full);
+    return ok;
+}
+
+template <class Table>
+static void bench_mixed(const char *name, int threads)
+{
+    Table table;
+    std::vector<conn_ptr> conns;
+    for (int u = 1; u <= BENCH_USERS; ++u)
+    {
+        conns.push_back(std::make_shared<fake_conn>(fake_conn{(uint64_t)u, PRESENCE_HALL}));
+        if (u % 2)
+            table.enter(u, PRESENCE_HALL, conns.back());
+    }
+    std::vector<std::thread> ths;
+    std::atomic<uint64_t> found(0);
+    bench_clock::time_point start = bench_clock::now();
+    for (int t = 0; t < threads; ++t)
+    {
+        ths.emplace_back([&, t]() {
+            std::mt19937 rng(t + 7);
+            uint64_t f = 0;
+            for (int i = 0; i < BENCH_OPS; ++i)
+            {
+                uint64_t uid = rng() % BENCH_USERS + 1;
+                int op = rng() % 100;
+                if (op < WRITE_PERCENT)
+                {
+                    if (table.enter(uid, PRESENCE_HALL, conns[uid - 1]) != ENTER_OK)
+                        table.exit(uid, PRESENCE_HALL);
+                }
+                else if (op < 55)
+                    f += table.state(uid) == PRESENCE_HALL;
+                else
+                    f += table.conn(uid, PRESENCE_HALL).get() != nullptr;
+            }
+            found += f;
+        });
+    }
+    for (auto &th : ths)
+        th.join();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    printf("%s %d threads: %6.1f M ops/s (%d%% transitions)\n", name, threads, (double)BENCH_OPS * threads / seconds / 1e6,
+           WRITE_PERCENT);
+}
+
+int main()
+{
+    printf("%u cpus\n", std::thread::hardware_concurrency());
+    bool ok = check_enter_race();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "concurrent enter: exactly one winner per player" << std::endl;
+    bool ret = check_conn_consistency();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "connections always match the queried state" << std::endl;
+    ok = ok && ret;
+    ret = check_reuse();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "offline entries are reused, a full table is reported as full" << std::endl;
+    ok = ok && ret;
+    for (int threads : {1, 2, 4})
+    {
+        bench_mixed<presence_table<conn_ptr>>("presence table     ", threads);
+        bench_mixed<locked_presence>("mutex + two maps   ", threads);
+    }
+    return ok ? 0 : 1;
+}
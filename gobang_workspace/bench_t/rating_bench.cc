@@ -0,0 +1,211 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+#include "../server/rating.hpp"
+
+/*
+* 等级分模块测试
+* 1. 用Glickman论文中的算例校验Glicko-2的计算
+* 2. 两个rating_book（相当于两个进程，各自有缓存）共用一张表，多个线程同时结束涉及同一名玩家的对局（写入时随机失败），
+*    按写入顺序重放，校验每一局都基于前一局的结果计算、失败的对局没有生效、场次没有丢失
+* 3. 多线程统计每秒可以结算的对局数（存储为内存中的表，不含数据库的耗时），缓存的玩家数不超过上限
+*/
+
+#define BENCH_THREADS 4
+#define BENCH_PLAYERS 100000
+#define BENCH_GAMES 400000
+#define HOT_GAMES 20000 // 正确性测试中每个线程结束的对局数
+#define BENCH_CACHE 10000
+
+struct mem_user
+{
+    glicko_rating rating;
+    int total;
+    int win;
+};
+
+// 内存中的用户表，事务由一把锁模拟数据库的行锁
+struct mem_table
+{
+    std::mutex mutex;
+    std::unordered_map<uint64_t, mem_user> users;
+    std::vector<rating_change> log; // 按写入顺序记录成功写入的结果
+    std::vector<std::pair<uint64_t, uint64_t>> games; // 成功写入的对局 胜方 负方
+    std::mt19937 rng{7};
+    int fail_rate = 0; // 每fail_rate次写入失败一次，0为不失败
+
+    bool load(uint64_t uid, glicko_rating &r)
+    {
+        auto it = users.find(uid);
+        if (it == users.end())
+            return false;
+        r = it->second.rating;
+        return true;
+    }
+
+    bool load_locked(uint64_t uid, glicko_rating &r)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return load(uid, r);
+    }
+
+    // 锁定、读取当前分数、计算、写入
+    bool update(rating_change *changes, int n, const rating_book::apply &fn)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (int i = 0; i < n; ++i)
+        {
+            if (load(changes[i].uid, changes[i].rating) == false)
+                return false;
+        }
+        fn(changes, n);
+        if (fail_rate != 0 && rng() % fail_rate == 0)
+            return false;
+        for (int i = 0; i < n; ++i)
+        {
+            mem_user &u = users[changes[i].uid];
+            u.rating = changes[i].rating;
+            u.total++;
+            u.win += changes[i].win;
+            log.push_back(changes[i]);
+        }
+        if (n == 2)
+            games.push_back(std::make_pair(changes[0].uid, changes[1].uid));
+        return true;
+    }
+};
+
+static bool near(double a, double b, double eps) { return fabs(a - b) < eps; }
+
+static bool check_paper()
+{
+    glicko_rating p = {1500, 200, 0.06};
+    glicko_game games[3] = {
+        {{1400, 30, 0.06}, 1},
+        {{1550, 100, 0.06}, 0},
+        {{1700, 300, 0.06}, 0},
+    };
+    glicko_rating r = glicko2_update(p, games, 3);
+    printf("paper example: rating %.2f rd %.2f vol %.5f (expect 1464.06 151.52 0.05999)\n", r.rating, r.rd, r.vol);
+    return near(r.rating, 1464.06, 0.01) && near(r.rd, 151.52, 0.01) && near(r.vol, 0.05999, 0.00001);
+}
+
+static bool check_concurrent()
+{
+    mem_table table;
+    table.fail_rate = 10;
+    const int players = 8;
+    for (uint64_t uid = 1; uid <= players; ++uid)
+        table.users[uid] = mem_user{{GLICKO_RATING, GLICKO_RD, GLICKO_VOL}, 0, 0};
+    rating_book books[2] = {
+        {[&](uint64_t uid, glicko_rating &r) { return table.load_locked(uid, r); },
+         [&](rating_change *c, int n, const rating_book::apply &fn) { return table.update(c, n, fn); }},
+        {[&](uint64_t uid, glicko_rating &r) { return table.load_locked(uid, r); },
+         [&](rating_change *c, int n, const rating_book::apply &fn) { return table.update(c, n, fn); }},
+    };
+    // 两边都先缓存所有玩家的分数
+    for (uint64_t uid = 1; uid <= players; ++uid)
+    {
+        glicko_rating r;
+        books[0].get(uid, r);
+        books[1].get(uid, r);
+    }
+
+    // 每局都有1号玩家参与，线程交替使用两个rating_book
+    std::vector<std::thread> threads;
+    for (int t = 0; t < BENCH_THREADS; ++t)
+    {
+        rating_book &book = books[t % 2];
+        threads.push_back(std::thread([&book, t]() {
+            std::mt19937 rng(t);
+            for (int i = 0; i < HOT_GAMES; ++i)
+            {
+                uint64_t peer = 2 + rng() % (players - 1);
+                rating_change c[2];
+                if (rng() % 2)
+                    book.game_over(1, peer, c);
+                else
+                    book.game_over(peer, 1, c);
+            }
+        }));
+    }
+    for (auto &th : threads)
+        th.join();
+
+    // 按写入顺序从初始分数重放
+    std::unordered_map<uint64_t, glicko_rating> replay;
+    for (uint64_t uid = 1; uid <= players; ++uid)
+        replay[uid] = glicko_rating{GLICKO_RATING, GLICKO_RD, GLICKO_VOL};
+    bool ok = table.log.size() == table.games.size() * 2;
+    for (size_t i = 0; i < table.games.size() && ok; ++i)
+    {
+        uint64_t w = table.games[i].first, l = table.games[i].second;
+        glicko_game wg = {replay[l], 1}, lg = {replay[w], 0};
+        glicko_rating nw = glicko2_update(replay[w], &wg, 1), nl = glicko2_update(replay[l], &lg, 1);
+        ok = nw.rating == table.log[2 * i].rating.rating && nl.rating == table.log[2 * i + 1].rating.rating &&
+             nw.rd == table.log[2 * i].rating.rd && nl.vol == table.log[2 * i + 1].rating.vol;
+        replay[w] = nw;
+        replay[l] = nl;
+    }
+    int total = 0;
+    for (uint64_t uid = 1; uid <= players; ++uid)
+    {
+        ok = ok && table.users[uid].rating.rating == replay[uid].rating;
+        total += table.users[uid].total;
+    }
+    ok = ok && table.users[1].total == (int)table.games.size() && total == (int)table.games.size() * 2;
+    size_t submitted = (size_t)BENCH_THREADS * HOT_GAMES;
+    printf("concurrent games on one player: %zu submitted, %zu written, %zu failed writes not applied\n",
+           submitted, table.games.size(), submitted - table.games.size());
+    return ok;
+}
+
+static bool throughput()
+{
+    mem_table table;
+    for (uint64_t uid = 1; uid <= BENCH_PLAYERS; ++uid)
+        table.users[uid] = mem_user{{GLICKO_RATING, GLICKO_RD, GLICKO_VOL}, 0, 0};
+    table.log.reserve((size_t)BENCH_GAMES * 2);
+    rating_book book([&](uint64_t uid, glicko_rating &r) { return table.load_locked(uid, r); },
+                     [&](rating_change *c, int n, const rating_book::apply &fn) { return table.update(c, n, fn); }, BENCH_CACHE);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < BENCH_THREADS; ++t)
+    {
+        threads.push_back(std::thread([&book, t]() {
+            std::mt19937 rng(100 + t);
+            for (int i = 0; i < BENCH_GAMES / BENCH_THREADS; ++i)
+            {
+                uint64_t a = 1 + rng() % BENCH_PLAYERS, b = 1 + rng() % BENCH_PLAYERS;
+                if (a == b)
+                    continue;
+                rating_change c[2];
+                book.game_over(a, b, c);
+            }
+        }));
+    }
+    for (auto &th : threads)
+        th.join();
+    double s = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e9;
+    printf("throughput: %zu games in %.3f s, %.0f games/s (%d threads, storage in memory), %zu of %d players cached\n",
+           table.games.size(), s, table.games.size() / s, BENCH_THREADS, book.cached(), BENCH_PLAYERS);
+    return book.cached() <= BENCH_CACHE;
+}
+
+int main()
+{
+    bool ok = check_paper();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "glicko-2 paper example" << std::endl;
+    bool ret = check_concurrent();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "concurrent results replay in write order" << std::endl;
+    ok = ok && ret;
+    ret = throughput();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "rating cache stays within its capacity" << std::endl;
+    return ok && ret ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "../server/board.hpp"
+
+/*
+* 规则模块测试
+* 先校验一组已知的禁手/非禁手局面，再统计随机局面下每次禁手判断的耗时
+*/
+
+#define BENCH_CHECKS 200000
+
+struct rule_case
+{
+    const char *name;
+    std::vector<std::pair<int, int>> mine; // 先手方已有的棋子
+    std::vector<std::pair<int, int>> peer; // 后手方已有的棋子
+    int row, col;                          // 待判断的落子
+    int color;                             // 落子方
+    bool forbidden;
+};
+
+static standard_board make_board(const rule_case &rc)
+{
+    standard_board board;
+    for (auto &p : rc.mine)
+        board.set(p.first, p.second, rc.color);
+    for (auto &p : rc.peer)
+        board.set(p.first, p.second, 3 - rc.color);
+    return board;
+}
+
+int main()
+{
+    std::vector<rule_case> cases = {
+        {"三三", {{7, 5}, {7, 6}, {5, 7}, {6, 7}}, {}, 7, 7, RULE_RESTRICTED, true},
+        {"跳三三三", {{7, 4}, {7, 6}, {5, 5}, {6, 6}}, {}, 7, 7, RULE_RESTRICTED, true},
+        {"四四", {{7, 4}, {7, 5}, {7, 6}, {4, 7}, {5, 7}, {6, 7}}, {}, 7, 7, RULE_RESTRICTED, true},
+        {"同线四四", {{7, 3}, {7, 5}, {7, 6}, {7, 9}}, {}, 7, 7, RULE_RESTRICTED, true},
+        {"长连", {{7, 2}, {7, 3}, {7, 4}, {7, 6}, {7, 7}, {7, 8}}, {}, 7, 5, RULE_RESTRICTED, true},
+        {"四三", {{7, 4}, {7, 5}, {7, 6}, {5, 7}, {6, 7}}, {}, 7, 7, RULE_RESTRICTED, false},
+        {"五连优先", {{7, 3}, {7, 4}, {7, 5}, {7, 6}, {4, 7}, {5, 7}, {6, 7}}, {}, 7, 7, RULE_RESTRICTED, false},
+        {"眠三不算三", {{7, 5}, {7, 6}, {5, 7}, {6, 7}}, {{7, 4}}, 7, 7, RULE_RESTRICTED, false},
+        {"边线眠三", {{0, 1}, {0, 2}, {2, 0}, {1, 0}}, {}, 0, 0, RULE_RESTRICTED, false},
+        {"被堵的四四", {{7, 4}, {7, 5}, {7, 6}, {4, 7}, {5, 7}, {6, 7}}, {{7, 3}, {7, 8}}, 7, 7, RULE_RESTRICTED, false},
+        {"后手方不受限制", {{7, 5}, {7, 6}, {5, 7}, {6, 7}}, {}, 7, 7, 3 - RULE_RESTRICTED, false},
+    };
+    int failed = 0;
+    rule_engine &re = rule_engine::instance();
+    for (auto &rc : cases)
+    {
+        standard_board board = make_board(rc);
+        bool ret = re.forbidden(board, rc.row, rc.col, rc.color, RULE_RENJU);
+        std::cout << (ret == rc.forbidden ? "[ OK ] " : "[FAIL] ") << rc.name << std::endl;
+        failed += ret != rc.forbidden;
+    }
+
+    // 随机局面，统计禁手判断的平均耗时
+    std::mt19937 rng(2023);
+    std::vector<standard_board> boards(1000);
+    for (auto &board : boards)
+    {
+        for (int k = 0; k < 40; ++k)
+            board.set(rng() % board.rows(), rng() % board.cols(), k % 2 + 1);
+    }
+    int forbidden = 0, checks = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_CHECKS; ++i)
+    {
+        standard_board &board = boards[i % boards.size()];
+        int r = rng() % board.rows(), c = rng() % board.cols();
+        if (board.get(r, c) != 0)
+            continue;
+        checks++;
+        forbidden += re.forbidden(board, r, c, RULE_RESTRICTED, RULE_RENJU);
+    }
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "checks:" << checks << " forbidden:" << forbidden << " cost:" << ns / checks << " ns/move" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../server/shard.hpp"
+
+/*
+* 多进程分片测试
+* 1. 一个worker创建的会话其他worker能查到，设置存活时间后过期
+* 2. 持有共享锁的worker崩溃后，其他进程仍然可以加锁
+* 3. worker重启时清理匹配队列中属于旧进程的玩家
+* 4. 端到端：N个worker进程用SO_REUSEPORT监听同一个端口，客户端连接后发送uid，
+*    worker创建会话、加入共享匹配队列并执行匹配，本worker的玩家直接回复，其他worker的玩家通过通知队列回复；
+*    每个玩家恰好收到一次匹配成功，房间数为玩家数的一半
+*    分别统计1~N个进程时每秒处理的连接数和匹配数，以及跨进程匹配的比例
+*/
+
+#define BENCH_PORT 28080
+#define BENCH_PLAYERS 20000
+#define BENCH_WINDOW 256 // 客户端同时保持的连接数
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 各个worker共用的统计，放在单独的共享内存中
+struct bench_stats
+{
+    std::atomic<int> ready;
+    std::atomic<uint64_t> rooms;
+    std::atomic<uint64_t> cross;
+};
+
+// worker回复给客户端的匹配结果
+struct bench_reply
+{
+    uint64_t uid;
+    uint32_t owner;    // 房间所在的worker
+    uint32_t acceptor; // 接受连接的worker
+};
+
+static bool check_sessions()
+{
+    shard_segment *seg = shard::create(2);
+    shard a(seg, 0), b(seg, 1);
+    uint64_t ssid = a.session_create(42, 30000), uid = 0;
+    bool ok = ssid != 0 && b.session_get(ssid, uid) && uid == 42;
+    b.session_expire(ssid, -1);
+    ok = ok && a.session_get(ssid, uid);
+    a.session_expire(ssid, 0);
+    ok = ok && b.session_get(ssid, uid) == false && a.session_get(ssid + 1, uid) == false;
+    // 永久存在的会话不会被新会话覆盖
+    uint64_t forever = a.session_create(7, -1);
+    for (int i = 0; i < SHARD_SESSIONS + 10; ++i)
+        a.session_create(i + 100, 0);
+    ok = ok && b.session_get(forever, uid) && uid == 7;
+    shard::destroy(seg);
+    return ok;
+}
+
+static bool check_robust_lock()
+{
+    shard_segment *seg = shard::create(2);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        pthread_mutex_lock(&seg->queues[0].mutex); // 持锁退出
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+    shard sd(seg, 1);
+    bool ok = sd.queue_push(0, 1) && sd.queue_push(0, 2);
+    shard_player p1, p2;
+    ok = ok && sd.queue_pop_pair(0, p1, p2) && p1.uid == 1 && p2.uid == 2;
+    shard::destroy(seg);
+    return ok;
+}
+
+static bool check_purge()
+{
+    shard_segment *seg = shard::create(2);
+    shard w0(seg, 0), w1(seg, 1);
+    w0.queue_push(1, 10);
+    w1.queue_push(1, 11);
+    w0.queue_push(1, 12);
+    w1.notify(0, 10);
+    w0.attach(28001); // worker 0 重启
+    shard_player p1, p2;
+    std::vector<shard_notice> notices;
+    bool ok = w1.queue_pop_pair(1, p1, p2) == false && w1.queue_remove(1, 11) && w0.drain(notices) == 0 &&
+              w1.room_port(0) == 28001;
+    shard::destroy(seg);
+    return ok;
+}
+
+static int listen_reuseport(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0)
+    {
+        perror("bind");
+        _exit(1);
+    }
+    return fd;
+}
+
+// 模拟服务器的worker：接受连接，读取uid，创建会话后匹配
+static void run_worker(shard_segment *seg, bench_stats *stats, uint32_t worker, int port)
+{
+    shard sd(seg, worker);
+    sd.attach(port + 1 + worker);
+    int lfd = listen_reuseport(port);
+    stats->ready++;
+    std::unordered_map<int, uint64_t> pending; // 还没有读到uid的连接
+    std::unordered_map<uint64_t, int> waiting; // 等待匹配结果的玩家
+    std::vector<shard_notice> notices;
+    auto reply = [&](uint64_t uid, uint32_t owner) {
+        auto it = waiting.find(uid);
+        if (it == waiting.end())
+            return;
+        bench_reply r{uid, owner, worker};
+        if (write(it->second, &r, sizeof(r)) != sizeof(r))
+            perror("write");
+        close(it->second);
+        waiting.erase(it);
+    };
+    while (1)
+    {
+        std::vector<struct pollfd> fds;
+        fds.push_back({lfd, POLLIN, 0});
+        for (auto &p : pending)
+            fds.push_back({p.first, POLLIN, 0});
+        poll(fds.data(), fds.size(), 1);
+        int cfd;
+        while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+            pending[cfd] = 0;
+        for (size_t i = 1; i < fds.size(); ++i)
+        {
+            if ((fds[i].revents & POLLIN) == 0)
+                continue;
+            uint64_t uid;
+            if (read(fds[i].fd, &uid, sizeof(uid)) != sizeof(uid))
+                continue;
+            pending.erase(fds[i].fd);
+            waiting[uid] = fds[i].fd;
+            sd.session_create(uid, SHARD_SESSIONS);
+            sd.queue_push(0, uid);
+            // 与服务器的matcher相同：入队后执行一次匹配，房间建在本worker上
+            shard_player a, b;
+            while (sd.queue_pop_pair(0, a, b))
+            {
+                stats->rooms++;
+                if (a.worker != b.worker)
+                    stats->cross++;
+                for (const shard_player &p : {a, b})
+                {
+                    if (p.worker == worker)
+                        reply(p.uid, worker);
+                    else
+                        sd.notify(p.worker, p.uid);
+                }
+            }
+        }
+        notices.clear();
+        sd.drain(notices);
+        for (const shard_notice &n : notices)
+            reply(n.uid, n.worker);
+    }
+}
+
+struct client_conn
+{
+    int fd;
+    uint64_t uid;
+    bool sent;
+};
+
+// 客户端：保持BENCH_WINDOW个连接，每个连接发送uid后等待匹配结果
+static bool drive_clients(int port, uint32_t workers, std::vector<int> &per_worker)
+{
+    std::vector<int> replies(BENCH_PLAYERS + 1, 0);
+    std::vector<client_conn> conns;
+    uint64_t next_uid = 1;
+    int done = 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    per_worker.assign(workers, 0);
+    while (done < BENCH_PLAYERS)
+    {
+        while (conns.size() < BENCH_WINDOW && next_uid <= BENCH_PLAYERS)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+            conns.push_back(client_conn{fd, next_uid++, false});
+        }
+        std::vector<struct pollfd> fds;
+        for (client_conn &c : conns)
+            fds.push_back({c.fd, (short)(c.sent ? POLLIN : POLLOUT), 0});
+        if (poll(fds.data(), fds.size(), 5000) <= 0)
+        {
+            printf("timeout: %d of %d players matched\n", done, BENCH_PLAYERS);
+            return false;
+        }
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            client_conn &c = conns[i];
+            if (fds[i].revents == 0)
+                continue;
+            if (c.sent == false)
+            {
+                if (write(c.fd, &c.uid, sizeof(c.uid)) != sizeof(c.uid))
+                    return false;
+                c.sent = true;
+                continue;
+            }
+            bench_reply r;
+            if (read(c.fd, &r, sizeof(r)) != sizeof(r) || r.uid != c.uid || r.owner >= workers || r.acceptor >= workers)
+            {
+                printf("bad reply for player %lu\n", (unsigned long)c.uid);
+                return false;
+            }
+            replies[c.uid]++;
+            per_worker[r.acceptor]++;
+            done++;
+            close(c.fd);
+            c.fd = -1;
+        }
+        std::vector<client_conn> rest;
+        for (client_conn &c : conns)
+        {
+            if (c.fd >= 0)
+                rest.push_back(c);
+        }
+        conns.swap(rest);
+    }
+    for (int i = 1; i <= BENCH_PLAYERS; ++i)
+    {
+        if (replies[i] != 1)
+            return false;
+    }
+    return true;
+}
+
+static bool bench(uint32_t workers)
+{
+    int port = BENCH_PORT + workers * 100;
+    shard_segment *seg = shard::create(workers);
+    bench_stats *stats = (bench_stats *)mmap(nullptr, sizeof(bench_stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    new (stats) bench_stats();
+    std::vector<pid_t> pids;
+    for (uint32_t w = 0; w < workers; ++w)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run_worker(seg, stats, w, port);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    while (stats->ready < (int)workers)
+        usleep(1000);
+    std::vector<int> per_worker;
+    bench_clock::time_point start = bench_clock::now();
+    bool ok = drive_clients(port, workers, per_worker);
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - start).count() / 1e6;
+    for (pid_t pid : pids)
+        kill(pid, SIGKILL);
+    for (pid_t pid : pids)
+        waitpid(pid, nullptr, 0);
+    ok = ok && stats->rooms == BENCH_PLAYERS / 2;
+    printf("%u workers: %8.0f conns/s %8.0f matches/s, %4.1f%% cross-process matches, connections per worker:", workers,
+           BENCH_PLAYERS / seconds, BENCH_PLAYERS / 2 / seconds, 100.0 * stats->cross / std::max<uint64_t>(stats->rooms, 1));
+    for (int n : per_worker)
+        printf(" %d", n);
+    printf("\n");
+    if (workers > 1 && stats->cross == 0)
+        ok = false;
+    munmap(stats, sizeof(bench_stats));
+    shard::destroy(seg);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t max_workers = argc > 1 ? atoi(argv[1]) : 4;
+    printf("%ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+    bool ok = check_sessions();
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "sessions are shared between workers and expire" << std::endl;
+    bool ret = check_robust_lock();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "shared lock recovered after its holder died" << std::endl;
+    ok = ok && ret;
+    ret = check_purge();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "restarted worker purges its stale queue entries and notices" << std::endl;
+    ok = ok && ret;
+    ret = true;
+    for (uint32_t w = 1; w <= max_workers; w *= 2)
+        ret = bench(w) && ret;
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "every player matched exactly once across worker processes" << std::endl;
+    return ok && ret ? 0 : 1;
+}
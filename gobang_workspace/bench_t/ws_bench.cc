@@ -0,0 +1,178 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../server/wsconfig.hpp"
+
+/*
+* websocket配置内存测试
+* 子进程启动一个使用WSserver的转发服务器：第2k和第2k+1个连接组成一局，一方发来的消息转发给另一方
+* 父进程用阻塞socket建立连接并收发走棋消息，读取子进程的VmRSS，计算：
+*   每1万个空闲连接占用的内存
+*   每1万局进行中的对局（每局两个连接，每方各走BENCH_ROUNDS步）占用的内存
+* 分别以默认配置（-DWS_STOCK_CONFIG）和精简配置编译运行进行对比，见makefile
+*/
+
+#define BENCH_PORT 8098
+#define BENCH_CONNS 20000 // 空闲连接测试中的连接数
+#define BENCH_GAMES 10000 // 对局测试中的对局数
+#define BENCH_ROUNDS 10
+
+static const char *move_msg = "{\"optype\":\"put_chess\",\"room_id\":1,\"uid\":2,\"row\":7,\"col\":7}";
+
+static void run_server()
+{
+    WSserver srv;
+    std::vector<websocketpp::connection_hdl> conns;
+    std::map<websocketpp::connection_hdl, size_t, std::owner_less<websocketpp::connection_hdl>> index;
+    srv.set_access_channels(websocketpp::log::alevel::none);
+    srv.clear_error_channels(websocketpp::log::elevel::all);
+    srv.init_asio();
+    srv.set_reuse_addr(true);
+    srv.set_listen_backlog(4096);
+    srv.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        index[hdl] = conns.size();
+        conns.push_back(hdl);
+    });
+    srv.set_message_handler([&](websocketpp::connection_hdl hdl, WSserver::message_ptr msg) {
+        size_t peer = index[hdl] ^ 1;
+        if (peer < conns.size())
+            srv.send(conns[peer], msg->get_payload(), msg->get_opcode());
+    });
+    srv.listen(BENCH_PORT);
+    srv.start_accept();
+    srv.run();
+}
+
+static long rss_kb(pid_t pid)
+{
+    std::ifstream ifs("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6);
+    }
+    return 0;
+}
+
+static int ws_connect()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+    std::string req = "GET /room HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    if (send(fd, req.c_str(), req.size(), 0) != (ssize_t)req.size())
+        return -1;
+    // 逐字节读取握手响应直到空行，避免读走后续的帧
+    std::string resp;
+    char ch;
+    while (resp.size() < 4 || resp.compare(resp.size() - 4, 4, "\r\n\r\n") != 0)
+    {
+        if (recv(fd, &ch, 1, 0) != 1)
+            return -1;
+        resp += ch;
+    }
+    return resp.find(" 101 ") == std::string::npos ? -1 : fd;
+}
+
+// 发送一个带掩码的文本帧，负载小于126字节
+static bool frame_send(int fd, const std::string &payload)
+{
+    std::string frame;
+    unsigned char mask[4] = {0x12, 0x34, 0x56, 0x78};
+    frame += (char)0x81;
+    frame += (char)(0x80 | payload.size());
+    frame.append((const char *)mask, 4);
+    for (size_t i = 0; i < payload.size(); ++i)
+        frame += (char)(payload[i] ^ mask[i % 4]);
+    return send(fd, frame.data(), frame.size(), 0) == (ssize_t)frame.size();
+}
+
+// 接收一个服务器发来的文本帧（无掩码，负载小于126字节）
+static bool frame_recv(int fd)
+{
+    unsigned char head[2];
+    if (recv(fd, head, 2, MSG_WAITALL) != 2)
+        return false;
+    size_t len = head[1] & 0x7f;
+    std::vector<char> payload(len);
+    return len == 0 || recv(fd, payload.data(), len, MSG_WAITALL) == (ssize_t)len;
+}
+
+int main()
+{
+    struct rlimit rl = {65536, 65536};
+    if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+    {
+        std::cout << "setrlimit failed, run as root or raise ulimit -n" << std::endl;
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        run_server();
+        return 0;
+    }
+    usleep(300000);
+
+    long base = rss_kb(pid);
+    std::vector<int> fds;
+    for (int i = 0; i < BENCH_CONNS; ++i)
+    {
+        int fd = ws_connect();
+        if (fd < 0)
+        {
+            std::cout << "connect failed at " << i << std::endl;
+            kill(pid, SIGKILL);
+            return 1;
+        }
+        fds.push_back(fd);
+    }
+    long idle = rss_kb(pid);
+
+    // 前BENCH_GAMES局两方交替走棋
+    bool ok = true;
+    for (int r = 0; r < BENCH_ROUNDS && ok; ++r)
+    {
+        for (int g = 0; g < BENCH_GAMES && ok; ++g)
+        {
+            int a = fds[2 * g + r % 2], b = fds[2 * g + 1 - r % 2];
+            ok = frame_send(a, move_msg) && frame_recv(b);
+        }
+    }
+    long active = rss_kb(pid);
+
+    for (int fd : fds)
+        close(fd);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+#ifdef WS_STOCK_CONFIG
+    std::cout << "config: stock" << std::endl;
+#else
+    std::cout << "config: lean" << std::endl;
+#endif
+    std::cout << "baseline rss: " << base << " KB" << std::endl;
+    std::cout << "idle connections: " << (idle - base) * 10000.0 / BENCH_CONNS / 1024 << " MB per 10k" << std::endl;
+    std::cout << "active games: " << (active - base) * 10000.0 / BENCH_GAMES / 1024 << " MB per 10k games ("
+              << BENCH_ROUNDS << " moves each)" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <jsoncpp/json/json.h>
+
+#include "../server/wsmsg.hpp"
+
+/*
+* 长连接消息解析测试
+* 语料：默认按客户端JSON.stringify的格式生成（落子为主，夹杂聊天、匹配请求，聊天中有中文、emoji和转义），
+*      也可以传入录制的语料文件，每行一条消息
+* 1. 每条语料分别用jsoncpp和ws_parser解析，字段必须一致
+* 2. 非法的UTF-8（超长编码、代理区、截断、单独的后续字节）和非法的json必须被拒绝；
+*    随机字节串上SSE2快速路径与逐字节校验的结果一致
+* 3. 比较两种解析方式每秒处理的消息数：jsoncpp（与原来的服务器相同，每条消息创建CharReader，
+*    再用asString()比较optype）和ws_parser（解析后按枚举分发）
+*/
+
+#define CORPUS_SIZE 100000
+#define BENCH_ROUNDS 10
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::vector<std::string> make_corpus()
+{
+    static const char *chats[] = {"你好", "好棋！", "gg", "再来一局？", "这步棋太妙了\\ud83d\\ude00", "\"引号\"和\\\\反斜杠",
+                                  "hello world", "🙂🙂🙂", "我先走了，下次再下", "line1\\nline2"};
+    std::mt19937 rng(2023);
+    std::vector<std::string> corpus;
+    char buf[512];
+    for (int i = 0; i < CORPUS_SIZE; ++i)
+    {
+        int kind = rng() % 100;
+        uint64_t rid = rng() % 100000 + 1, uid = rng() % 1000000 + 1;
+        if (kind < 80)
+            snprintf(buf, sizeof(buf), "{\"optype\":\"put_chess\",\"room_id\":%lu,\"uid\":%lu,\"row\":%u,\"col\":%u}",
+                     (unsigned long)rid, (unsigned long)uid, (unsigned)(rng() % 15), (unsigned)(rng() % 15));
+        else if (kind < 95)
+            snprintf(buf, sizeof(buf), "{\"optype\":\"chat\",\"room_id\":%lu,\"uid\":%lu,\"message\":\"%s\"}",
+                     (unsigned long)rid, (unsigned long)uid, chats[rng() % 10]);
+        else if (kind < 98)
+            snprintf(buf, sizeof(buf), "{\"optype\":\"match_start\",\"rule\":%u,\"board\":%u}", (unsigned)(rng() % 3), (unsigned)(rng() % 3));
+        else
+            snprintf(buf, sizeof(buf), "{\"optype\":\"%s\"}", rng() % 2 ? "match_start" : "match_stop");
+        corpus.push_back(buf);
+    }
+    return corpus;
+}
+
+static ws_optype optype_of(const std::string &s)
+{
+    if (s == "put_chess")
+        return WS_OP_PUT_CHESS;
+    else if (s == "chat")
+        return WS_OP_CHAT;
+    else if (s == "match_start")
+        return WS_OP_MATCH_START;
+    else if (s == "match_stop")
+        return WS_OP_MATCH_STOP;
+    return WS_OP_UNKNOWN;
+}
+
+static bool jsoncpp_parse(const std::string &s, Json::Value &v)
+{
+    Json::CharReaderBuilder crb;
+    std::unique_ptr<Json::CharReader> pcr(crb.newCharReader());
+    std::string err;
+    return pcr->parse(s.c_str(), s.c_str() + s.size(), &v, &err);
+}
+
+static bool check_corpus(const std::vector<std::string> &corpus)
+{
+    ws_parser parser;
+    ws_request req;
+    for (const std::string &msg : corpus)
+    {
+        Json::Value v;
+        if (jsoncpp_parse(msg, v) == false)
+            continue; // 录制的语料中可能有坏消息，两边都应拒绝
+        if (parser.parse(msg.data(), msg.size(), req) == false)
+        {
+            printf("rejected: %s\n", msg.c_str());
+            return false;
+        }
+        bool ok = req.optype == optype_of(v["optype"].asString()) && req.room_id == v["room_id"].asUInt64() &&
+                  req.uid == v["uid"].asUInt64() && req.row == v["row"].asInt() && req.col == v["col"].asInt() &&
+                  req.rule == v["rule"].asInt() && req.board == v["board"].asInt() &&
+                  std::string(req.message, req.message_len) == v["message"].asString();
+        if (ok == false)
+        {
+            printf("mismatch: %s\n", msg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// 逐字节校验UTF-8，作为对照
+static bool utf8_reference(const std::string &s)
+{
+    const unsigned char *p = (const unsigned char *)s.data(), *end = p + s.size();
+    while (p < end)
+    {
+        if (*p < 0x80)
+        {
+            p++;
+            continue;
+        }
+        size_t n = utf8_char(p, end);
+        if (n == 0)
+            return false;
+        p += n;
+    }
+    return true;
+}
+
+static bool check_invalid()
+{
+    const char *bad[] = {
+        "{\"optype\":\"chat\",\"message\":\"\xC0\xAF\"}",             // 超长编码
+        "{\"optype\":\"chat\",\"message\":\"\xE0\x80\xAF\"}",         // 超长编码
+        "{\"optype\":\"chat\",\"message\":\"\xED\xA0\x80\"}",         // 代理区
+        "{\"optype\":\"chat\",\"message\":\"\xF4\x90\x80\x80\"}",     // 超出U+10FFFF
+        "{\"optype\":\"chat\",\"message\":\"\xE4\xBD\"}",             // 截断
+        "{\"optype\":\"chat\",\"message\":\"\x80 0123456789abcdef\"}", // 单独的后续字节
+        "{\"optype\":\"chat\",\"message\":\"\\ud83d\"}",              // 单独的代理
+        "{\"optype\":\"chat\",\"message\":\"\\x\"}",                  // 非法转义
+        "{\"optype\":\"chat\",\"message\":\"a\nb\"}",                 // 控制字符
+        "{\"optype\":\"put_chess\",\"row\":1.5}",                     // 坐标不是整数
+        "{\"optype\":\"put_chess\",\"row\":1,}",                      // 多余的逗号
+        "{\"optype\":\"put_chess\"} x",                               // 多余的内容
+        "[1,2,3]",
+        "{\"optype\":\"put_chess\",\"row\":99999999999}", // 超出int
+        "",
+    };
+    ws_parser parser;
+    ws_request req;
+    for (const char *b : bad)
+    {
+        if (parser.parse(b, strlen(b), req))
+        {
+            printf("accepted: %s\n", b);
+            return false;
+        }
+    }
+    // 其他字段（包括嵌套的对象和数组）跳过，缺少字段时complete为false
+    const char *extra = "{\"seq\":[1,{\"a\":\"}\"}],\"optype\":\"put_chess\",\"ts\":-1.5e3,\"ok\":true,\"room_id\":3,\"uid\":4,\"row\":5}";
+    if (parser.parse(extra, strlen(extra), req) == false || req.optype != WS_OP_PUT_CHESS || req.row != 5 || ws_parser::complete(req))
+        return false;
+    // 随机字节串（大多是ASCII，夹杂多字节字符和坏字节）
+    std::mt19937 rng(5);
+    for (int i = 0; i < 200000; ++i)
+    {
+        std::string s;
+        int len = rng() % 64;
+        for (int k = 0; k < len; ++k)
+        {
+            int r = rng() % 100;
+            if (r < 85)
+                s += (char)(rng() % 0x80);
+            else if (r < 95)
+                s += "\xE4\xBD\xA0";
+            else
+                s += (char)(0x80 + rng() % 0x80);
+        }
+        if (utf8_valid(s.data(), s.size()) != utf8_reference(s))
+            return false;
+    }
+    return true;
+}
+
+static void bench(const std::vector<std::string> &corpus)
+{
+    size_t bytes = 0;
+    for (const std::string &m : corpus)
+        bytes += m.size();
+    // jsoncpp：与原来的服务器相同
+    uint64_t sink = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+    {
+        for (const std::string &msg : corpus)
+        {
+            Json::Value v;
+            if (jsoncpp_parse(msg, v) == false)
+                continue;
+            if (v["optype"].asString() == "put_chess")
+                sink += v["row"].asInt() + v["col"].asInt() + v["uid"].asUInt64();
+            else if (v["optype"].asString() == "chat")
+                sink += v["message"].asString().size();
+            else if (!v["optype"].isNull() && v["optype"].asString() == "match_start")
+                sink++;
+        }
+    }
+    double js = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1e9;
+    // jsoncpp复用CharReader，只看构造Json::Value的开销
+    Json::CharReaderBuilder crb;
+    std::unique_ptr<Json::CharReader> pcr(crb.newCharReader());
+    start = bench_clock::now();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+    {
+        for (const std::string &msg : corpus)
+        {
+            Json::Value v;
+            std::string err;
+            if (pcr->parse(msg.c_str(), msg.c_str() + msg.size(), &v, &err) == false)
+                continue;
+            if (v["optype"].asString() == "put_chess")
+                sink += v["row"].asInt() + v["col"].asInt() + v["uid"].asUInt64();
+            else if (v["optype"].asString() == "chat")
+                sink += v["message"].asString().size();
+            else if (!v["optype"].isNull() && v["optype"].asString() == "match_start")
+                sink++;
+        }
+    }
+    double jr = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1e9;
+    // ws_parser
+    ws_parser parser;
+    ws_request req;
+    start = bench_clock::now();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+    {
+        for (const std::string &msg : corpus)
+        {
+            if (parser.parse(msg.data(), msg.size(), req) == false)
+                continue;
+            switch (req.optype)
+            {
+            case WS_OP_PUT_CHESS:
+                sink += req.row + req.col + req.uid;
+                break;
+            case WS_OP_CHAT:
+                sink += req.message_len;
+                break;
+            case WS_OP_MATCH_START:
+                sink++;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    double ws = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1e9;
+    // 单独的UTF-8校验
+    start = bench_clock::now();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+        for (const std::string &msg : corpus)
+            sink += utf8_valid(msg.data(), msg.size());
+    double u8 = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / 1e9;
+    double n = (double)corpus.size() * BENCH_ROUNDS;
+    printf("%lu messages, %.1f bytes avg\n", corpus.size(), (double)bytes / corpus.size());
+    printf("jsoncpp                : %8.0f ns/msg %6.2f M msgs/s\n", js / n * 1e9, n / js / 1e6);
+    printf("jsoncpp (reused reader): %8.0f ns/msg %6.2f M msgs/s\n", jr / n * 1e9, n / jr / 1e6);
+    printf("ws_parser              : %8.0f ns/msg %6.2f M msgs/s (%.1fx / %.1fx), utf-8 check %.0f ns/msg (%.2f GB/s)\n",
+           ws / n * 1e9, n / ws / 1e6, js / ws, jr / ws, u8 / n * 1e9, bytes * BENCH_ROUNDS / u8 / 1e9);
+    if (sink == 42)
+        printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> corpus;
+    if (argc > 1)
+    {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while (std::getline(in, line))
+            corpus.push_back(line);
+    }
+    else
+        corpus = make_corpus();
+    bool ok = check_corpus(corpus);
+    std::cout << (ok ? "[ OK ] " : "[FAIL] ") << "ws_parser matches jsoncpp on every corpus message" << std::endl;
+    bool ret = check_invalid();
+    std::cout << (ret ? "[ OK ] " : "[FAIL] ") << "invalid utf-8 and malformed json rejected, simd check matches scalar" << std::endl;
+    ok = ok && ret;
+    bench(corpus);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,578 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include "log.hpp"
+#include "threadpool.hpp"
+
+/*
+* 人机对战模块
+* 匹配队列中长时间等不到对手的玩家，由服务器端的电脑玩家陪同对战
+*
+* ai_board  棋盘：每行一个位图用于生成候选点，同时增量维护所有五连窗口的棋子计数
+* ai_tt     置换表：由Zobrist哈希索引，每项打包为64位数据并与键异或校验，可被多个搜索线程无锁共享
+* ai_engine 搜索：迭代加深的alpha-beta搜索，按威胁程度排序候选点
+* ai_service 对外接口：搜索任务投递到独立的线程池中执行，结果通过回调返回，不阻塞网络io线程
+*/
+
+#define AI_UID ((uint64_t)1 << 32) // 电脑玩家的用户ID，超出数据库id字段(int)的取值范围，不会与真实玩家冲突
+#define AI_SIZE 15
+#define AI_CELLS (AI_SIZE * AI_SIZE)
+#define AI_ROW_MASK 0x7FFF
+#define AI_WINDOWS 572 // 长度为5的连线窗口数量：横竖各15*11，两个斜向各11*11
+#define AI_WHITE 1     // 与room中CHESS_WHITE取值一致
+#define AI_BLACK 2     // 与room中CHESS_BLACK取值一致
+#define AI_INF 100000000
+#define AI_WIN 10000000
+#define AI_WIN_BOUND (AI_WIN - 1000) // 超过该分值表示已经搜索到必胜/必败
+#define AI_MAX_DEPTH 32
+#define AI_BRANCH 16      // 每层最多展开的候选点数量
+#define AI_TT_BITS 18     // 置换表大小 2^18 项
+#define AI_MOVE_TIME 1000 // 电脑玩家每步的思考时间 ms
+#define AI_THREADS 2      // 人机对战搜索线程数量
+
+// 窗口中只有一方棋子时，按棋子数量给出的分值
+static const int ai_window_value[6] = {0, 1, 12, 150, 2000, 1000000};
+
+// 预计算的窗口表和Zobrist随机数，所有棋盘共享
+struct ai_tables
+{
+    int win_cells[AI_WINDOWS][5];      // 每个窗口包含的5个位置
+    int cell_windows[AI_CELLS][20];    // 每个位置所属的窗口，四个方向最多各5个
+    int cell_window_num[AI_CELLS];     // 每个位置所属的窗口数量
+    uint64_t zobrist[2][AI_CELLS];     // 每个位置每种颜色的随机数
+    uint64_t zobrist_side;             // 黑方走棋时异或的随机数
+
+    ai_tables()
+    {
+        static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        memset(cell_window_num, 0, sizeof(cell_window_num));
+        int w = 0;
+        for (int d = 0; d < 4; ++d)
+        {
+            for (int r = 0; r < AI_SIZE; ++r)
+            {
+                for (int c = 0; c < AI_SIZE; ++c)
+                {
+                    int er = r + 4 * dirs[d][0], ec = c + 4 * dirs[d][1];
+                    if (er < 0 || er >= AI_SIZE || ec < 0 || ec >= AI_SIZE)
+                        continue;
+                    for (int k = 0; k < 5; ++k)
+                    {
+                        int cell = (r + k * dirs[d][0]) * AI_SIZE + (c + k * dirs[d][1]);
+                        win_cells[w][k] = cell;
+                        cell_windows[cell][cell_window_num[cell]++] = w;
+                    }
+                    w++;
+                }
+            }
+        }
+        std::mt19937_64 rng(20231129);
+        for (int i = 0; i < AI_CELLS; ++i)
+        {
+            zobrist[0][i] = rng();
+            zobrist[1][i] = rng();
+        }
+        zobrist_side = rng();
+    }
+
+    static const ai_tables &instance()
+    {
+        static ai_tables tables;
+        return tables;
+    }
+};
+
+class ai_board
+{
+private:
+    uint16_t _rows[AI_SIZE];          // 每行的落子位图，第c位表示第c列有子
+    uint8_t _cells[AI_CELLS];         // 0 空，AI_WHITE 白，AI_BLACK 黑
+    uint8_t _cnt[2][AI_WINDOWS];      // 每个窗口中双方的棋子数量
+    int _sum[2];                      // 双方所有活窗口的分值之和
+    int _fours[2];                    // 双方只差一子成五的窗口数量
+    int _side;                        // 当前走棋方
+    int _stones;                      // 棋盘上的棋子数量
+    uint64_t _hash;                   // Zobrist哈希
+
+private:
+    // 在cell位置放置color颜色的棋子，增量更新窗口计数，返回是否成五
+    bool put(int cell, int color)
+    {
+        const ai_tables &t = ai_tables::instance();
+        int me = color - 1, op = 2 - color;
+        bool five = false;
+        for (int i = 0; i < t.cell_window_num[cell]; ++i)
+        {
+            int w = t.cell_windows[cell][i];
+            int a = _cnt[me][w], b = _cnt[op][w];
+            if (b == 0)
+            {
+                _sum[me] += ai_window_value[a + 1] - ai_window_value[a];
+                if (a == 3) _fours[me]++;
+                if (a == 4)
+                {
+                    _fours[me]--;
+                    five = true;
+                }
+            }
+            else if (a == 0)
+            {
+                // 对方的窗口被堵死
+                _sum[op] -= ai_window_value[b];
+                if (b == 4) _fours[op]--;
+            }
+            _cnt[me][w]++;
+        }
+        _rows[cell / AI_SIZE] |= (uint16_t)(1 << (cell % AI_SIZE));
+        _cells[cell] = color;
+        _hash ^= t.zobrist[me][cell];
+        _stones++;
+        return five;
+    }
+
+    // 移除cell位置的棋子，put的逆操作
+    void remove(int cell)
+    {
+        const ai_tables &t = ai_tables::instance();
+        int color = _cells[cell];
+        int me = color - 1, op = 2 - color;
+        for (int i = 0; i < t.cell_window_num[cell]; ++i)
+        {
+            int w = t.cell_windows[cell][i];
+            _cnt[me][w]--;
+            int a = _cnt[me][w], b = _cnt[op][w];
+            if (b == 0)
+            {
+                _sum[me] -= ai_window_value[a + 1] - ai_window_value[a];
+                if (a == 3) _fours[me]--;
+                if (a == 4) _fours[me]++;
+            }
+            else if (a == 0)
+            {
+                _sum[op] += ai_window_value[b];
+                if (b == 4) _fours[op]++;
+            }
+        }
+        _rows[cell / AI_SIZE] &= (uint16_t)~(1 << (cell % AI_SIZE));
+        _cells[cell] = 0;
+        _hash ^= t.zobrist[me][cell];
+        _stones--;
+    }
+
+public:
+    ai_board() { clear(); }
+
+    void clear()
+    {
+        memset(_rows, 0, sizeof(_rows));
+        memset(_cells, 0, sizeof(_cells));
+        memset(_cnt, 0, sizeof(_cnt));
+        _sum[0] = _sum[1] = 0;
+        _fours[0] = _fours[1] = 0;
+        _side = AI_WHITE;
+        _stones = 0;
+        _hash = 0;
+    }
+
+    // 从房间的棋盘加载局面，side为下一步走棋方
+    void load(const std::vector<std::vector<int>> &board, int side)
+    {
+        clear();
+        for (int r = 0; r < AI_SIZE && r < (int)board.size(); ++r)
+        {
+            for (int c = 0; c < AI_SIZE && c < (int)board[r].size(); ++c)
+            {
+                if (board[r][c] == AI_WHITE || board[r][c] == AI_BLACK)
+                    put(r * AI_SIZE + c, board[r][c]);
+            }
+        }
+        _side = side;
+        if (_side == AI_BLACK)
+            _hash ^= ai_tables::instance().zobrist_side;
+    }
+
+    // 当前走棋方在cell落子，并交换走棋方，返回是否成五
+    bool place(int cell)
+    {
+        bool five = put(cell, _side);
+        _side = 3 - _side;
+        _hash ^= ai_tables::instance().zobrist_side;
+        return five;
+    }
+
+    // 撤销cell处的落子，并交换回走棋方
+    void undo(int cell)
+    {
+        remove(cell);
+        _side = 3 - _side;
+        _hash ^= ai_tables::instance().zobrist_side;
+    }
+
+    int side() const { return _side; }
+    int stones() const { return _stones; }
+    uint64_t hash() const { return _hash; }
+    int cell(int idx) const { return _cells[idx]; }
+    int fours(int color) const { return _fours[color - 1]; }
+
+    // 判断color方是否已经成五
+    bool has_five(int color) const
+    {
+        for (int w = 0; w < AI_WINDOWS; ++w)
+        {
+            if (_cnt[color - 1][w] == 5)
+                return true;
+        }
+        return false;
+    }
+
+    // 以当前走棋方视角的局面评估
+    int eval() const { return _sum[_side - 1] - _sum[2 - _side]; }
+
+    // 生成候选点：距离已有棋子两格以内的空位
+    int gen_candidates(int *moves) const
+    {
+        uint16_t near[AI_SIZE] = {0};
+        for (int r = 0; r < AI_SIZE; ++r)
+        {
+            uint16_t o = _rows[r];
+            if (o == 0)
+                continue;
+            uint16_t d = (uint16_t)((o | o << 1 | o >> 1 | o << 2 | o >> 2) & AI_ROW_MASK);
+            for (int rr = std::max(0, r - 2); rr <= std::min(AI_SIZE - 1, r + 2); ++rr)
+                near[rr] |= d;
+        }
+        int n = 0;
+        for (int r = 0; r < AI_SIZE; ++r)
+        {
+            unsigned m = near[r] & ~_rows[r] & AI_ROW_MASK;
+            while (m)
+            {
+                moves[n++] = r * AI_SIZE + __builtin_ctz(m);
+                m &= m - 1;
+            }
+        }
+        return n;
+    }
+
+    // 候选点的威胁评分：己方落子的进攻收益+阻止对方的防守收益，block返回是否堵住了对方的冲四
+    int move_score(int cell, bool &block) const
+    {
+        const ai_tables &t = ai_tables::instance();
+        int me = _side - 1, op = 2 - _side;
+        int attack = 0, defend = 0;
+        block = false;
+        for (int i = 0; i < t.cell_window_num[cell]; ++i)
+        {
+            int w = t.cell_windows[cell][i];
+            int a = _cnt[me][w], b = _cnt[op][w];
+            if (b == 0)
+                attack += ai_window_value[a + 1] - ai_window_value[a];
+            if (a == 0)
+            {
+                defend += ai_window_value[b + 1] - ai_window_value[b];
+                if (b == 4) block = true;
+            }
+        }
+        return attack + defend;
+    }
+};
+
+// 无锁置换表，每项存放 key^data 和 data 两个64位数，读出后异或校验，
+// 多线程同时写同一项导致的撕裂数据会因校验失败而被丢弃
+class ai_tt
+{
+public:
+    enum { TT_EXACT, TT_LOWER, TT_UPPER };
+
+private:
+    struct slot
+    {
+        std::atomic<uint64_t> check; // key ^ data
+        std::atomic<uint64_t> data;  // 低32位分值，之后依次为着法、深度、类型各8位
+    };
+    std::unique_ptr<slot[]> _slots;
+    uint64_t _mask;
+
+    static uint64_t pack(int score, int move, int depth, int flag)
+    {
+        return (uint64_t)(uint32_t)score | (uint64_t)(move & 0xFF) << 32 | (uint64_t)(depth & 0xFF) << 40 | (uint64_t)(flag & 0xFF) << 48;
+    }
+
+public:
+    ai_tt(int bits) : _slots(new slot[(size_t)1 << bits]), _mask(((uint64_t)1 << bits) - 1) { clear(); }
+
+    void clear()
+    {
+        for (uint64_t i = 0; i <= _mask; ++i)
+        {
+            _slots[i].check.store(0, std::memory_order_relaxed);
+            _slots[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // 查找key对应的项，校验失败或不存在返回false
+    bool probe(uint64_t key, int &score, int &move, int &depth, int &flag) const
+    {
+        const slot &s = _slots[key & _mask];
+        uint64_t data = s.data.load(std::memory_order_relaxed);
+        if ((s.check.load(std::memory_order_relaxed) ^ data) != key)
+            return false;
+        score = (int32_t)(uint32_t)data;
+        move = (int)(data >> 32 & 0xFF);
+        depth = (int)(data >> 40 & 0xFF);
+        flag = (int)(data >> 48 & 0xFF);
+        return true;
+    }
+
+    // 写入一项，同一局面只有搜索深度不低于已有项时才覆盖
+    void store(uint64_t key, int score, int move, int depth, int flag)
+    {
+        slot &s = _slots[key & _mask];
+        uint64_t old = s.data.load(std::memory_order_relaxed);
+        if ((s.check.load(std::memory_order_relaxed) ^ old) == key && (int)(old >> 40 & 0xFF) > depth)
+            return;
+        uint64_t data = pack(score, move, depth, flag);
+        s.check.store(key ^ data, std::memory_order_relaxed);
+        s.data.store(data, std::memory_order_relaxed);
+    }
+};
+
+struct ai_result
+{
+    int row;
+    int col;
+    int score;
+    int depth;       // 完整搜索完成的深度
+    uint64_t nodes;  // 搜索的节点数量
+    int ms;          // 实际耗时
+};
+
+class ai_engine
+{
+private:
+    std::unique_ptr<ai_tt> _own_tt;  // 单独使用时自己的置换表
+    ai_tt *_tt;                      // 实际使用的置换表，多线程搜索时共享
+    std::atomic<bool> *_stop;        // 多线程搜索时由主线程通知其他线程停止
+    int _id;                         // 搜索线程编号，0为主线程
+    ai_board _board;
+    uint64_t _nodes;
+    bool _abort;
+    std::chrono::steady_clock::time_point _deadline;
+
+private:
+    // 必胜分值与当前层数相关，存入置换表时转换为相对当前节点的分值
+    static int to_tt(int score, int ply)
+    {
+        if (score > AI_WIN_BOUND) return score + ply;
+        if (score < -AI_WIN_BOUND) return score - ply;
+        return score;
+    }
+    static int from_tt(int score, int ply)
+    {
+        if (score > AI_WIN_BOUND) return score - ply;
+        if (score < -AI_WIN_BOUND) return score + ply;
+        return score;
+    }
+
+    // 生成并排序候选点，置换表中的最佳着法排在最前，返回展开的数量
+    int order_moves(int *moves, int tt_move)
+    {
+        int cand[AI_CELLS];
+        int n = _board.gen_candidates(cand);
+        if (n == 0)
+        {
+            moves[0] = (AI_SIZE / 2) * AI_SIZE + AI_SIZE / 2;
+            return 1;
+        }
+        bool must_block = _board.fours(3 - _board.side()) > 0;
+        std::pair<int, int> scored[AI_CELLS];
+        int m = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            bool block;
+            int s = _board.move_score(cand[i], block);
+            // 对方已经冲四，只需考虑堵截的位置
+            if (must_block && block == false)
+                continue;
+            if (cand[i] == tt_move)
+                s = AI_INF;
+            scored[m++] = std::make_pair(s, cand[i]);
+        }
+        if (m == 0)
+        {
+            moves[0] = cand[0];
+            return 1;
+        }
+        int k = std::min(m, AI_BRANCH);
+        std::partial_sort(scored, scored + k, scored + m,
+                          [](const std::pair<int, int> &a, const std::pair<int, int> &b) { return a.first > b.first; });
+        for (int i = 0; i < k; ++i)
+            moves[i] = scored[i].second;
+        return k;
+    }
+
+    bool timeout()
+    {
+        if ((_nodes & 1023) == 0 && std::chrono::steady_clock::now() >= _deadline)
+            _abort = true;
+        if (_stop != nullptr && _stop->load(std::memory_order_relaxed))
+            _abort = true;
+        return _abort;
+    }
+
+    int negamax(int depth, int alpha, int beta, int ply)
+    {
+        _nodes++;
+        if (timeout())
+            return 0;
+        // 己方已有冲四，下一步即可成五
+        if (_board.fours(_board.side()) > 0)
+            return AI_WIN - ply - 1;
+        if (depth <= 0)
+            return _board.eval();
+        if (_board.stones() == AI_CELLS)
+            return 0;
+
+        uint64_t key = _board.hash();
+        int tt_score, tt_move = -1, tt_depth, tt_flag;
+        if (_tt->probe(key, tt_score, tt_move, tt_depth, tt_flag) && tt_depth >= depth)
+        {
+            int s = from_tt(tt_score, ply);
+            if (tt_flag == ai_tt::TT_EXACT) return s;
+            if (tt_flag == ai_tt::TT_LOWER && s >= beta) return s;
+            if (tt_flag == ai_tt::TT_UPPER && s <= alpha) return s;
+        }
+
+        int moves[AI_BRANCH];
+        int n = order_moves(moves, tt_move);
+        int alpha0 = alpha, best = -AI_INF, best_move = moves[0];
+        for (int i = 0; i < n; ++i)
+        {
+            int score;
+            if (_board.place(moves[i]))
+                score = AI_WIN - ply - 1;
+            else
+                score = -negamax(depth - 1, -beta, -alpha, ply + 1);
+            _board.undo(moves[i]);
+            if (_abort)
+                return 0;
+            if (score > best)
+            {
+                best = score;
+                best_move = moves[i];
+                if (score > alpha) alpha = score;
+                if (alpha >= beta) break;
+            }
+        }
+
+        int flag = best <= alpha0 ? ai_tt::TT_UPPER : (best >= beta ? ai_tt::TT_LOWER : ai_tt::TT_EXACT);
+        _tt->store(key, to_tt(best, ply), best_move, depth, flag);
+        return best;
+    }
+
+    // 根节点搜索，返回最佳分值，best_move带出最佳着法
+    int search_root(int depth, int *moves, int n, int &best_move)
+    {
+        int alpha = -AI_INF, beta = AI_INF, best = -AI_INF;
+        for (int i = 0; i < n; ++i)
+        {
+            int score;
+            if (_board.place(moves[i]))
+                score = AI_WIN - 1;
+            else
+                score = -negamax(depth - 1, -beta, -alpha, 1);
+            _board.undo(moves[i]);
+            if (_abort)
+                return best;
+            if (score > best)
+            {
+                best = score;
+                best_move = moves[i];
+                if (score > alpha) alpha = score;
+            }
+        }
+        return best;
+    }
+
+public:
+    ai_engine(int tt_bits = AI_TT_BITS)
+        : _own_tt(new ai_tt(tt_bits)), _tt(_own_tt.get()), _stop(nullptr), _id(0), _nodes(0), _abort(false) {}
+
+    // Lazy-SMP多线程搜索：多个引擎共享同一个置换表，id不为0的辅助线程打乱搜索顺序
+    ai_engine(ai_tt *tt, std::atomic<bool> *stop, int id)
+        : _tt(tt), _stop(stop), _id(id), _nodes(0), _abort(false) {}
+
+    // 在ms毫秒内对board局面进行迭代加深搜索，最深搜索max_depth层，为当前走棋方选出最佳着法
+    void search(const ai_board &board, int ms, ai_result &res, int max_depth = AI_MAX_DEPTH)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _deadline = start + std::chrono::milliseconds(ms);
+        _board = board;
+        _nodes = 0;
+        _abort = false;
+
+        int moves[AI_BRANCH];
+        int n = order_moves(moves, -1);
+        // 辅助线程从不同的着法、不同的深度开始搜索，与主线程错开
+        if (_id != 0)
+            std::rotate(moves, moves + _id % n, moves + n);
+        int best_move = moves[0];
+        res.score = 0;
+        res.depth = 0;
+        for (int depth = 1 + (_id & 1); depth <= max_depth && n > 1; ++depth)
+        {
+            int move = best_move;
+            int score = search_root(depth, moves, n, move);
+            if (_abort)
+                break;
+            best_move = move;
+            res.score = score;
+            res.depth = depth;
+            // 上一轮的最佳着法放到最前面，提高下一轮的剪枝效率
+            int *pos = std::find(moves, moves + n, best_move);
+            std::rotate(moves, pos, pos + 1);
+            if (score > AI_WIN_BOUND || score < -AI_WIN_BOUND)
+                break;
+            // 剩余时间不足以完成下一轮搜索
+            if (_stop == nullptr && std::chrono::steady_clock::now() - start > std::chrono::milliseconds(ms / 2))
+                break;
+        }
+        res.row = best_move / AI_SIZE;
+        res.col = best_move % AI_SIZE;
+        res.nodes = _nodes;
+        res.ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+class ai_service
+{
+private:
+    thread_pool _pool;
+
+public:
+    ai_service(int thread_num = AI_THREADS) : _pool(thread_num) { LOG(DEBUG, "人机对战模块初始化完毕！"); }
+
+    // 为color方计算下一步，计算完成后在搜索线程中调用cb(row, col)
+    void think(const std::vector<std::vector<int>> &board, int color, int ms, const std::function<void(int, int)> &cb)
+    {
+        ai_board b;
+        b.load(board, color);
+        _pool.push([b, ms, cb]() {
+            // 每个搜索线程复用自己的搜索引擎，置换表在多局之间保留
+            static thread_local ai_engine engine;
+            ai_result res;
+            engine.search(b, ms, res);
+            LOG(DEBUG, "电脑落子(%d, %d) 深度:%d 节点:%lu 耗时:%dms", res.row, res.col, res.depth, res.nodes, res.ms);
+            cb(res.row, res.col);
+        });
+    }
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <list>
+#include <future>
+#include <unordered_map>
+#include <jsoncpp/json/json.h>
+
+#include "log.hpp"
+#include "ai.hpp"
+#include "threadpool.hpp"
+
+/*
+* 复盘分析模块
+* 对局结束后房间将棋谱交给本模块保存，玩家请求复盘时再进行分析
+*
+* 对棋谱中每一个局面进行深度搜索，给出最佳着法，并与实际着法比较找出失误
+* 每个局面使用Lazy-SMP并行搜索：所有工作线程同时搜索同一局面，共享同一个无锁置换表
+* 棋谱按对局结束的先后顺序保存，超过ANALYSIS_CACHE局时淘汰最早的
+*/
+
+#define ANALYSIS_THREADS 4     // 并行搜索的工作线程数量
+#define ANALYSIS_TT_BITS 22    // 共享置换表大小 2^22 项
+#define ANALYSIS_DEPTH 10      // 每个局面的搜索深度
+#define ANALYSIS_TIME 2000     // 每个局面最长搜索时间 ms
+#define ANALYSIS_BLUNDER 1500  // 实际着法比最佳着法损失超过该分值视为失误
+#define ANALYSIS_CACHE 1024    // 最多保存的棋谱数量
+
+// 一局对弈的棋谱
+struct game_record
+{
+    uint64_t room_id;
+    uint64_t white_id;
+    uint64_t black_id;
+    uint64_t winner;
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<int> colors; // 每一步的棋子颜色
+    uint64_t start_ms;           // 开始时间 unix ms
+    std::vector<uint32_t> times; // 每一步与上一步的间隔 ms，从日志恢复或迁移来的步数为0
+};
+
+typedef enum
+{
+    ANALYSIS_WAIT,    // 已保存，尚未分析
+    ANALYSIS_RUNNING, // 分析中
+    ANALYSIS_DONE     // 分析完毕
+} analysis_statu;
+
+class analysis_service
+{
+private:
+    struct game_entry
+    {
+        game_record record;
+        analysis_statu statu;
+        Json::Value result;
+    };
+
+    // 保护棋谱表
+    std::mutex _mutex;
+    // room_id 棋谱
+    std::unordered_map<uint64_t, game_entry> _games;
+    // 按保存顺序记录room_id，用于淘汰
+    std::list<uint64_t> _order;
+
+    // 所有工作线程共享的置换表
+    ai_tt _tt;
+    // 当前局面搜索结束时通知辅助线程停止
+    std::atomic<bool> _stop;
+    // 每个工作线程对应一个搜索引擎
+    std::vector<std::unique_ptr<ai_engine>> _engines;
+    // 并行搜索的工作线程
+    thread_pool _workers;
+    // 按顺序逐局分析的调度线程
+    thread_pool _dispatcher;
+
+private:
+    // 对一个局面进行并行搜索，返回主线程的搜索结果
+    void search(const ai_board &board, int depth, int ms, ai_result &res)
+    {
+        _stop = false;
+        std::vector<std::future<void>> helpers;
+        for (size_t i = 1; i < _engines.size(); ++i)
+        {
+            std::shared_ptr<std::promise<void>> done(new std::promise<void>());
+            helpers.push_back(done->get_future());
+            ai_engine *engine = _engines[i].get();
+            _workers.push([engine, board, depth, ms, done]() {
+                ai_result tmp;
+                engine->search(board, ms, tmp, depth);
+                done->set_value();
+            });
+        }
+        // 调度线程自己作为主线程参与搜索，主线程结束后通知辅助线程停止
+        _engines[0]->search(board, ms, res, depth);
+        _stop = true;
+        for (auto &f : helpers)
+        {
+            f.wait();
+        }
+    }
+
+    // 分析一局棋谱的每一步
+    void analyze(const game_record &record, Json::Value &result)
+    {
+        size_t n = record.rows.size();
+        std::vector<std::vector<int>> board(AI_SIZE, std::vector<int>(AI_SIZE, 0));
+        // best[i]为第i步之前的局面中，走棋方的最佳着法和分值
+        std::vector<ai_result> best(n + 1);
+        for (size_t i = 0; i <= n; ++i)
+        {
+            int side = i < n ? record.colors[i] : 3 - record.colors[n - 1];
+            ai_board ab;
+            ab.load(board, side);
+            if (i == n && ab.has_five(record.colors[n - 1]))
+                best[i].score = -(AI_WIN - 1); // 最后一步成五，对方已负
+            else
+                search(ab, ANALYSIS_DEPTH, ANALYSIS_TIME, best[i]);
+            if (i < n)
+                board[record.rows[i]][record.cols[i]] = record.colors[i];
+        }
+
+        result["room_id"] = (Json::UInt64)record.room_id;
+        result["white_id"] = (Json::UInt64)record.white_id;
+        result["black_id"] = (Json::UInt64)record.black_id;
+        result["winner"] = (Json::UInt64)record.winner;
+        result["moves"] = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < n; ++i)
+        {
+            Json::Value step;
+            step["row"] = record.rows[i];
+            step["col"] = record.cols[i];
+            step["uid"] = (Json::UInt64)(record.colors[i] == AI_WHITE ? record.white_id : record.black_id);
+            step["best_row"] = best[i].row;
+            step["best_col"] = best[i].col;
+            step["score"] = best[i].score;
+            step["depth"] = best[i].depth;
+            // 下一个局面由对方走棋，对方的最佳分值取反即为实际着法的分值
+            int loss = 0;
+            if (record.rows[i] != best[i].row || record.cols[i] != best[i].col)
+                loss = std::max(0, best[i].score + best[i + 1].score);
+            step["loss"] = loss;
+            step["blunder"] = loss > ANALYSIS_BLUNDER;
+            result["moves"].append(step);
+        }
+    }
+
+    // 调度线程中执行的分析任务
+    void run(uint64_t room_id)
+    {
+        game_record record;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _games.find(room_id);
+            if (it == _games.end())
+                return;
+            record = it->second.record;
+        }
+        Json::Value result;
+        analyze(record, result);
+        LOG(DEBUG, "房间%lu 复盘分析完毕，共%lu步", room_id, record.rows.size());
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _games.find(room_id);
+        if (it == _games.end())
+            return;
+        it->second.result = result;
+        it->second.statu = ANALYSIS_DONE;
+    }
+
+public:
+    analysis_service(int thread_num = ANALYSIS_THREADS)
+        : _tt(ANALYSIS_TT_BITS), _stop(false), _workers(thread_num > 1 ? thread_num - 1 : 1), _dispatcher(1)
+    {
+        for (int i = 0; i < thread_num; ++i)
+        {
+            _engines.push_back(std::unique_ptr<ai_engine>(new ai_engine(&_tt, &_stop, i)));
+        }
+        LOG(DEBUG, "复盘分析模块初始化完毕！");
+    }
+
+    // 对局结束时保存棋谱
+    void record(const game_record &record)
+    {
+        if (record.rows.empty())
+            return;
+        std::unique_lock<std::mutex> lock(_mutex);
+        game_entry &entry = _games[record.room_id];
+        entry.record = record;
+        entry.statu = ANALYSIS_WAIT;
+        _order.push_back(record.room_id);
+        while (_order.size() > ANALYSIS_CACHE)
+        {
+            _games.erase(_order.front());
+            _order.pop_front();
+        }
+    }
+
+    // 获取复盘结果，只有对局双方可以查看；首次请求时开始分析
+    bool query(uint64_t room_id, uint64_t uid, Json::Value &result)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _games.find(room_id);
+        if (it == _games.end())
+            return false;
+        game_entry &entry = it->second;
+        if (uid != entry.record.white_id && uid != entry.record.black_id)
+            return false;
+        if (entry.statu == ANALYSIS_WAIT)
+        {
+            entry.statu = ANALYSIS_RUNNING;
+            _dispatcher.push(std::bind(&analysis_service::run, this, room_id));
+        }
+        if (entry.statu == ANALYSIS_DONE)
+        {
+            result = entry.result;
+            result["status"] = "done";
+        }
+        else
+        {
+            result["room_id"] = (Json::UInt64)room_id;
+            result["status"] = "running";
+        }
+        return true;
+    }
+
+    // 同步分析一个局面，供性能测试使用
+    void search_position(const ai_board &board, int depth, int ms, ai_result &res)
+    {
+        search(board, depth, ms, res);
+    }
+
+    // 清空共享置换表
+    void clear() { _tt.clear(); }
+};
@@ -0,0 +1,712 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "log.hpp"
+
+/*
+* 对局归档模块
+* 已经结束的对局永久保存，用于申诉、回放和统计；不在MySQL中每步一行，而是紧凑编码后追加到段文件中
+*
+* 每局的编码：
+*   版本 | 房间id | 白方id | 黑方id | 双方赛前等级分 | 结果、规则、棋盘类型 | 棋盘列数 | 开始时间 | 时长 | 步数
+*   每一步：落点编号（行*列数+列）与上一步之差的zigzag varint | 与上一步的间隔 ms varint
+* 整数都是varint；落点差分后相邻的落子只需1个字节；白子先行，颜色按步数交替，不保存
+* 一局30多步的对局约150字节。记录在段文件中的格式：[varint 长度][u32 crc32][编码]
+*
+* 对局id在归档时分配，从1开始连续递增，段文件以第一局的id命名，段内的对局id连续
+* 稀疏索引：每个段每隔ARCHIVE_INDEX_STRIDE局记录一个偏移，按id查找时定位到最近的索引点再顺序跳过不超过STRIDE-1条记录
+* 玩家索引：uid -> 该玩家的对局id列表，差分varint编码保存在内存中
+* 段写满后封存，同时写出索引文件（.idx）；启动时有索引文件的段直接加载，没有的（最后一个段）扫描重建，
+* 扫描时遇到不完整或校验失败的记录即认为是崩溃时写了一半的尾部，截断丢弃
+*
+* 写入方只把编码后的记录放入缓冲区，由后台线程成批写入并落盘，写入后索引才可见
+*/
+
+#define ARCHIVE_DIR "./archive"
+#define ARCHIVE_SEGMENT_BYTES (64 << 20) // 默认的段文件大小上限
+#define ARCHIVE_INDEX_STRIDE 64          // 稀疏索引的间隔
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_READ_BLOCK 16384         // 按id查找时一次读取的字节数
+
+typedef enum
+{
+    ARCHIVE_WHITE_WIN = 0,
+    ARCHIVE_BLACK_WIN = 1,
+    ARCHIVE_NO_RESULT = 2
+} archive_result;
+
+struct archive_game
+{
+    uint64_t game_id; // 归档时分配
+    uint64_t room_id;
+    uint64_t white_id;
+    uint64_t black_id;
+    int white_rating; // 赛前等级分
+    int black_rating;
+    archive_result result;
+    int rule;
+    int variant;
+    int cols;
+    uint64_t start_ms;             // 开始时间 unix ms
+    uint64_t end_ms;               // 结束时间 unix ms
+    std::vector<uint16_t> squares; // 落点编号 行*列数+列
+    std::vector<uint32_t> times;   // 每一步与上一步（第一步与开始）的间隔 ms
+};
+
+// 当前的unix时间 ms
+inline uint64_t archive_now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+class archive_codec
+{
+public:
+    static void put_varint(std::string &buf, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            buf += (char)(v | 0x80);
+            v >>= 7;
+        }
+        buf += (char)v;
+    }
+
+    static bool get_varint(const char *&p, const char *end, uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+    static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+    // 第一步与棋盘中心做差分
+    static int center(int cols) { return cols / 2 * cols + cols / 2; }
+
+    static void encode(const archive_game &g, std::string &out)
+    {
+        out += (char)ARCHIVE_VERSION;
+        put_varint(out, g.room_id);
+        put_varint(out, g.white_id);
+        put_varint(out, g.black_id);
+        put_varint(out, g.white_rating < 0 ? 0 : g.white_rating);
+        put_varint(out, g.black_rating < 0 ? 0 : g.black_rating);
+        out += (char)(g.result | g.rule << 2 | g.variant << 4);
+        put_varint(out, g.cols);
+        put_varint(out, g.start_ms);
+        put_varint(out, g.end_ms > g.start_ms ? g.end_ms - g.start_ms : 0);
+        put_varint(out, g.squares.size());
+        int prev = center(g.cols);
+        for (size_t i = 0; i < g.squares.size(); ++i)
+        {
+            put_varint(out, zigzag((int64_t)g.squares[i] - prev));
+            put_varint(out, i < g.times.size() ? g.times[i] : 0);
+            prev = g.squares[i];
+        }
+    }
+
+    // 只解码到双方id，建立玩家索引时使用
+    static bool decode_players(const char *p, const char *end, uint64_t &white_id, uint64_t &black_id)
+    {
+        uint64_t room_id;
+        if (p >= end || (uint8_t)*p++ != ARCHIVE_VERSION)
+            return false;
+        return get_varint(p, end, room_id) && get_varint(p, end, white_id) && get_varint(p, end, black_id);
+    }
+
+    static bool decode(const char *p, const char *end, archive_game &g)
+    {
+        uint64_t v[5], flags, cols, start, duration, n;
+        if (p >= end || (uint8_t)*p++ != ARCHIVE_VERSION)
+            return false;
+        for (int i = 0; i < 5; ++i)
+        {
+            if (get_varint(p, end, v[i]) == false)
+                return false;
+        }
+        if (p >= end)
+            return false;
+        flags = (uint8_t)*p++;
+        if (get_varint(p, end, cols) == false || get_varint(p, end, start) == false || get_varint(p, end, duration) == false ||
+            get_varint(p, end, n) == false || n > (uint64_t)(end - p))
+            return false;
+        g.room_id = v[0];
+        g.white_id = v[1];
+        g.black_id = v[2];
+        g.white_rating = v[3];
+        g.black_rating = v[4];
+        g.result = (archive_result)(flags & 3);
+        g.rule = flags >> 2 & 3;
+        g.variant = flags >> 4;
+        g.cols = cols;
+        g.start_ms = start;
+        g.end_ms = start + duration;
+        g.squares.resize(n);
+        g.times.resize(n);
+        int64_t prev = center(cols);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            uint64_t d, t;
+            if (get_varint(p, end, d) == false || get_varint(p, end, t) == false)
+                return false;
+            prev += unzigzag(d);
+            g.squares[i] = prev;
+            g.times[i] = t;
+        }
+        return p == end;
+    }
+};
+
+class game_archive
+{
+private:
+    struct segment
+    {
+        uint64_t first_gid;
+        uint64_t count;
+        uint64_t size;
+        int fd;
+        std::vector<uint64_t> points; // 第i*STRIDE局的偏移
+    };
+
+    struct posting
+    {
+        uint64_t last;    // 最后一局的id，差分的基准
+        uint64_t count;
+        std::string gids; // 差分varint编码的对局id
+    };
+
+    // 等待写入的记录
+    struct pending_game
+    {
+        uint64_t gid;
+        uint64_t white_id;
+        uint64_t black_id;
+        std::string rec;
+    };
+
+    std::string _dir;
+    uint64_t _segment_bytes; // 段文件大小上限
+    // 保护段、索引和计数
+    std::mutex _mutex;
+    std::vector<segment> _segments; // 最后一个是正在写入的段
+    std::unordered_map<uint64_t, posting> _postings;
+    uint64_t _written; // 已经写入并建立索引的对局数
+    uint64_t _bytes;
+    // 保护待写入的记录
+    std::mutex _pending_mutex;
+    std::condition_variable _cond;
+    std::condition_variable _flushed;
+    std::vector<pending_game> _pending;
+    uint64_t _next_gid;
+    std::thread _writer;
+    bool _stop;
+    bool _open; // 打开失败时不接受写入
+
+private:
+    std::string seg_path(uint64_t first_gid)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016lu.seg", (unsigned long)first_gid);
+        return _dir + name;
+    }
+
+    static void frame(std::string &buf, const std::string &body)
+    {
+        archive_codec::put_varint(buf, body.size());
+        uint32_t crc = crc32(0, (const Bytef *)body.data(), body.size());
+        buf.append((const char *)&crc, sizeof(crc));
+        buf += body;
+    }
+
+    // 解析一条记录的长度和校验，成功时p指向编码，end指向记录末尾
+    static bool unframe(const char *&p, const char *&end)
+    {
+        uint64_t len;
+        uint32_t crc;
+        if (archive_codec::get_varint(p, end, len) == false || (uint64_t)(end - p) < sizeof(crc) + len)
+            return false;
+        memcpy(&crc, p, sizeof(crc));
+        p += sizeof(crc);
+        end = p + len;
+        return crc32(0, (const Bytef *)p, len) == crc;
+    }
+
+    static bool read_file(int fd, std::string &data)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            return false;
+        data.resize(st.st_size);
+        size_t off = 0;
+        while (off < data.size())
+        {
+            ssize_t n = pread(fd, &data[off], data.size() - off, off);
+            if (n <= 0)
+                return false;
+            off += n;
+        }
+        return true;
+    }
+
+    static bool write_all(int fd, const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = ::write(fd, data, len);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void add_posting(uint64_t uid, uint64_t gid)
+    {
+        posting &p = _postings[uid];
+        archive_codec::put_varint(p.gids, gid - p.last);
+        p.last = gid;
+        p.count++;
+    }
+
+    // 扫描段文件，重建稀疏索引，返回有效记录的长度；players非空时取出每局的双方id
+    static uint64_t scan(const std::string &data, segment &seg, std::vector<std::pair<uint64_t, uint64_t>> *players)
+    {
+        const char *base = data.data(), *end = base + data.size(), *p = base;
+        seg.count = 0;
+        seg.points.clear();
+        while (p < end)
+        {
+            const char *rec = p, *rec_end = end;
+            uint64_t white_id, black_id;
+            if (unframe(p, rec_end) == false || archive_codec::decode_players(p, rec_end, white_id, black_id) == false)
+            {
+                p = rec;
+                break;
+            }
+            if (seg.count % ARCHIVE_INDEX_STRIDE == 0)
+                seg.points.push_back(rec - base);
+            if (players != nullptr)
+                players->emplace_back(white_id, black_id);
+            seg.count++;
+            p = rec_end;
+        }
+        return p - base;
+    }
+
+    // 段的索引文件：[u32 crc][varint 局数][varint 有效长度][索引点]...[双方id]...
+    bool write_index(const segment &seg, const std::vector<std::pair<uint64_t, uint64_t>> &players)
+    {
+        std::string body;
+        archive_codec::put_varint(body, seg.count);
+        archive_codec::put_varint(body, seg.size);
+        for (uint64_t off : seg.points)
+            archive_codec::put_varint(body, off);
+        for (auto &pl : players)
+        {
+            archive_codec::put_varint(body, pl.first);
+            archive_codec::put_varint(body, pl.second);
+        }
+        std::string path = seg_path(seg.first_gid) + ".idx", tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        uint32_t crc = crc32(0, (const Bytef *)body.data(), body.size());
+        bool ok = write_all(fd, (const char *)&crc, sizeof(crc)) && write_all(fd, body.data(), body.size()) && fsync(fd) == 0;
+        ::close(fd);
+        return ok && ::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    bool read_index(segment &seg, std::vector<std::pair<uint64_t, uint64_t>> &players)
+    {
+        int fd = ::open((seg_path(seg.first_gid) + ".idx").c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        std::string data;
+        bool ok = read_file(fd, data);
+        ::close(fd);
+        uint32_t crc;
+        if (ok == false || data.size() < sizeof(crc))
+            return false;
+        memcpy(&crc, data.data(), sizeof(crc));
+        const char *p = data.data() + sizeof(crc), *end = data.data() + data.size();
+        if (crc32(0, (const Bytef *)p, end - p) != crc)
+            return false;
+        uint64_t count, size;
+        if (archive_codec::get_varint(p, end, count) == false || archive_codec::get_varint(p, end, size) == false)
+            return false;
+        seg.count = count;
+        seg.size = size;
+        seg.points.resize((count + ARCHIVE_INDEX_STRIDE - 1) / ARCHIVE_INDEX_STRIDE);
+        for (uint64_t &off : seg.points)
+        {
+            if (archive_codec::get_varint(p, end, off) == false)
+                return false;
+        }
+        players.resize(count);
+        for (auto &pl : players)
+        {
+            if (archive_codec::get_varint(p, end, pl.first) == false || archive_codec::get_varint(p, end, pl.second) == false)
+                return false;
+        }
+        return p == end;
+    }
+
+    // 加载一个段：有索引文件时直接读取，否则扫描并截断不完整的尾部
+    bool load_segment(uint64_t first_gid, bool last)
+    {
+        segment seg{first_gid, 0, 0, -1, {}};
+        std::string path = seg_path(first_gid);
+        seg.fd = ::open(path.c_str(), last ? O_RDWR | O_APPEND : O_RDONLY);
+        if (seg.fd < 0)
+            return false;
+        std::vector<std::pair<uint64_t, uint64_t>> players;
+        if (last || read_index(seg, players) == false)
+        {
+            std::string data;
+            if (read_file(seg.fd, data) == false)
+                return false;
+            players.clear();
+            seg.size = scan(data, seg, &players);
+            if (seg.size != data.size())
+            {
+                LOG(ERROR, "归档段 %s 尾部有 %lu 字节不完整，已丢弃", path.c_str(), data.size() - seg.size);
+                if (ftruncate(seg.fd, seg.size) != 0)
+                    return false;
+            }
+            if (last == false)
+                write_index(seg, players);
+        }
+        for (uint64_t i = 0; i < players.size(); ++i)
+        {
+            add_posting(players[i].first, first_gid + i);
+            if (players[i].second != players[i].first)
+                add_posting(players[i].second, first_gid + i);
+        }
+        _bytes += seg.size;
+        _segments.push_back(std::move(seg));
+        return true;
+    }
+
+    // 封存正在写入的段，写出索引文件，之后写入新的段（调用方持有_mutex）
+    bool roll(uint64_t first_gid)
+    {
+        if (_segments.empty() == false)
+        {
+            segment &cur = _segments.back();
+            std::string data;
+            std::vector<std::pair<uint64_t, uint64_t>> players;
+            if (fdatasync(cur.fd) != 0 || read_file(cur.fd, data) == false)
+                return false;
+            segment tmp{cur.first_gid, 0, 0, -1, {}};
+            tmp.size = scan(data, tmp, &players);
+            if (write_index(tmp, players) == false)
+                LOG(ERROR, "归档段索引写入失败: %s", strerror(errno));
+        }
+        int fd = ::open(seg_path(first_gid).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+            return false;
+        _segments.push_back(segment{first_gid, 0, 0, fd, {}});
+        return true;
+    }
+
+    // 写入失败后丢弃这一批剩下的对局：截掉写了一半的内容，空的段直接删除（调用方持有_mutex）
+    // 之后的对局id与段不再连续，写入时会开始新的段
+    void abandon()
+    {
+        if (_segments.empty())
+            return;
+        segment &seg = _segments.back();
+        if (ftruncate(seg.fd, seg.size) != 0)
+            LOG(ERROR, "归档段截断失败: %s", strerror(errno));
+        if (seg.count == 0)
+        {
+            ::close(seg.fd);
+            ::unlink(seg_path(seg.first_gid).c_str());
+            _segments.pop_back();
+        }
+    }
+
+    // 后台写入线程：取走所有待写入的记录，按段写入并落盘后建立索引
+    void writer_entry()
+    {
+        std::vector<pending_game> batch;
+        std::string buf;
+        while (1)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_pending_mutex);
+                _cond.wait(lock, [this]() { return _stop || !_pending.empty(); });
+                if (_pending.empty() && _stop)
+                    return;
+                batch.swap(_pending);
+            }
+            size_t i = 0;
+            while (i < batch.size())
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // 没有段、段已满或者对局id与段不连续（之前写入失败）时开始新的段
+                bool full = _segments.empty() == false && _segments.back().count > 0 &&
+                            _segments.back().size + batch[i].rec.size() > _segment_bytes;
+                if (_segments.empty() || full || _segments.back().first_gid + _segments.back().count != batch[i].gid)
+                {
+                    if (roll(batch[i].gid) == false)
+                    {
+                        LOG(ERROR, "归档段创建失败: %s", strerror(errno));
+                        break;
+                    }
+                }
+                segment &seg = _segments.back();
+                // 本段能容纳的记录一次写入
+                size_t j = i;
+                uint64_t size = seg.size;
+                buf.clear();
+                while (j < batch.size() && (j == i || size + batch[j].rec.size() <= _segment_bytes))
+                {
+                    size += batch[j].rec.size();
+                    buf += batch[j].rec;
+                    j++;
+                }
+                lock.unlock();
+                // 写入失败时这一批丢弃，不建立索引
+                if (write_all(seg.fd, buf.data(), buf.size()) == false || fdatasync(seg.fd) != 0)
+                {
+                    LOG(ERROR, "归档写入失败: %s", strerror(errno));
+                    break;
+                }
+                lock.lock();
+                for (; i < j; ++i)
+                {
+                    if (seg.count % ARCHIVE_INDEX_STRIDE == 0)
+                        seg.points.push_back(seg.size);
+                    seg.size += batch[i].rec.size();
+                    seg.count++;
+                    add_posting(batch[i].white_id, batch[i].gid);
+                    if (batch[i].black_id != batch[i].white_id)
+                        add_posting(batch[i].black_id, batch[i].gid);
+                }
+                _written = batch[i - 1].gid;
+                _bytes += buf.size();
+            }
+            if (i < batch.size())
+            {
+                // 出错后这一批剩下的对局id作废
+                std::unique_lock<std::mutex> lock(_mutex);
+                abandon();
+                _written = batch.back().gid;
+            }
+            batch.clear();
+            {
+                // 持有锁再通知，避免flush错过这次唤醒
+                std::unique_lock<std::mutex> lock(_pending_mutex);
+            }
+            _flushed.notify_all();
+        }
+    }
+
+public:
+    game_archive(const std::string &dir = ARCHIVE_DIR, uint64_t segment_bytes = ARCHIVE_SEGMENT_BYTES)
+        : _dir(dir), _segment_bytes(segment_bytes), _written(0), _bytes(0), _next_gid(1), _stop(false), _open(false) {}
+
+    ~game_archive()
+    {
+        if (_writer.joinable())
+        {
+            {
+                std::unique_lock<std::mutex> lock(_pending_mutex);
+                _stop = true;
+            }
+            _cond.notify_all();
+            _writer.join();
+        }
+        for (segment &seg : _segments)
+            ::close(seg.fd);
+    }
+
+    // 加载已有的段文件和索引，之后开始接受写入
+    bool open()
+    {
+        mkdir(_dir.c_str(), 0755);
+        DIR *dp = opendir(_dir.c_str());
+        if (dp == nullptr)
+        {
+            LOG(ERROR, "归档目录打开失败: %s", strerror(errno));
+            return false;
+        }
+        std::vector<uint64_t> firsts;
+        struct dirent *de;
+        while ((de = readdir(dp)) != nullptr)
+        {
+            std::string name = de->d_name;
+            if (name.size() == 20 && name.compare(16, 4, ".seg") == 0)
+                firsts.push_back(strtoull(name.c_str(), nullptr, 10));
+        }
+        closedir(dp);
+        std::sort(firsts.begin(), firsts.end());
+        for (size_t i = 0; i < firsts.size(); ++i)
+        {
+            if (load_segment(firsts[i], i + 1 == firsts.size()) == false)
+            {
+                LOG(ERROR, "归档段 %lu 加载失败: %s", firsts[i], strerror(errno));
+                return false;
+            }
+        }
+        if (_segments.empty() == false)
+            _next_gid = _segments.back().first_gid + _segments.back().count;
+        _written = _next_gid - 1;
+        _open = true;
+        _writer = std::thread(&game_archive::writer_entry, this);
+        LOG(DEBUG, "对局归档加载完毕，%lu 个段，%lu 局", _segments.size(), _written);
+        return true;
+    }
+
+    // 归档一局，返回分配的对局id，写入后才能查到；归档不可用时返回0
+    uint64_t append(const archive_game &g)
+    {
+        if (_open == false)
+            return 0;
+        std::string body;
+        archive_codec::encode(g, body);
+        pending_game pg{0, g.white_id, g.black_id, std::string()};
+        frame(pg.rec, body);
+        uint64_t gid;
+        {
+            std::unique_lock<std::mutex> lock(_pending_mutex);
+            gid = pg.gid = _next_gid++;
+            _pending.push_back(std::move(pg));
+        }
+        _cond.notify_one();
+        return gid;
+    }
+
+    // 等待已经提交的对局全部写入
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(_pending_mutex);
+        uint64_t target = _next_gid - 1;
+        _flushed.wait(lock, [this, target]() {
+            std::unique_lock<std::mutex> ilock(_mutex);
+            return _written >= target;
+        });
+    }
+
+    // 按对局id读取一局
+    bool get(uint64_t gid, archive_game &g)
+    {
+        int fd;
+        uint64_t off, skip, limit;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = std::upper_bound(_segments.begin(), _segments.end(), gid,
+                                       [](uint64_t id, const segment &s) { return id < s.first_gid; });
+            if (gid == 0 || it == _segments.begin())
+                return false;
+            segment &seg = *(it - 1);
+            uint64_t n = gid - seg.first_gid;
+            if (n >= seg.count)
+                return false;
+            fd = seg.fd;
+            off = seg.points[n / ARCHIVE_INDEX_STRIDE];
+            skip = n % ARCHIVE_INDEX_STRIDE;
+            limit = seg.size;
+        }
+        // 从索引点开始读，跳过前面的记录；一块不够时加大再读
+        std::string buf;
+        for (uint64_t want = ARCHIVE_READ_BLOCK;; want *= 2)
+        {
+            want = std::min(want, limit - off);
+            buf.resize(want);
+            ssize_t n = pread(fd, &buf[0], want, off);
+            if (n != (ssize_t)want)
+                return false;
+            const char *p = buf.data(), *end = p + buf.size();
+            uint64_t i = 0;
+            for (; i <= skip; ++i)
+            {
+                const char *rec_end = end;
+                if (unframe(p, rec_end) == false)
+                    break;
+                if (i == skip)
+                {
+                    g.game_id = gid;
+                    return archive_codec::decode(p, rec_end, g);
+                }
+                p = rec_end;
+            }
+            if (off + want >= limit)
+                return false;
+        }
+    }
+
+    // 玩家最近的limit局对局id，从新到旧
+    size_t games_of(uint64_t uid, size_t limit, std::vector<uint64_t> &gids)
+    {
+        std::vector<uint64_t> all;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _postings.find(uid);
+            if (it == _postings.end())
+                return 0;
+            const std::string &data = it->second.gids;
+            const char *p = data.data(), *end = p + data.size();
+            all.reserve(it->second.count);
+            uint64_t gid = 0, d;
+            while (archive_codec::get_varint(p, end, d))
+                all.push_back(gid += d);
+        }
+        size_t n = 0;
+        for (auto it = all.rbegin(); it != all.rend() && n < limit; ++it, ++n)
+            gids.push_back(*it);
+        return n;
+    }
+
+    // 已经写入的对局数和段文件的总字节数
+    uint64_t count()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        uint64_t n = 0;
+        for (segment &seg : _segments)
+            n += seg.count;
+        return n;
+    }
+    uint64_t bytes()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _bytes;
+    }
+    size_t segments()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _segments.size();
+    }
+};
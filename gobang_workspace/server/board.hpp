@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "rule.hpp"
+
+/*
+* 棋盘模块
+* 棋盘大小和获胜所需的连子数作为模板参数，每种棋盘在编译期生成各自的实现：
+*   BOARD_STANDARD 15x15 五子
+*   BOARD_LARGE    19x19 五子
+*   BOARD_BLITZ    9x9   五子快棋
+*
+* 棋盘四周各填充WIN-1格的墙，四个方向的步长都是编译期常量，
+* 从落子点向两侧数连子时不需要任何越界判断，循环次数固定为WIN-1，可以被编译器完全展开。
+* 房间通过board_base接口持有棋盘，每次落子只有一次虚函数调用，其余判断都在具体的棋盘类型中完成。
+*/
+
+#define BOARD_WALL 3 // 棋盘外的格子，与任何一方的棋子都不相同
+
+typedef enum
+{
+    BOARD_STANDARD,
+    BOARD_LARGE,
+    BOARD_BLITZ
+} board_variant;
+
+typedef enum
+{
+    MOVE_OK,        // 落子成功
+    MOVE_OUT,       // 不在棋盘内
+    MOVE_TAKEN,     // 已经有棋子
+    MOVE_FORBIDDEN  // 禁手
+} move_result;
+
+class board_base
+{
+public:
+    virtual ~board_base() {}
+
+    // 棋盘行数
+    virtual int rows() const = 0;
+    // 棋盘列数
+    virtual int cols() const = 0;
+    // 获胜所需的连子数
+    virtual int win_length() const = 0;
+    // 获取row行col列的棋子，位置必须在棋盘内
+    virtual int get(int row, int col) const = 0;
+    // color方在rule规则下于row行col列落子，落子成功时win带出是否获胜
+    virtual move_result place(int row, int col, int color, game_rule rule, bool &win) = 0;
+    // 导出为二维数组，供人机对战等模块使用
+    virtual std::vector<std::vector<int>> snapshot() const = 0;
+};
+
+template <int ROW, int COL, int WIN>
+class chess_board final : public board_base
+{
+    static_assert(ROW > 0 && COL > 0 && WIN > 1, "invalid board");
+    static_assert(WIN <= ROW || WIN <= COL, "win length exceeds board");
+
+public:
+    static constexpr int PAD = WIN - 1;                     // 四周填充的墙宽
+    static constexpr int STRIDE = COL + 2 * PAD;            // 一行的格子数（含墙）
+    static constexpr int CELLS = (ROW + 2 * PAD) * STRIDE;  // 总格子数（含墙）
+
+    // 四个方向上相邻格子的下标差：横、竖、正斜、反斜
+    static constexpr int DIR_H = 1;
+    static constexpr int DIR_V = STRIDE;
+    static constexpr int DIR_D = STRIDE + 1;
+    static constexpr int DIR_A = STRIDE - 1;
+
+private:
+    uint8_t _cells[CELLS];
+
+private:
+    static constexpr int index(int row, int col) { return (row + PAD) * STRIDE + col + PAD; }
+
+    // 从p出发沿D方向两侧数color方的连子数，墙和对方棋子都会终止计数
+    template <int D>
+    static int run(const uint8_t *p, int color)
+    {
+        int n = 1;
+        for (int k = 1; k < WIN; ++k)
+        {
+            if (p[k * D] != color)
+                break;
+            ++n;
+        }
+        for (int k = 1; k < WIN; ++k)
+        {
+            if (p[-k * D] != color)
+                break;
+            ++n;
+        }
+        return n;
+    }
+
+public:
+    chess_board() { clear(); }
+
+    void clear()
+    {
+        memset(_cells, BOARD_WALL, sizeof(_cells));
+        for (int r = 0; r < ROW; ++r)
+            memset(_cells + index(r, 0), 0, COL);
+    }
+
+    int rows() const override { return ROW; }
+    int cols() const override { return COL; }
+    int win_length() const override { return WIN; }
+
+    bool in_board(int row, int col) const { return row >= 0 && row < ROW && col >= 0 && col < COL; }
+    int get(int row, int col) const override { return _cells[index(row, col)]; }
+    void set(int row, int col, int color) { _cells[index(row, col)] = (uint8_t)color; }
+
+    // color方已在row行col列落子，判断是否连成WIN子（长连也算）
+    bool check_win(int row, int col, int color) const
+    {
+        const uint8_t *p = _cells + index(row, col);
+        return run<DIR_H>(p, color) >= WIN || run<DIR_V>(p, color) >= WIN ||
+               run<DIR_D>(p, color) >= WIN || run<DIR_A>(p, color) >= WIN;
+    }
+
+    move_result place(int row, int col, int color, game_rule rule, bool &win) override
+    {
+        if (in_board(row, col) == false)
+            return MOVE_OUT;
+        if (_cells[index(row, col)] != 0)
+            return MOVE_TAKEN;
+        // 禁手和恰好五连只对五子棋有意义，其他连子数的棋盘只按无禁手规则判断
+        if (WIN == 5 && rule_engine::instance().forbidden(*this, row, col, color, rule))
+            return MOVE_FORBIDDEN;
+        set(row, col, color);
+        if (WIN != 5 || rule == RULE_FREESTYLE)
+            win = check_win(row, col, color);
+        else
+            win = rule_engine::instance().win(*this, row, col, color, rule);
+        return MOVE_OK;
+    }
+
+    std::vector<std::vector<int>> snapshot() const override
+    {
+        std::vector<std::vector<int>> board(ROW, std::vector<int>(COL, 0));
+        for (int r = 0; r < ROW; ++r)
+            for (int c = 0; c < COL; ++c)
+                board[r][c] = get(r, c);
+        return board;
+    }
+};
+
+typedef chess_board<15, 15, 5> standard_board;
+typedef chess_board<19, 19, 5> large_board;
+typedef chess_board<9, 9, 5> blitz_board;
+
+// 根据棋盘类型创建对应的棋盘
+inline board_base *create_board(board_variant variant)
+{
+    switch (variant)
+    {
+    case BOARD_LARGE:
+        return new large_board();
+    case BOARD_BLITZ:
+        return new blitz_board();
+    default:
+        return new standard_board();
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "timer.hpp"
+#include "board.hpp"
+
+/*
+* 挑战邀请模块
+* 玩家在大厅中直接向指定的玩家发起挑战，对方接受后直接创建房间，不经过匹配队列
+* 邀请中记录挑战者选择的规则和棋盘，对方接受时按它们创建房间
+*
+* 待处理的邀请按被挑战者分段保存，每段一把锁，发起、接受、拒绝只锁被挑战者所在的段；
+* 每个邀请在时间轮上挂一个超时任务，超时未处理时删除邀请并回调通知双方，接受或拒绝时取消超时任务
+* 同一对玩家同时只有一个邀请，每个玩家待处理的邀请数有上限，防止被刷屏
+*/
+
+#define CHALLENGE_SHARDS 16
+#define CHALLENGE_TIMEOUT 30000   // 邀请的有效时间 ms
+#define CHALLENGE_MAX_PENDING 16  // 每个玩家最多收到的待处理邀请
+
+typedef enum
+{
+    CHALLENGE_OK,
+    CHALLENGE_DUPLICATE, // 已经向对方发出过邀请
+    CHALLENGE_FULL       // 对方待处理的邀请太多
+} challenge_statu;
+
+struct invite
+{
+    uint64_t from;  // 挑战者
+    uint64_t to;    // 被挑战者
+    uint64_t seq;   // 邀请的序号，超时任务用来确认还是同一个邀请
+    uint64_t timer; // 超时任务id
+    game_rule rule; // 挑战者选择的规则
+    board_variant variant; // 挑战者选择的棋盘
+};
+
+class invite_table
+{
+private:
+    struct invite_bucket
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::vector<invite>> inbox; // 被挑战者 -> 收到的邀请
+    };
+
+    std::vector<invite_bucket> _buckets;
+    timer_wheel *_wheel;
+    std::function<void(const invite &)> _on_expire;
+    std::atomic<uint64_t> _seq;
+    std::atomic<uint64_t> _size;
+
+private:
+    invite_bucket &bucket_of(uint64_t to) { return _buckets[to % _buckets.size()]; }
+
+    // 从被挑战者的邀请中删除from发出的邀请，seq不为0时只删除序号相同的邀请
+    bool remove(uint64_t from, uint64_t to, uint64_t seq, invite &out)
+    {
+        invite_bucket &b = bucket_of(to);
+        std::unique_lock<std::mutex> lock(b.mutex);
+        auto it = b.inbox.find(to);
+        if (it == b.inbox.end())
+            return false;
+        std::vector<invite> &list = it->second;
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            if (list[i].from != from || (seq != 0 && list[i].seq != seq))
+                continue;
+            out = list[i];
+            list[i] = list.back();
+            list.pop_back();
+            if (list.empty())
+                b.inbox.erase(it);
+            _size--;
+            return true;
+        }
+        return false;
+    }
+
+    void expire(uint64_t from, uint64_t to, uint64_t seq)
+    {
+        invite inv;
+        if (remove(from, to, seq, inv) && _on_expire)
+            _on_expire(inv);
+    }
+
+public:
+    // 时间轮的回调在网络io线程中执行，超时通知也在网络io线程中发出
+    invite_table(timer_wheel *wheel, size_t shards = CHALLENGE_SHARDS) : _buckets(shards), _wheel(wheel), _seq(0), _size(0) {}
+
+    // 设置邀请超时的回调，在构造之后、发出邀请之前调用
+    void on_expire(const std::function<void(const invite &)> &cb) { _on_expire = cb; }
+
+    // from向to发起挑战，在variant棋盘上使用rule规则对局
+    challenge_statu create(uint64_t from, uint64_t to, game_rule rule = RULE_FREESTYLE, board_variant variant = BOARD_STANDARD)
+    {
+        invite_bucket &b = bucket_of(to);
+        uint64_t seq = ++_seq;
+        {
+            std::unique_lock<std::mutex> lock(b.mutex);
+            std::vector<invite> &list = b.inbox[to];
+            for (const invite &inv : list)
+            {
+                if (inv.from == from)
+                    return CHALLENGE_DUPLICATE;
+            }
+            if (list.size() >= CHALLENGE_MAX_PENDING)
+                return CHALLENGE_FULL;
+            list.push_back(invite{from, to, seq, 0, rule, variant});
+            _size++;
+        }
+        if (_wheel == nullptr)
+            return CHALLENGE_OK;
+        uint64_t timer = _wheel->add(CHALLENGE_TIMEOUT, [this, from, to, seq]() { expire(from, to, seq); });
+        // 记录超时任务id，接受或拒绝时取消；期间邀请可能已经被处理
+        std::unique_lock<std::mutex> lock(b.mutex);
+        auto it = b.inbox.find(to);
+        if (it != b.inbox.end())
+        {
+            for (invite &inv : it->second)
+            {
+                if (inv.seq == seq)
+                    inv.timer = timer;
+            }
+        }
+        return CHALLENGE_OK;
+    }
+
+    // 接受或拒绝时取出邀请，邀请不存在（已经超时或被处理）时返回false
+    bool take(uint64_t from, uint64_t to, invite &inv)
+    {
+        if (remove(from, to, 0, inv) == false)
+            return false;
+        if (_wheel != nullptr && inv.timer != 0)
+            _wheel->cancel(inv.timer);
+        return true;
+    }
+
+    bool take(uint64_t from, uint64_t to)
+    {
+        invite inv;
+        return take(from, to, inv);
+    }
+
+    // 待处理的邀请总数
+    uint64_t size() { return _size; }
+};
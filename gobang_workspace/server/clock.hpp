@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+* 棋钟模块
+* 每方有一个总时间（base），每走一步加上固定的增量（Fischer加秒），同时每一步有最长思考时间；
+* 任一项为0表示不限制。当前走棋方的可用时间取两者中较小的一个，用完即超时判负
+*
+* 棋钟只负责计时和判断是否超时，超时的定时任务由房间挂在共用的时间轮上
+*/
+
+#define CLOCK_BASE_MS (10 * 60 * 1000) // 每方的总时间
+#define CLOCK_INCREMENT_MS 5000        // 每走一步增加的时间
+#define CLOCK_MOVE_MS 60000            // 每一步的最长思考时间
+#define CLOCK_UNLIMITED UINT64_MAX
+
+struct clock_config
+{
+    uint64_t base_ms;
+    uint64_t increment_ms;
+    uint64_t move_ms;
+};
+
+// 匹配创建房间时使用的棋钟
+inline clock_config default_clock()
+{
+    return clock_config{CLOCK_BASE_MS, CLOCK_INCREMENT_MS, CLOCK_MOVE_MS};
+}
+
+class game_clock
+{
+private:
+    clock_config _config;
+    uint64_t _bank[2];    // 白方 黑方剩余的总时间
+    int _turn;            // 当前走棋方的颜色 1白 2黑
+    uint64_t _turn_start; // 当前走棋方开始思考的时间
+    bool _running;
+
+    uint64_t &bank(int color) { return _bank[color == 1 ? 0 : 1]; }
+
+public:
+    game_clock(const clock_config &config = clock_config{0, 0, 0}) : _config(config), _turn(1), _turn_start(0), _running(false)
+    {
+        _bank[0] = _bank[1] = config.base_ms;
+    }
+
+    // 是否有时间限制
+    bool enabled() { return _config.base_ms != 0 || _config.move_ms != 0; }
+
+    const clock_config &config() { return _config; }
+
+    // 轮到color走棋，从now开始计时
+    void start(int color, uint64_t now)
+    {
+        _turn = color;
+        _turn_start = now;
+        _running = true;
+    }
+
+    void stop() { _running = false; }
+
+    int turn() { return _turn; }
+
+    // 当前走棋方从now起还能思考多久
+    uint64_t budget(uint64_t now)
+    {
+        if (_running == false || enabled() == false)
+            return CLOCK_UNLIMITED;
+        uint64_t elapsed = now > _turn_start ? now - _turn_start : 0;
+        uint64_t left = CLOCK_UNLIMITED;
+        if (_config.base_ms != 0)
+            left = bank(_turn) > elapsed ? bank(_turn) - elapsed : 0;
+        if (_config.move_ms != 0)
+        {
+            uint64_t move_left = _config.move_ms > elapsed ? _config.move_ms - elapsed : 0;
+            left = move_left < left ? move_left : left;
+        }
+        return left;
+    }
+
+    // 当前走棋方是否已经超时
+    bool flagged(uint64_t now) { return budget(now) == 0; }
+
+    // 当前走棋方落子，扣除用时并加上增量，轮到对方；已经超时返回false
+    bool move(uint64_t now)
+    {
+        if (flagged(now))
+            return false;
+        uint64_t elapsed = now > _turn_start ? now - _turn_start : 0;
+        if (_running && _config.base_ms != 0)
+            bank(_turn) = bank(_turn) - elapsed + _config.increment_ms;
+        start(_turn == 1 ? 2 : 1, now);
+        return true;
+    }
+
+    // color方在now时剩余的总时间，不限总时间时为0
+    uint64_t remaining(int color, uint64_t now)
+    {
+        if (_config.base_ms == 0)
+            return 0;
+        uint64_t left = bank(color);
+        if (_running && color == _turn)
+        {
+            uint64_t elapsed = now > _turn_start ? now - _turn_start : 0;
+            left = left > elapsed ? left - elapsed : 0;
+        }
+        return left;
+    }
+};
@@ -0,0 +1,755 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+#include "log.hpp"
+#include "executor.hpp"
+
+/*
+* 集群模块
+* 多个节点（各自独立的服务器进程，可以在不同的机器上）组成集群，房间和会话按一致性哈希分配给节点：
+* 每个节点在哈希环上有CLUSTER_VNODES个虚拟节点，键（房间id、ssid）哈希后顺时针找到的第一个虚拟节点所属的节点即为所有者。
+* 节点加入或离开时只有落在变化区间内的键换了所有者，只需要迁移这些房间和会话
+*
+* 节点之间用一个简单的TCP RPC通信：
+*   帧格式 [u32 负载长度][u8 类型][u64 序号][负载]，响应的类型为RPC_REPLY，序号与请求相同，负载的第一个字节表示是否成功
+*   服务端每个连接一个线程，按顺序处理请求；客户端每个节点保持CLUSTER_RPC_CONNS个连接，同步调用
+*   send为异步调用：投递到目标节点的mailbox中依次发出，同一个节点的消息保持顺序，不阻塞调用方
+*   请求可能已经被对方处理时（已经发出、等待响应超时或连接断开）不重发，只有连接失效或者没有发出时才重连后再发
+*   RPC服务只监听配置的地址；连接建立后服务端先发出随机数（RPC_HELLO），客户端回复用集群共享的密钥
+*   计算的HMAC-SHA256，验证通过之后才处理请求，没有密钥的连接不能冒充节点（创建会话、迁移房间）
+*
+* 成员变化：新节点启动时向已知的节点发送RPC_JOIN，主动离开时发送RPC_LEAVE；
+* 哈希环更新后在执行器上调用成员变化的回调，由上层迁移所有者已经改变的房间和会话。节点故障检测不在本模块中
+*/
+
+#define CLUSTER_VNODES 128          // 每个节点的虚拟节点数
+#define CLUSTER_RPC_CONNS 4         // 到每个节点的连接数
+#define CLUSTER_RPC_TIMEOUT 3000    // 同步调用的超时 ms
+#define CLUSTER_MAX_FRAME (1 << 20) // 单个请求的负载上限
+#define CLUSTER_HEAD 13             // 帧头：长度、类型、序号
+#define CLUSTER_NONCE_LEN 16        // 握手时服务端发出的随机数长度
+
+enum rpc_type
+{
+    RPC_REPLY = 0,
+    RPC_JOIN,           // 节点加入：节点号 端口 主机
+    RPC_LEAVE,          // 节点离开：节点号
+    RPC_SESSION_PUT,    // 在所有者上创建会话：ssid uid 存活时间
+    RPC_SESSION_GET,    // 查询会话：ssid -> uid
+    RPC_SESSION_EXPIRE, // 设置会话存活时间：ssid 存活时间
+    RPC_ROOM_FIND,      // 查询玩家所在的房间：uid -> room_id
+    RPC_ROOM_OPEN,      // 玩家的房间长连接建立在其他节点（网关）上：uid 网关节点
+    RPC_ROOM_MSG,       // 转发玩家在房间长连接上的消息：uid 消息
+    RPC_ROOM_CLOSE,     // 玩家的房间长连接断开：uid
+    RPC_ROOM_MOVE,      // 迁移房间：房间状态
+    RPC_PLAYER_SEND,    // 发送给连接在本节点上的玩家：uid 消息
+    RPC_ECHO,           // 原样返回，用于测试
+    RPC_HELLO,          // 握手：服务端发出随机数，客户端回复HMAC
+    RPC_TYPES
+};
+
+// 请求和响应的编码：定长字段按本机字节序写入，字符串带u32长度
+class rpc_writer
+{
+private:
+    std::string &_buf;
+
+public:
+    rpc_writer(std::string &buf) : _buf(buf) {}
+
+    template <class T>
+    rpc_writer &put(T v)
+    {
+        _buf.append((const char *)&v, sizeof(v));
+        return *this;
+    }
+
+    rpc_writer &put_str(const std::string &s)
+    {
+        put<uint32_t>(s.size());
+        _buf += s;
+        return *this;
+    }
+};
+
+// 解码时检查边界，越界后good()为false，之后读到的都是0
+class rpc_reader
+{
+private:
+    const char *_p;
+    const char *_end;
+    bool _good;
+
+public:
+    rpc_reader(const std::string &buf) : _p(buf.data()), _end(buf.data() + buf.size()), _good(true) {}
+
+    template <class T>
+    T get()
+    {
+        T v = T();
+        if (_end - _p < (ptrdiff_t)sizeof(T))
+        {
+            _good = false;
+            return v;
+        }
+        memcpy(&v, _p, sizeof(v));
+        _p += sizeof(v);
+        return v;
+    }
+
+    std::string get_str()
+    {
+        uint32_t n = get<uint32_t>();
+        if ((size_t)(_end - _p) < n)
+        {
+            _good = false;
+            return std::string();
+        }
+        std::string s(_p, n);
+        _p += n;
+        return s;
+    }
+
+    bool good() const { return _good; }
+};
+
+// 一致性哈希环
+class hash_ring
+{
+private:
+    std::map<uint64_t, uint32_t> _points; // 虚拟节点的哈希值 -> 节点号
+    std::set<uint32_t> _nodes;
+
+public:
+    // splitmix64的终结函数，连续的id也能均匀分布
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    void add(uint32_t node)
+    {
+        if (_nodes.insert(node).second == false)
+            return;
+        for (uint64_t v = 0; v < CLUSTER_VNODES; ++v)
+            _points[mix((uint64_t)node << 32 | v)] = node;
+    }
+
+    void remove(uint32_t node)
+    {
+        if (_nodes.erase(node) == 0)
+            return;
+        for (uint64_t v = 0; v < CLUSTER_VNODES; ++v)
+        {
+            auto it = _points.find(mix((uint64_t)node << 32 | v));
+            if (it != _points.end() && it->second == node)
+                _points.erase(it);
+        }
+    }
+
+    bool contains(uint32_t node) const { return _nodes.count(node) != 0; }
+    bool empty() const { return _nodes.empty(); }
+    std::vector<uint32_t> nodes() const { return std::vector<uint32_t>(_nodes.begin(), _nodes.end()); }
+
+    // 键的所有者，环为空时调用方自行判断
+    uint32_t owner(uint64_t key) const
+    {
+        auto it = _points.lower_bound(mix(key));
+        if (it == _points.end())
+            it = _points.begin();
+        return it->second;
+    }
+};
+
+class rpc_io
+{
+public:
+    static bool write_all(int fd, const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = ::recv(fd, data, len, 0);
+            if (n == 0)
+                return false;
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    static bool write_frame(int fd, uint8_t type, uint64_t seq, const std::string &payload)
+    {
+        std::string frame;
+        rpc_writer(frame).put<uint32_t>(payload.size()).put<uint8_t>(type).put<uint64_t>(seq);
+        frame += payload;
+        return write_all(fd, frame.data(), frame.size());
+    }
+
+    static bool read_frame(int fd, uint8_t &type, uint64_t &seq, std::string &payload)
+    {
+        char head[CLUSTER_HEAD];
+        if (read_all(fd, head, sizeof(head)) == false)
+            return false;
+        uint32_t len;
+        memcpy(&len, head, 4);
+        type = head[4];
+        memcpy(&seq, head + 5, 8);
+        if (len > CLUSTER_MAX_FRAME)
+            return false;
+        payload.resize(len);
+        return len == 0 || read_all(fd, &payload[0], len);
+    }
+
+    // 用集群的密钥对握手的随机数签名
+    static std::string sign(const std::string &secret, const std::string &nonce)
+    {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int len = 0;
+        HMAC(EVP_sha256(), secret.data(), secret.size(), (const unsigned char *)nonce.data(), nonce.size(), mac, &len);
+        return std::string((const char *)mac, len);
+    }
+};
+
+// RPC服务端：每个连接一个线程，依次处理请求并回复
+class rpc_server
+{
+public:
+    // 处理请求，返回false表示失败，resp为响应的负载
+    typedef std::function<bool(uint8_t type, const std::string &req, std::string &resp)> handler;
+
+private:
+    int _lfd;
+    std::string _secret;
+    handler _handler;
+    std::thread _acceptor;
+    std::mutex _mutex;
+    std::vector<int> _conns;
+    std::vector<std::thread> _threads;
+    std::atomic<bool> _stop;
+
+private:
+    // 握手：发出随机数，对方回复的签名正确才是集群中的节点
+    bool handshake(int fd)
+    {
+        unsigned char nonce[CLUSTER_NONCE_LEN];
+        if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+            return false;
+        std::string challenge((const char *)nonce, sizeof(nonce)), expect = rpc_io::sign(_secret, challenge), mac;
+        uint8_t type;
+        uint64_t seq;
+        if (rpc_io::write_frame(fd, RPC_HELLO, 0, challenge) == false || rpc_io::read_frame(fd, type, seq, mac) == false)
+            return false;
+        return type == RPC_HELLO && mac.size() == expect.size() && CRYPTO_memcmp(mac.data(), expect.data(), mac.size()) == 0;
+    }
+
+    void serve(int fd)
+    {
+        if (handshake(fd) == false)
+        {
+            LOG(ERROR, "RPC连接握手失败，断开连接");
+            ::shutdown(fd, SHUT_RDWR);
+            return;
+        }
+        uint8_t type;
+        uint64_t seq;
+        std::string req, resp;
+        while (rpc_io::read_frame(fd, type, seq, req))
+        {
+            resp.clear();
+            bool ok = _handler(type, req, resp);
+            std::string payload;
+            rpc_writer(payload).put<uint8_t>(ok);
+            payload += resp;
+            if (rpc_io::write_frame(fd, RPC_REPLY, seq, payload) == false)
+                break;
+        }
+    }
+
+    void accept_entry()
+    {
+        while (_stop == false)
+        {
+            int fd = ::accept(_lfd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::unique_lock<std::mutex> lock(_mutex);
+            _conns.push_back(fd);
+            _threads.emplace_back([this, fd]() { serve(fd); });
+        }
+    }
+
+public:
+    rpc_server() : _lfd(-1), _stop(false) {}
+    ~rpc_server() { stop(); }
+
+    // 在host:port上监听，port为0时由系统分配，返回实际的端口，失败返回0；secret为集群共享的密钥
+    uint16_t start(const std::string &host, uint16_t port, const std::string &secret, const handler &h)
+    {
+        _handler = h;
+        _secret = secret;
+        _lfd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(_lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        socklen_t len = sizeof(addr);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            LOG(ERROR, "RPC监听地址%s无效", host.c_str());
+            ::close(_lfd);
+            _lfd = -1;
+            return 0;
+        }
+        if (bind(_lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_lfd, 128) < 0 ||
+            getsockname(_lfd, (struct sockaddr *)&addr, &len) < 0)
+        {
+            LOG(ERROR, "RPC地址%s:%u监听失败: %s", host.c_str(), port, strerror(errno));
+            ::close(_lfd);
+            _lfd = -1;
+            return 0;
+        }
+        _acceptor = std::thread(&rpc_server::accept_entry, this);
+        return ntohs(addr.sin_port);
+    }
+
+    void stop()
+    {
+        if (_lfd < 0)
+            return;
+        _stop = true;
+        ::shutdown(_lfd, SHUT_RDWR);
+        _acceptor.join();
+        ::close(_lfd);
+        _lfd = -1;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int fd : _conns)
+            ::shutdown(fd, SHUT_RDWR);
+        for (std::thread &th : _threads)
+            th.join();
+        for (int fd : _conns)
+            ::close(fd);
+        _conns.clear();
+        _threads.clear();
+    }
+};
+
+// RPC客户端：到一个节点的一条连接，同步调用，断开后下次调用时重连
+class rpc_client
+{
+private:
+    std::string _host;
+    uint16_t _port;
+    std::string _secret;
+    std::mutex _mutex;
+    int _fd;
+    uint64_t _seq;
+
+private:
+    bool connect_peer()
+    {
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(_port);
+        inet_pton(AF_INET, _host.c_str(), &addr.sin_addr);
+        struct timeval tv = {CLUSTER_RPC_TIMEOUT / 1000, CLUSTER_RPC_TIMEOUT % 1000 * 1000};
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || handshake() == false)
+        {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    // 握手：对服务端发出的随机数签名
+    bool handshake()
+    {
+        uint8_t type;
+        uint64_t seq;
+        std::string nonce;
+        if (rpc_io::read_frame(_fd, type, seq, nonce) == false || type != RPC_HELLO || nonce.size() != CLUSTER_NONCE_LEN)
+            return false;
+        return rpc_io::write_frame(_fd, RPC_HELLO, 0, rpc_io::sign(_secret, nonce));
+    }
+
+    // 空闲的连接上不应该有可读的数据，可读（对方关闭了连接，如对方重启）或出错时连接已经失效
+    bool stale()
+    {
+        char c;
+        ssize_t n = ::recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
+    void disconnect()
+    {
+        if (_fd >= 0)
+            ::close(_fd);
+        _fd = -1;
+    }
+
+public:
+    rpc_client(const std::string &host, uint16_t port, const std::string &secret) : _host(host), _port(port), _secret(secret), _fd(-1), _seq(0) {}
+    ~rpc_client() { disconnect(); }
+
+    // 调用失败（连接断开、超时）返回false；成功时resp为对方处理的结果，第一个字节表示对方是否处理成功
+    // 请求发出之后的失败不重发：对方可能已经处理（RPC_SESSION_PUT、RPC_ROOM_MOVE等重复处理会出错）
+    bool call(uint8_t type, const std::string &req, std::string &resp)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_fd >= 0 && stale())
+            disconnect();
+        uint64_t seq = ++_seq;
+        // 请求没有完整发出时对方不会处理，重连后再发一次
+        bool sent = false;
+        for (int i = 0; i < 2 && sent == false; ++i)
+        {
+            if (_fd < 0 && connect_peer() == false)
+                return false;
+            sent = rpc_io::write_frame(_fd, type, seq, req);
+            if (sent == false)
+                disconnect();
+        }
+        uint8_t rtype;
+        uint64_t rseq;
+        if (sent == false || rpc_io::read_frame(_fd, rtype, rseq, resp) == false || rtype != RPC_REPLY || rseq != seq)
+        {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+};
+
+// 节点的启动参数：本节点的节点号、其他节点访问本节点RPC服务的地址（RPC服务也监听这个地址）、集群共享的密钥、已知的其他节点
+struct cluster_config
+{
+    uint32_t node;
+    std::string host;
+    uint16_t port;
+    std::string secret;
+    std::vector<std::tuple<uint32_t, std::string, uint16_t>> peers;
+};
+
+// 集群中的其他节点
+struct cluster_peer
+{
+    uint32_t id;
+    std::string host;
+    uint16_t port;
+    std::vector<std::unique_ptr<rpc_client>> clients;
+    std::atomic<size_t> next;
+    mailbox box; // 异步消息按顺序发出
+
+    cluster_peer(uint32_t i, const std::string &h, uint16_t p, const std::string &secret, executor *ex) : id(i), host(h), port(p), next(0), box(ex)
+    {
+        for (int c = 0; c < CLUSTER_RPC_CONNS; ++c)
+            clients.emplace_back(new rpc_client(h, p, secret));
+    }
+};
+
+class cluster
+{
+public:
+    // 处理其他节点的请求，在RPC服务线程中调用
+    typedef rpc_server::handler handler;
+    typedef std::shared_ptr<cluster_peer> peer_ptr;
+
+private:
+    uint32_t _self;
+    std::string _host;
+    uint16_t _port;
+    std::string _secret;
+    executor *_ex;
+    std::mutex _mutex; // 保护哈希环和节点表
+    hash_ring _ring;
+    std::unordered_map<uint32_t, peer_ptr> _peers;
+    handler _handlers[RPC_TYPES];
+    std::function<void()> _on_change;
+    rpc_server _server;
+    std::atomic<uint64_t> _calls;
+    std::atomic<uint64_t> _failures;
+
+private:
+    void add_peer(uint32_t id, const std::string &host, uint16_t port)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (id == _self)
+                return;
+            if (_peers.count(id) == 0)
+                _peers[id] = std::make_shared<cluster_peer>(id, host, port, _secret, _ex);
+            _ring.add(id);
+        }
+        LOG(INFO, "节点%u(%s:%u)加入集群", id, host.c_str(), port);
+    }
+
+    void remove_peer(uint32_t id)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ring.remove(id);
+        // 节点表保留，离开后仍可能有迁移的消息发往该节点
+    }
+
+    void changed()
+    {
+        if (_on_change)
+            _ex->post(_on_change);
+    }
+
+    bool dispatch(uint8_t type, const std::string &req, std::string &resp)
+    {
+        rpc_reader r(req);
+        if (type == RPC_JOIN)
+        {
+            uint32_t id = r.get<uint32_t>();
+            uint16_t port = r.get<uint16_t>();
+            std::string host = r.get_str();
+            if (r.good() == false)
+                return false;
+            add_peer(id, host, port);
+            changed();
+            // 回复本节点知道的成员，新节点只需要知道一个已经在运行的节点
+            std::unique_lock<std::mutex> lock(_mutex);
+            rpc_writer w(resp);
+            w.put<uint32_t>(_ring.nodes().size());
+            for (uint32_t n : _ring.nodes())
+            {
+                if (n == _self)
+                    w.put<uint32_t>(n).put<uint16_t>(_port).put_str(_host);
+                else
+                    w.put<uint32_t>(n).put<uint16_t>(_peers[n]->port).put_str(_peers[n]->host);
+            }
+            return true;
+        }
+        else if (type == RPC_LEAVE)
+        {
+            uint32_t id = r.get<uint32_t>();
+            if (r.good() == false)
+                return false;
+            remove_peer(id);
+            LOG(INFO, "节点%u离开集群", id);
+            changed();
+            return true;
+        }
+        else if (type == RPC_ECHO)
+        {
+            resp = req;
+            return true;
+        }
+        if (type >= RPC_TYPES || !_handlers[type])
+            return false;
+        return _handlers[type](type, req, resp);
+    }
+
+    peer_ptr peer(uint32_t id)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _peers.find(id);
+        return it == _peers.end() ? peer_ptr() : it->second;
+    }
+
+public:
+    // config.node为本节点的节点号（集群内唯一），host和port为其他节点访问本节点RPC服务的地址，secret为集群共享的密钥
+    cluster(const cluster_config &config, executor *ex)
+        : _self(config.node), _host(config.host), _port(config.port), _secret(config.secret), _ex(ex), _calls(0), _failures(0)
+    {
+        _ring.add(_self);
+    }
+
+    ~cluster() { _server.stop(); }
+
+    // 注册请求的处理函数，在start之前调用
+    void on(rpc_type type, const handler &h) { _handlers[type] = h; }
+
+    // 注册成员变化的回调，在执行器上执行
+    void on_change(const std::function<void()> &cb) { _on_change = cb; }
+
+    // 启动RPC服务
+    bool start()
+    {
+        uint16_t port = _server.start(_host, _port, _secret, [this](uint8_t type, const std::string &req, std::string &resp) {
+            return dispatch(type, req, resp);
+        });
+        if (port == 0)
+            return false;
+        _port = port;
+        LOG(INFO, "节点%u的RPC服务端口: %u", _self, _port);
+        return true;
+    }
+
+    // 加入集群：peers为已知的节点（节点号，主机，端口），通知已经在运行的节点
+    // 对方回复它知道的成员，其中本节点还不知道的也要通知
+    void join(const std::vector<std::tuple<uint32_t, std::string, uint16_t>> &peers)
+    {
+        std::vector<std::tuple<uint32_t, std::string, uint16_t>> todo(peers);
+        std::set<uint32_t> joined;
+        std::string req;
+        rpc_writer(req).put<uint32_t>(_self).put<uint16_t>(_port).put_str(_host);
+        while (todo.empty() == false)
+        {
+            auto p = todo.back();
+            todo.pop_back();
+            uint32_t id = std::get<0>(p);
+            if (id == _self || joined.insert(id).second == false)
+                continue;
+            add_peer(id, std::get<1>(p), std::get<2>(p));
+            std::string resp;
+            if (call(id, RPC_JOIN, req, resp) == false)
+            {
+                // 尚未启动的节点不放在环上，它启动后会向本节点发送RPC_JOIN
+                LOG(INFO, "节点%u尚未启动", id);
+                remove_peer(id);
+                continue;
+            }
+            rpc_reader r(resp);
+            uint32_t n = r.get<uint32_t>();
+            for (uint32_t i = 0; i < n && r.good(); ++i)
+            {
+                uint32_t mid = r.get<uint32_t>();
+                uint16_t port = r.get<uint16_t>();
+                std::string host = r.get_str();
+                if (r.good())
+                    todo.emplace_back(mid, host, port);
+            }
+        }
+    }
+
+    // 主动离开集群：通知其他节点后把本节点从环上摘除，由成员变化的回调迁移本节点所有的房间和会话
+    void leave()
+    {
+        std::string req, resp;
+        rpc_writer(req).put<uint32_t>(_self);
+        for (uint32_t id : peers())
+            call(id, RPC_LEAVE, req, resp);
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ring.remove(_self);
+        }
+        if (_on_change)
+            _on_change();
+    }
+
+    uint32_t self() const { return _self; }
+    uint16_t port() const { return _port; }
+
+    // 键的所有者，已经离开集群（环为空）时返回本节点
+    uint32_t owner(uint64_t key)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _ring.empty() ? _self : _ring.owner(key);
+    }
+
+    bool is_local(uint64_t key) { return owner(key) == _self; }
+
+    // 环上的其他节点
+    std::vector<uint32_t> peers()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::vector<uint32_t> ids;
+        for (uint32_t id : _ring.nodes())
+        {
+            if (id != _self)
+                ids.push_back(id);
+        }
+        return ids;
+    }
+
+    // 同步调用，调用失败或对方处理失败都返回false，resp为对方的响应
+    bool call(uint32_t node, uint8_t type, const std::string &req, std::string &resp)
+    {
+        peer_ptr p = peer(node);
+        if (p.get() == nullptr)
+            return false;
+        _calls++;
+        std::string raw;
+        rpc_client &c = *p->clients[p->next++ % p->clients.size()];
+        if (c.call(type, req, raw) == false || raw.empty() || raw[0] == 0)
+        {
+            _failures++;
+            return false;
+        }
+        resp.assign(raw, 1, std::string::npos);
+        return true;
+    }
+
+    // 异步调用：在目标节点的mailbox中依次发出，不关心结果
+    void send(uint32_t node, uint8_t type, const std::string &req)
+    {
+        peer_ptr p = peer(node);
+        if (p.get() == nullptr)
+            return;
+        p->box.post([this, node, type, req]() {
+            std::string resp;
+            if (call(node, type, req, resp) == false)
+                LOG(ERROR, "发往节点%u的消息(类型%u)处理失败", node, type);
+        });
+    }
+
+    uint64_t calls() { return _calls; }
+    uint64_t failures() { return _failures; }
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+
+#include "log.hpp"
+#include "threadpool.hpp"
+
+/*
+* 密码哈希模块
+* 注册和登录时在服务器上计算密码的哈希，数据库只保存哈希值，明文密码不再发给数据库
+* 使用内存困难的scrypt（OpenSSL的EVP_PBE_scrypt），每个密码使用随机的盐
+*   保存格式 $scrypt$ln$r$p$盐(hex)$哈希(hex)，参数随哈希一起保存，调整代价后旧的哈希仍然可以验证
+* 旧版本由MySQL的password()生成的哈希（*开头的40位hex）也在服务器上验证，验证通过后由调用方换成新的哈希
+*
+* 哈希计算很耗时（默认参数约几十毫秒、16MB内存），在固定数量的线程中进行，不阻塞网络io线程；
+* 等待的任务数量有上限，登录请求过多时直接拒绝，避免排队的请求占用大量内存且等待时间无限增长
+*/
+
+#define CRED_SCRYPT_LOGN 14   // N = 2^14
+#define CRED_SCRYPT_R 8
+#define CRED_SCRYPT_P 1
+#define CRED_SALT_LEN 16
+#define CRED_HASH_LEN 32
+#define CRED_THREADS 2        // 计算哈希的线程数，同时也限制了哈希占用的内存
+#define CRED_MAX_PENDING 1024 // 排队等待的请求上限
+
+class credential
+{
+private:
+    static std::string to_hex(const unsigned char *data, size_t len, bool upper = false)
+    {
+        static const char *lower_digits = "0123456789abcdef", *upper_digits = "0123456789ABCDEF";
+        const char *digits = upper ? upper_digits : lower_digits;
+        std::string out;
+        for (size_t i = 0; i < len; ++i)
+        {
+            out += digits[data[i] >> 4];
+            out += digits[data[i] & 15];
+        }
+        return out;
+    }
+
+    static bool from_hex(const std::string &hex, unsigned char *data, size_t len)
+    {
+        if (hex.size() != len * 2)
+            return false;
+        for (size_t i = 0; i < len; ++i)
+        {
+            unsigned int v;
+            if (sscanf(hex.c_str() + i * 2, "%2x", &v) != 1)
+                return false;
+            data[i] = v;
+        }
+        return true;
+    }
+
+    static bool scrypt(const std::string &password, const unsigned char *salt, int logn, int r, int p, unsigned char *out)
+    {
+        uint64_t n = 1ULL << logn;
+        // 需要的内存约为 128*r*(n+p)，留出余量
+        uint64_t maxmem = 128ULL * r * (n + p) + (1 << 20);
+        return EVP_PBE_scrypt(password.data(), password.size(), salt, CRED_SALT_LEN, n, r, p, maxmem, out, CRED_HASH_LEN) == 1;
+    }
+
+public:
+    // 计算密码的哈希，logn为scrypt的代价参数
+    static bool hash(const std::string &password, std::string &out, int logn = CRED_SCRYPT_LOGN)
+    {
+        unsigned char salt[CRED_SALT_LEN], key[CRED_HASH_LEN];
+        if (RAND_bytes(salt, sizeof(salt)) != 1 || scrypt(password, salt, logn, CRED_SCRYPT_R, CRED_SCRYPT_P, key) == false)
+        {
+            LOG(ERROR, "计算密码哈希失败");
+            return false;
+        }
+        char head[64];
+        snprintf(head, sizeof(head), "$scrypt$%d$%d$%d$", logn, CRED_SCRYPT_R, CRED_SCRYPT_P);
+        out = head + to_hex(salt, sizeof(salt)) + "$" + to_hex(key, sizeof(key));
+        return true;
+    }
+
+    // MySQL password()的算法：*加上SHA1(SHA1(密码))的大写hex
+    static std::string legacy_hash(const std::string &password)
+    {
+        unsigned char once[SHA_DIGEST_LENGTH], twice[SHA_DIGEST_LENGTH];
+        SHA1((const unsigned char *)password.data(), password.size(), once);
+        SHA1(once, sizeof(once), twice);
+        return "*" + to_hex(twice, sizeof(twice), true);
+    }
+
+    static bool is_legacy(const std::string &stored) { return stored.size() == 41 && stored[0] == '*'; }
+
+    // 验证密码，stored为数据库中保存的哈希；upgrade表示验证通过但需要换成当前参数的哈希
+    static bool verify(const std::string &password, const std::string &stored, bool &upgrade)
+    {
+        upgrade = false;
+        if (is_legacy(stored))
+        {
+            std::string h = legacy_hash(password);
+            upgrade = true;
+            return CRYPTO_memcmp(h.data(), stored.data(), h.size()) == 0;
+        }
+        int logn, r, p, used = 0;
+        if (sscanf(stored.c_str(), "$scrypt$%d$%d$%d$%n", &logn, &r, &p, &used) != 3 || used == 0 ||
+            logn < 1 || logn > 24 || r < 1 || r > 32 || p < 1 || p > 16)
+            return false;
+        std::string rest = stored.substr(used);
+        size_t sep = rest.find('$');
+        unsigned char salt[CRED_SALT_LEN], expect[CRED_HASH_LEN], key[CRED_HASH_LEN];
+        if (sep == std::string::npos || from_hex(rest.substr(0, sep), salt, sizeof(salt)) == false ||
+            from_hex(rest.substr(sep + 1), expect, sizeof(expect)) == false)
+            return false;
+        if (scrypt(password, salt, logn, r, p, key) == false)
+            return false;
+        upgrade = logn != CRED_SCRYPT_LOGN || r != CRED_SCRYPT_R || p != CRED_SCRYPT_P;
+        return CRYPTO_memcmp(key, expect, sizeof(key)) == 0;
+    }
+};
+
+// 执行注册和登录的线程池，排队的任务数量有上限
+class credential_pool
+{
+private:
+    std::atomic<int> _pending;
+    int _max_pending;
+    thread_pool _pool;
+
+public:
+    credential_pool(int thread_num = CRED_THREADS, int max_pending = CRED_MAX_PENDING)
+        : _pending(0), _max_pending(max_pending), _pool(thread_num) {}
+
+    // 投递任务，排队的任务已满时返回false，调用方回复服务器繁忙
+    bool submit(const std::function<void()> &task)
+    {
+        if (++_pending > _max_pending)
+        {
+            --_pending;
+            return false;
+        }
+        _pool.push([this, task]() {
+            task();
+            --_pending;
+        });
+        return true;
+    }
+
+    int pending() { return _pending; }
+};
@@ -2,9 +2,16 @@
 
 #include <mutex>
 #include <cassert>
+#include <mysql/mysqld_error.h>
 
 #include "log.hpp"
 #include "util.hpp"
+#include "leaderboard.hpp"
+#include "rating.hpp"
+#include "credential.hpp"
+#include "namefilter.hpp"
+#include "nameindex.hpp"
+#include "dbpool.hpp"
 
 /*
 * 用户数据管理模块
@@ -15,6 +22,22 @@
 * 登录验证用户数据
 * 游戏对战结束更新用户数据
 * 查询用户数据
+* 
+* 关联排行榜后，启动时把所有用户的分数加载到排行榜中，新增用户和分数变化时同步更新排行榜
+* 
+* score列保存Glicko-2等级分，rd和volatility列保存分数偏差和波动率，
+* 对局结束时在一个事务中锁定并读取双方当前的分数，由等级分模块同时计算双方的新分数，一条语句写入；
+* 多个进程共用数据库时其他进程会修改分数，构造时指定shared：不缓存等级分，读取分数时不使用只反映本进程对局的排行榜，
+* 排行榜和前缀索引由调用方定时从数据库刷新
+*
+* 关联用户名过滤器后，启动时加载所有的用户名，注册前先检查，过滤器中没有的用户名不再查询是否被占用，
+* 过滤器命中时可能是误判，由数据库按用户名查询确认
+* 关联用户名前缀索引后，启动时加载所有的用户名和分数，新增用户和分数变化时同步更新，按前缀搜索玩家不再访问数据库
+*
+* password列保存服务器计算的密码哈希（见credential.hpp），哈希由调用方在工作线程中计算和验证
+*
+* 注册、登录和查询用户信息是网络io线程发起的请求，在数据库线程池（见dbpool.hpp）中各自的连接上执行，
+* 完成后回调经由set_post设置的投递函数回到io线程；启动时的加载和对局结束的等级分读写仍然使用共用的连接
 */
 
 class user_table
@@ -22,122 +45,124 @@ class user_table
 private:
     MYSQL *_mysql;     // mysql操作句柄
     std::mutex _mutex; // 互斥锁保护数据库的访问操作
-public:
-    user_table(const std::string &host,
-               const std::string &username,
-               const std::string &password,
-               const std::string &dbname,
-               uint16_t port = 3306)
-    {
-        _mysql = util_mysql::mysql_create(host, username, password, dbname, port);
-        assert(_mysql != nullptr);
-    }
-    
-    ~user_table()
+    leaderboard *_lb;  // 关联的排行榜，可以为空
+    name_filter *_nf;  // 关联的用户名过滤器，可以为空
+    name_index *_ni;   // 关联的用户名前缀索引，可以为空
+    rating_book _ratings; // 等级分的计算和缓存，同一玩家的对局结果在事务中依次写入
+    bool _shared;         // 多个进程共用数据库（多进程和集群模式）
+    db_pool<MYSQL> _pool; // 执行io线程发起的查询
+
+private:
+    // 新增用户，成功时返回自增id
+    static bool query_insert(MYSQL *mysql, const std::string &name, const std::string &hash, uint64_t &id)
     {
-        if (_mysql != nullptr)
+#define INSERT_USER "insert into user(username, password, score, total_count, win_count, rd, volatility) values('%s', '%s', %d, 0, 0, %f, %f);"
+        char sql[4096] = {0};
+        sprintf(sql, INSERT_USER, name.c_str(), hash.c_str(), (int)GLICKO_RATING, GLICKO_RD, GLICKO_VOL);
+        if (util_mysql::mysql_exec(mysql, sql) == false)
         {
-            util_mysql::mysql_destroy(_mysql);
-            _mysql = nullptr;
+            LOG(DEBUG, "insert user info failed!!\n");
+            return false;
         }
+        id = mysql_insert_id(mysql);
+        return true;
     }
-    
-    // 注册时新增用户
-    bool insert(Json::Value &user)
+
+    // 以用户名查询用户信息和保存的密码哈希
+    static bool query_login(MYSQL *mysql, const std::string &name, Json::Value &user, std::string &stored)
     {
-#define INSERT_USER "insert user values(null, '%s', password('%s'), 1000, 0, 0);"
-        // sprintf(void *buf, char *format, ...)
-        if (user["password"].isNull() || user["username"].isNull()) // 需要用户名以及用户密码
+#define LOGIN_USER "select id, score, total_count, win_count, password from user where username='%s';"
+        char sql[4096] = {0};
+        sprintf(sql, LOGIN_USER, name.c_str());
+        if (util_mysql::mysql_exec(mysql, sql) == false)
         {
-            LOG(DEBUG, "INPUT PASSWORD OR USERNAME");
+            LOG(DEBUG, "user login failed\n");
             return false;
         }
-        char sql[4096] = {0};
-        sprintf(sql, INSERT_USER, user["username"].asCString(), user["password"].asCString());
-        bool ret = util_mysql::mysql_exec(_mysql, sql);
-        if (ret == false)
+        // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
+        MYSQL_RES *res = mysql_store_result(mysql);
+        if (res == NULL)
         {
-            LOG(DEBUG, "insert user info failed!!\n");
+            LOG(DEBUG, "have no login user info!");
             return false;
         }
+        if (mysql_num_rows(res) != 1)
+        {
+            LOG(DEBUG, "the user information queried is not unique!");
+            mysql_free_result(res);
+            return false;
+        }
+        MYSQL_ROW row = mysql_fetch_row(res);
+        stored = row[4] == NULL ? "" : row[4];
+        user["id"] = (Json::UInt64)std::stoul(row[0]);
+        user["username"] = name;
+        user["score"] = (Json::UInt64)std::stol(row[1]);
+        user["total_count"] = std::stoi(row[2]);
+        user["win_count"] = std::stoi(row[3]);
+        mysql_free_result(res);
         return true;
     }
-    
-    // 登录验证，并返回详细的用户信息
-    bool login(Json::Value &user)
+
+    // 通过用户id查询用户信息
+    static bool query_by_id(MYSQL *mysql, uint64_t id, Json::Value &user)
     {
-        if (user["password"].isNull() || user["username"].isNull()) // 需要用户名以及密码
+#define USER_BY_ID "select username, score, total_count, win_count from user where id=%lu;"
+        char sql[4096] = {0};
+        sprintf(sql, USER_BY_ID, id);
+        if (util_mysql::mysql_exec(mysql, sql) == false)
         {
-            LOG(DEBUG, "INPUT PASSWORD OR");
+            LOG(DEBUG, "get user by id failed!!\n");
             return false;
         }
-        // 以用户名和密码共同作为查询过滤条件，查询到数据则表示用户名密码一致，没有信息则用户名密码错误
-#define LOGIN_USER "select id, score, total_count, win_count from user where username='%s' and password=password('%s');"
-        char sql[4096] = {0};
-        sprintf(sql, LOGIN_USER, user["username"].asCString(), user["password"].asCString());
-        MYSQL_RES *res = NULL;
+        // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
+        MYSQL_RES *res = mysql_store_result(mysql);
+        if (res == NULL)
         {
-            std::unique_lock<std::mutex> lock(_mutex); // 查询时需要加锁保护
-            bool ret = util_mysql::mysql_exec(_mysql, sql);
-            if (ret == false)
-            {
-                LOG(DEBUG, "user login failed\n");
-                return false;
-            }
-            // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-            res = mysql_store_result(_mysql);
-            if (res == NULL)
-            {
-                LOG(DEBUG, "have no login user info!");
-                return false;
-            }
+            LOG(DEBUG, "have no user info!!");
+            return false;
         }
-        int row_num = mysql_num_rows(res);
-        if (row_num != 1)
+        if (mysql_num_rows(res) != 1)
         {
-            LOG(DEBUG, "the user information queried is not unique!");
+            LOG(DEBUG, "the user information queried is not unique!!");
+            mysql_free_result(res);
             return false;
         }
         MYSQL_ROW row = mysql_fetch_row(res);
-        user["id"] = (Json::UInt64)std::stol(row[0]);
+        user["id"] = (Json::UInt64)id;
+        user["username"] = row[0];
         user["score"] = (Json::UInt64)std::stol(row[1]);
         user["total_count"] = std::stoi(row[2]);
         user["win_count"] = std::stoi(row[3]);
         mysql_free_result(res);
         return true;
     }
-    
-    // 通过用户名获取用户信息
-    bool select_by_name(const std::string &name, Json::Value &user)
+
+    // 通过用户名查询用户信息
+    static bool query_by_name(MYSQL *mysql, const std::string &name, Json::Value &user)
     {
 #define USER_BY_NAME "select id, score, total_count, win_count from user where username='%s';"
         char sql[4096] = {0};
         sprintf(sql, USER_BY_NAME, name.c_str());
-        MYSQL_RES *res = NULL;
+        if (util_mysql::mysql_exec(mysql, sql) == false)
         {
-            std::unique_lock<std::mutex> lock(_mutex); // 查询时需要加锁保护
-            bool ret = util_mysql::mysql_exec(_mysql, sql);
-            if (ret == false)
-            {
-                LOG(DEBUG, "get user by name failed!!\n");
-                return false;
-            }
-            // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-            res = mysql_store_result(_mysql);
-            if (res == NULL)
-            {
-                LOG(DEBUG, "have no user info!!");
-                return false;
-            }
+            LOG(DEBUG, "get user by name failed!!\n");
+            return false;
         }
-        int row_num = mysql_num_rows(res);
-        if (row_num != 1)
+        // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
+        MYSQL_RES *res = mysql_store_result(mysql);
+        if (res == NULL)
+        {
+            LOG(DEBUG, "have no user info!!");
+            return false;
+        }
+        if (mysql_num_rows(res) != 1)
         {
             LOG(DEBUG, "the user information queried is not unique!!");
+            mysql_free_result(res);
             return false;
         }
         MYSQL_ROW row = mysql_fetch_row(res);
-        user["id"] = (Json::UInt64)std::stol(row[0]);
+        user["id"] = (Json::UInt64)std::stoul(row[0]);
         user["username"] = name;
         user["score"] = (Json::UInt64)std::stol(row[1]);
         user["total_count"] = std::stoi(row[2]);
@@ -145,85 +170,453 @@ public:
         mysql_free_result(res);
         return true;
     }
+
+    // 新用户加入排行榜、前缀索引和用户名过滤器
+    void user_added(uint64_t id, const std::string &name)
+    {
+        if (_lb != nullptr)
+            _lb->update(id, name, (int64_t)GLICKO_RATING);
+        if (_ni != nullptr)
+            _ni->insert(name, id, (int64_t)GLICKO_RATING);
+        if (_nf != nullptr)
+        {
+            _nf->add(name);
+            if (_nf->size() > _nf->capacity()) // 超过容量后误判率上升，按新的用户数重建
+                load_name_filter(_nf);
+        }
+    }
+
+public:
+    user_table(const std::string &host,
+               const std::string &username,
+               const std::string &password,
+               const std::string &dbname,
+               uint16_t port = 3306,
+               bool shared = false)
+        : _mysql(util_mysql::mysql_create(host, username, password, dbname, port)), _lb(nullptr), _nf(nullptr), _ni(nullptr),
+          _ratings(std::bind(&user_table::load_rating, this, std::placeholders::_1, std::placeholders::_2),
+                   std::bind(&user_table::update_ratings, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                   shared ? 0 : RATING_CACHE_SIZE),
+          _shared(shared),
+          _pool([host, username, password, dbname, port]() { return util_mysql::mysql_create(host, username, password, dbname, port); },
+                [](MYSQL *mysql) {
+                    util_mysql::mysql_destroy(mysql);
+                    mysql_thread_end();
+                })
+    {
+        // 共用的连接先于数据库线程的连接建立，由它完成客户端库的初始化
+        assert(_mysql != nullptr);
+    }
     
-    // 通过用户名获取用户信息
-    bool select_by_id(uint64_t id, Json::Value &user)
+    ~user_table()
     {
-#define USER_BY_ID "select username, score, total_count, win_count from user where id=%d;"
-        char sql[4096] = {0};
-        sprintf(sql, USER_BY_ID, id);
-        MYSQL_RES *res = NULL;
+        if (_mysql != nullptr)
         {
-            std::unique_lock<std::mutex> lock(_mutex); // 查询时需要加锁保护
-            bool ret = util_mysql::mysql_exec(_mysql, sql);
-            if (ret == false)
-            {
-                LOG(DEBUG, "get user by id failed!!\n");
-                return false;
-            }
-            // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-            res = mysql_store_result(_mysql);
-            if (res == NULL)
-            {
-                LOG(DEBUG, "have no user info!!");
-                return false;
-            }
+            util_mysql::mysql_destroy(_mysql);
+            _mysql = nullptr;
         }
-        int row_num = mysql_num_rows(res);
-        if (row_num != 1)
+    }
+    
+    // 设置查询完成后的投递函数（网络io线程的io_service::post）
+    void set_post(const db_pool<MYSQL>::post_t &post) { _pool.set_post(post); }
+
+    // 数据库线程中是否有可用的连接，没有时所有的异步查询都被拒绝
+    bool db_alive() { return _pool.alive() > 0; }
+
+    // 注册时新增用户，hash为调用方计算好的密码哈希，完成后回调done(是否成功)，排队的查询已满时返回false
+    bool async_insert(const std::string &name, const std::string &hash, const std::function<void(bool)> &done)
+    {
+        return _pool.submit([this, name, hash, done](MYSQL *mysql) {
+            uint64_t id = 0;
+            bool ret = query_insert(mysql, name, hash, id);
+            if (ret)
+                user_added(id, name);
+            // 用户名冲突：其他进程注册的或者过滤器重建之前的用户名，补充到过滤器中
+            else if (_nf != nullptr && mysql_errno(mysql) == ER_DUP_ENTRY)
+                _nf->add(name);
+            _pool.complete([done, ret]() { done(ret); });
+        });
+    }
+
+    // 用户名是否已经被占用，完成后回调done(是否被占用)，排队的查询已满时返回false
+    // 过滤器中没有的用户名一定没有被占用，直接回调，不访问数据库；
+    // 过滤器命中只说明可能被占用（有少量误判），在数据库线程中按用户名查询确认
+    bool async_name_taken(const std::string &name, const std::function<void(bool)> &done)
+    {
+        if (_nf == nullptr || _nf->contains(name) == false)
         {
-            LOG(DEBUG, "the user information queried is not unique!!");
+            done(false);
+            return true;
+        }
+        return _pool.submit([this, name, done](MYSQL *mysql) {
+            Json::Value user;
+            bool taken = query_by_name(mysql, name, user);
+            _pool.complete([done, taken]() { done(taken); });
+        });
+    }
+
+    // 关联用户名过滤器，并把数据库中所有的用户名加载进去
+    bool load_name_filter(name_filter *nf)
+    {
+#define USER_COUNT "select count(*) from user;"
+#define ALL_NAMES "select username from user;"
+        std::unique_lock<std::mutex> lock(_mutex);
+        _nf = nf;
+        if (util_mysql::mysql_exec(_mysql, USER_COUNT) == false)
+        {
+            LOG(DEBUG, "count users failed!!\n");
             return false;
         }
+        MYSQL_RES *res = mysql_store_result(_mysql);
+        if (res == NULL)
+            return false;
         MYSQL_ROW row = mysql_fetch_row(res);
-        user["id"] = (Json::UInt64)id;
-        user["username"] = row[0];
-        user["score"] = (Json::UInt64)std::stol(row[1]);
-        user["total_count"] = std::stoi(row[2]);
-        user["win_count"] = std::stoi(row[3]);
+        uint64_t count = row == NULL || row[0] == NULL ? 0 : std::stoul(row[0]);
         mysql_free_result(res);
+        nf->reset(count * 2);
+        if (util_mysql::mysql_exec(_mysql, ALL_NAMES) == false)
+        {
+            LOG(DEBUG, "load user names failed!!\n");
+            return false;
+        }
+        // 逐行读取，避免一次把所有用户名都缓存在客户端
+        res = mysql_use_result(_mysql);
+        if (res == NULL)
+            return false;
+        while ((row = mysql_fetch_row(res)) != NULL)
+        {
+            if (row[0] != NULL)
+                nf->add(row[0]);
+        }
+        mysql_free_result(res);
+        LOG(DEBUG, "用户名过滤器加载完毕，用户数量：%lu，占用内存：%lu字节", nf->size(), nf->memory());
+        return true;
+    }
+
+    // 关联排行榜，并把数据库中所有用户的分数加载进去
+    bool load_leaderboard(leaderboard *lb)
+    {
+#define ALL_SCORES "select id, username, score from user;"
+        std::unique_lock<std::mutex> lock(_mutex);
+        _lb = lb;
+        bool ret = util_mysql::mysql_exec(_mysql, ALL_SCORES);
+        if (ret == false)
+        {
+            LOG(DEBUG, "load user scores failed!!\n");
+            return false;
+        }
+        // 逐行读取，避免一次把所有用户数据都缓存在客户端
+        MYSQL_RES *res = mysql_use_result(_mysql);
+        if (res == NULL)
+        {
+            LOG(DEBUG, "have no user scores!!");
+            return false;
+        }
+        std::vector<lb_entry> entries;
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res)) != NULL)
+        {
+            entries.push_back(lb_entry{0, std::stoul(row[0]), row[2] == NULL ? 0 : std::stol(row[2]), row[1]});
+        }
+        mysql_free_result(res);
+        lb->load(entries);
+        LOG(DEBUG, "排行榜加载完毕，用户数量：%lu", lb->size());
         return true;
     }
     
-    // 胜利时天梯分数增加30分，战斗场次增加1，胜利场次增加1
-    bool win(uint64_t id)
+    // 关联用户名前缀索引，并把数据库中所有的用户名和分数加载进去
+    bool load_name_index(name_index *ni)
     {
-#define USER_WIN "update user set score=score+500, total_count=total_count+1, win_count=win_count+1 where id=%d;"
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ni = ni;
+        if (util_mysql::mysql_exec(_mysql, ALL_SCORES) == false)
+        {
+            LOG(DEBUG, "load user names failed!!\n");
+            return false;
+        }
+        MYSQL_RES *res = mysql_use_result(_mysql);
+        if (res == NULL)
+            return false;
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res)) != NULL)
+        {
+            if (row[1] != NULL)
+                ni->insert(row[1], std::stoul(row[0]), row[2] == NULL ? 0 : std::stol(row[2]));
+        }
+        mysql_free_result(res);
+        LOG(DEBUG, "用户名索引加载完毕，用户数量：%lu，占用内存：%lu字节", ni->size(), ni->memory());
+        return true;
+    }
+
+    // 登录：以用户名取出用户信息和保存的密码哈希，完成后回调done(是否找到, 用户信息, 密码哈希)
+    // 密码由调用方在本地验证，明文密码不发给数据库；排队的查询已满时返回false
+    bool async_login(const std::string &name, const std::function<void(bool, Json::Value &, const std::string &)> &done)
+    {
+        return _pool.submit([this, name, done](MYSQL *mysql) {
+            Json::Value user;
+            std::string stored;
+            bool ret = query_login(mysql, name, user, stored);
+            _pool.complete([done, ret, user, stored]() mutable { done(ret, user, stored); });
+        });
+    }
+
+    // 更新用户的密码哈希，不等待结果
+    bool async_update_password(uint64_t id, const std::string &hash)
+    {
+#define UPDATE_PASSWORD "update user set password='%s' where id=%lu;"
         char sql[4096] = {0};
-        sprintf(sql, USER_WIN, id);
+        sprintf(sql, UPDATE_PASSWORD, hash.c_str(), id);
+        std::string stmt = sql;
+        return _pool.submit([stmt](MYSQL *mysql) {
+            if (util_mysql::mysql_exec(mysql, stmt) == false)
+                LOG(DEBUG, "update password failed!!\n");
+        });
+    }
+    
+    // 通过用户名获取用户信息
+    bool select_by_name(const std::string &name, Json::Value &user)
+    {
+        std::unique_lock<std::mutex> lock(_mutex); // 查询时需要加锁保护
+        return query_by_name(_mysql, name, user);
+    }
+    
+    // 在数据库线程中重新读取所有用户的分数，更新排行榜和前缀索引中有变化的用户（包括其他进程新增的用户）
+    // 多个进程共用数据库时由调用方定时调用，排队的查询已满时返回false
+    bool async_refresh_leaderboard()
+    {
+        if (_lb == nullptr)
+            return true;
+        return _pool.submit([this](MYSQL *mysql) {
+            if (util_mysql::mysql_exec(mysql, ALL_SCORES) == false)
+                return;
+            MYSQL_RES *res = mysql_use_result(mysql);
+            if (res == NULL)
+                return;
+            size_t changed = 0;
+            MYSQL_ROW row;
+            while ((row = mysql_fetch_row(res)) != NULL)
+            {
+                if (row[1] == NULL)
+                    continue;
+                uint64_t uid = std::stoul(row[0]);
+                int64_t score = row[2] == NULL ? 0 : std::stol(row[2]);
+                if (_lb->update(uid, row[1], score) == false)
+                    continue;
+                changed++;
+                if (_ni != nullptr)
+                    _ni->insert(row[1], uid, score);
+            }
+            mysql_free_result(res);
+            if (changed != 0)
+                LOG(DEBUG, "排行榜刷新完毕，%lu个用户的分数有变化", changed);
+        });
+    }
+
+    // 通过用户id获取用户信息，完成后回调done(是否找到, 用户信息)，排队的查询已满时返回false
+    bool async_select_by_id(uint64_t id, const std::function<void(bool, Json::Value &)> &done)
+    {
+        return _pool.submit([this, id, done](MYSQL *mysql) {
+            Json::Value user;
+            bool ret = query_by_id(mysql, id, user);
+            _pool.complete([done, ret, user]() mutable { done(ret, user); });
+        });
+    }
+    
+    // 玩家当前的分数，匹配时按分数选择队列；先从排行榜（内存中）读取，不在排行榜中时读取等级分
+    // 多个进程共用数据库时排行榜可能落后于其他进程的对局结果，直接读取等级分（不缓存，即数据库中的分数）
+    bool get_score(uint64_t uid, int &score)
+    {
+        lb_entry entry;
+        if (_lb != nullptr && _shared == false && _lb->rank(uid, entry))
+        {
+            score = entry.score;
+            return true;
+        }
+        glicko_rating rating;
+        if (get_rating(uid, rating) == false)
+            return false;
+        score = llround(rating.rating);
+        return true;
+    }
+
+    // 获取玩家当前的等级分
+    bool get_rating(uint64_t uid, glicko_rating &rating)
+    {
+        return _ratings.get(uid, rating);
+    }
+
+    // 对局结束，同时计算并更新双方的等级分、战斗场次和胜利场次
+    bool game_over(uint64_t winner_id, uint64_t loser_id)
+    {
+        rating_change changes[2];
+        if (_ratings.game_over(winner_id, loser_id, changes) == false)
+        {
+            LOG(DEBUG, "update game result failed!!\n");
+            return false;
+        }
+        sync_leaderboard(changes, 2);
+        return true;
+    }
+
+    // 与固定分数的对手（电脑玩家）对局结束，只更新玩家一方
+    bool game_over(uint64_t uid, bool win, const glicko_rating &opponent)
+    {
+        rating_change change;
+        if (_ratings.game_over(uid, win, opponent, change) == false)
+        {
+            LOG(DEBUG, "update game result failed!!\n");
+            return false;
+        }
+        sync_leaderboard(&change, 1);
+        return true;
+    }
+
+private:
+    void sync_leaderboard(const rating_change *changes, int n)
+    {
+        if (_lb == nullptr)
+            return;
+        for (int i = 0; i < n; ++i)
+        {
+            int64_t score = llround(changes[i].rating.rating);
+            _lb->update(changes[i].uid, score);
+            // 前缀索引按用户名更新，用户名从排行榜中取得
+            lb_entry entry;
+            if (_ni != nullptr && _lb->rank(changes[i].uid, entry))
+                _ni->update(entry.name, score);
+        }
+    }
+
+    // 等级分缓存未命中时从数据库读取
+    bool load_rating(uint64_t id, glicko_rating &rating)
+    {
+#define USER_RATING "select score, rd, volatility from user where id=%lu;"
+        char sql[4096] = {0};
+        sprintf(sql, USER_RATING, id);
+        std::unique_lock<std::mutex> lock(_mutex);
         bool ret = util_mysql::mysql_exec(_mysql, sql);
         if (ret == false)
         {
-            LOG(DEBUG, "update win user info failed!!\n");
+            LOG(DEBUG, "get user rating failed!!\n");
+            return false;
+        }
+        MYSQL_RES *res = mysql_store_result(_mysql);
+        if (res == NULL)
+        {
+            LOG(DEBUG, "have no user rating!!");
+            return false;
+        }
+        MYSQL_ROW row = mysql_fetch_row(res);
+        if (mysql_num_rows(res) != 1 || row == NULL)
+        {
+            LOG(DEBUG, "the user rating queried is not unique!!");
+            mysql_free_result(res);
             return false;
         }
+        rating.rating = row[0] == NULL ? GLICKO_RATING : std::stod(row[0]);
+        rating.rd = row[1] == NULL ? GLICKO_RD : std::stod(row[1]);
+        rating.vol = row[2] == NULL ? GLICKO_VOL : std::stod(row[2]);
+        mysql_free_result(res);
         return true;
     }
 
-    // 失败时天梯分数减少30，战斗场次增加1，其他不变
-    bool lose(uint64_t id)
+    // 一局对局中所有玩家的结果在一个事务中完成：select ... for update锁定并读取当前的分数，
+    // 计算出新分数后用一条update语句写入，其他进程对同一玩家的更新在行锁上等待，读到的总是提交后的分数
+    bool update_ratings(rating_change *changes, int n, const rating_book::apply &fn)
     {
-#define USER_LOSE "update user set score=score-500, total_count=total_count+1 where id=%d;"
-#define TO_ZERO "update user set score=0, total_count=total_count+1 where id=%d;"
-        char sql[4096] = {0};
+        std::string ids;
+        char buf[256];
+        for (int i = 0; i < n; ++i)
+        {
+            sprintf(buf, "%s%lu", i == 0 ? "" : ", ", changes[i].uid);
+            ids += buf;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (util_mysql::mysql_exec(_mysql, "start transaction;") == false)
+        {
+            LOG(DEBUG, "start rating transaction failed!!\n");
+            return false;
+        }
+        bool ret = lock_ratings(changes, n, ids);
+        if (ret)
+        {
+            fn(changes, n);
+            ret = write_ratings(changes, n, ids);
+        }
+        if (ret == false || util_mysql::mysql_exec(_mysql, "commit;") == false)
+        {
+            util_mysql::mysql_exec(_mysql, "rollback;");
+            return false;
+        }
+        return true;
+    }
 
-        // 判断是否会扣减分数至负数
-        Json::Value user;
-        select_by_id(id, user);
-        if(user["score"].asUInt64() > 500)
+    // 事务中锁定并读取玩家当前的分数，调用时持有_mutex
+    bool lock_ratings(rating_change *changes, int n, const std::string &ids)
+    {
+        std::string sql = "select id, score, rd, volatility from user where id in (" + ids + ") for update;";
+        if (util_mysql::mysql_exec(_mysql, sql) == false)
         {
-            sprintf(sql, USER_LOSE, id);
+            LOG(DEBUG, "lock user rating failed!!\n");
+            return false;
         }
-        else
+        MYSQL_RES *res = mysql_store_result(_mysql);
+        if (res == NULL)
         {
-            LOG(ERROR, "分数被降至最低分");
-            sprintf(sql, TO_ZERO, id);
+            LOG(DEBUG, "have no user rating!!");
+            return false;
         }
+        int found = 0;
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res)) != NULL)
+        {
+            uint64_t id = std::stoul(row[0]);
+            for (int i = 0; i < n; ++i)
+            {
+                if (changes[i].uid != id)
+                    continue;
+                changes[i].rating.rating = row[1] == NULL ? GLICKO_RATING : std::stod(row[1]);
+                changes[i].rating.rd = row[2] == NULL ? GLICKO_RD : std::stod(row[2]);
+                changes[i].rating.vol = row[3] == NULL ? GLICKO_VOL : std::stod(row[3]);
+                found++;
+            }
+        }
+        mysql_free_result(res);
+        if (found != n)
+        {
+            LOG(ERROR, "lock user rating found %d users, expect %d", found, n);
+            return false;
+        }
+        return true;
+    }
 
+    // 用一条update语句写入所有玩家的新分数，调用时持有_mutex
+    bool write_ratings(const rating_change *changes, int n, const std::string &ids)
+    {
+        std::string score = "score=case id", rd = "rd=case id", vol = "volatility=case id", win = "win_count=case id";
+        char buf[256];
+        for (int i = 0; i < n; ++i)
+        {
+            sprintf(buf, " when %lu then %lld", changes[i].uid, llround(changes[i].rating.rating));
+            score += buf;
+            sprintf(buf, " when %lu then %.6f", changes[i].uid, changes[i].rating.rd);
+            rd += buf;
+            sprintf(buf, " when %lu then %.8f", changes[i].uid, changes[i].rating.vol);
+            vol += buf;
+            sprintf(buf, " when %lu then win_count+%d", changes[i].uid, changes[i].win ? 1 : 0);
+            win += buf;
+        }
+        std::string sql = "update user set " + score + " end, " + rd + " end, " + vol + " end, " + win +
+                          " end, total_count=total_count+1 where id in (" + ids + ");";
         bool ret = util_mysql::mysql_exec(_mysql, sql);
         if (ret == false)
         {
-            LOG(DEBUG, "update lose user info failed!!\n");
+            LOG(DEBUG, "update user rating failed!!\n");
+            return false;
+        }
+        if (mysql_affected_rows(_mysql) != (uint64_t)n)
+        {
+            LOG(ERROR, "update user rating affected %lu rows, expect %d", (uint64_t)mysql_affected_rows(_mysql), n);
             return false;
         }
         return true;
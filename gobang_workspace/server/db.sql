@@ -4,8 +4,12 @@ use CRgobang;
 create table if not exists user(
     id int primary key auto_increment,
     username varchar(32) unique key not null,
-    password varchar(128) not null,
-    score int,
+    password varchar(128) not null,           -- 服务器计算的scrypt哈希，旧数据为password()的哈希，登录时升级
+    score int,                                -- Glicko-2等级分
     total_count int,
-    win_count int
-);
\ No newline at end of file
+    win_count int,
+    rd double not null default 350,           -- 等级分偏差
+    volatility double not null default 0.06   -- 等级分波动率
+);
+-- 已有的数据库升级：
+-- alter table user add column rd double not null default 350, add column volatility double not null default 0.06;
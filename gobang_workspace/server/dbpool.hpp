@@ -0,0 +1,129 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "log.hpp"
+#include "threadpool.hpp"
+
+/*
+* 数据库线程池模块
+* 固定数量的数据库线程，每个线程在启动时建立一条自己的连接，之后只在这条连接上执行查询，线程之间不共用连接也不加锁
+*
+* 网络io线程不直接访问数据库：查询作为任务投递到队列，由空闲的数据库线程执行，
+* 执行完毕后把继续处理的回调交给投递函数（网络io线程的io_service::post），后续的处理仍然在io线程中进行
+* 一条慢查询只占用一个数据库线程，websocket的收发和其他连接上的查询不受影响
+*
+* 线程和队列由线程池模块管理，连接在工作线程启动时建立、退出前关闭，保存在线程局部变量中
+* 排队的任务数量有上限，超过时拒绝，调用方回复服务器繁忙
+* Conn为连接类型，由connect在数据库线程中创建、close在线程退出前关闭；连接失败的线程直接退出，任务由其他线程执行
+* 构造时等待所有线程完成连接，没有任何线程连接成功（数据库不可用）时拒绝所有查询，调用方立即回复错误，请求不会一直等待
+*/
+
+#define DB_THREADS 4          // 数据库线程数，也是同时执行的查询数
+#define DB_MAX_PENDING 1024   // 排队等待的查询上限
+
+template <class Conn>
+class db_pool
+{
+public:
+    typedef std::function<void(Conn *)> task_t;
+    typedef std::function<void(const std::function<void()> &)> post_t;
+
+private:
+    std::function<Conn *()> _connect;
+    std::function<void(Conn *)> _close;
+    post_t _post; // 把完成回调交给调用方的事件循环，为空时在数据库线程中直接执行
+    std::atomic<int> _pending;
+    std::atomic<int> _alive; // 已经建立连接的线程数
+    int _max_pending;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _started; // 已经尝试过连接的线程数
+    std::unique_ptr<thread_pool> _threads;
+
+private:
+    // 当前数据库线程的连接
+    static Conn *&local_conn()
+    {
+        static thread_local Conn *conn = nullptr;
+        return conn;
+    }
+
+    bool worker_init()
+    {
+        Conn *conn = _connect();
+        local_conn() = conn;
+        if (conn == nullptr)
+            LOG(ERROR, "数据库线程建立连接失败，线程退出");
+        else
+            ++_alive;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            ++_started;
+        }
+        _cond.notify_all();
+        return conn != nullptr;
+    }
+
+    void worker_fini()
+    {
+        --_alive;
+        _close(local_conn());
+        local_conn() = nullptr;
+    }
+
+public:
+    db_pool(const std::function<Conn *()> &connect, const std::function<void(Conn *)> &close, int thread_num = DB_THREADS,
+            int max_pending = DB_MAX_PENDING)
+        : _connect(connect), _close(close), _pending(0), _alive(0), _max_pending(max_pending), _started(0)
+    {
+        _threads.reset(new thread_pool(thread_num, std::bind(&db_pool::worker_init, this), std::bind(&db_pool::worker_fini, this)));
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_started < thread_num)
+            _cond.wait(lock);
+        if (_alive == 0)
+            LOG(ERROR, "数据库线程全部连接失败，查询将被拒绝");
+    }
+
+    // 先执行完排队的查询，再由各个线程关闭自己的连接
+    ~db_pool() { _threads.reset(); }
+
+    // 设置完成回调的投递函数，在投递第一个查询之前调用
+    void set_post(const post_t &post) { _post = post; }
+
+    // 投递一个查询，排队的查询已满或者没有可用的连接时返回false
+    bool submit(const task_t &task)
+    {
+        if (_alive == 0)
+            return false;
+        if (++_pending > _max_pending)
+        {
+            --_pending;
+            return false;
+        }
+        _threads->push([this, task]() {
+            task(local_conn());
+            --_pending;
+        });
+        return true;
+    }
+
+    // 在数据库线程中调用：把查询之后的处理交给调用方的事件循环
+    void complete(const std::function<void()> &done)
+    {
+        if (_post)
+            _post(done);
+        else
+            done();
+    }
+
+    // 排队和正在执行的查询数
+    int pending() { return _pending; }
+
+    // 已经建立连接的线程数
+    int alive() { return _alive; }
+};
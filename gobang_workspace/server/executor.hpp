@@ -0,0 +1,231 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "log.hpp"
+
+/*
+* 任务执行模块（work-stealing）
+* 每个工作线程有自己的双端任务队列：工作线程投递的任务放入自己队列的尾部，
+* 外部线程（网络io线程、时间轮、人机搜索线程、日志线程）投递的任务轮流放入各个工作线程的队列；
+* 工作线程从自己队列的头部按先后顺序取任务，高负载时先到的消息不会被饿死；
+* 自己的队列为空时从其他线程队列的尾部窃取任务，所有队列都为空时休眠
+*
+* actor（mailbox）
+* 房间和匹配队列各有一个消息队列，消息投递到mailbox，由mailbox作为一个任务调度到执行器上；
+* 同一时刻最多只有一个工作线程在处理同一个mailbox的消息，actor内部的状态不需要加锁
+*/
+
+#define EXECUTOR_THREADS 0 // 工作线程数量，0表示与cpu核数相同
+#define MAILBOX_BATCH 64   // mailbox每次被调度最多处理的消息数，处理不完重新排队，不长期占用工作线程
+
+class executor
+{
+private:
+    struct worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread th;
+    };
+
+    std::vector<std::unique_ptr<worker>> _workers;
+    // 所有队列中等待执行的任务数量
+    std::atomic<size_t> _pending;
+    // 正在休眠的工作线程数量，没有休眠的线程时投递任务不需要唤醒
+    std::atomic<int> _sleepers;
+    // 外部线程投递任务时轮流选择的队列
+    std::atomic<size_t> _next;
+    // 窃取到的任务数量
+    std::atomic<uint64_t> _steals;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop;
+
+private:
+    // 当前线程所属的执行器和队列下标，用于判断是否由工作线程投递
+    static executor *&current()
+    {
+        static thread_local executor *ex = nullptr;
+        return ex;
+    }
+    static size_t &current_index()
+    {
+        static thread_local size_t idx = 0;
+        return idx;
+    }
+
+    bool pop_local(size_t i, std::function<void()> &task)
+    {
+        worker &w = *_workers[i];
+        std::unique_lock<std::mutex> lock(w.mutex);
+        if (w.tasks.empty())
+            return false;
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        return true;
+    }
+
+    // 从其他工作线程队列的尾部窃取一个任务
+    bool steal(size_t i, std::function<void()> &task)
+    {
+        for (size_t k = 1; k < _workers.size(); ++k)
+        {
+            worker &w = *_workers[(i + k) % _workers.size()];
+            std::unique_lock<std::mutex> lock(w.mutex);
+            if (w.tasks.empty())
+                continue;
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            _steals++;
+            return true;
+        }
+        return false;
+    }
+
+    void worker_entry(size_t i)
+    {
+        current() = this;
+        current_index() = i;
+        std::function<void()> task;
+        while (1)
+        {
+            if (pop_local(i, task) || steal(i, task))
+            {
+                _pending--;
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sleepers++;
+            while (_pending == 0 && _stop == false)
+                _cond.wait(lock);
+            _sleepers--;
+            // 停止且任务已经处理完毕，则退出线程
+            if (_stop && _pending == 0)
+                return;
+        }
+    }
+
+public:
+    executor(int thread_num = EXECUTOR_THREADS) : _pending(0), _sleepers(0), _next(0), _steals(0), _stop(false)
+    {
+        if (thread_num <= 0)
+            thread_num = std::thread::hardware_concurrency();
+        if (thread_num <= 0)
+            thread_num = 1;
+        for (int i = 0; i < thread_num; ++i)
+            _workers.emplace_back(new worker);
+        for (int i = 0; i < thread_num; ++i)
+            _workers[i]->th = std::thread(&executor::worker_entry, this, i);
+        LOG(DEBUG, "任务执行模块初始化完毕，线程数量：%d", thread_num);
+    }
+
+    ~executor()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_all();
+        for (auto &w : _workers)
+            w->th.join();
+    }
+
+    // 获取工作线程数量
+    int size() { return _workers.size(); }
+
+    // 获取等待执行的任务数量
+    size_t pending() { return _pending; }
+
+    // 获取窃取到的任务数量
+    uint64_t steals() { return _steals; }
+
+    // 投递任务，有线程休眠时唤醒一个
+    void post(std::function<void()> task)
+    {
+        size_t i = current() == this ? current_index() : _next++ % _workers.size();
+        // 先计数再入队，休眠的线程被唤醒后最多空转到任务入队
+        _pending++;
+        {
+            std::unique_lock<std::mutex> lock(_workers[i]->mutex);
+            _workers[i]->tasks.push_back(std::move(task));
+        }
+        if (_sleepers > 0)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.notify_one();
+        }
+    }
+};
+
+class mailbox
+{
+private:
+    struct state
+    {
+        executor *ex;
+        std::mutex mutex; // 只保护消息队列，处理消息时不持有
+        std::deque<std::function<void()>> msgs;
+        bool scheduled; // 是否已经在执行器中排队或正在处理
+    };
+    std::shared_ptr<state> _st;
+
+private:
+    // 依次处理消息，处理完一批仍有消息时重新排到执行器的队列中
+    static void drain(const std::shared_ptr<state> &st)
+    {
+        for (int i = 0; i < MAILBOX_BATCH; ++i)
+        {
+            std::function<void()> msg;
+            {
+                std::unique_lock<std::mutex> lock(st->mutex);
+                if (st->msgs.empty())
+                {
+                    st->scheduled = false;
+                    return;
+                }
+                msg = std::move(st->msgs.front());
+                st->msgs.pop_front();
+            }
+            msg();
+        }
+        st->ex->post([st]() { drain(st); });
+    }
+
+public:
+    mailbox(executor *ex) : _st(std::make_shared<state>())
+    {
+        _st->ex = ex;
+        _st->scheduled = false;
+    }
+
+    // 投递消息，mailbox空闲时调度到执行器上
+    void post(std::function<void()> msg)
+    {
+        std::shared_ptr<state> st = _st;
+        {
+            std::unique_lock<std::mutex> lock(st->mutex);
+            st->msgs.push_back(std::move(msg));
+            if (st->scheduled)
+                return;
+            st->scheduled = true;
+        }
+        st->ex->post([st]() { drain(st); });
+    }
+
+    // 获取等待处理的消息数量
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lock(_st->mutex);
+        return _st->msgs.size();
+    }
+};
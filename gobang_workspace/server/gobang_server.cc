@@ -1,11 +1,75 @@
 #include "server.hpp"
 
 
-int main()
+#define LISTEN_PORT 8080
+
+// ./gobang [worker数量]
+// worker数量大于1时以多进程模式运行：各个worker共用LISTEN_PORT，房间长连接使用LISTEN_PORT+1+worker编号
+// ./gobang cluster 节点号 websocket端口 RPC主机:RPC端口 [节点号@主机:RPC端口 ...]
+// 以集群模式运行：房间和会话按一致性哈希分布在各个节点上，玩家可以连接任意节点
+// RPC主机是其他节点访问本节点的地址，RPC服务只监听这个地址；集群共享的密钥由环境变量GOBANG_CLUSTER_SECRET给出
+static int run_cluster(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        std::cout << "usage: " << argv[0] << " cluster node ws_port rpc_host:rpc_port [node@host:rpc_port ...]" << std::endl;
+        return 1;
+    }
+    const char *secret = getenv("GOBANG_CLUSTER_SECRET");
+    if (secret == nullptr || *secret == '\0')
+    {
+        std::cout << "GOBANG_CLUSTER_SECRET is not set" << std::endl;
+        return 1;
+    }
+    cluster_config cc;
+    cc.node = atoi(argv[2]);
+    std::string self = argv[4];
+    size_t colon = self.rfind(':');
+    if (colon == std::string::npos || colon == 0)
+    {
+        std::cout << "bad rpc address: " << self << std::endl;
+        return 1;
+    }
+    cc.host = self.substr(0, colon);
+    cc.port = atoi(self.substr(colon + 1).c_str());
+    cc.secret = secret;
+    for (int i = 5; i < argc; ++i)
+    {
+        std::string peer = argv[i];
+        size_t at = peer.find('@'), colon = peer.rfind(':');
+        if (at == std::string::npos || colon == std::string::npos || colon < at)
+        {
+            std::cout << "bad peer: " << peer << std::endl;
+            return 1;
+        }
+        cc.peers.emplace_back(atoi(peer.substr(0, at).c_str()), peer.substr(at + 1, colon - at - 1), atoi(peer.substr(colon + 1).c_str()));
+    }
+    gobang_server gs(HOST, USER, PWD, DBNAME, PORT, WWWROOT, nullptr, &cc);
+    gs.start(atoi(argv[3]));
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
-    gobang_server gs(HOST, USER, PWD, DBNAME, PORT);
-    gs.start(8080);
-    
+    if (argc > 1 && std::string(argv[1]) == "cluster")
+        return run_cluster(argc, argv);
+    int workers = argc > 1 ? atoi(argv[1]) : 1;
+    if (workers <= 1)
+    {
+        gobang_server gs(HOST, USER, PWD, DBNAME, PORT);
+        gs.start(LISTEN_PORT);
+        return 0;
+    }
+    shard_segment *seg = shard::create(workers);
+    if (seg == nullptr)
+        return 1;
+    // 服务器对象（数据库连接、执行器线程）在子进程中创建
+    shard::run_workers(seg, [seg](uint32_t worker) {
+        shard sd(seg, worker);
+        gobang_server gs(HOST, USER, PWD, DBNAME, PORT, WWWROOT, &sd);
+        gs.start(LISTEN_PORT);
+    });
+    shard::destroy(seg);
     return 0;
 }
 
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "timer.hpp"
+
+/*
+* 断线重连宽限模块
+* 对局中玩家的房间长连接断开后不立即判负，而是在时间轮上登记一个宽限期，
+* 宽限期内重新连接则取消定时任务，对局继续；宽限期到期仍未回来才执行判负
+*
+* 同一玩家反复断开重连时只保留最近一次断开的定时任务，
+* 每次断开分配新的序号，到期时序号不一致（期间重连过又断开）的旧任务直接忽略
+*/
+
+#define GRACE_MS 30000 // 断线后等待重连的时间
+
+class grace_table
+{
+private:
+    struct grace_entry
+    {
+        uint64_t timer_id;
+        uint64_t seq;
+    };
+
+    std::mutex _mutex;
+    timer_wheel *_wheel;
+    uint64_t _grace_ms;
+    uint64_t _next_seq;
+    // uid 宽限信息
+    std::unordered_map<uint64_t, grace_entry> _users;
+
+    void expire(uint64_t uid, uint64_t seq, const std::function<void()> &on_expire)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _users.find(uid);
+            if (it == _users.end() || it->second.seq != seq)
+                return;
+            _users.erase(it);
+        }
+        on_expire();
+    }
+
+public:
+    grace_table(timer_wheel *wheel, uint64_t grace_ms = GRACE_MS) : _wheel(wheel), _grace_ms(grace_ms), _next_seq(1) {}
+
+    // 玩家断开连接，宽限期到期后调用on_expire
+    void leave(uint64_t uid, const std::function<void()> &on_expire)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        uint64_t seq = _next_seq++;
+        auto it = _users.find(uid);
+        if (it != _users.end())
+            _wheel->cancel(it->second.timer_id);
+        uint64_t id = _wheel->add(_grace_ms, [this, uid, seq, on_expire]() { expire(uid, seq, on_expire); });
+        _users[uid] = grace_entry{id, seq};
+    }
+
+    // 玩家重新连接，处于宽限期内返回true
+    bool back(uint64_t uid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _users.find(uid);
+        if (it == _users.end())
+            return false;
+        _wheel->cancel(it->second.timer_id);
+        _users.erase(it);
+        return true;
+    }
+
+    bool in_grace(uint64_t uid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _users.count(uid) != 0;
+    }
+
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _users.size();
+    }
+};
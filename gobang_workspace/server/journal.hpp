@@ -0,0 +1,335 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "log.hpp"
+
+/*
+* 房间日志模块（预写日志）
+* 房间的创建、每一步落子和对局结果在广播之前先追加写入日志文件，服务器重启后
+* 从日志中恢复所有未结束的对局，玩家重新连接即可继续下棋
+*
+* 组提交：写入方只把记录追加到内存缓冲区并登记落盘后的回调，立即返回；
+* 后台线程每次取走缓冲区中的全部记录，一次write一次fdatasync，再按顺序执行回调。
+* 一次fsync期间到达的记录自然组成下一批，落盘的代价按批计算而不是按步计算，
+* 网络线程也不会被fsync阻塞。落子的广播放在回调中，玩家看到的每一步都已经落盘
+*
+* 记录格式：[u32 长度][u32 crc32][类型 + 字段]，恢复时遇到不完整或校验失败的记录即认为
+* 是崩溃时写了一半的尾部，丢弃之后的内容。恢复后只把未结束的房间重写为新的日志文件，
+* 已结束的对局不再保留
+*/
+
+#define JOURNAL_PATH "./gobang.journal"
+#define JOURNAL_HEAD 8 // 记录头：长度和校验
+
+enum journal_type
+{
+    JOURNAL_CREATE = 1, // 创建房间
+    JOURNAL_MOVE = 2,   // 落子
+    JOURNAL_OVER = 3    // 对局结束
+};
+
+// 从日志中恢复出的一个未结束的房间
+struct journal_room
+{
+    uint64_t room_id;
+    uint64_t white_id;
+    uint64_t black_id;
+    int rule;
+    int variant;
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<int> colors;
+};
+
+class room_journal
+{
+private:
+    std::string _path;
+    int _fd;
+    // 保护缓冲区和回调队列
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    // 等待下一次提交的记录和落盘后的回调
+    std::string _pending;
+    std::vector<std::function<void()>> _callbacks;
+    std::thread _flusher;
+    bool _stop;
+    // 提交的批数和追加的次数
+    std::atomic<uint64_t> _batches;
+    std::atomic<uint64_t> _appends;
+
+private:
+    template <class T>
+    static void put(std::string &buf, T v)
+    {
+        buf.append((const char *)&v, sizeof(v));
+    }
+
+    template <class T>
+    static T get(const char *&p)
+    {
+        T v;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+
+    // 给记录体加上长度和校验，追加到buf
+    static void seal(std::string &buf, const std::string &body)
+    {
+        put<uint32_t>(buf, body.size());
+        put<uint32_t>(buf, crc32(0, (const Bytef *)body.data(), body.size()));
+        buf += body;
+    }
+
+    static bool write_all(int fd, const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = ::write(fd, data, len);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // 后台提交线程：取走当前所有记录，写入并落盘后执行回调
+    void flusher_entry()
+    {
+        std::string batch;
+        std::vector<std::function<void()>> callbacks;
+        while (1)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [this]() { return _stop || !_pending.empty() || !_callbacks.empty(); });
+                if (_pending.empty() && _callbacks.empty() && _stop)
+                    return;
+                batch.swap(_pending);
+                callbacks.swap(_callbacks);
+            }
+            if (!batch.empty())
+            {
+                // 落盘失败时记录错误后照常回调，对局继续进行，只是这一批不再保证能恢复
+                if (write_all(_fd, batch.data(), batch.size()) == false || fdatasync(_fd) != 0)
+                    LOG(ERROR, "房间日志写入失败: %s", strerror(errno));
+                _batches++;
+            }
+            for (auto &cb : callbacks)
+                cb();
+            batch.clear();
+            callbacks.clear();
+        }
+    }
+
+    // 解析一条记录，更新未结束房间的集合
+    static bool apply(const char *p, uint32_t len, std::unordered_map<uint64_t, journal_room> &rooms, uint64_t &max_rid)
+    {
+        const char *end = p + len;
+        if (len < 9)
+            return false;
+        uint8_t type = get<uint8_t>(p);
+        uint64_t rid = get<uint64_t>(p);
+        if (rid > max_rid)
+            max_rid = rid;
+        if (type == JOURNAL_CREATE && end - p == 18)
+        {
+            journal_room &r = rooms[rid];
+            r.room_id = rid;
+            r.white_id = get<uint64_t>(p);
+            r.black_id = get<uint64_t>(p);
+            r.rule = get<uint8_t>(p);
+            r.variant = get<uint8_t>(p);
+        }
+        else if (type == JOURNAL_MOVE && end - p == 3)
+        {
+            auto it = rooms.find(rid);
+            if (it == rooms.end())
+                return true;
+            it->second.rows.push_back(get<uint8_t>(p));
+            it->second.cols.push_back(get<uint8_t>(p));
+            it->second.colors.push_back(get<uint8_t>(p));
+        }
+        else if (type == JOURNAL_OVER && end - p == 8)
+        {
+            rooms.erase(rid);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // 把未结束的房间重写为新的日志文件，先写临时文件再原子替换
+    // 最后补一条最大房间id的结束记录，保证重启后不会复用已经分配过的房间id
+    bool rewrite(const std::vector<journal_room> &rooms, uint64_t max_rid)
+    {
+        std::string tmp = _path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        std::string buf;
+        bool max_live = false;
+        for (const journal_room &r : rooms)
+        {
+            max_live = max_live || r.room_id == max_rid;
+            encode_create(buf, r.room_id, r.white_id, r.black_id, r.rule, r.variant);
+            for (size_t i = 0; i < r.rows.size(); ++i)
+                encode_move(buf, r.room_id, r.rows[i], r.cols[i], r.colors[i]);
+        }
+        if (max_rid != 0 && max_live == false)
+            encode_over(buf, max_rid, 0);
+        bool ok = write_all(fd, buf.data(), buf.size()) && fsync(fd) == 0;
+        ::close(fd);
+        if (ok == false || ::rename(tmp.c_str(), _path.c_str()) != 0)
+            return false;
+        // 让rename本身落盘
+        std::string dir = _path.find('/') == std::string::npos ? "." : _path.substr(0, _path.rfind('/') + 1);
+        int dfd = ::open(dir.c_str(), O_RDONLY);
+        if (dfd >= 0)
+        {
+            fsync(dfd);
+            ::close(dfd);
+        }
+        return true;
+    }
+
+public:
+    room_journal(const std::string &path = JOURNAL_PATH)
+        : _path(path), _fd(-1), _stop(false), _batches(0), _appends(0) {}
+
+    ~room_journal()
+    {
+        if (_flusher.joinable())
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _cond.notify_all();
+            _flusher.join();
+        }
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+
+    static void encode_create(std::string &buf, uint64_t rid, uint64_t white_id, uint64_t black_id, int rule, int variant)
+    {
+        std::string body;
+        put<uint8_t>(body, JOURNAL_CREATE);
+        put<uint64_t>(body, rid);
+        put<uint64_t>(body, white_id);
+        put<uint64_t>(body, black_id);
+        put<uint8_t>(body, rule);
+        put<uint8_t>(body, variant);
+        seal(buf, body);
+    }
+
+    static void encode_move(std::string &buf, uint64_t rid, int row, int col, int color)
+    {
+        std::string body;
+        put<uint8_t>(body, JOURNAL_MOVE);
+        put<uint64_t>(body, rid);
+        put<uint8_t>(body, row);
+        put<uint8_t>(body, col);
+        put<uint8_t>(body, color);
+        seal(buf, body);
+    }
+
+    static void encode_over(std::string &buf, uint64_t rid, uint64_t winner_id)
+    {
+        std::string body;
+        put<uint8_t>(body, JOURNAL_OVER);
+        put<uint64_t>(body, rid);
+        put<uint64_t>(body, winner_id);
+        seal(buf, body);
+    }
+
+    // 读取已有日志，恢复出未结束的房间和出现过的最大房间id，压缩日志后开始接受写入
+    bool recover(std::vector<journal_room> &rooms, uint64_t &max_rid)
+    {
+        rooms.clear();
+        max_rid = 0;
+        std::string data;
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            char buf[1 << 16];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+                data.append(buf, n);
+            ::close(fd);
+        }
+        std::unordered_map<uint64_t, journal_room> live;
+        size_t pos = 0, count = 0;
+        while (pos + JOURNAL_HEAD <= data.size())
+        {
+            const char *p = data.data() + pos;
+            uint32_t len = get<uint32_t>(p);
+            uint32_t crc = get<uint32_t>(p);
+            if (pos + JOURNAL_HEAD + len > data.size() || crc32(0, (const Bytef *)p, len) != crc)
+                break;
+            if (apply(p, len, live, max_rid) == false)
+                break;
+            pos += JOURNAL_HEAD + len;
+            count++;
+        }
+        if (pos != data.size())
+            LOG(ERROR, "房间日志尾部有 %lu 字节不完整，已丢弃", data.size() - pos);
+        rooms.reserve(live.size());
+        for (auto &it : live)
+            rooms.push_back(std::move(it.second));
+        if (rewrite(rooms, max_rid) == false)
+        {
+            LOG(ERROR, "房间日志重写失败: %s", strerror(errno));
+            return false;
+        }
+        _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND);
+        if (_fd < 0)
+        {
+            LOG(ERROR, "房间日志打开失败: %s", strerror(errno));
+            return false;
+        }
+        _flusher = std::thread(&room_journal::flusher_entry, this);
+        LOG(DEBUG, "房间日志恢复完毕，读取 %lu 条记录，未结束的房间 %lu 个", count, rooms.size());
+        return true;
+    }
+
+    // 追加已编码的记录，done在这些记录落盘后由提交线程调用，可以为空
+    void append(const std::string &records, const std::function<void()> &done)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _pending += records;
+            if (done)
+                _callbacks.push_back(done);
+            _appends++;
+        }
+        _cond.notify_one();
+    }
+
+    // 已提交的批数和追加的次数，用于统计平均每批合并了多少次写入
+    uint64_t batches() { return _batches; }
+    uint64_t appends() { return _appends; }
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+/*
+* 排行榜模块
+* 启动时从数据库加载所有用户的分数，之后随对局结果增量更新，排名查询不再访问数据库
+*
+* 使用带跨度的跳表维护按分数从高到低（同分按用户id从小到大）排列的用户：
+* 每一层的指针记录跨过了多少个节点，查找时沿途累加跨度即为排名，
+* 按排名定位起点后沿最底层顺序取出即为分页结果，两种查询都是O(log n)
+* 启动时先排序再从尾部依次追加建表，避免逐个插入的随机访问
+*/
+
+#define LB_MAX_LEVEL 32
+#define LB_MAX_LIMIT 100 // 一次最多获取的排行数量
+
+// 排行榜中的一项
+struct lb_entry
+{
+    uint64_t rank; // 排名，从1开始
+    uint64_t uid;
+    int64_t score;
+    std::string name;
+};
+
+class leaderboard
+{
+private:
+    struct lb_node;
+    struct lb_level
+    {
+        lb_node *next;
+        uint64_t span; // 到next跨过的节点数
+    };
+    struct lb_node
+    {
+        uint64_t uid;
+        int64_t score;
+        std::string name;
+        int level;
+        lb_level lv[1]; // 实际长度为level，随节点一起分配
+    };
+
+    // 保护跳表和索引
+    std::mutex _mutex;
+    lb_node *_head;
+    int _level;
+    uint64_t _size;
+    // uid 跳表节点
+    std::unordered_map<uint64_t, lb_node *> _nodes;
+    std::mt19937 _rng;
+
+private:
+    static lb_node *create_node(int level, uint64_t uid, int64_t score, const std::string &name)
+    {
+        void *mem = ::operator new(sizeof(lb_node) + (level - 1) * sizeof(lb_level));
+        lb_node *node = new (mem) lb_node();
+        node->uid = uid;
+        node->score = score;
+        node->name = name;
+        node->level = level;
+        for (int i = 0; i < level; ++i)
+        {
+            node->lv[i].next = nullptr;
+            node->lv[i].span = 0;
+        }
+        return node;
+    }
+
+    static void destroy_node(lb_node *node)
+    {
+        node->~lb_node();
+        ::operator delete(node);
+    }
+
+    // 节点a是否排在(score, uid)之前：分数高的在前，同分时id小的在前
+    static bool before(const lb_node *a, int64_t score, uint64_t uid)
+    {
+        return a->score > score || (a->score == score && a->uid < uid);
+    }
+
+    // 每升高一层的概率为1/4
+    int random_level()
+    {
+        int level = 1;
+        while (level < LB_MAX_LEVEL && (_rng() & 3) == 0)
+            ++level;
+        return level;
+    }
+
+    void insert_node(uint64_t uid, int64_t score, const std::string &name)
+    {
+        lb_node *update[LB_MAX_LEVEL];
+        uint64_t rank[LB_MAX_LEVEL];
+        lb_node *x = _head;
+        for (int i = _level - 1; i >= 0; --i)
+        {
+            rank[i] = i == _level - 1 ? 0 : rank[i + 1];
+            while (x->lv[i].next != nullptr && before(x->lv[i].next, score, uid))
+            {
+                rank[i] += x->lv[i].span;
+                x = x->lv[i].next;
+            }
+            update[i] = x;
+        }
+        int level = random_level();
+        if (level > _level)
+        {
+            for (int i = _level; i < level; ++i)
+            {
+                rank[i] = 0;
+                update[i] = _head;
+                update[i]->lv[i].span = _size;
+            }
+            _level = level;
+        }
+        x = create_node(level, uid, score, name);
+        for (int i = 0; i < level; ++i)
+        {
+            x->lv[i].next = update[i]->lv[i].next;
+            update[i]->lv[i].next = x;
+            x->lv[i].span = update[i]->lv[i].span - (rank[0] - rank[i]);
+            update[i]->lv[i].span = (rank[0] - rank[i]) + 1;
+        }
+        for (int i = level; i < _level; ++i)
+            update[i]->lv[i].span++;
+        _size++;
+        _nodes[uid] = x;
+    }
+
+    void erase_node(lb_node *node)
+    {
+        lb_node *update[LB_MAX_LEVEL];
+        lb_node *x = _head;
+        for (int i = _level - 1; i >= 0; --i)
+        {
+            while (x->lv[i].next != nullptr && before(x->lv[i].next, node->score, node->uid))
+                x = x->lv[i].next;
+            update[i] = x;
+        }
+        for (int i = 0; i < _level; ++i)
+        {
+            if (update[i]->lv[i].next == node)
+            {
+                update[i]->lv[i].span += node->lv[i].span - 1;
+                update[i]->lv[i].next = node->lv[i].next;
+            }
+            else
+            {
+                update[i]->lv[i].span--;
+            }
+        }
+        while (_level > 1 && _head->lv[_level - 1].next == nullptr)
+            _level--;
+        _size--;
+        _nodes.erase(node->uid);
+        destroy_node(node);
+    }
+
+public:
+    leaderboard() : _head(create_node(LB_MAX_LEVEL, 0, 0, "")), _level(1), _size(0), _rng(std::random_device()()) {}
+
+    ~leaderboard()
+    {
+        lb_node *x = _head;
+        while (x != nullptr)
+        {
+            lb_node *next = x->lv[0].next;
+            destroy_node(x);
+            x = next;
+        }
+    }
+
+    // 批量加载用户，排行榜需要为空；entries会被排序
+    void load(std::vector<lb_entry> &entries)
+    {
+        std::sort(entries.begin(), entries.end(), [](const lb_entry &a, const lb_entry &b) {
+            return a.score > b.score || (a.score == b.score && a.uid < b.uid);
+        });
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_size != 0)
+            return;
+        // tail[i]为第i层当前的最后一个节点，tail_rank[i]为其排名
+        lb_node *tail[LB_MAX_LEVEL];
+        uint64_t tail_rank[LB_MAX_LEVEL];
+        for (int i = 0; i < LB_MAX_LEVEL; ++i)
+        {
+            tail[i] = _head;
+            tail_rank[i] = 0;
+        }
+        _nodes.reserve(entries.size());
+        for (lb_entry &e : entries)
+        {
+            if (_nodes.count(e.uid) != 0)
+                continue;
+            uint64_t r = ++_size;
+            int level = random_level();
+            if (level > _level)
+                _level = level;
+            lb_node *x = create_node(level, e.uid, e.score, e.name);
+            for (int i = 0; i < level; ++i)
+            {
+                tail[i]->lv[i].next = x;
+                tail[i]->lv[i].span = r - tail_rank[i];
+                tail[i] = x;
+                tail_rank[i] = r;
+            }
+            _nodes[e.uid] = x;
+        }
+        for (int i = 0; i < _level; ++i)
+            tail[i]->lv[i].span = _size - tail_rank[i];
+    }
+
+    // 设置用户的分数，用户不存在则插入；分数和用户名都没有变化时返回false
+    bool update(uint64_t uid, const std::string &name, int64_t score)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _nodes.find(uid);
+        if (it != _nodes.end())
+        {
+            if (it->second->score == score && it->second->name == name)
+                return false;
+            erase_node(it->second);
+        }
+        insert_node(uid, score, name);
+        return true;
+    }
+
+    // 修改已有用户的分数，用户名不变
+    void update(uint64_t uid, int64_t score)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _nodes.find(uid);
+        if (it == _nodes.end() || it->second->score == score)
+            return;
+        std::string name = std::move(it->second->name);
+        erase_node(it->second);
+        insert_node(uid, score, name);
+    }
+
+    // 获取用户的分数
+    bool score(uint64_t uid, int64_t &score)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _nodes.find(uid);
+        if (it == _nodes.end())
+            return false;
+        score = it->second->score;
+        return true;
+    }
+
+    void remove(uint64_t uid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _nodes.find(uid);
+        if (it != _nodes.end())
+            erase_node(it->second);
+    }
+
+    // 获取用户的排名信息，用户不存在返回false
+    bool rank(uint64_t uid, lb_entry &entry)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _nodes.find(uid);
+        if (it == _nodes.end())
+            return false;
+        lb_node *node = it->second;
+        uint64_t r = 0;
+        lb_node *x = _head;
+        for (int i = _level - 1; i >= 0; --i)
+        {
+            while (x->lv[i].next != nullptr && (x->lv[i].next == node || before(x->lv[i].next, node->score, node->uid)))
+            {
+                r += x->lv[i].span;
+                x = x->lv[i].next;
+            }
+            if (x == node)
+                break;
+        }
+        entry.rank = r;
+        entry.uid = uid;
+        entry.score = node->score;
+        entry.name = node->name;
+        return true;
+    }
+
+    // 从第offset名（从0开始）起获取最多limit项
+    void range(uint64_t offset, size_t limit, std::vector<lb_entry> &entries)
+    {
+        entries.clear();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (offset >= _size || limit == 0)
+            return;
+        // 按跨度定位到排名为offset的节点（头节点排名为0）
+        uint64_t r = 0;
+        lb_node *x = _head;
+        for (int i = _level - 1; i >= 0; --i)
+        {
+            while (x->lv[i].next != nullptr && r + x->lv[i].span <= offset)
+            {
+                r += x->lv[i].span;
+                x = x->lv[i].next;
+            }
+        }
+        x = x->lv[0].next;
+        while (x != nullptr && entries.size() < limit)
+        {
+            entries.push_back(lb_entry{++r, x->uid, x->score, x->name});
+            x = x->lv[0].next;
+        }
+    }
+
+    uint64_t size()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _size;
+    }
+};
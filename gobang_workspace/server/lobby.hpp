@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include <cstdint>
+#include <unordered_set>
+#include <jsoncpp/json/json.h>
+
+/*
+* 大厅状态模块
+* 大厅页面展示在线人数、各分段匹配队列的人数、房间数和最近开始的对局
+*
+* 状态不是每次变化都推送，而是由网络io线程每LOBBY_PUSH_MS采集一次快照（在线用户、匹配队列、房间管理），
+* 与上一次的快照比较，只把变化的部分编码成一个增量帧；帧只序列化一次，所有大厅连接共用同一个消息
+* 没有变化时不推送；新进入大厅的连接先收到完整快照，之后按序号接收增量
+*
+* 增量帧的格式：
+* {"optype":"lobby","seq":序号,"full":false,"hall":大厅人数,"room":房间人数,"rooms":房间数,"queue":[三个分段的人数],
+*  "add":[新出现的对局],"del":[结束的对局的房间id]}
+* 只包含变化了的字段；完整快照的full为true，包含所有字段，对局列表在games中
+*
+* 快照的采集、编码和推送都在网络io线程中执行，不加锁
+*/
+
+#define LOBBY_PUSH_MS 1000 // 推送间隔
+#define LOBBY_GAMES 20     // 大厅展示的对局数
+
+struct lobby_game
+{
+    uint64_t room_id;
+    uint64_t white_id;
+    uint64_t black_id;
+    std::string white_name;
+    std::string black_name;
+};
+
+struct lobby_snapshot
+{
+    uint64_t hall = 0;                // 大厅中的人数
+    uint64_t room = 0;                // 房间中的人数
+    uint64_t rooms = 0;               // 房间数
+    uint64_t queue[3] = {0, 0, 0};    // 各分段匹配队列中的人数
+    std::vector<lobby_game> games;    // 最近开始的对局，房间id从大到小
+};
+
+class lobby_feed
+{
+private:
+    lobby_snapshot _last;
+    uint64_t _seq;
+    uint64_t _next_ms; // 下一次采集的时间
+    std::string _full; // 当前的完整快照帧
+    std::unique_ptr<Json::StreamWriter> _writer;
+
+private:
+    // 广播的帧不带缩进
+    std::string write(const Json::Value &v)
+    {
+        std::ostringstream ss;
+        _writer->write(v, &ss);
+        return ss.str();
+    }
+
+    static Json::Value game_json(const lobby_game &g)
+    {
+        Json::Value v;
+        v["room_id"] = (Json::UInt64)g.room_id;
+        v["white_id"] = (Json::UInt64)g.white_id;
+        v["black_id"] = (Json::UInt64)g.black_id;
+        v["white"] = g.white_name;
+        v["black"] = g.black_name;
+        return v;
+    }
+
+    static Json::Value queue_json(const lobby_snapshot &snap)
+    {
+        Json::Value v(Json::arrayValue);
+        for (int i = 0; i < 3; ++i)
+            v.append((Json::UInt64)snap.queue[i]);
+        return v;
+    }
+
+    void build_full()
+    {
+        Json::Value v;
+        v["optype"] = "lobby";
+        v["seq"] = (Json::UInt64)_seq;
+        v["full"] = true;
+        v["hall"] = (Json::UInt64)_last.hall;
+        v["room"] = (Json::UInt64)_last.room;
+        v["rooms"] = (Json::UInt64)_last.rooms;
+        v["queue"] = queue_json(_last);
+        v["games"] = Json::Value(Json::arrayValue);
+        for (const lobby_game &g : _last.games)
+            v["games"].append(game_json(g));
+        _full = write(v);
+    }
+
+public:
+    lobby_feed() : _seq(0), _next_ms(0)
+    {
+        Json::StreamWriterBuilder swb;
+        swb["indentation"] = "";
+        _writer.reset(swb.newStreamWriter());
+        build_full();
+    }
+
+    // 到了采集的时间返回true，now_ms是时间轮的当前时间
+    bool due(uint64_t now_ms)
+    {
+        if (now_ms < _next_ms)
+            return false;
+        _next_ms = now_ms + LOBBY_PUSH_MS;
+        return true;
+    }
+
+    // 与上一次的快照比较，有变化时生成增量帧并返回true，没有变化返回false
+    bool update(const lobby_snapshot &snap, std::string &delta)
+    {
+        Json::Value v;
+        if (snap.hall != _last.hall)
+            v["hall"] = (Json::UInt64)snap.hall;
+        if (snap.room != _last.room)
+            v["room"] = (Json::UInt64)snap.room;
+        if (snap.rooms != _last.rooms)
+            v["rooms"] = (Json::UInt64)snap.rooms;
+        if (snap.queue[0] != _last.queue[0] || snap.queue[1] != _last.queue[1] || snap.queue[2] != _last.queue[2])
+            v["queue"] = queue_json(snap);
+        // 对局按房间id比较：新快照中有、上一次没有的是新对局，反之是结束或挤出列表的对局
+        std::unordered_set<uint64_t> before, after;
+        for (const lobby_game &g : _last.games)
+            before.insert(g.room_id);
+        for (const lobby_game &g : snap.games)
+        {
+            after.insert(g.room_id);
+            if (before.count(g.room_id) == 0)
+                v["add"].append(game_json(g));
+        }
+        for (const lobby_game &g : _last.games)
+        {
+            if (after.count(g.room_id) == 0)
+                v["del"].append((Json::UInt64)g.room_id);
+        }
+        if (v.empty()) // 没有变化的字段
+            return false;
+        v["optype"] = "lobby";
+        v["seq"] = (Json::UInt64)++_seq;
+        v["full"] = false;
+        delta = write(v);
+        _last = snap;
+        build_full();
+        return true;
+    }
+
+    // 当前的完整快照帧，发给新进入大厅的连接
+    const std::string &full() { return _full; }
+
+    // 最后一帧的序号
+    uint64_t seq() { return _seq; }
+};
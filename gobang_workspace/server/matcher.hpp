@@ -2,25 +2,44 @@
 
 #include <list>
 #include <mutex>
-#include <condition_variable>
+#include <memory>
+#include <vector>
 
 #include "util.hpp"
 #include "onlineuser.hpp"
 #include "db.hpp"
 #include "room.hpp"
+#include "executor.hpp"
+#include "timer.hpp"
+#include "shard.hpp"
 
 /*
 * 对战匹配功能模块 
 * 目前只存在积分匹配排位赛
-* 相同段位的人进入相同匹配队列 不同段位的人进入不同的匹配队列
+* 相同段位且选择相同规则和棋盘的人进入相同匹配队列，匹配成功后按该规则和棋盘创建房间
 * 
-* 使用一个阻塞队列实现匹配队列
-* 创建线程从对应的匹配队列取出玩家进行对战
+* 每个匹配队列有一个mailbox，玩家入队后向mailbox投递一次匹配，在执行器上从队列中取出玩家进行对战，
+* 不再为每个队列创建一个阻塞等待的线程
 *
 * 向外提供add接口添加玩家到匹配队列
 * del接口取消对应玩家的匹配
+*
+* 队列中只有一个玩家且等待超过MATCH_AI_TIMEOUT（期间没有新玩家入队）时，由时间轮触发为其匹配电脑玩家，电脑玩家只下标准棋盘
+*
+* 多进程模式下匹配队列在共享内存中，不同worker上的玩家也能匹配：
+* 执行匹配的worker创建房间，本worker的玩家直接回复匹配成功，其他worker的玩家通过通知队列告诉其所在的worker；
+* 匹配成功的响应中带有房间所在worker的端口，客户端的房间长连接直接连到该worker
 */
 
+#define MATCH_AI_TIMEOUT 30000 // 等待多久之后匹配电脑玩家 ms
+#define MATCH_TIERS 3          // 段位数
+#define MATCH_RULES 3          // 规则数，与game_rule一致
+#define MATCH_BOARDS 3         // 棋盘类型数，与board_variant一致
+#define MATCH_MODES (MATCH_RULES * MATCH_BOARDS)
+#define MATCH_QUEUES (MATCH_TIERS * MATCH_MODES)
+
+static_assert(MATCH_QUEUES == SHARD_QUEUES, "shared match queues");
+
 template <class T>
 class match_queue
 {
@@ -29,8 +48,8 @@ private:
     std::list<T> _list;
     // 实现线程安全
     std::mutex _mutex;
-    // 这个条件变量主要为了阻塞消费者，后边使用的时候：队列中元素个数<2则阻塞
-    std::condition_variable _cond;
+    // 入队的次数，用来判断等待电脑玩家期间是否有新玩家入队
+    uint64_t _seq = 0;
 
 public:
     // 获取元素个数
@@ -47,19 +66,19 @@ public:
         return _list.empty();
     }
 
-    // 阻塞线程
-    void wait()
+    // 获取入队的次数
+    uint64_t seq()
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        _cond.wait(lock);
+        return _seq;
     }
 
-    // 入队数据，并唤醒线程
+    // 入队数据
     void push(const T &data)
     {
         std::unique_lock<std::mutex> lock(_mutex);
         _list.push_back(data);
-        _cond.notify_all();
+        _seq++;
     }
 
     // 出队数据
@@ -74,7 +93,7 @@ public:
         return true;
     }
 
-    // 从阻塞队列中移除指定的数据
+    // 从队列中移除指定的数据
     void remove(T &data)
     {
         std::unique_lock<std::mutex> lock(_mutex);
@@ -82,20 +101,22 @@ public:
     }
 };
 
+// 一个分段中一种规则和棋盘的匹配队列和处理它的mailbox
+struct match_tier
+{
+    match_queue<uint64_t> queue;
+    mailbox box;
+    game_rule rule;
+    board_variant variant;
+
+    match_tier(executor *ex, game_rule r, board_variant v) : box(ex), rule(r), variant(v) {}
+};
+
 class matcher
 {
 private:
-    // 第一分段选手匹配队列
-    match_queue<uint64_t> _q_normal;
-    // 第二分段匹配队列
-    match_queue<uint64_t> _q_high;
-    // 第三分段匹配队列
-    match_queue<uint64_t> _q_super;
-
-    // 对应三个匹配队列的处理线程
-    std::thread _th_normal;
-    std::thread _th_high;
-    std::thread _th_super;
+    // 各分段各规则各棋盘的匹配队列，下标为 分段 * MATCH_MODES + 规则 * MATCH_BOARDS + 棋盘
+    std::vector<std::unique_ptr<match_tier>> _tiers;
 
     // 房间管理模块
     room_manager *_rm;
@@ -103,105 +124,251 @@ private:
     user_table *_ut;
     // 在线用户管理模块
     onlineuser *_ou;
+    // 等待电脑玩家的定时任务，为空时不匹配电脑玩家
+    timer_wheel *_wheel;
+    // 多进程模式下的共享匹配队列，单进程时为空
+    shard *_shard;
 
 private:
-    // 新线程处理对应匹配队列的匹配从队列中取出玩家进行对战
-    void handle_match(match_queue<uint64_t> &mq)//  match_queue<T>?
+    // 在分段的mailbox中执行一次匹配：队列中有两个以上的玩家时依次出队两两对战
+    void handle_match(match_tier &tier)
     {
-        while (1)
+        match_queue<uint64_t> &mq = tier.queue;
+        while (mq.size() >= 2)
         {
-            // 1. 判断队列人数是否大于2，<2则阻塞等待
-            while (mq.size() < 2)
-            {
-                mq.wait();
-            }
-            // 2. 走下来代表人数够了，出队两个玩家
+            // 1. 出队两个玩家
             uint64_t uid1, uid2;
             bool ret = mq.pop(uid1);
             if (ret == false)
             {
-                continue;
+                break;
             }
             ret = mq.pop(uid2);
             if (ret == false)
             {
-                add(uid1);
-                continue;
+                add(uid1, tier.rule, tier.variant);
+                break;
             }
-            // 3. 校验两个玩家是否在线，如果有人掉线，则将另一个人重新添加入队列
-            websocketpp::server<websocketpp::config::asio>::connection_ptr conn1 = _ou->get_conn_from_hall(uid1);
+            // 2. 校验两个玩家是否在线，如果有人掉线，则将另一个人重新添加入队列
+            WSserver::connection_ptr conn1 = _ou->get_conn_from_hall(uid1);
             if (conn1.get() == nullptr)
             {
-                add(uid2);
+                add(uid2, tier.rule, tier.variant);
                 LOG(INFO, "玩家%d掉线，重新匹配", uid1);
                 continue;
             }
-            websocketpp::server<websocketpp::config::asio>::connection_ptr conn2 = _ou->get_conn_from_hall(uid2);
+            WSserver::connection_ptr conn2 = _ou->get_conn_from_hall(uid2);
             if (conn2.get() == nullptr)
             {
-                add(uid1);
+                add(uid1, tier.rule, tier.variant);
                 LOG(INFO, "玩家%d掉线，重新匹配", uid2);
                 continue;
             }
-            // 4. 为两个玩家创建房间，并将玩家加入房间中
-            room_ptr rp = _rm->create_room(uid1, uid2);
+            // 3. 为两个玩家创建房间，并将玩家加入房间中
+            room_ptr rp = _rm->create_room(uid1, uid2, tier.rule, tier.variant);
             if (rp.get() == nullptr)
             {
-                add(uid1);
-                add(uid2);
+                // 接受挑战进入房间的玩家不再回到队列
+                requeue(uid1, tier.rule, tier.variant);
+                requeue(uid2, tier.rule, tier.variant);
                 continue;
             }
-            // 5. 对两个玩家进行响应
+            // 4. 对两个玩家进行响应
             Json::Value resp;
             resp["optype"] = "match_success";
             resp["result"] = true;
             std::string body;
             util_json::serialization(resp, body);
-            conn1->send(body);
-            conn2->send(body);
+            ws_send(conn1, body);
+            ws_send(conn2, body);
+        }
+        // 5. 只剩一个玩家时开始等待，期间没有新玩家入队则为其匹配电脑玩家
+        if (_wheel != nullptr && tier.variant == BOARD_STANDARD && mq.size() == 1)
+        {
+            uint64_t seq = mq.seq();
+            match_tier *tp = &tier;
+            _wheel->add(MATCH_AI_TIMEOUT, [this, tp, seq]() {
+                tp->box.post([this, tp, seq]() {
+                    uint64_t uid;
+                    if (tp->queue.seq() == seq && tp->queue.size() == 1 && tp->queue.pop(uid))
+                        match_ai(uid, tp->rule);
+                });
+            });
+        }
+    }
+
+    // 创建房间失败后把玩家放回队列，已经在房间中的玩家（如刚刚接受了挑战）不放回
+    void requeue(uint64_t uid, game_rule rule, board_variant variant)
+    {
+        if (_rm->get_room_by_uid(uid).get() == nullptr)
+            add(uid, rule, variant);
+    }
+
+    // 为玩家创建与电脑玩家对战的房间
+    void match_ai(uint64_t uid, game_rule rule)
+    {
+        WSserver::connection_ptr conn = _ou->get_conn_from_hall(uid);
+        if (conn.get() == nullptr)
+        {
+            LOG(INFO, "玩家%lu掉线，取消人机匹配", uid);
+            return;
         }
+        room_ptr rp = _rm->create_room(uid, AI_UID, rule);
+        if (rp.get() == nullptr)
+        {
+            requeue(uid, rule, BOARD_STANDARD);
+            return;
+        }
+        Json::Value resp;
+        resp["optype"] = "match_success";
+        resp["result"] = true;
+        std::string body;
+        util_json::serialization(resp, body);
+        ws_send(conn, body);
+    }
+
+    // 根据天梯分数选择匹配队列
+    int tier_index(int score)
+    {
+        if (score < 2000)
+            return 0;
+        else if (score >= 2000 && score < 3000)
+            return 1;
+        return 2;
+    }
+
+    // 分段、规则和棋盘对应的匹配队列下标
+    int queue_index(int score, game_rule rule, board_variant variant)
+    {
+        return tier_index(score) * MATCH_MODES + rule * MATCH_BOARDS + variant;
+    }
+
+    match_tier &tier_at(int index) { return *_tiers[index]; }
+
+    // 匹配成功的响应，多进程模式下带上房间所在worker的端口
+    std::string match_success(uint32_t owner)
+    {
+        Json::Value resp;
+        resp["optype"] = "match_success";
+        resp["result"] = true;
+        if (_shard != nullptr)
+            resp["room_port"] = _shard->room_port(owner);
+        std::string body;
+        util_json::serialization(resp, body);
+        return body;
     }
 
-    void th_normal_entry() { handle_match(_q_normal); } // 第一梯队匹配队列处理函数
-    void th_high_entry() { handle_match(_q_high); }     // 第二梯队匹配队列处理函数
-    void th_super_entry() { handle_match(_q_super); }   // 第三梯队匹配队列处理函数
+    // 多进程模式：玩家在其他worker上时认为在线，由其所在的worker投递通知时再确认
+    bool shared_online(const shard_player &p)
+    {
+        return p.worker != _shard->worker() || _ou->get_conn_from_hall(p.uid).get() != nullptr;
+    }
+
+    // 多进程模式：房间已经在本worker上创建，通知玩家
+    void shared_deliver(const shard_player &p)
+    {
+        if (p.worker != _shard->worker())
+        {
+            _shard->notify(p.worker, p.uid);
+            return;
+        }
+        WSserver::connection_ptr conn = _ou->get_conn_from_hall(p.uid);
+        if (conn.get() != nullptr)
+            ws_send(conn, match_success(_shard->worker()));
+    }
+
+    // 多进程模式：在分段的mailbox中从共享队列中取出玩家两两对战，房间创建在本worker上
+    void handle_shared_match(int index)
+    {
+        game_rule rule = tier_at(index).rule;
+        board_variant variant = tier_at(index).variant;
+        shard_player a, b;
+        while (_shard->queue_pop_pair(index, a, b))
+        {
+            if (shared_online(a) == false)
+            {
+                _shard->queue_push(index, b.uid, b.worker);
+                LOG(INFO, "玩家%lu掉线，重新匹配", a.uid);
+                continue;
+            }
+            if (shared_online(b) == false)
+            {
+                _shard->queue_push(index, a.uid, a.worker);
+                LOG(INFO, "玩家%lu掉线，重新匹配", b.uid);
+                continue;
+            }
+            room_ptr rp = _rm->open_room(a.uid, b.uid, rule, variant);
+            if (rp.get() == nullptr)
+            {
+                if (_rm->get_room_by_uid(a.uid).get() == nullptr)
+                    _shard->queue_push(index, a.uid, a.worker);
+                if (_rm->get_room_by_uid(b.uid).get() == nullptr)
+                    _shard->queue_push(index, b.uid, b.worker);
+                break;
+            }
+            shared_deliver(a);
+            shared_deliver(b);
+        }
+        uint32_t count;
+        uint64_t seq;
+        _shard->queue_state(index, count, seq);
+        if (_wheel != nullptr && variant == BOARD_STANDARD && count == 1)
+        {
+            match_tier *tp = &tier_at(index);
+            _wheel->add(MATCH_AI_TIMEOUT, [this, tp, index, seq, rule]() {
+                tp->box.post([this, index, seq, rule]() {
+                    shard_player p;
+                    if (_shard->queue_pop_single(index, seq, p) == false || shared_online(p) == false)
+                        return;
+                    if (_rm->open_room(p.uid, AI_UID, rule).get() == nullptr)
+                    {
+                        if (_rm->get_room_by_uid(p.uid).get() == nullptr)
+                            _shard->queue_push(index, p.uid, p.worker);
+                        return;
+                    }
+                    shared_deliver(p);
+                });
+            });
+        }
+    }
 
 public:
-    // 房间管理模块 用户数据模块 在线用户管理模块
-    matcher(room_manager *rm, user_table *ut, onlineuser *om) : _rm(rm), _ut(ut), _ou(om),
-                                                                _th_normal(std::thread(&matcher::th_normal_entry, this)),
-                                                                _th_high(std::thread(&matcher::th_high_entry, this)),
-                                                                _th_super(std::thread(&matcher::th_super_entry, this))
+    // 房间管理模块 用户数据模块 在线用户管理模块 执行器 时间轮 多进程模式下的共享内存
+    matcher(room_manager *rm, user_table *ut, onlineuser *om, executor *ex, timer_wheel *wheel = nullptr, shard *sd = nullptr)
+        : _rm(rm), _ut(ut), _ou(om), _wheel(wheel), _shard(sd)
     {
+        for (int index = 0; index < MATCH_QUEUES; ++index)
+        {
+            int mode = index % MATCH_MODES;
+            _tiers.emplace_back(new match_tier(ex, (game_rule)(mode / MATCH_BOARDS), (board_variant)(mode % MATCH_BOARDS)));
+        }
         LOG(DEBUG, "游戏匹配模块初始化完毕....");
     }
 
-    // 输入uid 根据玩家的天梯分数，来判定玩家档次，添加到不同的匹配队列
-    bool add(uint64_t uid)
+    // 输入uid 根据玩家的天梯分数和选择的规则、棋盘，来判定玩家档次，添加到不同的匹配队列，并投递一次匹配
+    bool add(uint64_t uid, game_rule rule = DEFAULT_RULE, board_variant variant = DEFAULT_BOARD)
     {
         //  1. 根据用户ID，获取玩家信息
-        Json::Value user;
-        bool ret = _ut->select_by_id(uid, user); // 检查是否存在
+        int score = 0;
+        bool ret = _ut->get_score(uid, score); // 检查是否存在并取得分数，单进程时从排行榜中读取
         if (ret == false)
         {
-            LOG(DEBUG, "匹配时获取玩家:%d 信息失败！！", uid);
+            LOG(DEBUG, "匹配时获取玩家:%lu 信息失败！！", uid);
             return false;
         }
-        int score = user["score"].asInt();
 
-        // 2. 添加到指定的队列中
-        if (score < 2000)
+        // 2. 添加到指定的队列中，在队列的mailbox中进行匹配
+        int index = queue_index(score, rule, variant);
+        if (_shard != nullptr)
         {
-            _q_normal.push(uid);
-        }
-        else if (score >= 2000 && score < 3000)
-        {
-            _q_high.push(uid);
-        }
-        else
-        {
-            _q_super.push(uid);
+            if (_shard->queue_push(index, uid) == false)
+                return false;
+            tier_at(index).box.post([this, index]() { handle_shared_match(index); });
+            return true;
         }
+        match_tier *tp = &tier_at(index);
+        tp->queue.push(uid);
+        tp->box.post([this, tp]() { handle_match(*tp); });
         return true;
     }
 
@@ -209,27 +376,73 @@ public:
     bool del(uint64_t uid)
     {
         //  1. 根据用户ID，获取玩家信息
-        Json::Value user;
-        bool ret = _ut->select_by_id(uid, user);
+        int score = 0;
+        bool ret = _ut->get_score(uid, score); // 检查是否存在并取得分数，单进程时从排行榜中读取
         if (ret == false)
         {
-            LOG(DEBUG, "取消匹配时获取玩家:%d 信息失败！！", uid);
+            LOG(DEBUG, "取消匹配时获取玩家:%lu 信息失败！！", uid);
             return false;
         }
-        int score = user["score"].asInt();
-        // 2. 从指定的队列中删除
-        if (score < 2000)
+        // 2. 从该分段所有规则和棋盘的队列中删除
+        for (int mode = 0; mode < MATCH_MODES; ++mode)
         {
-            _q_normal.remove(uid);
+            int index = tier_index(score) * MATCH_MODES + mode;
+            if (_shard != nullptr)
+                _shard->queue_remove(index, uid);
+            else
+                tier_at(index).queue.remove(uid);
         }
-        else if (score >= 2000 && score < 3000)
+        return true;
+    }
+
+    // 从所有匹配队列中移除玩家，不查询玩家的分数（接受挑战时调用）
+    void cancel(uint64_t uid)
+    {
+        for (int index = 0; index < MATCH_QUEUES; ++index)
         {
-            _q_high.remove(uid);
+            if (_shard != nullptr)
+                _shard->queue_remove(index, uid);
+            else
+                tier_at(index).queue.remove(uid);
         }
-        else
+    }
+
+    // 各分段匹配队列中等待的人数（所有规则和棋盘合计），多进程模式下是共享队列中所有worker的玩家
+    void queue_sizes(size_t sizes[MATCH_TIERS])
+    {
+        for (int tier = 0; tier < MATCH_TIERS; ++tier)
+            sizes[tier] = 0;
+        for (int index = 0; index < MATCH_QUEUES; ++index)
         {
-            _q_super.remove(uid);
+            if (_shard != nullptr)
+            {
+                uint32_t count;
+                uint64_t seq;
+                _shard->queue_state(index, count, seq);
+                sizes[index / MATCH_MODES] += count;
+            }
+            else
+                sizes[index / MATCH_MODES] += tier_at(index).queue.size();
+        }
+    }
+
+    // 多进程模式：处理其他worker发来的匹配成功通知，由网络io线程定时调用
+    void deliver_notices()
+    {
+        if (_shard == nullptr)
+            return;
+        std::vector<shard_notice> notices;
+        if (_shard->drain(notices) == 0)
+            return;
+        for (const shard_notice &n : notices)
+        {
+            WSserver::connection_ptr conn = _ou->get_conn_from_hall(n.uid);
+            if (conn.get() == nullptr)
+            {
+                LOG(INFO, "玩家%lu已离开大厅，worker %u 上的房间等待超时回收", n.uid, n.worker);
+                continue;
+            }
+            ws_send(conn, match_success(n.worker));
         }
-        return true;
     }
 };
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+
+/*
+* 用户名过滤模块
+* 启动时把数据库中所有的用户名加入计数布隆过滤器，注册成功后增量加入
+* 注册前先查过滤器：不存在的用户名一定没有被占用，不再查询数据库，直接插入；存在只说明可能被占用，由数据库查询确认
+*
+* 每个键对应NF_COUNTERS_PER_KEY个4位计数器（每个键8字节），NF_HASHES个位置由两个哈希值组合得到，
+* 在容量以内误判率约0.05%（误判的用户名多一次数据库查询）；计数器饱和后不再减少，删除时不会误删其他键
+* 数据库的用户名比较不区分大小写，过滤器也按小写计算
+*/
+
+#define NF_COUNTERS_PER_KEY 16
+#define NF_HASHES 11
+#define NF_MIN_CAPACITY 65536 // 最小容量，启动时按已有用户数的两倍分配
+#define NF_COUNTER_MAX 15
+
+class name_filter
+{
+private:
+    std::mutex _mutex;
+    std::vector<uint64_t> _words; // 每个uint64_t保存16个4位计数器
+    uint64_t _counters;
+    uint64_t _size;     // 当前的键数量
+    uint64_t _capacity; // 误判率保持在预期以内的键数量
+
+private:
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // FNV-1a后再混合，得到两个独立的哈希值
+    static void hash(const std::string &name, uint64_t &h1, uint64_t &h2)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (unsigned char c : name)
+        {
+            h ^= tolower(c);
+            h *= 0x100000001b3ULL;
+        }
+        h1 = mix(h);
+        h2 = mix(h ^ 0x9e3779b97f4a7c15ULL) | 1;
+    }
+
+    unsigned int get(uint64_t i) const { return (_words[i >> 4] >> ((i & 15) * 4)) & 15; }
+
+    void set(uint64_t i, unsigned int v)
+    {
+        uint64_t shift = (i & 15) * 4;
+        _words[i >> 4] = (_words[i >> 4] & ~(15ULL << shift)) | ((uint64_t)v << shift);
+    }
+
+public:
+    name_filter(uint64_t capacity = NF_MIN_CAPACITY) { reset(capacity); }
+
+    // 清空并按容量重新分配
+    void reset(uint64_t capacity)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _capacity = capacity < NF_MIN_CAPACITY ? NF_MIN_CAPACITY : capacity;
+        _counters = _capacity * NF_COUNTERS_PER_KEY;
+        _words.assign(_counters / 16, 0);
+        _size = 0;
+    }
+
+    void add(const std::string &name)
+    {
+        uint64_t h1, h2;
+        hash(name, h1, h2);
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int i = 0; i < NF_HASHES; ++i)
+        {
+            uint64_t pos = (h1 + i * h2) % _counters;
+            unsigned int v = get(pos);
+            if (v < NF_COUNTER_MAX)
+                set(pos, v + 1);
+        }
+        _size++;
+    }
+
+    // 删除之前加入过的用户名
+    void remove(const std::string &name)
+    {
+        uint64_t h1, h2;
+        hash(name, h1, h2);
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int i = 0; i < NF_HASHES; ++i)
+        {
+            uint64_t pos = (h1 + i * h2) % _counters;
+            unsigned int v = get(pos);
+            if (v > 0 && v < NF_COUNTER_MAX) // 饱和的计数器不知道真实的次数，保持不变
+                set(pos, v - 1);
+        }
+        if (_size > 0)
+            _size--;
+    }
+
+    // 返回false表示一定不存在，true表示可能存在
+    bool contains(const std::string &name)
+    {
+        uint64_t h1, h2;
+        hash(name, h1, h2);
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int i = 0; i < NF_HASHES; ++i)
+        {
+            if (get((h1 + i * h2) % _counters) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    uint64_t size()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _size;
+    }
+
+    uint64_t capacity()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _capacity;
+    }
+
+    // 占用的内存字节数
+    uint64_t memory()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _words.size() * sizeof(uint64_t);
+    }
+};
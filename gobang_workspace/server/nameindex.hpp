@@ -0,0 +1,273 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+
+/*
+* 用户名前缀索引模块
+* 启动时把所有用户名加入压缩的基数树（路径压缩的trie），注册和分数变化时增量更新，按前缀搜索玩家不再访问数据库
+*
+* 节点保存在数组中用下标互相引用，边上的字符串保存在公共的字符区中（偏移+长度），孩子用兄弟链表按首字符排序；
+* 每个节点记录子树中的最高分，按前缀找到子树后按最高分优先展开，取出前K名只访问很少的节点
+* 数据库的用户名比较不区分大小写，索引中的键按小写保存，返回uid后由调用方取得原始的用户名
+*/
+
+#define NI_NIL 0xffffffffu
+#define NI_MAX_LIMIT 50 // 一次最多返回的玩家数量
+
+// 搜索结果中的一项，name为小写的用户名
+struct ni_entry
+{
+    uint64_t uid;
+    int64_t score;
+    std::string name;
+};
+
+class name_index
+{
+private:
+    struct ni_node
+    {
+        uint32_t label;   // 边上的字符串在字符区中的偏移
+        uint32_t child;   // 第一个孩子
+        uint32_t sibling; // 下一个兄弟
+        int32_t best;     // 子树中的最高分
+        int32_t score;    // 用户名在此结束时的分数
+        uint32_t uid;
+        uint8_t len;      // 边上的字符串长度
+        uint8_t term;     // 是否有用户名在此结束
+    };
+
+    // 搜索时展开的项：节点（按子树最高分）或者节点上的用户名（按自身分数）
+    struct ni_item
+    {
+        int32_t priority;
+        uint32_t node;
+        uint32_t from; // 在已展开路径中的下标，用于还原用户名
+        bool entry;
+        bool operator<(const ni_item &o) const { return priority < o.priority; }
+    };
+
+    std::mutex _mutex;
+    std::vector<ni_node> _nodes; // 0号为根节点
+    std::string _chars;          // 字符区
+    uint64_t _size;
+
+private:
+    static std::string normalize(const std::string &name)
+    {
+        std::string key(name);
+        for (char &c : key)
+            c = tolower((unsigned char)c);
+        return key;
+    }
+
+    uint32_t new_node(uint32_t label, uint8_t len)
+    {
+        _nodes.push_back(ni_node{label, NI_NIL, NI_NIL, INT32_MIN, 0, 0, len, 0});
+        return _nodes.size() - 1;
+    }
+
+    // 在parent的孩子中查找首字符为c的孩子，prev为前一个兄弟（没有则为NI_NIL）
+    uint32_t find_child(uint32_t parent, char c, uint32_t &prev) const
+    {
+        prev = NI_NIL;
+        for (uint32_t x = _nodes[parent].child; x != NI_NIL; x = _nodes[x].sibling)
+        {
+            char first = _chars[_nodes[x].label];
+            if (first == c)
+                return x;
+            if ((unsigned char)first > (unsigned char)c)
+                break;
+            prev = x;
+        }
+        return NI_NIL;
+    }
+
+    void link_after(uint32_t parent, uint32_t prev, uint32_t node)
+    {
+        if (prev == NI_NIL)
+        {
+            _nodes[node].sibling = _nodes[parent].child;
+            _nodes[parent].child = node;
+        }
+        else
+        {
+            _nodes[node].sibling = _nodes[prev].sibling;
+            _nodes[prev].sibling = node;
+        }
+    }
+
+    // 找到key结束的节点，不存在时按需创建（create为false时返回NI_NIL），path记录经过的节点
+    uint32_t descend(const std::string &key, bool create, std::vector<uint32_t> &path)
+    {
+        uint32_t cur = 0;
+        size_t i = 0;
+        path.push_back(cur);
+        while (i < key.size())
+        {
+            uint32_t prev;
+            uint32_t c = find_child(cur, key[i], prev);
+            if (c == NI_NIL)
+            {
+                if (create == false)
+                    return NI_NIL;
+                // 剩余的部分作为新的叶子，边长超过255时分成多段
+                while (i < key.size())
+                {
+                    size_t len = std::min<size_t>(key.size() - i, 255);
+                    uint32_t leaf = new_node(_chars.size(), len);
+                    _chars.append(key, i, len);
+                    link_after(cur, prev, leaf);
+                    cur = leaf;
+                    prev = NI_NIL;
+                    i += len;
+                    path.push_back(cur);
+                }
+                return cur;
+            }
+            size_t j = 0, len = _nodes[c].len;
+            uint32_t label = _nodes[c].label;
+            while (j < len && i + j < key.size() && _chars[label + j] == key[i + j])
+                ++j;
+            if (j < len)
+            {
+                if (create == false)
+                    return NI_NIL;
+                // 从第j个字符处分裂：新的中间节点接替c的位置，c成为它的孩子
+                uint32_t mid = new_node(label, j);
+                _nodes[mid].best = _nodes[c].best;
+                _nodes[mid].child = c;
+                _nodes[mid].sibling = _nodes[c].sibling;
+                if (prev == NI_NIL)
+                    _nodes[cur].child = mid;
+                else
+                    _nodes[prev].sibling = mid;
+                _nodes[c].sibling = NI_NIL;
+                _nodes[c].label += j;
+                _nodes[c].len -= j;
+                c = mid;
+            }
+            cur = c;
+            i += j;
+            path.push_back(cur);
+        }
+        return cur;
+    }
+
+    // 分数变化后自下而上重新计算路径上的子树最高分
+    void refresh(const std::vector<uint32_t> &path)
+    {
+        for (size_t i = path.size(); i-- > 0;)
+        {
+            ni_node &n = _nodes[path[i]];
+            int32_t best = n.term ? n.score : INT32_MIN;
+            for (uint32_t x = n.child; x != NI_NIL; x = _nodes[x].sibling)
+                best = std::max(best, _nodes[x].best);
+            if (best == n.best && i + 1 < path.size())
+                break; // 上层不受影响
+            n.best = best;
+        }
+    }
+
+public:
+    name_index() : _size(0) { new_node(0, 0); }
+
+    // 加入用户名，已经存在时更新uid和分数
+    void insert(const std::string &name, uint64_t uid, int64_t score)
+    {
+        std::string key = normalize(name);
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::vector<uint32_t> path;
+        uint32_t x = descend(key, true, path);
+        if (_nodes[x].term == 0)
+            _size++;
+        _nodes[x].term = 1;
+        _nodes[x].uid = uid;
+        _nodes[x].score = score;
+        refresh(path);
+    }
+
+    // 更新分数，用户名不存在时返回false
+    bool update(const std::string &name, int64_t score)
+    {
+        std::string key = normalize(name);
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::vector<uint32_t> path;
+        uint32_t x = descend(key, false, path);
+        if (x == NI_NIL || _nodes[x].term == 0)
+            return false;
+        _nodes[x].score = score;
+        refresh(path);
+        return true;
+    }
+
+    // 以prefix开头的用户名中分数最高的limit个，按分数从高到低
+    void search(const std::string &prefix, size_t limit, std::vector<ni_entry> &out)
+    {
+        std::string key = normalize(prefix);
+        std::unique_lock<std::mutex> lock(_mutex);
+        // 1. 找到覆盖前缀的子树，前缀可能在某条边的中间结束
+        uint32_t cur = 0;
+        std::string base; // 根到cur的父节点的字符串
+        size_t i = 0;
+        while (i < key.size())
+        {
+            uint32_t prev;
+            uint32_t c = find_child(cur, key[i], prev);
+            if (c == NI_NIL)
+                return;
+            size_t len = _nodes[c].len, n = std::min(len, key.size() - i);
+            if (_chars.compare(_nodes[c].label, n, key, i, n) != 0)
+                return;
+            base.append(_chars, _nodes[cur].label, _nodes[cur].len);
+            cur = c;
+            i += n;
+        }
+        // 2. 按子树最高分优先展开，用户名按自身分数和子树一起排序，先出队的分数一定更高
+        std::vector<std::pair<uint32_t, uint32_t>> visited; // 节点，父项下标
+        std::priority_queue<ni_item> pq;
+        pq.push(ni_item{_nodes[cur].best, cur, NI_NIL, false});
+        while (pq.empty() == false && out.size() < limit)
+        {
+            ni_item it = pq.top();
+            pq.pop();
+            if (it.entry)
+            {
+                // 还原用户名：沿已展开的路径回到起点
+                std::vector<uint32_t> chain;
+                for (uint32_t v = it.from; v != NI_NIL; v = visited[v].second)
+                    chain.push_back(visited[v].first);
+                std::string name = base;
+                for (size_t k = chain.size(); k-- > 0;)
+                    name.append(_chars, _nodes[chain[k]].label, _nodes[chain[k]].len);
+                out.push_back(ni_entry{_nodes[it.node].uid, _nodes[it.node].score, name});
+                continue;
+            }
+            visited.emplace_back(it.node, it.from);
+            uint32_t self = visited.size() - 1;
+            const ni_node &n = _nodes[it.node];
+            if (n.term)
+                pq.push(ni_item{n.score, it.node, self, true});
+            for (uint32_t x = n.child; x != NI_NIL; x = _nodes[x].sibling)
+                pq.push(ni_item{_nodes[x].best, x, self, false});
+        }
+    }
+
+    uint64_t size()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _size;
+    }
+
+    // 占用的内存字节数
+    uint64_t memory()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _nodes.capacity() * sizeof(ni_node) + _chars.capacity();
+    }
+};
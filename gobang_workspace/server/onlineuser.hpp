@@ -2,13 +2,15 @@
 
 #include <iostream>
 #include <string>
-#include <unordered_map>
 #include <mutex>
-#include <websocketpp/server.hpp>
-#include <websocketpp/config/asio_no_tls.hpp>
+#include <functional>
+#include <vector>
+#include <unordered_map>
 
 #include "log.hpp"
 #include "util.hpp"
+#include "wsconfig.hpp"
+#include "presence.hpp"
 
 /*
 * 在线用户管理模块
@@ -16,22 +18,26 @@
 * 用户登录成功后进入游戏大厅，对战匹配成功后进入游戏房间
 * 
 * 功能需求：
-* 维护两个容器：游戏大厅和游戏房间
+* 维护玩家的在线状态：离线、游戏大厅、游戏房间
 * 进入/退出 大厅/房间
 * 判断用户是否在大厅/房间内
 * 获取大厅/房间指定用户的连接
+* 统计大厅/房间的人数，取出大厅中所有的连接（大厅状态推送）
+*
+* 状态保存在无锁的在线状态表中，查询不加锁；进入时检查是否已经在线和登记是一个原子操作
+*
+* 集群模式下房间所在的节点与玩家连接的节点（网关）可能不同：房间所在的节点记录玩家连接在哪个节点上，
+* 发给房间中玩家的消息经由中继函数转发到网关节点
 */
 
 
 class onlineuser
 {
 public:
-    // onlineuser(/* args */);
-    // ~onlineuser();
-
     // websocket连接建立的时候才会加入游戏大厅&游戏房间在线用户管理
-    void enter_game_hall(uint64_t uid, websocketpp::server<websocketpp::config::asio>::connection_ptr &conn);
-    void enter_game_room(uint64_t uid, websocketpp::server<websocketpp::config::asio>::connection_ptr &conn);
+    // 玩家已经在大厅或房间中（重复登录）时返回ENTER_ONLINE，在线状态表已满时返回ENTER_FULL
+    enter_result enter_game_hall(uint64_t uid, WSserver::connection_ptr &conn);
+    enter_result enter_game_room(uint64_t uid, WSserver::connection_ptr &conn);
 
     // websocket连接断开的时候，才会移除游戏大厅&游戏房间在线用户管理
     void exit_game_hall(uint64_t uid);
@@ -42,98 +48,162 @@ public:
     bool is_in_game_room(uint64_t uid);
 
     // 通过用户ID在游戏大厅/游戏房间用户管理中获取对应的通信连接
-    websocketpp::server<websocketpp::config::asio>::connection_ptr get_conn_from_hall(uint64_t uid);
-    websocketpp::server<websocketpp::config::asio>::connection_ptr get_conn_from_room(uint64_t uid);
+    WSserver::connection_ptr get_conn_from_hall(uint64_t uid);
+    WSserver::connection_ptr get_conn_from_room(uint64_t uid);
+
+    // 大厅/房间中的人数，房间人数包括集群模式下连接在其他节点上的玩家
+    size_t hall_count();
+    size_t room_count();
+    // 取出大厅中所有玩家的连接
+    size_t hall_conns(std::vector<WSserver::connection_ptr> &conns);
+
+    // 集群模式：玩家通过node节点进入/退出本节点上的房间
+    void enter_remote_room(uint64_t uid, uint32_t node);
+    void exit_remote_room(uint64_t uid);
+    // 玩家在房间中时获取其连接所在的节点，本节点的玩家返回false
+    bool remote_node(uint64_t uid, uint32_t &node);
+    // 设置转发到其他节点的中继函数
+    void set_relay(const std::function<void(uint32_t, uint64_t, const std::string &)> &relay);
+
+    // 发送给房间中的玩家，玩家连接在其他节点上时经由中继转发，不在房间中返回false
+    bool send_to_room(uint64_t uid, const std::string &body);
 
 private: /* data */
-    std::mutex _mtx;
-    std::unordered_map<uint64_t, websocketpp::server<websocketpp::config::asio>::connection_ptr> _hall;
-    std::unordered_map<uint64_t, websocketpp::server<websocketpp::config::asio>::connection_ptr> _room;
+    presence_table<WSserver::connection_ptr> _presence;
+    // 集群模式下连接在其他节点上的房间玩家 uid -> 节点
+    std::mutex _remote_mutex;
+    std::unordered_map<uint64_t, uint32_t> _remote;
+    std::function<void(uint32_t, uint64_t, const std::string &)> _relay;
 };
 
-// onlineuser::onlineuser(/* args */)
-// {
-// }
-
-// onlineuser::~onlineuser()
-// {
-// }
-
 // websocket连接建立的时候才会加入游戏大厅&游戏房间在线用户管理
-void onlineuser::enter_game_hall(uint64_t uid, websocketpp::server<websocketpp::config::asio>::connection_ptr &conn)
+enter_result onlineuser::enter_game_hall(uint64_t uid, WSserver::connection_ptr &conn)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _hall.insert(std::make_pair(uid, conn));
+    enter_result ret = _presence.enter(uid, PRESENCE_HALL, conn);
+    if (ret == ENTER_FULL)
+        LOG(ERROR, "在线状态表已满，玩家%lu无法进入大厅", uid);
+    return ret;
 }
 
 
-void onlineuser::enter_game_room(uint64_t uid, websocketpp::server<websocketpp::config::asio>::connection_ptr &conn)
+enter_result onlineuser::enter_game_room(uint64_t uid, WSserver::connection_ptr &conn)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _room.insert(std::make_pair(uid, conn));
+    enter_result ret = _presence.enter(uid, PRESENCE_ROOM, conn);
+    if (ret == ENTER_FULL)
+        LOG(ERROR, "在线状态表已满，玩家%lu无法进入房间", uid);
+    return ret;
 }
 
 
 // websocket连接断开的时候，才会移除游戏大厅&游戏房间在线用户管理
 void onlineuser::exit_game_hall(uint64_t uid)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _hall.erase(uid);
+    _presence.exit(uid, PRESENCE_HALL);
 }
 
 
 void onlineuser::exit_game_room(uint64_t uid)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    _room.erase(uid);
+    _presence.exit(uid, PRESENCE_ROOM);
 }
 
 
 // 判断当前指定用户是否在游戏大厅/游戏房间
 bool onlineuser::is_in_game_hall(uint64_t uid)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    auto it = _hall.find(uid);
-    if (it == _hall.end())
-    {
-        return false;
-    }
-    return true;
+    return _presence.state(uid) == PRESENCE_HALL;
 }
 
 
 bool onlineuser::is_in_game_room(uint64_t uid)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    auto it = _room.find(uid);
-    if (it == _room.end())
-    {
+    if (_presence.state(uid) == PRESENCE_ROOM)
+        return true;
+    uint32_t node;
+    return remote_node(uid, node);
+}
+
+
+// 通过用户ID在游戏大厅/游戏房间用户管理中获取对应的通信连接
+WSserver::connection_ptr onlineuser::get_conn_from_hall(uint64_t uid)
+{
+    return _presence.conn(uid, PRESENCE_HALL);
+}
+
+
+WSserver::connection_ptr onlineuser::get_conn_from_room(uint64_t uid)
+{
+    return _presence.conn(uid, PRESENCE_ROOM);
+}
+
+
+// 大厅/房间中的人数
+size_t onlineuser::hall_count()
+{
+    return _presence.count(PRESENCE_HALL);
+}
+
+
+size_t onlineuser::room_count()
+{
+    std::unique_lock<std::mutex> lock(_remote_mutex);
+    return _presence.count(PRESENCE_ROOM) + _remote.size();
+}
+
+
+// 取出大厅中所有玩家的连接
+size_t onlineuser::hall_conns(std::vector<WSserver::connection_ptr> &conns)
+{
+    return _presence.collect(PRESENCE_HALL, conns);
+}
+
+
+// 集群模式：玩家通过node节点进入/退出本节点上的房间
+void onlineuser::enter_remote_room(uint64_t uid, uint32_t node)
+{
+    std::unique_lock<std::mutex> lock(_remote_mutex);
+    _remote[uid] = node;
+}
+
+
+void onlineuser::exit_remote_room(uint64_t uid)
+{
+    std::unique_lock<std::mutex> lock(_remote_mutex);
+    _remote.erase(uid);
+}
+
+
+bool onlineuser::remote_node(uint64_t uid, uint32_t &node)
+{
+    std::unique_lock<std::mutex> lock(_remote_mutex);
+    auto it = _remote.find(uid);
+    if (it == _remote.end())
         return false;
-    }
+    node = it->second;
     return true;
 }
 
 
-// 通过用户ID在游戏大厅/游戏房间用户管理中获取对应的通信连接
-websocketpp::server<websocketpp::config::asio>::connection_ptr onlineuser::get_conn_from_hall(uint64_t uid)
+void onlineuser::set_relay(const std::function<void(uint32_t, uint64_t, const std::string &)> &relay)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    auto it = _hall.find(uid);
-    if (it == _hall.end())
-    {
-        return websocketpp::server<websocketpp::config::asio>::connection_ptr();
-    }
-    return it->second;
+    _relay = relay;
 }
 
 
-websocketpp::server<websocketpp::config::asio>::connection_ptr onlineuser::get_conn_from_room(uint64_t uid)
+// 发送给房间中的玩家，玩家连接在其他节点上时经由中继转发
+bool onlineuser::send_to_room(uint64_t uid, const std::string &body)
 {
-    std::unique_lock<std::mutex> lock(_mtx);
-    auto it = _room.find(uid);
-    if (it == _room.end())
+    WSserver::connection_ptr conn = get_conn_from_room(uid);
+    if (conn.get() != nullptr)
+    {
+        ws_send(conn, body);
+        return true;
+    }
+    uint32_t node;
+    if (_relay && remote_node(uid, node))
     {
-        return websocketpp::server<websocketpp::config::asio>::connection_ptr();
+        _relay(node, uid, body);
+        return true;
     }
-    return it->second;
+    return false;
 }
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.hpp"
+
+/*
+* 开局库模块
+* 统计标准棋盘上每局前OPENING_PLIES步经过的局面的白胜/和/黑胜次数，按规则和等级分段分开统计，
+* 玩家可以查看当前局面下每个落点在自己分段的胜率
+*
+* 局面的键：Zobrist哈希（每个落点、每种颜色一个随机数，局面的哈希为所有棋子的异或）
+* 棋盘的8种对称（4种旋转，各自再左右翻转）得到的局面视为同一个局面，取8个哈希中最小的一个；
+* 8个哈希随落子增量更新，不需要每步变换整个棋盘。键再异或上规则和分段对应的随机数
+*
+* 统计表是内存映射文件中的开放寻址哈希表（线性探测），槽位 = 键 + 三个计数，键为0表示空槽：
+*   写入：用CAS占用空槽，计数用原子加，不加锁，多进程模式下各worker映射同一个文件共同写入
+*   读取：不加锁，先读键再读计数，计数之间可能相差正在写入的一局
+* 表的容量在创建文件时确定，不扩容；已用槽位超过OPENING_MAX_LOAD后不再加入新局面（已有局面照常计数）
+* 数据由内核回写到文件，进程崩溃不会丢失已经写入映射的计数
+*/
+
+#define OPENING_PATH "./opening.tbl"
+#define OPENING_CAPACITY (1 << 24) // 默认的槽位数，2的幂
+#define OPENING_MAX_LOAD 0.85      // 已用槽位的上限比例
+#define OPENING_MAX_PROBE 256      // 线性探测的最大步数
+#define OPENING_PLIES 12           // 每局统计的步数
+#define OPENING_COLS 15            // 只统计标准棋盘
+#define OPENING_SQUARES (OPENING_COLS * OPENING_COLS)
+#define OPENING_BANDS 4            // 等级分段：<1400 1400~1700 1700~2000 >=2000
+#define OPENING_RULES 3
+#define OPENING_MAGIC 0x4f50454e494e4731ULL // "OPENING1"
+#define OPENING_VERSION 1
+
+typedef enum
+{
+    OPENING_WHITE_WIN = 0,
+    OPENING_DRAW = 1,
+    OPENING_BLACK_WIN = 2
+} opening_result;
+
+struct opening_stats
+{
+    uint64_t count[3] = {0, 0, 0}; // 按opening_result下标
+
+    uint64_t games() const { return count[0] + count[1] + count[2]; }
+};
+
+// 某个局面下的一个落点及落子之后的局面的统计
+struct opening_move
+{
+    int row;
+    int col;
+    opening_stats stats;
+};
+
+struct opening_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t capacity;
+    std::atomic<uint64_t> used; // 已用的槽位数
+    char reserved[32];
+};
+
+struct opening_slot
+{
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> count[3];
+    uint32_t reserved;
+};
+
+static_assert(sizeof(opening_header) == 64, "opening_header size");
+static_assert(sizeof(opening_slot) == 24, "opening_slot size");
+
+// Zobrist哈希和对称变换，随落子维护8个对称局面的哈希
+class opening_hasher
+{
+private:
+    uint64_t _zobrist[2][OPENING_SQUARES];
+    uint64_t _rule_key[OPENING_RULES];
+    uint64_t _band_key[OPENING_BANDS];
+    uint16_t _sym[8][OPENING_SQUARES]; // 第k种对称下落点的位置
+
+    static uint64_t splitmix(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    // 随机数由固定的种子生成，文件中的键在重启和不同进程之间保持一致
+    opening_hasher()
+    {
+        uint64_t seed = OPENING_MAGIC;
+        for (int c = 0; c < 2; ++c)
+            for (int sq = 0; sq < OPENING_SQUARES; ++sq)
+                _zobrist[c][sq] = splitmix(seed);
+        for (int i = 0; i < OPENING_RULES; ++i)
+            _rule_key[i] = splitmix(seed);
+        for (int i = 0; i < OPENING_BANDS; ++i)
+            _band_key[i] = splitmix(seed);
+        const int n = OPENING_COLS - 1;
+        for (int r = 0; r < OPENING_COLS; ++r)
+        {
+            for (int c = 0; c < OPENING_COLS; ++c)
+            {
+                int sq = r * OPENING_COLS + c;
+                _sym[0][sq] = r * OPENING_COLS + c;
+                _sym[1][sq] = c * OPENING_COLS + (n - r);
+                _sym[2][sq] = (n - r) * OPENING_COLS + (n - c);
+                _sym[3][sq] = (n - c) * OPENING_COLS + r;
+                _sym[4][sq] = r * OPENING_COLS + (n - c);
+                _sym[5][sq] = (n - r) * OPENING_COLS + c;
+                _sym[6][sq] = c * OPENING_COLS + r;
+                _sym[7][sq] = (n - c) * OPENING_COLS + (n - r);
+            }
+        }
+    }
+
+    static opening_hasher &instance()
+    {
+        static opening_hasher hasher;
+        return hasher;
+    }
+
+    // 第k种对称下落点的位置
+    int transform(int k, int sq) const { return _sym[k][sq]; }
+
+    // 在8个对称局面的哈希上落一子，第ply步（从0开始）的颜色：白子先行
+    void play(uint64_t h[8], int ply, int sq) const
+    {
+        int color = ply & 1;
+        for (int k = 0; k < 8; ++k)
+            h[k] ^= _zobrist[color][_sym[k][sq]];
+    }
+
+    // 规范化的局面键，不为0
+    uint64_t key(const uint64_t h[8], int rule, int band) const
+    {
+        uint64_t m = *std::min_element(h, h + 8);
+        uint64_t k = m ^ _rule_key[rule] ^ _band_key[band];
+        return k == 0 ? 1 : k;
+    }
+
+    // 整个局面的哈希，squares为按顺序的落点，用于校验增量结果
+    uint64_t full(const std::vector<uint16_t> &squares, int k) const
+    {
+        uint64_t h = 0;
+        for (size_t i = 0; i < squares.size(); ++i)
+            h ^= _zobrist[i & 1][_sym[k][squares[i]]];
+        return h;
+    }
+};
+
+class opening_table
+{
+private:
+    std::string _path;
+    uint64_t _capacity; // 创建新文件时的槽位数，已有的文件以文件头为准
+    opening_header *_head;
+    opening_slot *_slots;
+    size_t _map_bytes;
+    uint64_t _mask;
+    uint64_t _max_used;
+    std::atomic<bool> _full_logged;
+
+private:
+    static size_t file_bytes(uint64_t capacity) { return sizeof(opening_header) + capacity * sizeof(opening_slot); }
+
+    // 找到键所在的槽位，insert为true时占用空槽，找不到或表已满返回nullptr
+    opening_slot *find(uint64_t key, bool insert)
+    {
+        uint64_t i = key & _mask;
+        for (int probe = 0; probe < OPENING_MAX_PROBE; ++probe, i = (i + 1) & _mask)
+        {
+            opening_slot &s = _slots[i];
+            uint64_t k = s.key.load(std::memory_order_acquire);
+            if (k == key)
+                return &s;
+            if (k != 0)
+                continue;
+            if (insert == false)
+                return nullptr;
+            if (_head->used.load(std::memory_order_relaxed) >= _max_used)
+            {
+                if (_full_logged.exchange(true) == false)
+                    LOG(ERROR, "开局库已满(%lu个局面)，不再加入新局面", _head->used.load());
+                return nullptr;
+            }
+            // 其他线程（或进程）同时占用了这个槽位时，k被更新为它写入的键，重新比较
+            if (s.key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+            {
+                _head->used.fetch_add(1, std::memory_order_relaxed);
+                return &s;
+            }
+            if (k == key)
+                return &s;
+        }
+        return nullptr;
+    }
+
+public:
+    opening_table(const std::string &path = OPENING_PATH, uint64_t capacity = OPENING_CAPACITY)
+        : _path(path), _capacity(capacity), _head(nullptr), _slots(nullptr), _map_bytes(0), _mask(0), _max_used(0), _full_logged(false) {}
+
+    ~opening_table()
+    {
+        if (_head == nullptr)
+            return;
+        msync(_head, _map_bytes, MS_SYNC);
+        munmap(_head, _map_bytes);
+    }
+
+    // 打开或创建统计文件并映射到内存
+    bool open()
+    {
+        if (_capacity == 0 || (_capacity & (_capacity - 1)) != 0)
+        {
+            LOG(ERROR, "开局库容量%lu不是2的幂", _capacity);
+            return false;
+        }
+        int fd = ::open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            LOG(ERROR, "开局库文件打开失败: %s", strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+        {
+            LOG(ERROR, "开局库文件读取失败: %s", strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        // 已有的文件按文件头中的容量映射；新文件扩展为稀疏文件，槽位全部为0
+        uint64_t capacity = _capacity;
+        if ((size_t)st.st_size >= sizeof(opening_header))
+        {
+            opening_header head;
+            if (pread(fd, &head, sizeof(head), 0) == (ssize_t)sizeof(head) && head.magic == OPENING_MAGIC)
+                capacity = head.capacity;
+        }
+        size_t bytes = file_bytes(capacity);
+        if ((size_t)st.st_size < bytes && ftruncate(fd, bytes) < 0)
+        {
+            LOG(ERROR, "开局库文件扩展失败: %s", strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            LOG(ERROR, "开局库文件映射失败: %s", strerror(errno));
+            return false;
+        }
+        _head = (opening_header *)p;
+        _map_bytes = bytes;
+        // 新文件写入文件头；多个worker同时创建时写入的内容相同
+        if (_head->magic != OPENING_MAGIC)
+        {
+            _head->version = OPENING_VERSION;
+            _head->slot_size = sizeof(opening_slot);
+            _head->capacity = capacity;
+            std::atomic_thread_fence(std::memory_order_release);
+            _head->magic = OPENING_MAGIC;
+        }
+        if (_head->version != OPENING_VERSION || _head->slot_size != sizeof(opening_slot) || _head->capacity != capacity)
+        {
+            LOG(ERROR, "开局库文件格式不匹配: %s", _path.c_str());
+            munmap(_head, _map_bytes);
+            _head = nullptr;
+            return false;
+        }
+        _slots = (opening_slot *)((char *)p + sizeof(opening_header));
+        _capacity = capacity;
+        _mask = capacity - 1;
+        _max_used = (uint64_t)(capacity * OPENING_MAX_LOAD);
+        LOG(DEBUG, "开局库加载完毕，%lu 个局面，容量 %lu", _head->used.load(), capacity);
+        return true;
+    }
+
+    bool is_open() { return _head != nullptr; }
+
+    // 等级分所在的分段
+    static int band_of(int rating)
+    {
+        if (rating < 1400)
+            return 0;
+        if (rating < 1700)
+            return 1;
+        if (rating < 2000)
+            return 2;
+        return 3;
+    }
+
+    // 一个局面的计数加一，表已满且是新局面时返回false
+    bool update(uint64_t key, opening_result result)
+    {
+        opening_slot *s = find(key, true);
+        if (s == nullptr)
+            return false;
+        s->count[result].fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 读取一个局面的计数，没有记录时返回false
+    bool lookup(uint64_t key, opening_stats &stats)
+    {
+        opening_slot *s = find(key, false);
+        if (s == nullptr)
+            return false;
+        for (int i = 0; i < 3; ++i)
+            stats.count[i] += s->count[i].load(std::memory_order_relaxed);
+        return true;
+    }
+
+    // 对局结束后统计前OPENING_PLIES步的局面，squares为标准棋盘上按顺序的落点
+    void record(const std::vector<uint16_t> &squares, int rule, int rating, opening_result result)
+    {
+        if (_head == nullptr || rule < 0 || rule >= OPENING_RULES)
+            return;
+        const opening_hasher &oh = opening_hasher::instance();
+        uint64_t h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        int band = band_of(rating);
+        for (size_t i = 0; i < squares.size() && i < OPENING_PLIES; ++i)
+        {
+            if (squares[i] >= OPENING_SQUARES)
+                return;
+            oh.play(h, i, squares[i]);
+            update(oh.key(h, rule, band), result);
+        }
+    }
+
+    // 查询squares局面本身和之后每个落点的统计，band为-1时合计所有分段；next按局数从多到少，最多limit个
+    void explore(const std::vector<uint16_t> &squares, int rule, int band, size_t limit, opening_stats &here, std::vector<opening_move> &next)
+    {
+        if (_head == nullptr || rule < 0 || rule >= OPENING_RULES || squares.size() >= OPENING_PLIES)
+            return;
+        const opening_hasher &oh = opening_hasher::instance();
+        uint64_t h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        std::vector<bool> taken(OPENING_SQUARES, false);
+        for (size_t i = 0; i < squares.size(); ++i)
+        {
+            if (squares[i] >= OPENING_SQUARES || taken[squares[i]])
+                return;
+            taken[squares[i]] = true;
+            oh.play(h, i, squares[i]);
+        }
+        int first = band < 0 ? 0 : band, last = band < 0 ? OPENING_BANDS - 1 : band;
+        if (squares.empty() == false)
+        {
+            for (int b = first; b <= last; ++b)
+                lookup(oh.key(h, rule, b), here);
+        }
+        // 对称的落点得到相同的局面，只查一次
+        std::vector<uint64_t> seen;
+        for (int sq = 0; sq < OPENING_SQUARES; ++sq)
+        {
+            if (taken[sq])
+                continue;
+            uint64_t child[8];
+            std::copy(h, h + 8, child);
+            oh.play(child, squares.size(), sq);
+            uint64_t canon = oh.key(child, rule, 0);
+            bool dup = std::find(seen.begin(), seen.end(), canon) != seen.end();
+            seen.push_back(canon);
+            if (dup)
+                continue;
+            opening_move m{sq / OPENING_COLS, sq % OPENING_COLS, opening_stats()};
+            for (int b = first; b <= last; ++b)
+                lookup(oh.key(child, rule, b), m.stats);
+            if (m.stats.games() > 0)
+                next.push_back(m);
+        }
+        std::sort(next.begin(), next.end(), [](const opening_move &a, const opening_move &b) {
+            return a.stats.games() > b.stats.games();
+        });
+        if (next.size() > limit)
+            next.resize(limit);
+    }
+
+    // 已有的局面数
+    uint64_t size() { return _head == nullptr ? 0 : _head->used.load(std::memory_order_relaxed); }
+
+    uint64_t capacity() { return _head == nullptr ? 0 : _capacity; }
+};
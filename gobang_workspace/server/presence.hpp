@@ -0,0 +1,282 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+/*
+* 在线状态表
+* 以uid为键的开放寻址哈希表，每个条目记录玩家的状态（离线/大厅/房间）和连接
+*
+* 状态字的低2位是状态，其余位是版本号，每次变化加1；进入和退出都用CAS修改状态字，
+* 已经在线的玩家再次进入会失败，检查和插入是一个原子操作，不会出现两个连接同时进入
+* 查询状态只读一次状态字；获取连接时读取后再次检查状态字，版本号变化说明期间发生了切换，重新读取
+*
+* 连接保存在单独分配的盒子中，切换时换下来的盒子要等到没有线程正在读取时才释放：
+* 读取方在分段的计数器上登记（不同线程落在不同的缓存行上），写入方换下盒子后所有计数器都为0时释放
+*
+* 离线时只清空连接，条目留在表中；新玩家插入时可以回收离线的条目（墓碑），表中的条目数由同时在线的人数决定
+* 插入在一把锁内进行，先确认玩家不在表中，再占用探测序列上第一个空条目或离线条目，同一玩家不会有两个条目；
+* 回收时先把状态字切换为正在切换再换上新的uid，读取方读到状态字后检查uid，uid不符说明条目已经换了主人
+* 每个玩家的条目只放在探测序列的前PRESENCE_PROBE个位置，查找最多探测这么多条目；都被在线玩家占用时表满，进入失败
+* 每种状态的人数单独计数；遍历某种状态的所有连接时扫描整个表（大厅状态推送每秒一次）
+*/
+
+#define PRESENCE_CAPACITY (1 << 18) // 条目数量，2的幂
+#define PRESENCE_STRIPES 16         // 读取计数器的分段数
+#define PRESENCE_PROBE 64           // 最多探测的条目数
+
+typedef enum
+{
+    PRESENCE_OFFLINE = 0,
+    PRESENCE_HALL = 1,
+    PRESENCE_ROOM = 2,
+    PRESENCE_BUSY = 3 // 正在切换，连接还没有放好或取走
+} presence_state;
+
+typedef enum
+{
+    ENTER_OK,     // 进入成功
+    ENTER_ONLINE, // 已经在线（重复登录）
+    ENTER_FULL    // 表满
+} enter_result;
+
+template <class Conn>
+class presence_table
+{
+private:
+    struct conn_box
+    {
+        Conn conn;
+    };
+
+    struct entry
+    {
+        std::atomic<uint64_t> uid; // 0表示空条目
+        std::atomic<uint64_t> word; // 版本号<<2 | 状态
+        std::atomic<conn_box *> box;
+    };
+
+    struct alignas(64) stripe
+    {
+        std::atomic<int> readers;
+    };
+
+    std::vector<entry> _entries;
+    uint64_t _mask;
+    stripe _stripes[PRESENCE_STRIPES];
+    std::atomic<int64_t> _count[4]; // 各状态的人数，不统计正在切换的条目
+    std::mutex _insert_mutex;       // 插入新玩家时加锁，查找不加锁
+    // 等待释放的盒子，只有切换状态的线程访问
+    std::mutex _retire_mutex;
+    std::vector<conn_box *> _retired;
+
+private:
+    static presence_state state_of(uint64_t word) { return (presence_state)(word & 3); }
+    static uint64_t make_word(uint64_t word, presence_state state) { return ((word >> 2) + 1) << 2 | state; }
+
+    static size_t stripe_index()
+    {
+        static thread_local size_t idx = std::hash<std::thread::id>()(std::this_thread::get_id()) % PRESENCE_STRIPES;
+        return idx;
+    }
+
+    size_t slot_of(uint64_t uid) { return (uid * 0x9E3779B97F4A7C15ULL >> 20) & _mask; }
+
+    size_t probe() { return _mask + 1 < PRESENCE_PROBE ? _mask + 1 : PRESENCE_PROBE; }
+
+    // 查找uid的条目，没有时返回nullptr
+    entry *find(uint64_t uid)
+    {
+        for (size_t i = slot_of(uid), n = 0; n < probe(); i = (i + 1) & _mask, ++n)
+        {
+            uint64_t cur = _entries[i].uid.load(std::memory_order_acquire);
+            if (cur == uid)
+                return &_entries[i];
+            if (cur == 0)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    // 查找uid的条目，没有时插入，表满时返回nullptr
+    entry *find_or_insert(uint64_t uid)
+    {
+        entry *e = find(uid);
+        if (e != nullptr)
+            return e;
+        std::unique_lock<std::mutex> lock(_insert_mutex);
+        e = find(uid);
+        if (e != nullptr)
+            return e;
+        for (size_t i = slot_of(uid), n = 0; n < probe(); i = (i + 1) & _mask, ++n)
+        {
+            entry &cand = _entries[i];
+            if (cand.uid.load() == 0)
+            {
+                cand.uid.store(uid);
+                return &cand;
+            }
+            // 回收离线的条目：切换期间原来的玩家无法进入，换上新的uid后再恢复为离线
+            uint64_t word = cand.word.load();
+            if (state_of(word) == PRESENCE_OFFLINE && cand.word.compare_exchange_strong(word, make_word(word, PRESENCE_BUSY)))
+            {
+                cand.uid.store(uid);
+                cand.word.store(make_word(cand.word.load(), PRESENCE_OFFLINE));
+                return &cand;
+            }
+        }
+        return nullptr;
+    }
+
+    // 换下的盒子在没有读取方时释放
+    void retire(conn_box *box)
+    {
+        std::unique_lock<std::mutex> lock(_retire_mutex);
+        if (box != nullptr)
+            _retired.push_back(box);
+        for (int i = 0; i < PRESENCE_STRIPES; ++i)
+        {
+            if (_stripes[i].readers.load() != 0)
+                return;
+        }
+        for (conn_box *b : _retired)
+            delete b;
+        _retired.clear();
+    }
+
+public:
+    presence_table(size_t capacity = PRESENCE_CAPACITY) : _entries(capacity), _mask(capacity - 1)
+    {
+        for (entry &e : _entries)
+        {
+            e.uid = 0;
+            e.word = PRESENCE_OFFLINE;
+            e.box = nullptr;
+        }
+        for (int i = 0; i < PRESENCE_STRIPES; ++i)
+            _stripes[i].readers = 0;
+        for (int i = 0; i < 4; ++i)
+            _count[i] = 0;
+    }
+
+    ~presence_table()
+    {
+        for (entry &e : _entries)
+            delete e.box.load();
+        for (conn_box *b : _retired)
+            delete b;
+    }
+
+    // 离线的玩家进入state状态，已经在线时返回ENTER_ONLINE，表满时返回ENTER_FULL
+    enter_result enter(uint64_t uid, presence_state state, const Conn &conn)
+    {
+        while (1)
+        {
+            entry *e = find_or_insert(uid);
+            if (e == nullptr)
+                return ENTER_FULL;
+            uint64_t word = e->word.load();
+            // 条目被回收给了其他玩家，重新查找
+            if (e->uid.load() != uid)
+                continue;
+            // 正在切换（进入、退出或回收）的条目很快会恢复，等待后重新判断
+            if (state_of(word) == PRESENCE_BUSY)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (state_of(word) != PRESENCE_OFFLINE)
+                return ENTER_ONLINE;
+            if (e->word.compare_exchange_strong(word, make_word(word, PRESENCE_BUSY)) == false)
+                continue;
+            // 占住条目后放入连接，再公开状态
+            conn_box *old = e->box.exchange(new conn_box{conn});
+            e->word.store(make_word(e->word.load(), state));
+            _count[state]++;
+            if (old != nullptr)
+                retire(old);
+            return ENTER_OK;
+        }
+    }
+
+    // 处于state状态的玩家离线，状态不符时返回false
+    bool exit(uint64_t uid, presence_state state)
+    {
+        entry *e = find(uid);
+        if (e == nullptr)
+            return false;
+        uint64_t word = e->word.load();
+        if (e->uid.load() != uid || state_of(word) != state || e->word.compare_exchange_strong(word, make_word(word, PRESENCE_BUSY)) == false)
+            return false;
+        _count[state]--;
+        conn_box *old = e->box.exchange(nullptr);
+        e->word.store(make_word(e->word.load(), PRESENCE_OFFLINE));
+        retire(old);
+        return true;
+    }
+
+    // 获取玩家的状态
+    presence_state state(uint64_t uid)
+    {
+        entry *e = find(uid);
+        if (e == nullptr)
+            return PRESENCE_OFFLINE;
+        presence_state s = state_of(e->word.load());
+        if (e->uid.load() != uid)
+            return PRESENCE_OFFLINE;
+        return s == PRESENCE_BUSY ? PRESENCE_OFFLINE : s;
+    }
+
+    // 获取处于state状态的玩家的连接，不在该状态时返回空连接
+    Conn conn(uint64_t uid, presence_state state)
+    {
+        entry *e = find(uid);
+        if (e == nullptr)
+            return Conn();
+        std::atomic<int> &readers = _stripes[stripe_index()].readers;
+        while (1)
+        {
+            uint64_t word = e->word.load();
+            if (e->uid.load() != uid || state_of(word) != state)
+                return Conn();
+            readers.fetch_add(1);
+            conn_box *box = e->box.load();
+            Conn c = box != nullptr ? box->conn : Conn();
+            readers.fetch_sub(1);
+            if (e->word.load() == word)
+                return c;
+        }
+    }
+
+    // 处于state状态的人数
+    size_t count(presence_state state)
+    {
+        int64_t n = _count[state].load();
+        return n < 0 ? 0 : (size_t)n;
+    }
+
+    // 取出所有处于state状态的玩家的连接，返回个数
+    size_t collect(presence_state state, std::vector<Conn> &out)
+    {
+        std::atomic<int> &readers = _stripes[stripe_index()].readers;
+        size_t n = 0;
+        // 整个扫描期间登记为读取方，换下的盒子等扫描结束后再释放
+        readers.fetch_add(1);
+        for (entry &e : _entries)
+        {
+            if (e.uid.load(std::memory_order_relaxed) == 0 || state_of(e.word.load()) != state)
+                continue;
+            conn_box *box = e.box.load();
+            if (box == nullptr)
+                continue;
+            out.push_back(box->conn);
+            n++;
+        }
+        readers.fetch_sub(1);
+        return n;
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+/*
+* 等级分模块
+* 使用Glicko-2计算对局双方的等级分：除了分数本身，还记录分数的可信程度（rating deviation）
+* 和玩家发挥的稳定程度（volatility），新玩家的分数变化快，对局越多分数越稳定
+*
+* 每局对局视为一个评分周期，对局结束时同时计算双方的新分数，通过更新回调一次性持久化双方的结果。
+* 同一玩家的多局对局可能同时结束，也可能结束在不同的进程（多进程、集群模式）中，
+* 因此计算不使用缓存中的分数：更新回调在一个事务中锁定并读取双方当前的分数，计算后写入再提交，
+* 由存储的行锁保证每一局都基于前一局的结果计算，不会丢失更新。
+*
+* 缓存只用于读取（匹配、房间信息），数量有上限，满了之后随意淘汰一项；
+* 事务提交后用新分数更新缓存，缓存的锁不在访问存储期间持有。
+* 多进程和集群模式下其他进程的更新不会反映到本进程的缓存中，此时容量为0，不缓存。
+*/
+
+#define GLICKO_RATING 1500.0   // 新玩家的初始分数
+#define GLICKO_RD 350.0        // 新玩家的初始分数偏差
+#define GLICKO_VOL 0.06        // 新玩家的初始波动率
+#define GLICKO_TAU 0.5         // 系统常数，限制波动率的变化速度
+#define GLICKO_SCALE 173.7178  // Glicko与Glicko-2刻度的换算系数
+#define GLICKO_EPS 0.000001    // 波动率迭代的收敛精度
+#define GLICKO_MIN_RD 30.0     // 分数偏差的下限，避免老玩家的分数完全不再变化
+#define RATING_CACHE_SIZE 100000 // 缓存的玩家分数上限
+
+struct glicko_rating
+{
+    double rating;
+    double rd;
+    double vol;
+};
+
+// 评分周期内的一局对局
+struct glicko_game
+{
+    glicko_rating opponent;
+    double score; // 胜1 和0.5 负0
+};
+
+// 一局对局结束后需要持久化的一名玩家的结果
+struct rating_change
+{
+    uint64_t uid;
+    glicko_rating rating;
+    bool win;
+};
+
+inline double glicko_g(double phi)
+{
+    return 1.0 / sqrt(1.0 + 3.0 * phi * phi / (M_PI * M_PI));
+}
+
+// 按Glicko-2计算玩家经过一个评分周期（n局对局）后的分数
+inline glicko_rating glicko2_update(const glicko_rating &player, const glicko_game *games, int n)
+{
+    double mu = (player.rating - GLICKO_RATING) / GLICKO_SCALE;
+    double phi = player.rd / GLICKO_SCALE;
+    double sigma = player.vol;
+    if (n == 0)
+    {
+        double rd = sqrt(phi * phi + sigma * sigma) * GLICKO_SCALE;
+        return glicko_rating{player.rating, rd < GLICKO_RD ? rd : GLICKO_RD, sigma};
+    }
+    // 1. 估计方差v和分数改进量delta
+    double v_inv = 0, sum = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        double mu_j = (games[i].opponent.rating - GLICKO_RATING) / GLICKO_SCALE;
+        double g = glicko_g(games[i].opponent.rd / GLICKO_SCALE);
+        double e = 1.0 / (1.0 + exp(-g * (mu - mu_j)));
+        v_inv += g * g * e * (1 - e);
+        sum += g * (games[i].score - e);
+    }
+    double v = 1.0 / v_inv;
+    double delta = v * sum;
+
+    // 2. Illinois算法迭代求新的波动率
+    double a = log(sigma * sigma);
+    auto f = [&](double x) {
+        double ex = exp(x);
+        double d = phi * phi + v + ex;
+        return ex * (delta * delta - phi * phi - v - ex) / (2 * d * d) - (x - a) / (GLICKO_TAU * GLICKO_TAU);
+    };
+    double A = a, B;
+    if (delta * delta > phi * phi + v)
+    {
+        B = log(delta * delta - phi * phi - v);
+    }
+    else
+    {
+        int k = 1;
+        while (f(a - k * GLICKO_TAU) < 0)
+            ++k;
+        B = a - k * GLICKO_TAU;
+    }
+    double fa = f(A), fb = f(B);
+    while (fabs(B - A) > GLICKO_EPS)
+    {
+        double C = A + (A - B) * fa / (fb - fa);
+        double fc = f(C);
+        if (fc * fb <= 0)
+        {
+            A = B;
+            fa = fb;
+        }
+        else
+        {
+            fa /= 2;
+        }
+        B = C;
+        fb = fc;
+    }
+    double new_sigma = exp(A / 2);
+
+    // 3. 更新分数偏差和分数
+    double phi_star = sqrt(phi * phi + new_sigma * new_sigma);
+    double new_phi = 1.0 / sqrt(1.0 / (phi_star * phi_star) + 1.0 / v);
+    double new_mu = mu + new_phi * new_phi * sum;
+
+    glicko_rating ret;
+    ret.rating = GLICKO_SCALE * new_mu + GLICKO_RATING;
+    ret.rd = GLICKO_SCALE * new_phi;
+    if (ret.rd < GLICKO_MIN_RD)
+        ret.rd = GLICKO_MIN_RD;
+    if (ret.rd > GLICKO_RD)
+        ret.rd = GLICKO_RD;
+    ret.vol = new_sigma;
+    return ret;
+}
+
+class rating_book
+{
+public:
+    // 从存储中读取玩家的分数
+    using loader = std::function<bool(uint64_t uid, glicko_rating &rating)>;
+    // 根据双方当前的分数计算新分数：调用时changes[i].rating为当前分数，返回时为新分数
+    using apply = std::function<void(rating_change *changes, int n)>;
+    // 在一个事务中锁定并读取changes中所有玩家当前的分数，调用apply计算后写入，全部成功才提交
+    using updater = std::function<bool(rating_change *changes, int n, const apply &fn)>;
+
+private:
+    // 保护缓存，不在访问存储期间持有
+    std::mutex _mutex;
+    // 已经读取过的玩家分数 uid rating
+    std::unordered_map<uint64_t, glicko_rating> _cache;
+    size_t _capacity;
+    loader _load;
+    updater _update;
+
+private:
+    void put(uint64_t uid, const glicko_rating &rating)
+    {
+        if (_capacity == 0)
+            return;
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_cache.size() >= _capacity && _cache.count(uid) == 0)
+            _cache.erase(_cache.begin());
+        _cache[uid] = rating;
+    }
+
+public:
+    rating_book(const loader &load, const updater &update, size_t capacity = RATING_CACHE_SIZE)
+        : _capacity(capacity), _load(load), _update(update) {}
+
+    // 获取玩家当前的分数
+    bool get(uint64_t uid, glicko_rating &rating)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto it = _cache.find(uid);
+            if (it != _cache.end())
+            {
+                rating = it->second;
+                return true;
+            }
+        }
+        if (_load(uid, rating) == false)
+            return false;
+        put(uid, rating);
+        return true;
+    }
+
+    // 两名玩家对局结束，同时计算并写入双方的新分数
+    bool game_over(uint64_t winner_id, uint64_t loser_id, rating_change changes[2])
+    {
+        changes[0] = rating_change{winner_id, glicko_rating{}, true};
+        changes[1] = rating_change{loser_id, glicko_rating{}, false};
+        bool ret = _update(changes, 2, [](rating_change *c, int) {
+            glicko_rating w = c[0].rating, l = c[1].rating;
+            glicko_game wg = {l, 1.0}, lg = {w, 0.0};
+            c[0].rating = glicko2_update(w, &wg, 1);
+            c[1].rating = glicko2_update(l, &lg, 1);
+        });
+        if (ret == false)
+            return false;
+        put(winner_id, changes[0].rating);
+        put(loser_id, changes[1].rating);
+        return true;
+    }
+
+    // 玩家与固定分数的对手（如电脑玩家）对局结束，只更新玩家一方
+    bool game_over(uint64_t uid, bool win, const glicko_rating &opponent, rating_change &change)
+    {
+        change = rating_change{uid, glicko_rating{}, win};
+        bool ret = _update(&change, 1, [&opponent, win](rating_change *c, int) {
+            glicko_game g = {opponent, win ? 1.0 : 0.0};
+            c[0].rating = glicko2_update(c[0].rating, &g, 1);
+        });
+        if (ret == false)
+            return false;
+        put(uid, change.rating);
+        return true;
+    }
+
+    // 缓存的玩家数
+    size_t cached()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cache.size();
+    }
+};
\ No newline at end of file
@@ -4,6 +4,17 @@
 #include "log.hpp"
 #include "onlineuser.hpp"
 #include "db.hpp"
+#include "ai.hpp"
+#include "analysis.hpp"
+#include "board.hpp"
+#include "journal.hpp"
+#include "archive.hpp"
+#include "opening.hpp"
+#include "grace.hpp"
+#include "clock.hpp"
+#include "executor.hpp"
+#include "wsmsg.hpp"
+#include "cluster.hpp"
 
 /*
  * 房间模块和房间管理模块
@@ -12,12 +23,24 @@
  * 
  * 将棋盘单独进行描述
  * 可做成可选的不同类的游戏
+ *
+ * 每个房间是一个actor：玩家的请求、电脑玩家的落子、棋钟超时、掉线重连和退出都作为消息投递到房间的mailbox，
+ * 由执行器中的一个工作线程依次处理，房间的状态不需要加锁。
+ * 房间的id、规则、棋盘类型和双方玩家在创建后不再改变，可以在任意线程读取
+ *
+ * 集群模式下房间的所有者由房间id在一致性哈希环上的位置决定，创建时选取所有者为本节点的id；
+ * 成员变化后所有者改变的房间迁移到新的所有者（棋谱和双方连接所在的节点，棋钟重新计时），
+ * 本节点上的旧房间不再处理请求，之后到达的请求转发给新的所有者
  */
 
-#define BOARD_ROW 15
-#define BOARD_COL 15
 #define CHESS_WHITE 1
 #define CHESS_BLACK 2
+#define DEFAULT_RULE RULE_FREESTYLE   // 匹配创建房间时使用的规则
+#define DEFAULT_BOARD BOARD_STANDARD  // 匹配创建房间时使用的棋盘
+#define AI_RATING 1800.0              // 电脑玩家在等级分计算中的固定分数
+#define AI_RATING_RD 50.0
+#define CLUSTER_RID_SHIFT 40          // 集群模式下房间id的高位为节点号+1，各节点分配的id不重复
+#define CLUSTER_NO_NODE 0xffffffff    // 迁移房间时表示玩家不在线
 
 typedef enum
 {
@@ -25,7 +48,7 @@ typedef enum
     GAME_OVER
 } room_statu;
 
-class room
+class room : public std::enable_shared_from_this<room>
 {
 private:
     uint64_t _room_id;
@@ -40,61 +63,189 @@ private:
     // 在线用户管理
     onlineuser *_online_user;
 
-    // 棋盘
-    std::vector<std::vector<int>> _board;
+    // 人机对战模块，房间中有电脑玩家时使用
+    ai_service *_ai;
+
+    // 复盘分析模块，对局结束后保存棋谱
+    analysis_service *_analysis;
+
+    // 本局棋谱
+    game_record _record;
+
+    // 房间的消息队列，除创建和只读的信息外，房间的所有操作都在这里依次执行
+    mailbox _mailbox;
+
+    // 棋盘，具体大小和连子数由创建房间时选择的棋盘类型决定
+    std::unique_ptr<board_base> _board;
+
+    // 本房间的棋盘类型
+    board_variant _variant;
+
+    // 本房间的规则：无禁手/标准/连珠
+    game_rule _rule;
+
+    // 房间日志，为空时不记录
+    room_journal *_journal;
+
+    // 本次动作产生的日志记录，随广播一起提交
+    std::string _journal_buf;
+
+    // 对局归档，为空时不归档
+    game_archive *_archive;
+
+    // 开局库，为空时不统计
+    opening_table *_opening;
+
+    // 上一步落子的时间 unix ms
+    uint64_t _last_move_ms;
+
+    // 棋钟，同时记录轮到哪一方走棋
+    game_clock _clock;
+
+    // 共用的时间轮和当前走棋方的超时任务
+    timer_wheel *_wheel;
+    uint64_t _clock_timer;
+
+    // 超时结束对局后通知房间管理清理房间
+    std::function<void()> _on_timeout;
+
+    // 房间迁移到其他节点后，之后到达的请求交给它转发
+    std::function<void(const ws_request &)> _forward;
 
 private:
-    // 判断是否五子相连
-    bool five(int row, int col, int row_off, int col_off, int color)
+    // 赛前的等级分，电脑玩家为固定分数
+    int rating_of(uint64_t uid)
     {
-        // row和col是下棋位置，  row_off和col_off是偏移量，也是方向
-        int count = 1;
-        int search_row = row + row_off;
-        int search_col = col + col_off;
-        while (search_row >= 0 && search_row < BOARD_ROW &&
-               search_col >= 0 && search_col < BOARD_COL &&
-               _board[search_row][search_col] == color)
-        {
-            // 同色棋子数量++
-            count++;
-            // 检索位置继续向后偏移
-            search_row += row_off;
-            search_col += col_off;
-        }
-        search_row = row - row_off;
-        search_col = col - col_off;
-        while (search_row >= 0 && search_row < BOARD_ROW &&
-               search_col >= 0 && search_col < BOARD_COL &&
-               _board[search_row][search_col] == color)
-        {
-            // 同色棋子数量++
-            count++;
-            // 检索位置继续向后偏移
-            search_row -= row_off;
-            search_col -= col_off;
-        }
-        return (count >= 5);
+        glicko_rating r;
+        if (uid == AI_UID)
+            return AI_RATING;
+        return _tb_user->get_rating(uid, r) ? llround(r.rating) : 0;
+    }
+
+    // 对局结束后写入归档
+    void archive(uint64_t winner_id, int white_rating, int black_rating)
+    {
+        archive_game g;
+        g.room_id = _room_id;
+        g.white_id = _white_id;
+        g.black_id = _black_id;
+        g.white_rating = white_rating;
+        g.black_rating = black_rating;
+        g.result = winner_id == _white_id ? ARCHIVE_WHITE_WIN : (winner_id == _black_id ? ARCHIVE_BLACK_WIN : ARCHIVE_NO_RESULT);
+        g.rule = _rule;
+        g.variant = _variant;
+        g.cols = _board->cols();
+        g.start_ms = _record.start_ms;
+        g.end_ms = archive_now_ms();
+        for (size_t i = 0; i < _record.rows.size(); ++i)
+            g.squares.push_back(_record.rows[i] * g.cols + _record.cols[i]);
+        g.times = _record.times;
+        _archive->append(g);
+    }
+
+    // 对局结束后统计开局的局面，按双方赛前等级分的平均值分段
+    void opening(uint64_t winner_id, int white_rating, int black_rating)
+    {
+        std::vector<uint16_t> squares;
+        for (size_t i = 0; i < _record.rows.size() && i < OPENING_PLIES; ++i)
+            squares.push_back(_record.rows[i] * OPENING_COLS + _record.cols[i]);
+        // 取不到一方的等级分时按另一方计算
+        int rating = white_rating == 0 ? black_rating : (black_rating == 0 ? white_rating : (white_rating + black_rating) / 2);
+        opening_result result = winner_id == _white_id ? OPENING_WHITE_WIN : (winner_id == _black_id ? OPENING_BLACK_WIN : OPENING_DRAW);
+        _opening->record(squares, _rule, rating, result);
     }
 
-    // 判断棋局是否结束
-    uint64_t check_win(int row, int col, int color)
+    // 对局结束，更新双方的数据库信息（电脑玩家没有数据库记录），保存棋谱用于复盘和归档
+    void game_over(uint64_t winner_id, uint64_t loser_id)
     {
-        // 从下棋位置的四个不同方向上检测是否出现了5个及以上相同颜色的棋子（横行，纵列，正斜，反斜）
-        if (five(row, col, 0, 1, color) ||
-            five(row, col, 1, 0, color) ||
-            five(row, col, -1, 1, color) ||
-            five(row, col, -1, -1, color))
+        // 归档和开局库使用赛前的等级分，在更新之前取得
+        int white_rating = 0, black_rating = 0;
+        if (_archive != nullptr || _opening != nullptr)
         {
-            // 任意一个方向上出现了true也就是五星连珠，则设置返回值
-            return color == CHESS_WHITE ? _white_id : _black_id;
+            white_rating = rating_of(_white_id);
+            black_rating = rating_of(_black_id);
         }
-        return 0;
+        // 双方都是真人时同时计算双方的等级分，电脑玩家按固定分数参与计算
+        if (winner_id == AI_UID)
+            _tb_user->game_over(loser_id, false, glicko_rating{AI_RATING, AI_RATING_RD, GLICKO_VOL});
+        else if (loser_id == AI_UID)
+            _tb_user->game_over(winner_id, true, glicko_rating{AI_RATING, AI_RATING_RD, GLICKO_VOL});
+        else
+            _tb_user->game_over(winner_id, loser_id);
+        _statu = GAME_OVER;
+        _record.winner = winner_id;
+        _clock.stop();
+        if (_wheel != nullptr && _clock_timer != 0)
+            _wheel->cancel(_clock_timer);
+        _clock_timer = 0;
+        if (_journal != nullptr)
+            room_journal::encode_over(_journal_buf, _room_id, winner_id);
+        // 复盘分析只支持标准棋盘
+        if (_variant == BOARD_STANDARD)
+            _analysis->record(_record);
+        if (_archive != nullptr)
+            archive(winner_id, white_rating, black_rating);
+        // 开局库只统计标准棋盘
+        if (_opening != nullptr && _variant == BOARD_STANDARD)
+            opening(winner_id, white_rating, black_rating);
+    }
+
+    // 玩家落子后轮到电脑玩家，将搜索任务交给人机对战模块，搜索完成后以电脑玩家身份落子
+    void ai_move()
+    {
+        int color = _white_id == AI_UID ? CHESS_WHITE : CHESS_BLACK;
+        std::shared_ptr<room> self = shared_from_this();
+        _ai->think(_board->snapshot(), color, AI_MOVE_TIME, [self](int row, int col) {
+            ws_request req;
+            req.optype = WS_OP_PUT_CHESS;
+            req.room_id = self->id();
+            req.uid = AI_UID;
+            req.row = row;
+            req.col = col;
+            req.message_len = 0;
+            req.fields = WS_FIELD_OPTYPE | WS_FIELD_ROOM_ID | WS_FIELD_UID | WS_FIELD_ROW | WS_FIELD_COL;
+            self->push_request(req);
+        });
+    }
+
+    // 为当前走棋方挂上超时任务，取代之前的任务
+    void arm_clock()
+    {
+        if (_wheel == nullptr || _clock.enabled() == false)
+            return;
+        if (_clock_timer != 0)
+            _wheel->cancel(_clock_timer);
+        std::weak_ptr<room> wp = shared_from_this();
+        size_t moves = _record.rows.size();
+        _clock_timer = _wheel->add(_clock.budget(_wheel->now_ms()), [wp, moves]() {
+            std::shared_ptr<room> rp = wp.lock();
+            if (rp.get() != nullptr)
+                rp->post([rp, moves]() { rp->handle_timeout(moves); });
+        });
+    }
+
+    uint64_t clock_now() { return _wheel == nullptr ? 0 : _wheel->now_ms(); }
+
+    // 广播本次动作的结果，有日志记录时等记录落盘后再广播
+    void publish(Json::Value &rsp)
+    {
+        if (_journal == nullptr || _journal_buf.empty())
+            return broadcast(rsp);
+        std::shared_ptr<room> self = shared_from_this();
+        _journal->append(_journal_buf, [self, rsp]() mutable { self->broadcast(rsp); });
+        _journal_buf.clear();
     }
 
 public:
-    room(uint64_t room_id, user_table *tb_user, onlineuser *online_user)
-        : _room_id(room_id), _statu(GAME_START), _player_count(0), _tb_user(tb_user), _online_user(online_user), _board(BOARD_ROW, std::vector<int>(BOARD_COL, 0))
+    room(uint64_t room_id, user_table *tb_user, onlineuser *online_user, ai_service *ai, analysis_service *analysis, executor *ex,
+         room_journal *journal = nullptr, game_rule rule = DEFAULT_RULE, board_variant variant = DEFAULT_BOARD, game_archive *archive = nullptr,
+         opening_table *opening = nullptr)
+        : _room_id(room_id), _statu(GAME_START), _player_count(0), _tb_user(tb_user), _online_user(online_user), _ai(ai), _analysis(analysis),
+          _mailbox(ex), _board(create_board(variant)), _variant(variant), _rule(rule), _journal(journal), _archive(archive), _opening(opening), _wheel(nullptr), _clock_timer(0)
     {
+        _record.room_id = room_id;
+        _record.winner = 0;
+        _record.start_ms = _last_move_ms = archive_now_ms();
         LOG(DEBUG, "%lu 房间创建成功!!", _room_id);
     }
     ~room() { LOG(DEBUG, "%lu 房间销毁成功!!", _room_id); }
@@ -108,10 +259,19 @@ public:
     // 获取玩家数量
     int player_count() { return _player_count; }
 
+    // 获取房间规则
+    game_rule rule() { return _rule; }
+
+    // 获取棋盘类型和大小
+    board_variant variant() { return _variant; }
+    int board_rows() { return _board->rows(); }
+    int board_cols() { return _board->cols(); }
+
     // 添加白子玩家
     void add_white_user(uint64_t uid)
     {
         _white_id = uid;
+        _record.white_id = uid;
         _player_count++;
     }
 
@@ -119,6 +279,7 @@ public:
     void add_black_user(uint64_t uid)
     {
         _black_id = uid;
+        _record.black_id = uid;
         _player_count++;
     }
 
@@ -127,55 +288,202 @@ public:
     // 获取黑子玩家id
     uint64_t get_black_user() { return _black_id; }
 
+    // 房间中是否有电脑玩家
+    bool has_ai() { return _white_id == AI_UID || _black_id == AI_UID; }
+
+    // 向房间投递一个操作，在房间的mailbox中执行
+    void post(std::function<void()> msg) { _mailbox.post(std::move(msg)); }
+
+    // 投递玩家或电脑玩家的请求
+    void push_request(const ws_request &req)
+    {
+        std::shared_ptr<room> self = shared_from_this();
+        std::shared_ptr<ws_request> msg(new ws_request(req));
+        post([self, msg]() { self->handle_request(*msg); });
+    }
+
+    // 获取已经下过的棋，用于重新进入房间的玩家还原棋盘（在房间的mailbox中调用）
+    const game_record &record() { return _record; }
+
+    // 从日志恢复房间时重放一步落子，不做广播和胜负处理
+    bool replay(int row, int col, int color)
+    {
+        bool win = false;
+        if (_board->place(row, col, color, _rule, win) != MOVE_OK)
+            return false;
+        _record.rows.push_back(row);
+        _record.cols.push_back(col);
+        _record.colors.push_back(color);
+        _record.times.push_back(0);
+        return true;
+    }
+
+    // 按已经下过的棋确定走棋方（白子先行）并开始计时，wheel为空时只记录走棋方不计时
+    // 在房间交给其他线程之前调用
+    void start_clock(timer_wheel *wheel, const clock_config &config, const std::function<void()> &on_timeout)
+    {
+        _wheel = wheel;
+        _on_timeout = on_timeout;
+        _clock = game_clock(config);
+        int next = _record.colors.empty() || _record.colors.back() == CHESS_BLACK ? CHESS_WHITE : CHESS_BLACK;
+        _clock.start(next, clock_now());
+        arm_clock();
+    }
+
+    // 房间已经迁移到其他节点：停止计时，之后的请求交给forward转发（在房间的mailbox中调用）
+    void detach(const std::function<void(const ws_request &)> &forward)
+    {
+        _forward = forward;
+        _clock.stop();
+        if (_wheel != nullptr && _clock_timer != 0)
+            _wheel->cancel(_clock_timer);
+        _clock_timer = 0;
+    }
+
+    // 超时任务到期：moves为挂任务时的步数，期间有人落子则任务已经过时
+    void handle_timeout(size_t moves)
+    {
+        if (_statu != GAME_START || moves != _record.rows.size() || _forward)
+            return;
+        if (_clock.flagged(clock_now()) == false)
+            return arm_clock();
+        // 与掉线判负相同，以一条没有落子位置的put_chess广播结果
+        uint64_t loser_id = _clock.turn() == CHESS_WHITE ? _white_id : _black_id;
+        uint64_t winner_id = loser_id == _white_id ? _black_id : _white_id;
+        Json::Value json_resp;
+        json_resp["optype"] = "put_chess";
+        json_resp["result"] = true;
+        json_resp["reason"] = "对方超时，己方胜利！";
+        json_resp["room_id"] = (Json::UInt64)_room_id;
+        json_resp["uid"] = (Json::UInt64)loser_id;
+        json_resp["row"] = -1;
+        json_resp["col"] = -1;
+        json_resp["winner"] = (Json::UInt64)winner_id;
+        game_over(winner_id, loser_id);
+        publish(json_resp);
+        if (_on_timeout)
+            _on_timeout();
+    }
+
+    // 双方剩余的时间和棋钟设置，随房间信息和每一步的结果发给客户端
+    void clock_json(Json::Value &v)
+    {
+        uint64_t now = clock_now();
+        v["turn"] = _clock.turn();
+        v["white_ms"] = (Json::UInt64)_clock.remaining(CHESS_WHITE, now);
+        v["black_ms"] = (Json::UInt64)_clock.remaining(CHESS_BLACK, now);
+        v["move_ms"] = (Json::UInt64)_clock.config().move_ms;
+        v["increment_ms"] = (Json::UInt64)_clock.config().increment_ms;
+    }
+
+    // 获取棋钟信息（在房间的mailbox中调用）
+    Json::Value clock_info()
+    {
+        Json::Value v;
+        clock_json(v);
+        return v;
+    }
+
+    // 恢复的房间轮到电脑玩家时继续搜索（白子先行）
+    void resume()
+    {
+        if (_statu != GAME_START || has_ai() == false)
+            return;
+        int next = _record.colors.empty() || _record.colors.back() == CHESS_BLACK ? CHESS_WHITE : CHESS_BLACK;
+        if ((next == CHESS_WHITE ? _white_id : _black_id) == AI_UID)
+            ai_move();
+    }
+
     // 处理下棋动作
-    Json::Value handle_chess(Json::Value &req)
+    Json::Value handle_chess(const ws_request &req)
     {
-        Json::Value json_resp = req;
-        int chess_row = req["row"].asInt();
-        int chess_col = req["col"].asInt();
-        uint64_t cur_uid = req["uid"].asUInt64();
+        Json::Value json_resp;
+        int chess_row = req.row;
+        int chess_col = req.col;
+        uint64_t cur_uid = req.uid;
+        json_resp["optype"] = "put_chess";
+        json_resp["room_id"] = (Json::UInt64)req.room_id;
+        json_resp["uid"] = (Json::UInt64)cur_uid;
+        json_resp["row"] = chess_row;
+        json_resp["col"] = chess_col;
 
-        // 1. 判断房间中两个玩家是否都在线，任意一个不在线，就是另一方胜利。
-        if (_online_user->is_in_game_room(_white_id) == false)
+        // 1. 对方掉线时不再直接判负，由房间管理的断线宽限期到期后判负，期间对方的落子照常记录
+        // 2. 获取走棋位置，判断当前走棋是否合理（对局是否已经结束，位置是否已经被占用）
+        if (_statu == GAME_OVER)
         {
-            json_resp["result"] = true;
-            json_resp["reason"] = "对方掉线";
-            json_resp["winner"] = (Json::UInt64)_black_id;
+            json_resp["result"] = false;
+            json_resp["reason"] = "对局已经结束！";
+            return json_resp;
+        }
+        int cur_color = cur_uid == _white_id ? CHESS_WHITE : CHESS_BLACK;
+        if (cur_color != _clock.turn())
+        {
+            json_resp["result"] = false;
+            json_resp["reason"] = "还没有轮到己方走棋！";
             return json_resp;
         }
-        if (_online_user->is_in_game_room(_black_id) == false)
+        // 已经超时的落子不再接受，与超时任务到期一样判负
+        uint64_t now = clock_now();
+        if (_clock.flagged(now))
         {
             json_resp["result"] = true;
-            json_resp["reason"] = "对方掉线";
-            json_resp["winner"] = (Json::UInt64)_white_id;
+            json_resp["reason"] = "对方超时，己方胜利！";
+            json_resp["row"] = -1;
+            json_resp["col"] = -1;
+            json_resp["winner"] = (Json::UInt64)(cur_color == CHESS_WHITE ? _black_id : _white_id);
             return json_resp;
         }
-        // 2. 获取走棋位置，判断当前走棋是否合理（位置是否已经被占用）
-        if (_board[chess_row][chess_col] != 0)
+        // 越界、占用、禁手的判断和落子后的胜负判断都在具体的棋盘类型中完成
+        bool win = false;
+        move_result ret = _board->place(chess_row, chess_col, cur_color, _rule, win);
+        if (ret != MOVE_OK)
         {
             json_resp["result"] = false;
-            json_resp["reason"] = "当前位置已经有了其他棋子！";
+            if (ret == MOVE_OUT)
+                json_resp["reason"] = "落子位置不在棋盘内！";
+            else if (ret == MOVE_TAKEN)
+                json_resp["reason"] = "当前位置已经有了其他棋子！";
+            else
+                json_resp["reason"] = "禁手！不能在这里落子";
             return json_resp;
         }
-        int cur_color = cur_uid == _white_id ? CHESS_WHITE : CHESS_BLACK;
-        _board[chess_row][chess_col] = cur_color;
+        _record.rows.push_back(chess_row);
+        _record.cols.push_back(chess_col);
+        _record.colors.push_back(cur_color);
+        uint64_t wall = archive_now_ms();
+        _record.times.push_back(wall > _last_move_ms ? wall - _last_move_ms : 0);
+        _last_move_ms = wall;
+        if (_journal != nullptr)
+            room_journal::encode_move(_journal_buf, _room_id, chess_row, chess_col, cur_color);
+        // 落子方停表并加上增量，轮到对方计时
+        _clock.move(now);
         // 3. 判断是否有玩家胜利（从当前走棋位置开始判断是否存在五子相连）
-        uint64_t winner_id = check_win(chess_row, chess_col, cur_color);
-        if (winner_id != 0)
+        uint64_t winner_id = 0;
+        if (win)
         {
+            winner_id = cur_color == CHESS_WHITE ? _white_id : _black_id;
             json_resp["reason"] = "无双，万军取首！";
         }
+        else
+        {
+            arm_clock();
+        }
+        clock_json(json_resp);
         json_resp["result"] = true;
         json_resp["winner"] = (Json::UInt64)winner_id;
         return json_resp;
     }
 
     // 处理聊天动作
-    Json::Value handle_chat(Json::Value &req)
+    Json::Value handle_chat(const ws_request &req)
     {
-        Json::Value json_resp = req;
+        Json::Value json_resp;
         // 检测消息中是否包含敏感词
-        std::string msg = req["message"].asString();
+        std::string msg(req.message, req.message_len);
+        json_resp["optype"] = "chat";
+        json_resp["room_id"] = (Json::UInt64)req.room_id;
+        json_resp["uid"] = (Json::UInt64)req.uid;
+        json_resp["message"] = msg;
         size_t pos = msg.find("垃圾");
         // 可封装一个检测敏感词的函数
         // bool words_detect(Json::Value &req)
@@ -207,54 +515,73 @@ public:
             json_resp["col"] = -1;
             json_resp["winner"] = (Json::UInt64)winner_id;
             uint64_t loser_id = winner_id == _white_id ? _black_id : _white_id;
-            _tb_user->win(winner_id);
-            _tb_user->lose(loser_id);
-            _statu = GAME_OVER;
-            broadcast(json_resp);
+            game_over(winner_id, loser_id);
+            publish(json_resp);
         }
         // 房间中玩家数量--
         _player_count--;
+        // 真人玩家退出后，电脑玩家随之退出
+        if (has_ai())
+            _player_count--;
     }
 
     // 总的请求处理函数，在函数内部，区分请求类型，根据不同的请求调用不同的处理函数，得到响应进行广播
-    void handle_request(Json::Value &req)
+    void handle_request(const ws_request &req)
     {
+        // 0. 房间已经迁移，转发给新的所有者
+        if (_forward)
+            return _forward(req);
         // 1. 校验房间号是否匹配
         Json::Value json_resp;
-        uint64_t room_id = req["room_id"].asUInt64();
-        if (room_id != _room_id)
+        if (req.room_id != _room_id)
         {
-            json_resp["optype"] = req["optype"].asString();
+            json_resp["optype"] = ws_optype_name(req.optype);
             json_resp["result"] = false;
             json_resp["reason"] = "房间号不匹配！";
             return broadcast(json_resp);
         }
         // 2. 根据不同的请求类型调用不同的处理函数
-        if (req["optype"].asString() == "put_chess") // 2.1 下棋
+        if (req.optype == WS_OP_PUT_CHESS) // 2.1 下棋
         {
             json_resp = handle_chess(req);
             if (json_resp["winner"].asUInt64() != 0)
             {
                 uint64_t winner_id = json_resp["winner"].asUInt64();
                 uint64_t loser_id = winner_id == _white_id ? _black_id : _white_id;
-                _tb_user->win(winner_id);
-                _tb_user->lose(loser_id);
-                _statu = GAME_OVER;
+                game_over(winner_id, loser_id);
+            }
+            // 真人玩家落子成功且对局未结束，轮到电脑玩家
+            else if (json_resp["result"].asBool() && has_ai() && req.uid != AI_UID)
+            {
+                ai_move();
             }
         }
-        else if (req["optype"].asString() == "chat") // 2.2 聊天
+        else if (req.optype == WS_OP_CHAT) // 2.2 聊天
         {
             json_resp = handle_chat(req);
         }
         else // 其他/未知错误
         {
-            json_resp["optype"] = req["optype"].asString();
+            json_resp["optype"] = ws_optype_name(req.optype);
             json_resp["result"] = false;
             json_resp["reason"] = "未知请求类型";
         }
         std::string body;
         util_json::serialization(json_resp, body);
         LOG(DEBUG, "房间-广播动作: %s", body.c_str());
+        publish(json_resp);
+    }
+
+    // 通知房间中的玩家uid掉线或重新连接
+    void notify_presence(uint64_t uid, bool online)
+    {
+        Json::Value json_resp;
+        json_resp["optype"] = online ? "opponent_online" : "opponent_offline";
+        json_resp["result"] = true;
+        json_resp["room_id"] = (Json::UInt64)_room_id;
+        json_resp["uid"] = (Json::UInt64)uid;
+        if (online == false)
+            json_resp["grace_ms"] = GRACE_MS;
         broadcast(json_resp);
     }
 
@@ -264,23 +591,12 @@ public:
         // 1. 对要响应的信息进行序列化，将Json::Value中的数据序列化成为json格式字符串
         std::string body;
         util_json::serialization(rsp, body);
-        // 2. 获取房间中所有用户的通信连接
-        // 3. 发送响应信息
-        websocketpp::server<websocketpp::config::asio>::connection_ptr wconn = _online_user->get_conn_from_room(_white_id);
-        if (wconn.get() != nullptr)
-        {
-            wconn->send(body);
-        }
-        else
+        // 2. 发送给房间中的玩家，玩家的连接在其他节点上时由在线用户管理转发
+        if (_online_user->send_to_room(_white_id, body) == false)
         {
             LOG(DEBUG, "房间-白棋玩家连接获取失败");
         }
-        websocketpp::server<websocketpp::config::asio>::connection_ptr bconn = _online_user->get_conn_from_room(_black_id);
-        if (bconn.get() != nullptr)
-        {
-            bconn->send(body);
-        }
-        else
+        if (_online_user->send_to_room(_black_id, body) == false)
         {
             LOG(DEBUG, "房间-黑棋玩家连接获取失败");
         }
@@ -296,18 +612,133 @@ private:
     std::mutex _mutex;
     user_table *_tb_user;
     onlineuser *_online_user;
+    analysis_service *_analysis;
+    ai_service _ai;
+    executor *_ex;          // 房间的消息在执行器上处理
+    room_journal *_journal; // 房间日志，为空时不记录，重启后无法恢复对局
+    game_archive *_archive; // 对局归档，为空时不归档
+    opening_table *_opening; // 开局库，为空时不统计
+    timer_wheel *_wheel;    // 共用的时间轮，为空时断线立即判负
+    grace_table _grace;     // 断线等待重连的玩家
     std::unordered_map<uint64_t, room_ptr> _rooms;
 
     // uid room_id 
     std::unordered_map<uint64_t, uint64_t> _users;
+    // 集群模式，单节点时为空
+    cluster *_cluster;
+    // 集群模式下连接在本节点上、房间在其他节点上的玩家 uid room_id
+    std::unordered_map<uint64_t, uint64_t> _remote;
+
+private:
+    // 分配房间id，集群模式下选取所有者为本节点的id（调用方持有_mutex）
+    uint64_t next_room_id()
+    {
+        uint64_t rid = _next_rid++;
+        while (_cluster != nullptr && _cluster->is_local(rid) == false)
+            rid = _next_rid++;
+        return rid;
+    }
+
+    // 在房间的mailbox中迁移房间到新的所有者：发送棋谱和双方连接所在的节点，成功后本节点不再管理该房间
+    void move_out(const room_ptr &rp)
+    {
+        uint64_t rid = rp->id();
+        uint32_t owner = _cluster->owner(rid);
+        if (owner == _cluster->self() || get_room_by_rid(rid) != rp)
+            return; // 期间成员又发生了变化，或者房间已经销毁
+        uint64_t uids[2] = {rp->get_white_user(), rp->get_black_user()};
+        uint32_t nodes[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            nodes[i] = CLUSTER_NO_NODE;
+            if (_online_user->get_conn_from_room(uids[i]).get() != nullptr)
+                nodes[i] = _cluster->self();
+            else
+                _online_user->remote_node(uids[i], nodes[i]);
+        }
+        const game_record &record = rp->record();
+        std::string req, resp;
+        rpc_writer w(req);
+        w.put<uint64_t>(rid).put<uint64_t>(uids[0]).put<uint64_t>(uids[1]).put<uint8_t>(rp->rule()).put<uint8_t>(rp->variant());
+        w.put<uint32_t>(nodes[0]).put<uint32_t>(nodes[1]).put<uint32_t>(record.rows.size());
+        for (size_t i = 0; i < record.rows.size(); ++i)
+            w.put<uint8_t>(record.rows[i]).put<uint8_t>(record.cols[i]).put<uint8_t>(record.colors[i]);
+        if (_cluster->call(owner, RPC_ROOM_MOVE, req, resp) == false)
+        {
+            LOG(ERROR, "%lu 房间迁移到节点%u失败，留在本节点", rid, owner);
+            return;
+        }
+        rp->detach([this](const ws_request &r) { forward_request(r.uid, r.room_id, r); });
+        if (_journal != nullptr)
+        {
+            std::string rec;
+            room_journal::encode_over(rec, rid, 0);
+            _journal->append(rec, nullptr);
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _rooms.erase(rid);
+        for (int i = 0; i < 2; ++i)
+        {
+            if (uids[i] == AI_UID)
+                continue;
+            _users.erase(uids[i]);
+            if (nodes[i] == _cluster->self())
+                _remote[uids[i]] = rid; // 本节点成为该玩家的网关
+            else
+                _online_user->exit_remote_room(uids[i]);
+        }
+        LOG(INFO, "%lu 房间迁移到节点%u", rid, owner);
+    }
+
+public:
+    // 转发给其他节点的房间请求的编码
+    static void encode_request(std::string &buf, uint64_t uid, uint64_t rid, const ws_request &req)
+    {
+        rpc_writer(buf).put<uint64_t>(uid).put<uint64_t>(rid).put<uint8_t>(req.optype).put<uint64_t>(req.room_id)
+            .put<uint64_t>(req.uid).put<int32_t>(req.row).put<int32_t>(req.col).put<int32_t>(req.fields)
+            .put_str(std::string(req.message, req.message_len));
+    }
+
+    static bool decode_request(const std::string &buf, uint64_t &uid, uint64_t &rid, ws_request &req)
+    {
+        rpc_reader r(buf);
+        uid = r.get<uint64_t>();
+        rid = r.get<uint64_t>();
+        req.optype = (ws_optype)r.get<uint8_t>();
+        req.room_id = r.get<uint64_t>();
+        req.uid = r.get<uint64_t>();
+        req.row = r.get<int32_t>();
+        req.col = r.get<int32_t>();
+        req.fields = r.get<int32_t>();
+        std::string msg = r.get_str();
+        if (r.good() == false || msg.size() > WS_CHAT_MAX)
+            return false;
+        memcpy(req.message, msg.data(), msg.size());
+        req.message_len = msg.size();
+        return true;
+    }
 
 public:
     // 初始化房间ID计数器
-    room_manager(user_table *ut, onlineuser *om) : _next_rid(1), _tb_user(ut), _online_user(om) { LOG(DEBUG, "房间管理模块初始化完毕！"); }
+    // 传入日志时先从日志中恢复上次未结束的对局
+    // 集群模式下房间id从(节点号+1)<<CLUSTER_RID_SHIFT开始分配
+    room_manager(user_table *ut, onlineuser *om, analysis_service *as, executor *ex, room_journal *journal = nullptr, timer_wheel *wheel = nullptr,
+                 cluster *cl = nullptr, game_archive *archive = nullptr, opening_table *opening = nullptr)
+        : _next_rid(1), _tb_user(ut), _online_user(om), _analysis(as), _ex(ex), _journal(journal), _archive(archive), _opening(opening), _wheel(wheel), _grace(wheel), _cluster(cl)
+    {
+        if (_cluster != nullptr)
+            _next_rid = ((uint64_t)_cluster->self() + 1) << CLUSTER_RID_SHIFT | 1;
+        if (_journal != nullptr)
+            restore();
+        LOG(DEBUG, "房间管理模块初始化完毕！");
+    }
     ~room_manager() { LOG(DEBUG, "房间管理模块即将销毁！"); }
 
     // 为两个用户创建房间，并返回房间的智能指针管理对象
-    room_ptr create_room(uint64_t uid1, uint64_t uid2)
+    // uid2为AI_UID时，由电脑玩家执黑子与uid1对战；rule为房间使用的规则，variant为棋盘类型
+    // clock为房间的棋钟设置，超时由共用的时间轮判负
+    room_ptr create_room(uint64_t uid1, uint64_t uid2, game_rule rule = DEFAULT_RULE, board_variant variant = DEFAULT_BOARD,
+                         const clock_config &clock = default_clock())
     {
         // 两个用户在游戏大厅中进行对战匹配，匹配成功后创建房间
         // 1. 校验两个用户是否都还在游戏大厅中，只有都在才需要创建房间。
@@ -316,27 +747,96 @@ public:
             LOG(DEBUG, "用户：%lu 不在大厅中，创建房间失败!", uid1);
             return room_ptr();
         }
-        if (_online_user->is_in_game_hall(uid2) == false)
+        if (uid2 != AI_UID && _online_user->is_in_game_hall(uid2) == false)
         {
             LOG(DEBUG, "用户：%lu 不在大厅中，创建房间失败!", uid2);
             return room_ptr();
         }
+        // 2. 创建房间
+        return open_room(uid1, uid2, rule, variant, clock);
+    }
 
-        // 2. 创建房间，将用户信息添加到房间中
+    // 创建房间，不检查玩家是否在本进程的大厅中
+    // 多进程模式下匹配到的玩家可能连接在其他worker上，由调用方确认玩家在线
+    room_ptr open_room(uint64_t uid1, uint64_t uid2, game_rule rule = DEFAULT_RULE, board_variant variant = DEFAULT_BOARD,
+                       const clock_config &clock = default_clock())
+    {
+        // 电脑玩家只会下标准棋盘
+        if (uid2 == AI_UID && variant != BOARD_STANDARD)
+        {
+            LOG(DEBUG, "电脑玩家不支持该棋盘，创建房间失败!");
+            return room_ptr();
+        }
+        // 1. 创建房间，将用户信息添加到房间中；检查和登记在同一把锁内，已经有房间的玩家不能再进入新的房间
         std::unique_lock<std::mutex> lock(_mutex);
-        room_ptr rp(new room(_next_rid, _tb_user, _online_user));
+        if (_users.count(uid1) != 0 || (uid2 != AI_UID && _users.count(uid2) != 0))
+        {
+            LOG(DEBUG, "用户：%lu 或 %lu 已经在房间中，创建房间失败!", uid1, uid2);
+            return room_ptr();
+        }
+        uint64_t rid = next_room_id();
+        room_ptr rp(new room(rid, _tb_user, _online_user, &_ai, _analysis, _ex, _journal, rule, variant, _archive, _opening));
         rp->add_white_user(uid1);
         rp->add_black_user(uid2);
+        if (_journal != nullptr)
+        {
+            std::string rec;
+            room_journal::encode_create(rec, rid, uid1, uid2, rule, variant);
+            _journal->append(rec, nullptr);
+        }
+        rp->start_clock(_wheel, clock, [this, rid]() { reap_room(rid); });
 
-        // 3. 将房间信息管理起来
-        _rooms.insert(std::make_pair(_next_rid, rp));
-        _users.insert(std::make_pair(uid1, _next_rid));
-        _users.insert(std::make_pair(uid2, _next_rid));
-        _next_rid++;
-        // 4. 返回房间信息
+        // 2. 将房间信息管理起来
+        _rooms.insert(std::make_pair(rid, rp));
+        _users.insert(std::make_pair(uid1, rid));
+        if (uid2 != AI_UID) // 电脑玩家可以同时在多个房间中，不记录房间映射
+            _users.insert(std::make_pair(uid2, rid));
+        // 3. 返回房间信息
         return rp;
     }
 
+    // 重建日志中未结束的房间，玩家重新登录后通过房间长连接回到对局中
+    void restore()
+    {
+        std::vector<journal_room> rooms;
+        uint64_t max_rid = 0;
+        if (_journal->recover(rooms, max_rid) == false)
+        {
+            LOG(ERROR, "房间日志不可用，本次运行不记录对局!");
+            _journal = nullptr;
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        // 集群模式下日志中可能有从其他节点迁移来的房间，只按本节点分配的id继续分配
+        if (_cluster == nullptr || max_rid >> CLUSTER_RID_SHIFT == _next_rid >> CLUSTER_RID_SHIFT)
+            _next_rid = std::max(_next_rid, max_rid + 1);
+        for (journal_room &jr : rooms)
+        {
+            if (_cluster != nullptr && jr.room_id >> CLUSTER_RID_SHIFT == _next_rid >> CLUSTER_RID_SHIFT)
+                _next_rid = std::max(_next_rid, jr.room_id + 1);
+            room_ptr rp(new room(jr.room_id, _tb_user, _online_user, &_ai, _analysis, _ex, _journal, (game_rule)jr.rule, (board_variant)jr.variant, _archive, _opening));
+            rp->add_white_user(jr.white_id);
+            rp->add_black_user(jr.black_id);
+            for (size_t i = 0; i < jr.rows.size(); ++i)
+            {
+                if (rp->replay(jr.rows[i], jr.cols[i], jr.colors[i]) == false)
+                {
+                    LOG(ERROR, "%lu 房间第 %lu 步重放失败", jr.room_id, i + 1);
+                    break;
+                }
+            }
+            // 日志中没有记录用时，恢复的对局双方按新的棋钟重新计时
+            uint64_t rid = jr.room_id;
+            rp->start_clock(_wheel, default_clock(), [this, rid]() { reap_room(rid); });
+            _rooms.insert(std::make_pair(jr.room_id, rp));
+            _users.insert(std::make_pair(jr.white_id, jr.room_id));
+            if (jr.black_id != AI_UID)
+                _users.insert(std::make_pair(jr.black_id, jr.room_id));
+            rp->post([rp]() { rp->resume(); });
+        }
+        LOG(DEBUG, "从房间日志中恢复了 %lu 个对局", rooms.size());
+    }
+
     // 通过房间ID获取房间信息
     room_ptr get_room_by_rid(uint64_t rid)
     {
@@ -390,16 +890,211 @@ public:
         _rooms.erase(rid);
     }
 
-    // 删除房间中指定用户，如果房间中没有用户了，则销毁房间，用户连接断开时被调用
+    // 玩家的房间长连接断开：对局进行中时等待重连，宽限期到期仍未回来才判负退出；否则直接退出房间
+    void leave_room(uint64_t uid)
+    {
+        room_ptr rp = get_room_by_uid(uid);
+        if (rp.get() == nullptr)
+            return;
+        rp->post([this, rp, uid]() {
+            if (_wheel == nullptr || rp->statu() != GAME_START)
+                return exit_room(rp, uid);
+            uint64_t rid = rp->id();
+            rp->notify_presence(uid, false);
+            _grace.leave(uid, [this, uid, rid]() {
+                // 宽限期内房间可能已经销毁，只处理断线时所在的房间
+                room_ptr cur = get_room_by_uid(uid);
+                if (cur.get() != nullptr && cur->id() == rid && _online_user->is_in_game_room(uid) == false)
+                    remove_room_user(uid);
+            });
+        });
+    }
+
+    // 玩家重新建立房间长连接，处于宽限期内时取消判负并通知对方
+    bool rejoin_room(uint64_t uid)
+    {
+        if (_grace.back(uid) == false)
+            return false;
+        room_ptr rp = get_room_by_uid(uid);
+        if (rp.get() != nullptr)
+            rp->post([rp, uid]() { rp->notify_presence(uid, true); });
+        return true;
+    }
+
+    // 对局超时结束后，让不在房间中的玩家（从未进入或正在等待重连）退出，房间不再一直占用
+    void reap_room(uint64_t rid)
+    {
+        room_ptr rp = get_room_by_rid(rid);
+        if (rp.get() == nullptr)
+            return;
+        uint64_t uids[2] = {rp->get_white_user(), rp->get_black_user()};
+        for (uint64_t uid : uids)
+        {
+            if (uid == AI_UID || _online_user->is_in_game_room(uid))
+                continue;
+            _grace.back(uid);
+            remove_room_user(uid);
+        }
+    }
+
+    // 删除房间中指定用户，如果房间中没有用户了，则销毁房间，宽限期到期或对局结束后连接断开时被调用
     void remove_room_user(uint64_t uid)
     {
         room_ptr rp = get_room_by_uid(uid);
         if (rp.get() == nullptr)
             return;
-        // 处理房间中玩家退出动作
+        rp->post([this, rp, uid]() { exit_room(rp, uid); });
+    }
+
+    // 在房间的mailbox中处理玩家退出动作，房间中没有玩家了，则销毁房间
+    void exit_room(const room_ptr &rp, uint64_t uid)
+    {
         rp->handle_exit(uid);
-        // 房间中没有玩家了，则销毁房间
         if (rp->player_count() == 0)
             remove_room(rp->id());
     }
-};
+
+    // 获取房间数量
+    size_t room_count()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _rooms.size();
+    }
+
+    // 最近创建的limit个房间，房间id从大到小
+    void recent_rooms(size_t limit, std::vector<room_ptr> &rooms)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::vector<uint64_t> rids;
+        rids.reserve(_rooms.size());
+        for (auto &it : _rooms)
+            rids.push_back(it.first);
+        limit = std::min(limit, rids.size());
+        std::partial_sort(rids.begin(), rids.begin() + limit, rids.end(), std::greater<uint64_t>());
+        for (size_t i = 0; i < limit; ++i)
+            rooms.push_back(_rooms[rids[i]]);
+    }
+
+    ///////////////////////////// 集群模式
+
+    // 玩家连接在本节点上、房间在其他节点上时获取房间id
+    bool remote_room(uint64_t uid, uint64_t &rid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _remote.find(uid);
+        if (it == _remote.end())
+            return false;
+        rid = it->second;
+        return true;
+    }
+
+    void set_remote_room(uint64_t uid, uint64_t rid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _remote[uid] = rid;
+    }
+
+    void clear_remote_room(uint64_t uid)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _remote.erase(uid);
+    }
+
+    // 把玩家uid对房间rid的请求转发给房间的所有者，同一节点的消息按顺序发出
+    void forward_request(uint64_t uid, uint64_t rid, const ws_request &req)
+    {
+        std::string buf;
+        encode_request(buf, uid, rid, req);
+        _cluster->send(_cluster->owner(rid), RPC_ROOM_MSG, buf);
+    }
+
+    // 处理其他节点转发来的请求；房间不在本节点上时（对方的哈希环还没有更新）再转发一次
+    bool handle_forwarded(const std::string &buf)
+    {
+        uint64_t uid, rid;
+        ws_request req;
+        if (decode_request(buf, uid, rid, req) == false)
+            return false;
+        room_ptr rp = get_room_by_rid(rid);
+        if (rp.get() != nullptr)
+        {
+            rp->push_request(req);
+            return true;
+        }
+        if (_cluster->is_local(rid))
+        {
+            LOG(DEBUG, "%lu 房间不存在，丢弃玩家%lu的请求", rid, uid);
+            return false;
+        }
+        forward_request(uid, rid, req);
+        return true;
+    }
+
+    // 成员变化后，把所有者不再是本节点的房间迁移出去
+    void rebalance()
+    {
+        std::vector<room_ptr> moving;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (auto &it : _rooms)
+            {
+                if (_cluster->is_local(it.first) == false)
+                    moving.push_back(it.second);
+            }
+        }
+        for (room_ptr &rp : moving)
+            rp->post([this, rp]() { move_out(rp); });
+        if (moving.empty() == false)
+            LOG(INFO, "成员变化，迁移 %lu 个房间", moving.size());
+    }
+
+    // 接收其他节点迁移来的房间，按棋谱重建并重新计时
+    bool move_in(const std::string &buf)
+    {
+        rpc_reader r(buf);
+        uint64_t rid = r.get<uint64_t>();
+        uint64_t uids[2] = {r.get<uint64_t>(), r.get<uint64_t>()};
+        game_rule rule = (game_rule)r.get<uint8_t>();
+        board_variant variant = (board_variant)r.get<uint8_t>();
+        uint32_t nodes[2] = {r.get<uint32_t>(), r.get<uint32_t>()};
+        uint32_t moves = r.get<uint32_t>();
+        if (r.good() == false)
+            return false;
+        room_ptr rp(new room(rid, _tb_user, _online_user, &_ai, _analysis, _ex, _journal, rule, variant, _archive, _opening));
+        rp->add_white_user(uids[0]);
+        rp->add_black_user(uids[1]);
+        std::string rec;
+        if (_journal != nullptr)
+            room_journal::encode_create(rec, rid, uids[0], uids[1], rule, variant);
+        for (uint32_t i = 0; i < moves; ++i)
+        {
+            int row = r.get<uint8_t>(), col = r.get<uint8_t>(), color = r.get<uint8_t>();
+            if (r.good() == false || rp->replay(row, col, color) == false)
+                return false;
+            if (_journal != nullptr)
+                room_journal::encode_move(rec, rid, row, col, color);
+        }
+        if (_journal != nullptr)
+            _journal->append(rec, nullptr);
+        rp->start_clock(_wheel, default_clock(), [this, rid]() { reap_room(rid); });
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _rooms[rid] = rp;
+            for (int i = 0; i < 2; ++i)
+            {
+                if (uids[i] == AI_UID)
+                    continue;
+                _users[uids[i]] = rid;
+                _remote.erase(uids[i]); // 本节点原来是该玩家的网关，房间回到了本节点
+            }
+        }
+        for (int i = 0; i < 2; ++i)
+        {
+            if (uids[i] != AI_UID && nodes[i] != CLUSTER_NO_NODE && nodes[i] != _cluster->self())
+                _online_user->enter_remote_room(uids[i], nodes[i]);
+        }
+        rp->post([rp]() { rp->resume(); });
+        LOG(INFO, "%lu 房间迁移到本节点，已下 %u 步", rid, moves);
+        return true;
+    }
+};
\ No newline at end of file
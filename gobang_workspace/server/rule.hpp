@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+* 规则模块
+* 每个房间可以选择不同的规则：
+*   RULE_FREESTYLE 无禁手，五连及长连（六子及以上）均获胜
+*   RULE_STANDARD  双方都只有恰好五连获胜，长连不算胜也不算负
+*   RULE_RENJU     连珠规则，先手方禁止三三、四四和长连，且只有恰好五连获胜；后手方五连及长连均获胜
+*
+* 禁手判断需要知道每个方向上落子后形成的棋型，以及活三能否继续成为活四（递归判断延伸点是否为禁手）。
+* 以落子点为中心，每个方向取左右各5格共11格，每格三种状态（空、己方、对方或墙）编码为3^11种，
+* 启动时预先算好每种编码的棋型：是否五连/长连、冲四的数量、可以把活三变成活四的延伸点，
+* 落子时每个方向只需一次查表。
+*
+* 棋盘类型作为模板参数，需要提供 in_board(row, col)、get(row, col)、set(row, col, color)
+*/
+
+#define RULE_RESTRICTED 1  // 受禁手限制的先手方，本项目中白棋先行（与CHESS_WHITE一致）
+#define RULE_HALF 5        // 中心点两侧各取的格数
+#define RULE_WINDOW 11
+#define RULE_CODES 177147  // 3^11
+#define RULE_DEPTH 3       // 活三延伸点递归判断禁手的最大深度
+
+typedef enum
+{
+    RULE_FREESTYLE,
+    RULE_STANDARD,
+    RULE_RENJU
+} game_rule;
+
+class rule_engine
+{
+private:
+    // 中心点有己方棋子时，一个方向上的棋型
+    struct line_info
+    {
+        uint8_t five;          // 经过中心恰好五连
+        uint8_t overline;      // 经过中心长连
+        uint8_t fours;         // 经过中心的冲四（活四）数量
+        uint16_t three_points; // 能把经过中心的活三变成活四的延伸点，按窗口下标记录的位图
+    };
+
+    std::vector<line_info> _table;
+
+private:
+    // 窗口中经过pos的己方连续棋子区间
+    static void run(const int *w, int pos, int &l, int &r)
+    {
+        l = r = pos;
+        while (l > 0 && w[l - 1] == 1) --l;
+        while (r < RULE_WINDOW - 1 && w[r + 1] == 1) ++r;
+    }
+
+    // 窗口中pos处为己方棋子时，经过pos和中心是否恰好五连
+    // 连续区间碰到窗口边缘时，经过中心的区间长度至少为6，必然是长连
+    static bool exact_five(const int *w, int pos)
+    {
+        int l, r;
+        run(w, pos, l, r);
+        return l <= RULE_HALF && r >= RULE_HALF && r - l + 1 == 5;
+    }
+
+    // 统计落子后能与中心一起恰好成五的空位，straight带出是否为活四（两个成五点夹着同一个四连）
+    static int five_points(int *w, int *points, bool &straight)
+    {
+        int n = 0;
+        for (int e = 0; e < RULE_WINDOW; ++e)
+        {
+            if (w[e] != 0)
+                continue;
+            w[e] = 1;
+            if (exact_five(w, e))
+                points[n++] = e;
+            w[e] = 0;
+        }
+        straight = false;
+        for (int i = 0; i + 1 < n; ++i)
+        {
+            if (points[i + 1] - points[i] == 5)
+            {
+                bool full = true;
+                for (int k = points[i] + 1; k < points[i + 1]; ++k)
+                    full = full && w[k] == 1;
+                straight = straight || full;
+            }
+        }
+        return n;
+    }
+
+    static line_info classify(int code)
+    {
+        int w[RULE_WINDOW];
+        for (int k = 0; k < RULE_WINDOW; ++k)
+        {
+            w[k] = code % 3;
+            code /= 3;
+        }
+        line_info info = {0, 0, 0, 0};
+        int l, r;
+        run(w, RULE_HALF, l, r);
+        if (r - l + 1 >= 6)
+        {
+            info.overline = 1;
+            return info;
+        }
+        if (r - l + 1 == 5)
+        {
+            info.five = 1;
+            return info;
+        }
+        int points[RULE_WINDOW];
+        bool straight;
+        int n = five_points(w, points, straight);
+        if (n > 0)
+        {
+            // 活四的两个成五点只算一个四
+            info.fours = (uint8_t)(straight ? n - 1 : n);
+            return info;
+        }
+        // 没有四时，找出落子后能成为活四的延伸点，存在则为活三
+        for (int e = 0; e < RULE_WINDOW; ++e)
+        {
+            if (w[e] != 0)
+                continue;
+            w[e] = 1;
+            int tmp[RULE_WINDOW];
+            five_points(w, tmp, straight);
+            if (straight)
+                info.three_points |= (uint16_t)(1 << e);
+            w[e] = 0;
+        }
+        return info;
+    }
+
+    rule_engine() : _table(RULE_CODES)
+    {
+        int center = 1;
+        for (int k = 0; k < RULE_HALF; ++k)
+            center *= 3;
+        for (int code = 0; code < RULE_CODES; ++code)
+        {
+            // 只有中心为己方棋子的编码会被查询
+            if (code / center % 3 == 1)
+                _table[code] = classify(code);
+        }
+    }
+
+    // 以(row, col)为中心，dr/dc方向上的窗口编码
+    template <class Board>
+    static int window_code(const Board &board, int row, int col, int dr, int dc, int color)
+    {
+        int code = 0;
+        for (int k = RULE_HALF; k >= -RULE_HALF; --k)
+        {
+            int r = row + k * dr, c = col + k * dc;
+            int v = 2;
+            if (board.in_board(r, c))
+                v = board.get(r, c) == 0 ? 0 : (board.get(r, c) == color ? 1 : 2);
+            if (k == 0)
+                v = 1;
+            code = code * 3 + v;
+        }
+        return code;
+    }
+
+    // 连珠规则下color方在(row, col)落子是否为禁手，board上该位置为空
+    template <class Board>
+    bool renju_forbidden(Board &board, int row, int col, int color, int depth)
+    {
+        static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        const line_info *infos[4];
+        for (int d = 0; d < 4; ++d)
+        {
+            infos[d] = &_table[window_code(board, row, col, dirs[d][0], dirs[d][1], color)];
+            // 成五优先于禁手
+            if (infos[d]->five)
+                return false;
+        }
+        int fours = 0;
+        for (int d = 0; d < 4; ++d)
+        {
+            if (infos[d]->overline)
+                return true;
+            fours += infos[d]->fours;
+        }
+        if (fours >= 2)
+            return true;
+        if (depth >= RULE_DEPTH)
+            return false;
+        // 活三只有在延伸点本身不是禁手时才算数
+        int threes = 0;
+        board.set(row, col, color);
+        for (int d = 0; d < 4 && threes < 2; ++d)
+        {
+            if (infos[d]->fours != 0)
+                continue;
+            for (int e = 0; e < RULE_WINDOW; ++e)
+            {
+                if ((infos[d]->three_points >> e & 1) == 0)
+                    continue;
+                int r = row + (e - RULE_HALF) * dirs[d][0], c = col + (e - RULE_HALF) * dirs[d][1];
+                if (renju_forbidden(board, r, c, color, depth + 1) == false)
+                {
+                    threes++;
+                    break;
+                }
+            }
+        }
+        board.set(row, col, 0);
+        return threes >= 2;
+    }
+
+public:
+    static rule_engine &instance()
+    {
+        static rule_engine engine;
+        return engine;
+    }
+
+    // color方在空位(row, col)落子在rule规则下是否为禁手
+    template <class Board>
+    bool forbidden(Board &board, int row, int col, int color, game_rule rule)
+    {
+        if (rule != RULE_RENJU || color != RULE_RESTRICTED)
+            return false;
+        return renju_forbidden(board, row, col, color, 0);
+    }
+
+    // color方已在(row, col)落子，判断在rule规则下是否获胜
+    template <class Board>
+    bool win(const Board &board, int row, int col, int color, game_rule rule)
+    {
+        static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        bool overline_wins = rule == RULE_FREESTYLE || (rule == RULE_RENJU && color != RULE_RESTRICTED);
+        for (int d = 0; d < 4; ++d)
+        {
+            const line_info &info = _table[window_code(board, row, col, dirs[d][0], dirs[d][1], color)];
+            if (info.five || (info.overline && overline_wins))
+                return true;
+        }
+        return false;
+    }
+};
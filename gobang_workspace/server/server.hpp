@@ -3,16 +3,30 @@
 #include <iostream>
 #include <string>
 #include <functional>
-#include <websocketpp/server.hpp>
-#include <websocketpp/config/asio_no_tls.hpp>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
 
 #include "log.hpp"
 #include "util.hpp"
+#include "wsconfig.hpp"
 #include "db.hpp"
 #include "onlineuser.hpp"
 #include "room.hpp"
 #include "session.hpp"
 #include "matcher.hpp"
+#include "analysis.hpp"
+#include "leaderboard.hpp"
+#include "journal.hpp"
+#include "timer.hpp"
+#include "executor.hpp"
+#include "shard.hpp"
+#include "cluster.hpp"
+#include "credential.hpp"
+#include "challenge.hpp"
+#include "lobby.hpp"
+#include "archive.hpp"
+#include "opening.hpp"
 
 #define HOST "127.0.0.1"
 #define PORT 3306
@@ -22,19 +36,38 @@
 
 
 #define WWWROOT "./wwwroot/"
+#define ARCHIVE_LIST_MAX 50 // 一次最多返回的归档对局数
+#define OPENING_LIST_MAX 20 // 开局库一次返回的落点数
+#define LB_REFRESH_MS 10000 // 多进程和集群模式下从数据库刷新排行榜的间隔 ms
 
-using WSserver = websocketpp::server<websocketpp::config::asio>;
 
 class gobang_server
 {
 private:
     std::string _web_root; // 静态资源根目录 ./wwwroot/      /register.html ->  ./wwwroot/register.html
+    shard *_shard; // 多进程模式下的共享内存，单进程时为空
     WSserver _wssrv;
+    WSserver _wsroom; // 多进程模式下本worker的房间端口，与_wssrv共用io线程
+    leaderboard _lb;
+    name_filter _nf; // 已经被占用的用户名
+    name_index _ni;  // 按前缀搜索用户名
     user_table _ut;
+    credential_pool _cp; // 注册和登录的密码哈希在这里计算
     onlineuser _ou;
+    analysis_service _as;
+    room_journal _rj;
+    game_archive _ga; // 已经结束的对局
+    opening_table _ot; // 开局库
+    timer_wheel _tw;
+    executor _ex; // 房间和匹配的逻辑在执行器上处理，网络io线程只负责收发
+    std::unique_ptr<cluster> _cluster; // 集群模式，单节点时为空
+    std::vector<std::tuple<uint32_t, std::string, uint16_t>> _seeds; // 启动时已知的其他节点
     room_manager _rm;
     matcher _mm;
     session_manager _sm;
+    invite_table _it; // 待处理的挑战邀请
+    lobby_feed _lf;   // 大厅状态推送
+    uint64_t _lb_refresh = 0; // 下次从数据库刷新排行榜的时间 ms
 
 private:
     // http 处理静态资源请求
@@ -99,14 +132,57 @@ private:
             LOG(DEBUG, "用户名或密码缺失");
             return http_resp(conn, false, websocketpp::http::status_code::bad_request, "请输入用户名/密码");
         }
-        ret = _ut.insert(reg_info);
+        // 先确认用户名没有被占用：过滤器中没有的用户名直接新增，命中的由数据库确认
+        conn->defer_http_response();
+        bool submitted = _ut.async_name_taken(reg_info["username"].asString(), [this, conn, reg_info](bool taken) mutable {
+            if (taken)
+            {
+                http_resp(conn, false, websocketpp::http::status_code::bad_request, "用户名已经被占用!");
+                return conn->send_http_response();
+            }
+            reg_insert(conn, reg_info);
+        });
+        if (submitted == false)
+            busy(conn);
+    }
+
+    // 用户名没有被占用，新增用户
+    void reg_insert(WSserver::connection_ptr &conn, Json::Value &reg_info)
+    {
+        // 计算密码哈希很耗时，在工作线程中计算，之后在数据库线程中新增用户，完成后回到io线程发送响应
+        boost::asio::io_service &io = _wssrv.get_io_service();
+        bool submitted = _cp.submit([this, conn, reg_info, &io]() mutable {
+            std::string hash;
+            if (credential::hash(reg_info["password"].asString(), hash) == false)
+                return io.post([this, conn]() mutable { reg_done(conn, false); });
+            if (_ut.async_insert(reg_info["username"].asString(), hash, [this, conn](bool ret) mutable { reg_done(conn, ret); }) == false)
+                io.post([this, conn]() mutable { busy(conn); });
+        });
+        if (submitted == false)
+            busy(conn);
+    }
+
+    // 新增用户完毕，在网络io线程中发送响应
+    void reg_done(WSserver::connection_ptr &conn, bool ret)
+    {
         if (ret == false)
         {
             LOG(DEBUG, "向数据库插入数据失败");
-            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "用户名已经被占用!");
+            http_resp(conn, false, websocketpp::http::status_code::bad_request, "用户名已经被占用!");
         }
-        //  如果成功了，则返回200
-        http_resp(conn, true, websocketpp::http::status_code::ok, "注册用户成功");
+        else //  如果成功了，则返回200
+            http_resp(conn, true, websocketpp::http::status_code::ok, "注册用户成功");
+        conn->send_http_response();
+    }
+
+    // 延迟响应的请求被拒绝：数据库不可用时回复500，排队已满时回复服务器繁忙
+    void busy(WSserver::connection_ptr &conn)
+    {
+        if (_ut.db_alive() == false)
+            http_resp(conn, false, websocketpp::http::status_code::internal_server_error, "数据库不可用，请稍后再试");
+        else
+            http_resp(conn, false, websocketpp::http::status_code::service_unavailable, "服务器繁忙，请稍后再试");
+        conn->send_http_response();
     }
     
     // http 处理用户登录请求
@@ -127,7 +203,40 @@ private:
             LOG(DEBUG, "用户名或密码缺失");
             return http_resp(conn, false, websocketpp::http::status_code::bad_request, "请输入用户名/密码");
         }
-        ret = _ut.login(login_info);
+        //  先在数据库线程中取出用户信息和密码哈希，回到io线程后把验证密码交给工作线程，验证完毕再回到io线程创建会话
+        //  任何一步排队的请求已满时直接拒绝
+        conn->defer_http_response();
+        std::string password = login_info["password"].asString();
+        bool submitted = _ut.async_login(login_info["username"].asString(), [this, conn, password](bool found, Json::Value &user, const std::string &stored) mutable {
+            if (found == false)
+            {
+                login_done(conn, user, false);
+                return conn->send_http_response();
+            }
+            boost::asio::io_service &io = _wssrv.get_io_service();
+            bool submitted = _cp.submit([this, conn, password, user, stored, &io]() mutable {
+                bool upgrade = false;
+                bool ret = credential::verify(password, stored, upgrade);
+                // 旧版本的哈希（MySQL password()或者较低的代价参数）在登录成功后换成新的哈希
+                std::string hash;
+                if (ret && upgrade && credential::hash(password, hash))
+                    _ut.async_update_password(user["id"].asUInt64(), hash);
+                // 会话和定时器在网络io线程中创建
+                io.post([this, conn, user, ret]() mutable {
+                    login_done(conn, user, ret);
+                    conn->send_http_response();
+                });
+            });
+            if (submitted == false)
+                busy(conn);
+        });
+        if (submitted == false)
+            busy(conn);
+    }
+
+    // 密码验证完毕，在网络io线程中创建会话并设置响应
+    void login_done(WSserver::connection_ptr &conn, Json::Value &login_info, bool ret)
+    {
         //  2.1 如果验证失败，则返回400
         if (ret == false)
         {
@@ -175,6 +284,33 @@ private:
         return false;
     }
     
+    // 从uri的查询字符串中获取参数  /analysis?room_id=1
+    bool get_query_val(const std::string &uri, const std::string &key, std::string &val)
+    {
+        size_t pos = uri.find('?');
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+        std::vector<std::string> query_arr;
+        util_string::split(uri.substr(pos + 1), "&", query_arr);
+        for (auto str : query_arr)
+        {
+            std::vector<std::string> tmp_arr;
+            util_string::split(str, "=", tmp_arr);
+            if (tmp_arr.size() != 2)
+            {
+                continue;
+            }
+            if (tmp_arr[0] == key)
+            {
+                val = tmp_arr[1];
+                return true;
+            }
+        }
+        return false;
+    }
+
     // http 处理用户信息获取请求
     void info(WSserver::connection_ptr &conn)
     {
@@ -201,24 +337,296 @@ private:
             // 没有找到session，则认为登录已经过期，需要重新登录
             return http_resp(conn, true, websocketpp::http::status_code::bad_request, "登录过期，请重新登录");
         }
-        // 3. 从数据库中取出用户信息，进行序列化发送给客户端
-        uint64_t uid = ssp->get_user();
-        Json::Value user_info;
-        ret = _ut.select_by_id(uid, user_info);
-        if (ret == false)
+        // 3. 在数据库线程中取出用户信息，回到io线程后进行序列化发送给客户端
+        conn->defer_http_response();
+        bool submitted = _ut.async_select_by_id(ssp->get_user(), [this, conn, ssp](bool ret, Json::Value &user_info) mutable {
+            if (ret == false)
+            {
+                // 获取用户信息失败，返回错误：找不到用户信息
+                http_resp(conn, true, websocketpp::http::status_code::bad_request, "找不到用户信息，请重新登录");
+                return conn->send_http_response();
+            }
+            std::string body;
+            util_json::serialization(user_info, body);
+            conn->set_body(body);
+            conn->append_header("Content-Type", "application/json"); // http_resp?
+            conn->set_status(websocketpp::http::status_code::ok);
+            conn->send_http_response();
+            // 4. 刷新session的过期时间
+            _sm.set_session_expire_time(ssp->ssid(), SESSION_TIMEOUT);
+        });
+        if (submitted == false)
+            busy(conn);
+    }
+    
+    // http 处理对局复盘请求，只有对局双方可以获取
+    void analysis(WSserver::connection_ptr &conn)
+    {
+        // 1. 通过Cookie中的ssid找到会话，确认用户身份
+        std::string cookie = conn->get_request_header("Cookie");
+        std::string ssid;
+        if (cookie.empty() || get_cookie_val(cookie, "SSID", ssid) == false)
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "找不到ssid信息，请重新登录");
+        }
+        session_ptr ssp = _sm.get_session_by_ssid(std::stol(ssid));
+        if (ssp.get() == nullptr)
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "登录过期，请重新登录");
+        }
+        // 2. 获取要复盘的房间号
+        std::string rid;
+        if (get_query_val(conn->get_request().get_uri(), "room_id", rid) == false)
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "缺少房间号");
+        }
+        char *end = nullptr;
+        uint64_t room_id = strtoull(rid.c_str(), &end, 10);
+        if (rid.empty() || *end != '\0')
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "房间号格式错误");
+        }
+        // 3. 获取复盘结果，首次请求时开始分析，客户端需要轮询直到status为done
+        Json::Value result;
+        if (_as.query(room_id, ssp->get_user(), result) == false)
         {
-            // 获取用户信息失败，返回错误：找不到用户信息
-            return http_resp(conn, true, websocketpp::http::status_code::bad_request, "找不到用户信息，请重新登录");
+            return http_resp(conn, false, websocketpp::http::status_code::not_found, "找不到对局记录");
         }
+        result["result"] = true;
         std::string body;
-        util_json::serialization(user_info, body);
+        util_json::serialization(result, body);
         conn->set_body(body);
-        conn->append_header("Content-Type", "application/json"); // http_resp?
+        conn->append_header("Content-Type", "application/json");
         conn->set_status(websocketpp::http::status_code::ok);
-        // 4. 刷新session的过期时间
-        _sm.set_session_expire_time(ssp->ssid(), SESSION_TIMEOUT);
     }
-    
+
+    // 将一局归档转换为json，moves为false时只有对局信息
+    static Json::Value game_json(const archive_game &g, bool moves)
+    {
+        static const char *results[] = {"white", "black", "none"};
+        Json::Value v;
+        v["game_id"] = (Json::UInt64)g.game_id;
+        v["room_id"] = (Json::UInt64)g.room_id;
+        v["white_id"] = (Json::UInt64)g.white_id;
+        v["black_id"] = (Json::UInt64)g.black_id;
+        v["white_rating"] = g.white_rating;
+        v["black_rating"] = g.black_rating;
+        v["winner"] = results[g.result];
+        v["rule"] = g.rule;
+        v["variant"] = g.variant;
+        v["start_ms"] = (Json::UInt64)g.start_ms;
+        v["end_ms"] = (Json::UInt64)g.end_ms;
+        v["move_count"] = (Json::UInt64)g.squares.size();
+        if (moves == false)
+            return v;
+        v["moves"] = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < g.squares.size(); ++i)
+        {
+            Json::Value m;
+            m["row"] = g.squares[i] / g.cols;
+            m["col"] = g.squares[i] % g.cols;
+            m["color"] = i % 2 == 0 ? CHESS_WHITE : CHESS_BLACK;
+            m["ms"] = g.times[i];
+            v["moves"].append(m);
+        }
+        return v;
+    }
+
+    // http 查询对局归档  /archive?game_id=1 返回一局的棋谱；/archive?uid=1&limit=20 返回玩家最近的对局，从新到旧
+    void archive(WSserver::connection_ptr &conn)
+    {
+        std::string uri = conn->get_request().get_uri();
+        std::string val;
+        Json::Value resp;
+        archive_game g;
+        if (get_query_val(uri, "game_id", val))
+        {
+            if (_ga.get(strtoull(val.c_str(), nullptr, 10), g) == false)
+                return http_resp(conn, false, websocketpp::http::status_code::not_found, "找不到对局记录");
+            resp = game_json(g, true);
+        }
+        else if (get_query_val(uri, "uid", val))
+        {
+            uint64_t uid = strtoull(val.c_str(), nullptr, 10);
+            size_t limit = 20;
+            if (get_query_val(uri, "limit", val))
+                limit = strtoul(val.c_str(), nullptr, 10);
+            if (limit > ARCHIVE_LIST_MAX)
+                limit = ARCHIVE_LIST_MAX;
+            std::vector<uint64_t> gids;
+            _ga.games_of(uid, limit, gids);
+            resp["games"] = Json::Value(Json::arrayValue);
+            for (uint64_t gid : gids)
+            {
+                if (_ga.get(gid, g))
+                    resp["games"].append(game_json(g, false));
+            }
+        }
+        else
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "缺少对局id或用户id");
+        }
+        resp["result"] = true;
+        std::string body;
+        util_json::serialization(resp, body);
+        conn->set_body(body);
+        conn->append_header("Content-Type", "application/json");
+        conn->set_status(websocketpp::http::status_code::ok);
+    }
+
+    static Json::Value opening_json(const opening_stats &st)
+    {
+        Json::Value v;
+        v["games"] = (Json::UInt64)st.games();
+        v["white"] = (Json::UInt64)st.count[OPENING_WHITE_WIN];
+        v["draw"] = (Json::UInt64)st.count[OPENING_DRAW];
+        v["black"] = (Json::UInt64)st.count[OPENING_BLACK_WIN];
+        return v;
+    }
+
+    // http 查询开局库  /opening?rule=0&moves=7,7;7,8&rating=1500
+    // moves为当前局面按顺序的落点（行,列），rating为空时合计所有分段；返回当前局面和之后每个落点的白胜/和/黑胜次数
+    // 读取不加锁，在网络io线程中直接处理
+    void opening(WSserver::connection_ptr &conn)
+    {
+        std::string uri = conn->get_request().get_uri();
+        std::string val;
+        int rule = DEFAULT_RULE, band = -1;
+        if (get_query_val(uri, "rule", val))
+            rule = atoi(val.c_str());
+        if (get_query_val(uri, "rating", val))
+            band = opening_table::band_of(atoi(val.c_str()));
+        std::vector<uint16_t> squares;
+        if (get_query_val(uri, "moves", val))
+        {
+            std::vector<std::string> moves;
+            util_string::split(val, ";", moves);
+            for (const std::string &m : moves)
+            {
+                int row, col;
+                if (sscanf(m.c_str(), "%d,%d", &row, &col) != 2 || row < 0 || row >= OPENING_COLS || col < 0 || col >= OPENING_COLS)
+                    return http_resp(conn, false, websocketpp::http::status_code::bad_request, "落点格式错误");
+                squares.push_back(row * OPENING_COLS + col);
+            }
+        }
+        if (rule < 0 || rule >= OPENING_RULES)
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "规则错误");
+        opening_stats here;
+        std::vector<opening_move> next;
+        _ot.explore(squares, rule, band, OPENING_LIST_MAX, here, next);
+        Json::Value resp = opening_json(here);
+        resp["result"] = true;
+        resp["moves"] = Json::Value(Json::arrayValue);
+        for (const opening_move &m : next)
+        {
+            Json::Value v = opening_json(m.stats);
+            v["row"] = m.row;
+            v["col"] = m.col;
+            resp["moves"].append(v);
+        }
+        std::string body;
+        util_json::serialization(resp, body);
+        conn->set_body(body);
+        conn->append_header("Content-Type", "application/json");
+        conn->set_status(websocketpp::http::status_code::ok);
+    }
+
+    // 将排行榜中的一项转换为json
+    static Json::Value entry_json(const lb_entry &entry)
+    {
+        Json::Value v;
+        v["rank"] = (Json::UInt64)entry.rank;
+        v["id"] = (Json::UInt64)entry.uid;
+        v["username"] = entry.name;
+        v["score"] = (Json::Int64)entry.score;
+        return v;
+    }
+
+    // http 处理排行榜请求  /leaderboard?offset=0&limit=20
+    void leaderboard_list(WSserver::connection_ptr &conn)
+    {
+        std::string uri = conn->get_request().get_uri();
+        std::string val;
+        uint64_t offset = 0;
+        size_t limit = 20;
+        if (get_query_val(uri, "offset", val))
+            offset = strtoull(val.c_str(), nullptr, 10);
+        if (get_query_val(uri, "limit", val))
+            limit = strtoul(val.c_str(), nullptr, 10);
+        if (limit > LB_MAX_LIMIT)
+            limit = LB_MAX_LIMIT;
+        std::vector<lb_entry> entries;
+        _lb.range(offset, limit, entries);
+        Json::Value resp;
+        resp["result"] = true;
+        resp["total"] = (Json::UInt64)_lb.size();
+        resp["users"] = Json::Value(Json::arrayValue);
+        for (auto &e : entries)
+            resp["users"].append(entry_json(e));
+        std::string body;
+        util_json::serialization(resp, body);
+        conn->set_body(body);
+        conn->append_header("Content-Type", "application/json");
+        conn->set_status(websocketpp::http::status_code::ok);
+    }
+
+    // http 处理用户排名请求  /rank?uid=1
+    void rank(WSserver::connection_ptr &conn)
+    {
+        std::string uid;
+        if (get_query_val(conn->get_request().get_uri(), "uid", uid) == false)
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "缺少用户id");
+        }
+        lb_entry entry;
+        if (_lb.rank(strtoull(uid.c_str(), nullptr, 10), entry) == false)
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::not_found, "找不到用户");
+        }
+        Json::Value resp = entry_json(entry);
+        resp["result"] = true;
+        resp["total"] = (Json::UInt64)_lb.size();
+        std::string body;
+        util_json::serialization(resp, body);
+        conn->set_body(body);
+        conn->append_header("Content-Type", "application/json");
+        conn->set_status(websocketpp::http::status_code::ok);
+    }
+
+    // http 处理按前缀搜索玩家请求  /search?prefix=ab&limit=10，按分数从高到低返回
+    void search(WSserver::connection_ptr &conn)
+    {
+        std::string uri = conn->get_request().get_uri();
+        std::string prefix, val;
+        if (get_query_val(uri, "prefix", prefix) == false || (prefix = util_string::url_decode(prefix)).empty())
+        {
+            return http_resp(conn, false, websocketpp::http::status_code::bad_request, "缺少搜索的用户名前缀");
+        }
+        size_t limit = 10;
+        if (get_query_val(uri, "limit", val))
+            limit = strtoul(val.c_str(), nullptr, 10);
+        if (limit > NI_MAX_LIMIT)
+            limit = NI_MAX_LIMIT;
+        std::vector<ni_entry> entries;
+        _ni.search(prefix, limit, entries);
+        Json::Value resp;
+        resp["result"] = true;
+        resp["users"] = Json::Value(Json::arrayValue);
+        for (auto &e : entries)
+        {
+            // 索引中的用户名是小写的，从排行榜中取得原始的用户名和排名
+            lb_entry entry;
+            if (_lb.rank(e.uid, entry) == false)
+                entry = lb_entry{0, e.uid, e.score, e.name};
+            resp["users"].append(entry_json(entry));
+        }
+        std::string body;
+        util_json::serialization(resp, body);
+        conn->set_body(body);
+        conn->append_header("Content-Type", "application/json");
+        conn->set_status(websocketpp::http::status_code::ok);
+    }
+
 //////////////////// http请求响应函数
     void http_callback(websocketpp::connection_hdl hdl)
     {
@@ -226,6 +634,7 @@ private:
         websocketpp::http::parser::request req = conn->get_request();
         std::string method = req.get_method();
         std::string uri = req.get_uri();
+        std::string path = uri.substr(0, uri.find('?')); // 去掉查询字符串
         if (method == "POST" && uri == "/reg")
         {
             reg(conn); // 用户注册请求
@@ -238,6 +647,30 @@ private:
         {
             info(conn); // 用户信息获取请求
         }
+        else if (method == "GET" && path == "/analysis")
+        {
+            analysis(conn); // 对局复盘请求
+        }
+        else if (method == "GET" && path == "/leaderboard")
+        {
+            leaderboard_list(conn); // 排行榜请求
+        }
+        else if (method == "GET" && path == "/archive")
+        {
+            archive(conn); // 查询对局归档
+        }
+        else if (method == "GET" && path == "/opening")
+        {
+            opening(conn); // 查询开局库
+        }
+        else if (method == "GET" && path == "/search")
+        {
+            search(conn); // 按用户名前缀搜索玩家
+        }
+        else if (method == "GET" && path == "/rank")
+        {
+            rank(conn); // 用户排名请求
+        }
         else
         {
             return file_handler(conn); // 页面静态资源请求
@@ -250,7 +683,7 @@ private:
     {
         std::string body;
         util_json::serialization(resp, body);
-        conn->send(body);
+        ws_send(conn, body);
     }
     
     // 使用cookie信息找到session
@@ -305,20 +738,41 @@ private:
         {
             return;
         }
-        // 2. 判断当前客户端是否是重复登录
-        if (_ou.is_in_game_hall(ssp->get_user()) || _ou.is_in_game_room(ssp->get_user()))
+        // 2. 将当前客户端以及连接加入到游戏大厅，已经在大厅或房间中则是重复登录
+        enter_result er = _ou.enter_game_hall(ssp->get_user(), conn);
+        if (er != ENTER_OK)
         {
-            resp_json["reason"] = "玩家重复登录！";
+            resp_json["reason"] = er == ENTER_FULL ? "在线人数已满，请稍后再试！" : "玩家重复登录！";
             resp_json["result"] = false;
             return ws_resp(conn, resp_json);
         }
-        // 3. 将当前客户端以及连接加入到游戏大厅
-        _ou.enter_game_hall(ssp->get_user(), conn);
-        // 4. 给客户端响应游戏大厅连接建立成功
+        // 3. 记得将session设置为永久存在
+        _sm.set_session_expire_time(ssp->ssid(), SESSION_FOREVER);
+        // 4. 给客户端响应游戏大厅连接建立成功，有未结束的对局（如服务器重启前的对局）时让客户端回到房间
         resp_json["result"] = true;
+        room_ptr rp = _rm.get_room_by_uid(ssp->get_user());
+        if (rp.get() != nullptr)
+        {
+            if (rp->statu() == GAME_START)
+            {
+                resp_json["room_id"] = (Json::UInt64)rp->id();
+                if (_shard != nullptr) // 房间长连接连到本worker
+                    resp_json["room_port"] = _shard->room_port(_shard->worker());
+            }
+            return hall_ready(conn, resp_json);
+        }
+        find_remote_room(ssp->get_user(), [this, conn, resp_json](uint64_t rid) mutable {
+            if (rid != 0)
+                resp_json["room_id"] = (Json::UInt64)rid; // 房间在其他节点上，由本节点转发
+            hall_ready(conn, resp_json);
+        });
+    }
+
+    void hall_ready(WSserver::connection_ptr &conn, Json::Value &resp_json)
+    {
         ws_resp(conn, resp_json);
-        // 5. 记得将session设置为永久存在
-        _sm.set_session_expire_time(ssp->ssid(), SESSION_FOREVER);
+        // 大厅状态的完整快照，之后定时推送增量
+        ws_send(conn, _lf.full());
     }
     
     // 建立游戏房间长连接
@@ -330,36 +784,125 @@ private:
         session_ptr ssp = get_session_by_cookie(conn);
         if (ssp.get() == nullptr) return;
         
-        // 2. 当前用户是否已经在在线用户管理的游戏房间或者游戏大厅中---在线用户管理
-        if (_ou.is_in_game_hall(ssp->get_user()) || _ou.is_in_game_room(ssp->get_user()))
+        // 2. 判断当前用户是否已经创建好了房间 --- 房间管理；集群模式下房间可能在其他节点上
+        room_ptr rp = _rm.get_room_by_uid(ssp->get_user());
+        if (rp.get() == nullptr)
         {
-            resp_json["reason"] = "玩家重复登录！";
-            resp_json["result"] = false;
-            return ws_resp(conn, resp_json);
+            return find_remote_room(ssp->get_user(), [this, conn, ssp, resp_json](uint64_t rid) mutable {
+                // 询问其他节点期间连接可能已经关闭
+                if (conn->get_state() != websocketpp::session::state::open)
+                    return;
+                if (rid != 0)
+                    return wsopen_remote_room(conn, ssp, rid);
+                resp_json["reason"] = "没有找到玩家的房间信息";
+                resp_json["result"] = false;
+                ws_resp(conn, resp_json);
+            });
         }
 
-        // 3. 判断当前用户是否已经创建好了房间 --- 房间管理
-        room_ptr rp = _rm.get_room_by_uid(ssp->get_user());
-        if (rp.get() == nullptr)
+        // 3. 将当前用户添加到在线用户管理的游戏房间中，已经在游戏房间或者游戏大厅中则是重复登录
+        enter_result er = _ou.enter_game_room(ssp->get_user(), conn);
+        if (er != ENTER_OK)
         {
-            resp_json["reason"] = "没有找到玩家的房间信息";
+            resp_json["reason"] = er == ENTER_FULL ? "在线人数已满，请稍后再试！" : "玩家重复登录！";
             resp_json["result"] = false;
             return ws_resp(conn, resp_json);
         }
 
-        // 4. 将当前用户添加到在线用户管理的游戏房间中
-        _ou.enter_game_room(ssp->get_user(), conn);
+        // 4. 断线重连的玩家取消判负
+        _rm.rejoin_room(ssp->get_user());
 
         // 5. 将session重新设置为永久存在
         _sm.set_session_expire_time(ssp->ssid(), SESSION_FOREVER);
 
         // 6. 回复房间准备完毕
+        room_ready(rp, ssp->get_user());
+    }
+
+    // 回复玩家房间准备完毕，集群模式下玩家的连接可能在其他节点上，经由在线用户管理转发
+    void room_ready(const room_ptr &rp, uint64_t uid)
+    {
+        Json::Value resp_json;
+        resp_json["optype"] = "room_ready";
         resp_json["result"] = true;
         resp_json["room_id"] = (Json::UInt64)rp->id();
-        resp_json["uid"] = (Json::UInt64)ssp->get_user();
+        resp_json["uid"] = (Json::UInt64)uid;
         resp_json["white_id"] = (Json::UInt64)rp->get_white_user();
         resp_json["black_id"] = (Json::UInt64)rp->get_black_user();
-        return ws_resp(conn, resp_json);
+        resp_json["rule"] = rp->rule();
+        resp_json["board_size"] = rp->board_rows();
+        // 开局库按玩家自己的等级分段查询
+        int score = 0;
+        resp_json["rating"] = _ut.get_score(uid, score) ? score : 0;
+        // 对方是否在线，对方在断线宽限期内时客户端显示等待重连
+        uint64_t peer = uid == rp->get_white_user() ? rp->get_black_user() : rp->get_white_user();
+        resp_json["peer_online"] = peer == AI_UID || _ou.is_in_game_room(peer);
+        // 棋钟和棋谱属于房间的状态，在房间的mailbox中读取后回复
+        rp->post([this, rp, uid, resp_json]() mutable {
+            // 双方剩余的时间
+            resp_json["clock"] = rp->clock_info();
+            // 已经下过的棋，重新进入房间时还原棋盘
+            const game_record &record = rp->record();
+            for (size_t i = 0; i < record.rows.size(); ++i)
+            {
+                Json::Value move;
+                move["row"] = record.rows[i];
+                move["col"] = record.cols[i];
+                move["color"] = record.colors[i];
+                resp_json["moves"].append(move);
+            }
+            std::string body;
+            util_json::serialization(resp_json, body);
+            _ou.send_to_room(uid, body);
+        });
+    }
+
+    // 集群模式：查找玩家在其他节点上的房间，done在网络io线程中执行，没有找到时rid为0
+    // 本节点记录的房间直接返回；不知道时（玩家换了节点重新连接）在执行器上询问其他节点，不阻塞网络io线程
+    void find_remote_room(uint64_t uid, const std::function<void(uint64_t rid)> &done)
+    {
+        uint64_t rid = 0;
+        if (_cluster.get() == nullptr || _rm.remote_room(uid, rid))
+            return done(rid);
+        boost::asio::io_service &io = _wssrv.get_io_service();
+        _ex.post([this, uid, done, &io]() {
+            uint64_t rid = 0;
+            std::string req, resp;
+            rpc_writer(req).put<uint64_t>(uid);
+            for (uint32_t node : _cluster->peers())
+            {
+                if (_cluster->call(node, RPC_ROOM_FIND, req, resp))
+                {
+                    rpc_reader r(resp);
+                    uint64_t found = r.get<uint64_t>();
+                    if (r.good())
+                        rid = found;
+                    break;
+                }
+            }
+            io.post([done, rid]() { done(rid); });
+        });
+    }
+
+    // 集群模式：玩家的房间在其他节点上，本节点作为网关，房间长连接上的消息转发给房间的所有者
+    void wsopen_remote_room(WSserver::connection_ptr conn, const session_ptr &ssp, uint64_t rid)
+    {
+        uint64_t uid = ssp->get_user();
+        enter_result er = _ou.enter_game_room(uid, conn);
+        if (er != ENTER_OK)
+        {
+            Json::Value resp_json;
+            resp_json["optype"] = "room_ready";
+            resp_json["reason"] = er == ENTER_FULL ? "在线人数已满，请稍后再试！" : "玩家重复登录！";
+            resp_json["result"] = false;
+            return ws_resp(conn, resp_json);
+        }
+        _rm.set_remote_room(uid, rid);
+        _sm.set_session_expire_time(ssp->ssid(), SESSION_FOREVER);
+        // 由房间的所有者登记玩家并回复房间准备完毕
+        std::string req;
+        rpc_writer(req).put<uint64_t>(uid).put<uint32_t>(_cluster->self());
+        _cluster->send(_cluster->owner(rid), RPC_ROOM_OPEN, req);
     }
 
 /////////////////// Websocket长连接建立请求响应函数
@@ -408,8 +951,17 @@ private:
         _ou.exit_game_room(ssp->get_user());
         // 3. 将session回复生命周期的管理，设置定时销毁
         _sm.set_session_expire_time(ssp->ssid(), SESSION_TIMEOUT);
-        // 4. 将玩家从游戏房间中移除，房间中所有用户退出了就会销毁房间
-        _rm.remove_room_user(ssp->get_user());
+        // 4. 将玩家从游戏房间中移除，房间中所有用户退出了就会销毁房间；对局中断线的玩家先等待重连
+        //    集群模式下房间在其他节点上时，由房间的所有者处理
+        uint64_t rid;
+        if (_cluster.get() != nullptr && _rm.remote_room(ssp->get_user(), rid))
+        {
+            _rm.clear_remote_room(ssp->get_user());
+            std::string req;
+            rpc_writer(req).put<uint64_t>(ssp->get_user());
+            return _cluster->send(_cluster->owner(rid), RPC_ROOM_CLOSE, req);
+        }
+        _rm.leave_room(ssp->get_user());
     }
 
 /////////////////// Websocket长连接关闭请求响应函数
@@ -440,10 +992,10 @@ private:
         if (ssp.get() == nullptr) return;
 
         // 2. 获取请求信息
-        std::string req_body = msg->get_payload();
-        Json::Value req_json;
-        bool ret = util_json::deserialization(req_body, req_json);
-        if (ret == false)
+        const std::string &req_body = msg->get_payload();
+        ws_request req;
+        ws_parser parser;
+        if (parser.parse(req_body.data(), req_body.size(), req) == false)
         {
             resp_json["result"] = false;
             resp_json["reason"] = "请求信息解析失败";
@@ -451,15 +1003,23 @@ private:
         }
 
         // 3. 对于请求进行处理：
-        if (!req_json["optype"].isNull() && req_json["optype"].asString() == "match_start")
+        if (req.optype == WS_OP_MATCH_START)
         {
-            //  开始对战匹配：通过匹配模块，将用户添加到匹配队列中
-            _mm.add(ssp->get_user());
+            //  开始对战匹配：通过匹配模块，将用户添加到所选规则和棋盘的匹配队列中
             resp_json["optype"] = "match_start";
+            game_rule rule;
+            board_variant variant;
+            if (request_mode(req, rule, variant) == false)
+            {
+                resp_json["result"] = false;
+                resp_json["reason"] = "未知的规则或棋盘";
+                return ws_resp(conn, resp_json);
+            }
+            _mm.add(ssp->get_user(), rule, variant);
             resp_json["result"] = true;
             return ws_resp(conn, resp_json);
         }
-        else if (!req_json["optype"].isNull() && req_json["optype"].asString() == "match_stop")
+        else if (req.optype == WS_OP_MATCH_STOP)
         {
             //  停止对战匹配：通过匹配模块，将用户从匹配队列中移除
             _mm.del(ssp->get_user());  // ??匹配成功时取消匹配？目前会照常匹配
@@ -467,13 +1027,177 @@ private:
             resp_json["result"] = true;
             return ws_resp(conn, resp_json);
         }
+        else if (req.optype == WS_OP_CHALLENGE || req.optype == WS_OP_ACCEPT || req.optype == WS_OP_DECLINE)
+        {
+            resp_json["optype"] = ws_optype_name(req.optype);
+            resp_json["uid"] = (Json::UInt64)req.uid;
+            if (ws_parser::complete(req) == false)
+            {
+                resp_json["result"] = false;
+                resp_json["reason"] = "缺少对方的用户id";
+                return ws_resp(conn, resp_json);
+            }
+            return handle_challenge(conn, ssp->get_user(), req, resp_json);
+        }
         resp_json["optype"] = "unknown";
         resp_json["reason"] = "请求类型未知";
         resp_json["result"] = false;
         return ws_resp(conn, resp_json);
     }
 
-    // 处理房间中的请求  确认客户端信息，反序列化成json格式的信息交给上层room对象处理请求
+    // 匹配和挑战请求中选择的规则和棋盘，没有选择时使用默认值，规则或棋盘未知时返回false
+    static bool request_mode(const ws_request &req, game_rule &rule, board_variant &variant)
+    {
+        rule = DEFAULT_RULE;
+        variant = DEFAULT_BOARD;
+        if (req.fields & WS_FIELD_RULE)
+        {
+            if (req.rule < RULE_FREESTYLE || req.rule > RULE_RENJU)
+                return false;
+            rule = (game_rule)req.rule;
+        }
+        if (req.fields & WS_FIELD_BOARD)
+        {
+            if (req.board < BOARD_STANDARD || req.board > BOARD_BLITZ)
+                return false;
+            variant = (board_variant)req.board;
+        }
+        return true;
+    }
+
+    // 通知大厅中的玩家挑战邀请的变化：收到挑战、被拒绝、超时，peer为对方，msg中可以预先放入其他字段
+    void challenge_notify(uint64_t uid, const char *optype, uint64_t peer, Json::Value msg = Json::Value())
+    {
+        WSserver::connection_ptr conn = _ou.get_conn_from_hall(uid);
+        if (conn.get() == nullptr)
+            return;
+        msg["optype"] = optype;
+        msg["result"] = true;
+        msg["uid"] = (Json::UInt64)peer;
+        // 对方的用户名和分数从排行榜中取得，不访问数据库
+        lb_entry entry;
+        if (_lb.rank(peer, entry))
+        {
+            msg["username"] = entry.name;
+            msg["score"] = (Json::Int64)entry.score;
+        }
+        ws_resp(conn, msg);
+    }
+
+    // 采集大厅状态的快照，对局双方的用户名从排行榜中取得
+    void lobby_collect(lobby_snapshot &snap)
+    {
+        snap.hall = _ou.hall_count();
+        snap.room = _ou.room_count();
+        snap.rooms = _rm.room_count();
+        size_t sizes[MATCH_TIERS];
+        _mm.queue_sizes(sizes);
+        for (int i = 0; i < MATCH_TIERS; ++i)
+            snap.queue[i] = sizes[i];
+        std::vector<room_ptr> rooms;
+        _rm.recent_rooms(LOBBY_GAMES, rooms);
+        for (room_ptr &rp : rooms)
+        {
+            lobby_game g{rp->id(), rp->get_white_user(), rp->get_black_user(), "", ""};
+            lb_entry entry;
+            if (_lb.rank(g.white_id, entry))
+                g.white_name = entry.name;
+            if (g.black_id == AI_UID)
+                g.black_name = "电脑玩家";
+            else if (_lb.rank(g.black_id, entry))
+                g.black_name = entry.name;
+            snap.games.push_back(g);
+        }
+    }
+
+    // 定时推送大厅状态：有变化时生成一个增量帧，所有大厅连接共用同一个消息
+    void lobby_push()
+    {
+        if (_lf.due(_tw.now_ms()) == false)
+            return;
+        lobby_snapshot snap;
+        lobby_collect(snap);
+        std::string delta;
+        if (_lf.update(snap, delta) == false)
+            return;
+        std::vector<WSserver::connection_ptr> conns;
+        if (_ou.hall_conns(conns) == 0)
+            return;
+        WSserver::message_ptr msg = ws_shared_frame(conns[0], delta);
+        for (WSserver::connection_ptr &conn : conns)
+            conn->send(msg);
+    }
+
+    // 处理大厅中的挑战：发起、接受、拒绝，接受后直接创建房间，不经过匹配队列
+    void handle_challenge(WSserver::connection_ptr &conn, uint64_t uid, const ws_request &req, Json::Value &resp_json)
+    {
+        uint64_t peer = req.uid;
+        resp_json["result"] = false;
+        if (req.optype == WS_OP_CHALLENGE)
+        {
+            // 对方必须在本进程的大厅中，且没有在对局
+            if (peer == uid || _ou.is_in_game_hall(peer) == false || _rm.get_room_by_uid(peer).get() != nullptr)
+            {
+                resp_json["reason"] = "对方不在大厅中";
+                return ws_resp(conn, resp_json);
+            }
+            game_rule rule;
+            board_variant variant;
+            if (request_mode(req, rule, variant) == false)
+            {
+                resp_json["reason"] = "未知的规则或棋盘";
+                return ws_resp(conn, resp_json);
+            }
+            challenge_statu st = _it.create(uid, peer, rule, variant);
+            if (st != CHALLENGE_OK)
+            {
+                resp_json["reason"] = st == CHALLENGE_DUPLICATE ? "已经向对方发出过挑战" : "对方待处理的挑战太多";
+                return ws_resp(conn, resp_json);
+            }
+            Json::Value msg;
+            msg["rule"] = rule;
+            msg["board"] = variant;
+            challenge_notify(peer, "challenged", uid, msg);
+            resp_json["result"] = true;
+            return ws_resp(conn, resp_json);
+        }
+        // 接受和拒绝：取出对方发给自己的邀请
+        invite inv;
+        if (_it.take(peer, uid, inv) == false)
+        {
+            resp_json["reason"] = "挑战已经失效";
+            return ws_resp(conn, resp_json);
+        }
+        if (req.optype == WS_OP_DECLINE)
+        {
+            challenge_notify(peer, "declined", uid);
+            resp_json["result"] = true;
+            return ws_resp(conn, resp_json);
+        }
+        // 双方先退出匹配，之后匹配线程不会再为他们创建房间
+        _mm.cancel(peer);
+        _mm.cancel(uid);
+        // 挑战者执白，按挑战者选择的规则和棋盘创建房间；房间创建时检查双方仍在大厅中，已经在对局中的玩家（包括匹配线程刚刚配对的）不能再进入新的房间
+        WSserver::connection_ptr peer_conn = _ou.get_conn_from_hall(peer);
+        room_ptr rp;
+        if (peer_conn.get() != nullptr)
+            rp = _rm.create_room(peer, uid, inv.rule, inv.variant);
+        if (rp.get() == nullptr)
+        {
+            resp_json["reason"] = "对方已经离开大厅或正在对局中";
+            return ws_resp(conn, resp_json);
+        }
+        Json::Value success;
+        success["optype"] = "match_success";
+        success["result"] = true;
+        success["room_id"] = (Json::UInt64)rp->id();
+        if (_shard != nullptr)
+            success["room_port"] = _shard->room_port(_shard->worker());
+        ws_resp(peer_conn, success);
+        ws_resp(conn, success);
+    }
+
+    // 处理房间中的请求  确认客户端信息，解析成请求结构体交给上层room对象处理请求
     void wsmsg_game_room(WSserver::connection_ptr conn, WSserver::message_ptr msg)
     {
         Json::Value resp_json;
@@ -485,9 +1209,10 @@ private:
             return;
         }
 
-        // 2. 获取客户端房间信息
+        // 2. 获取客户端房间信息，集群模式下房间可能在其他节点上
         room_ptr rp = _rm.get_room_by_uid(ssp->get_user());
-        if (rp.get() == nullptr)
+        uint64_t remote_rid = 0;
+        if (rp.get() == nullptr && (_cluster.get() == nullptr || _rm.remote_room(ssp->get_user(), remote_rid) == false))
         {
             resp_json["optype"] = "unknow";
             resp_json["reason"] = "没有找到玩家的房间信息";
@@ -496,21 +1221,23 @@ private:
             return ws_resp(conn, resp_json);
         }
 
-        // 3. 对消息进行反序列化
-        Json::Value req_json;
-        std::string req_body = msg->get_payload();
-        bool ret = util_json::deserialization(req_body, req_json);
-        if (ret == false)
+        // 3. 对消息进行解析，检查消息类型需要的字段
+        const std::string &req_body = msg->get_payload();
+        ws_request req;
+        ws_parser parser;
+        if (parser.parse(req_body.data(), req_body.size(), req) == false || ws_parser::complete(req) == false)
         {
             resp_json["optype"] = "unknow";
             resp_json["reason"] = "请求解析失败";
             resp_json["result"] = false;
-            LOG(DEBUG, "房间-反序列化请求失败");
+            LOG(DEBUG, "房间-解析请求失败");
             return ws_resp(conn, resp_json);
         }
 
-        // 4. 通过房间模块进行消息请求的处理
-        rp->handle_request(req_json);
+        // 4. 投递给房间，在执行器上处理请求；房间在其他节点上时转发给房间的所有者
+        if (rp.get() == nullptr)
+            return _rm.forward_request(ssp->get_user(), remote_rid, req);
+        rp->push_request(req);
     }
 
 /////////////////// Websocket长连接通信响应函数
@@ -530,6 +1257,148 @@ private:
     }
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+    // 每个worker/节点使用自己的房间日志
+    static std::string journal_path(shard *sd, const cluster_config *cc)
+    {
+        if (sd != nullptr)
+            return JOURNAL_PATH + ("." + std::to_string(sd->worker()));
+        if (cc != nullptr)
+            return JOURNAL_PATH + (".node" + std::to_string(cc->node));
+        return JOURNAL_PATH;
+    }
+
+    // 多进程和集群模式下同一玩家的对局可能在不同的worker/节点中结束，用户数据模块不缓存分数，排行榜定时从数据库刷新
+    static bool shared_db(shard *sd, const cluster_config *cc)
+    {
+        return sd != nullptr || cc != nullptr;
+    }
+
+    // 归档目录，多进程和集群模式下每个worker/节点各自归档
+    static std::string archive_dir(shard *sd, const cluster_config *cc)
+    {
+        if (sd != nullptr)
+            return ARCHIVE_DIR + ("." + std::to_string(sd->worker()));
+        if (cc != nullptr)
+            return ARCHIVE_DIR + (".node" + std::to_string(cc->node));
+        return ARCHIVE_DIR;
+    }
+
+    // 开局库文件，多进程模式下所有worker映射同一个文件，集群模式下每个节点各自统计
+    static std::string opening_path(const cluster_config *cc)
+    {
+        if (cc != nullptr)
+            return OPENING_PATH + (".node" + std::to_string(cc->node));
+        return OPENING_PATH;
+    }
+
+    // 集群模式：处理其他节点的请求（在RPC服务线程中执行），会话的定时器在网络io线程中设置
+    void set_cluster_handlers()
+    {
+        boost::asio::io_service &io = _wssrv.get_io_service();
+        _cluster->on(RPC_SESSION_PUT, [this, &io](uint8_t, const std::string &req, std::string &) {
+            rpc_reader r(req);
+            uint64_t ssid = r.get<uint64_t>(), uid = r.get<uint64_t>();
+            int ms = r.get<int32_t>();
+            if (r.good() == false)
+                return false;
+            _sm.put_session(ssid, uid);
+            io.post([this, ssid, ms]() { _sm.set_session_expire_time(ssid, ms); });
+            return true;
+        });
+        _cluster->on(RPC_SESSION_GET, [this](uint8_t, const std::string &req, std::string &resp) {
+            rpc_reader r(req);
+            session_ptr ssp = _sm.get_session_by_ssid(r.get<uint64_t>());
+            if (r.good() == false || ssp.get() == nullptr)
+                return false;
+            rpc_writer(resp).put<uint64_t>(ssp->get_user());
+            return true;
+        });
+        _cluster->on(RPC_SESSION_EXPIRE, [this, &io](uint8_t, const std::string &req, std::string &) {
+            rpc_reader r(req);
+            uint64_t ssid = r.get<uint64_t>();
+            int ms = r.get<int32_t>();
+            if (r.good() == false)
+                return false;
+            io.post([this, ssid, ms]() { _sm.set_session_expire_time(ssid, ms); });
+            return true;
+        });
+        _cluster->on(RPC_ROOM_FIND, [this](uint8_t, const std::string &req, std::string &resp) {
+            rpc_reader r(req);
+            room_ptr rp = _rm.get_room_by_uid(r.get<uint64_t>());
+            if (r.good() == false || rp.get() == nullptr || rp->statu() != GAME_START)
+                return false;
+            rpc_writer(resp).put<uint64_t>(rp->id());
+            return true;
+        });
+        _cluster->on(RPC_ROOM_OPEN, [this](uint8_t, const std::string &req, std::string &) {
+            rpc_reader r(req);
+            uint64_t uid = r.get<uint64_t>();
+            uint32_t gateway = r.get<uint32_t>();
+            room_ptr rp = _rm.get_room_by_uid(uid);
+            if (r.good() == false || rp.get() == nullptr)
+                return false;
+            _ou.enter_remote_room(uid, gateway);
+            _rm.rejoin_room(uid);
+            room_ready(rp, uid);
+            return true;
+        });
+        _cluster->on(RPC_ROOM_MSG, [this](uint8_t, const std::string &req, std::string &) { return _rm.handle_forwarded(req); });
+        _cluster->on(RPC_ROOM_CLOSE, [this](uint8_t, const std::string &req, std::string &) {
+            rpc_reader r(req);
+            uint64_t uid = r.get<uint64_t>();
+            if (r.good() == false)
+                return false;
+            _ou.exit_remote_room(uid);
+            _rm.leave_room(uid);
+            return true;
+        });
+        _cluster->on(RPC_ROOM_MOVE, [this](uint8_t, const std::string &req, std::string &) { return _rm.move_in(req); });
+        _cluster->on(RPC_PLAYER_SEND, [this](uint8_t, const std::string &req, std::string &) {
+            rpc_reader r(req);
+            uint64_t uid = r.get<uint64_t>();
+            std::string body = r.get_str();
+            WSserver::connection_ptr conn = _ou.get_conn_from_room(uid);
+            if (r.good() == false || conn.get() == nullptr)
+                return false;
+            ws_send(conn, body);
+            return true;
+        });
+        // 房间发给连接在其他节点上的玩家的消息
+        _ou.set_relay([this](uint32_t node, uint64_t uid, const std::string &body) {
+            std::string req;
+            rpc_writer(req).put<uint64_t>(uid).put_str(body);
+            _cluster->send(node, RPC_PLAYER_SEND, req);
+        });
+        // 成员变化后迁移所有者改变的房间和会话
+        _cluster->on_change([this]() {
+            _rm.rebalance();
+            _sm.rebalance();
+        });
+    }
+
+    // 集群模式：主动离开集群，等待房间迁移完成后停止服务
+    void leave_cluster()
+    {
+        _cluster->leave();
+        for (int i = 0; i < CLUSTER_RPC_TIMEOUT / 10 && _rm.room_count() > 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        LOG(INFO, "节点%u离开集群，剩余 %lu 个房间未迁移", _cluster->self(), _rm.room_count());
+        _wssrv.stop();
+    }
+
+    // 设置服务器的回调函数，多进程模式下房间端口使用相同的回调
+    void set_handlers(WSserver &srv)
+    {
+        // http请求响应函数
+        srv.set_http_handler(std::bind(&gobang_server::http_callback, this, std::placeholders::_1));
+        // Websocket长连接建立请求响应函数
+        srv.set_open_handler(std::bind(&gobang_server::wsopen_callback, this, std::placeholders::_1));
+        // Websocket长连接关闭请求响应函数
+        srv.set_close_handler(std::bind(&gobang_server::wsclose_callback, this, std::placeholders::_1));
+        // Websocket通信响应函数
+        srv.set_message_handler(std::bind(&gobang_server::wsmsg_callback, this, std::placeholders::_1, std::placeholders::_2));
+    }
+
 public:
     // mysql数据库访问模块初始化，以及服务器回调函数的设置
     gobang_server(const std::string &host,
@@ -537,28 +1406,111 @@ public:
                   const std::string &pass,
                   const std::string &dbname,
                   uint16_t port = PORT,
-                  const std::string &wwwroot = WWWROOT) 
-                  : _web_root(wwwroot), _ut(host, user, pass, dbname, port), _rm(&_ut, &_ou), _sm(&_wssrv), _mm(&_rm, &_ut, &_ou)
+                  const std::string &wwwroot = WWWROOT,
+                  shard *sd = nullptr,
+                  const cluster_config *cc = nullptr)
+                  : _web_root(wwwroot), _shard(sd), _ut(host, user, pass, dbname, port, shared_db(sd, cc)), _rj(journal_path(sd, cc)), _ga(archive_dir(sd, cc)), _ot(opening_path(cc)),
+                    _cluster(cc == nullptr ? nullptr : new cluster(*cc, &_ex)),
+                    _rm(&_ut, &_ou, &_as, &_ex, &_rj, &_tw, _cluster.get(), &_ga, &_ot), _sm(&_wssrv, sd, _cluster.get()), _mm(&_rm, &_ut, &_ou, &_ex, &_tw, sd),
+                    _it(&_tw)
     {
+        if (cc != nullptr)
+        {
+            _seeds = cc->peers;
+            set_cluster_handlers();
+        }
+        // 挑战邀请超时，通知双方
+        _it.on_expire([this](const invite &inv) {
+            challenge_notify(inv.from, "challenge_timeout", inv.to);
+            challenge_notify(inv.to, "challenge_timeout", inv.from);
+        });
+        // 数据库线程完成查询后回到网络io线程继续处理
+        _ut.set_post([this](const std::function<void()> &f) { _wssrv.get_io_service().post(f); });
+        // 打开对局归档，失败时本次运行不归档
+        if (_ga.open() == false)
+            LOG(ERROR, "对局归档不可用，本次运行不归档对局!");
+        // 打开开局库，失败时本次运行不统计
+        if (_ot.open() == false)
+            LOG(ERROR, "开局库不可用，本次运行不统计开局!");
+        // 加载排行榜，之后由用户数据模块随分数变化同步更新
+        _ut.load_leaderboard(&_lb);
+        // 加载用户名过滤器，注册时先检查用户名是否已经被占用
+        _ut.load_name_filter(&_nf);
+        // 加载用户名前缀索引，之后由用户数据模块随注册和分数变化同步更新
+        _ut.load_name_index(&_ni);
+
         _wssrv.set_access_channels(websocketpp::log::alevel::none);
         _wssrv.init_asio();
         _wssrv.set_reuse_addr(true);
-        
-        // http请求响应函数
-        _wssrv.set_http_handler(std::bind(&gobang_server::http_callback, this, std::placeholders::_1));
-        // Websocket长连接建立请求响应函数
-        _wssrv.set_open_handler(std::bind(&gobang_server::wsopen_callback, this, std::placeholders::_1));
-        // Websocket长连接关闭请求响应函数
-        _wssrv.set_close_handler(std::bind(&gobang_server::wsclose_callback, this, std::placeholders::_1));
-        // Websocket通信响应函数
-        _wssrv.set_message_handler(std::bind(&gobang_server::wsmsg_callback, this, std::placeholders::_1, std::placeholders::_2));
+        set_handlers(_wssrv);
+        if (_shard != nullptr)
+        {
+            // 多个worker监听同一个端口，由内核分配连接
+            _wssrv.set_tcp_pre_bind_handler([](WSserver::transport_type::acceptor_ptr acceptor) {
+                int one = 1;
+                if (setsockopt(acceptor->native_handle(), SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+                    LOG(ERROR, "设置SO_REUSEPORT失败: %s", strerror(errno));
+                return websocketpp::lib::error_code();
+            });
+            _wsroom.set_access_channels(websocketpp::log::alevel::none);
+            _wsroom.init_asio(&_wssrv.get_io_service());
+            _wsroom.set_reuse_addr(true);
+            set_handlers(_wsroom);
+        }
     }
-    
+
+    // 多进程和集群模式下其他worker/节点结束的对局只写入了数据库，定时把分数刷新到本进程的排行榜
+    void leaderboard_refresh()
+    {
+        if (_shard == nullptr && _cluster.get() == nullptr)
+            return;
+        uint64_t now = _tw.now_ms();
+        if (now < _lb_refresh)
+            return;
+        _lb_refresh = now + LB_REFRESH_MS;
+        if (_ut.async_refresh_leaderboard() == false)
+            LOG(ERROR, "数据库查询排队已满，本次不刷新排行榜");
+    }
+
+    // 推动时间轮，执行到期的定时任务（断线宽限期等）；多进程模式下处理其他worker发来的匹配通知；定时推送大厅状态和刷新排行榜
+    void timer_tick(const websocketpp::lib::error_code &ec)
+    {
+        _tw.advance();
+        _mm.deliver_notices();
+        lobby_push();
+        leaderboard_refresh();
+        _wssrv.set_timer(TW_TICK_MS, std::bind(&gobang_server::timer_tick, this, std::placeholders::_1));
+    }
+
     // 启动服务器
+    // 多进程模式下所有worker共用port，本worker的房间长连接使用port+1+worker编号
     void start(int port)
     {
+        if (_shard != nullptr)
+        {
+            uint16_t room_port = port + 1 + _shard->worker();
+            _wsroom.listen(room_port);
+            _wsroom.start_accept();
+            _shard->attach(room_port);
+            LOG(INFO, "worker %u 房间端口: %u", _shard->worker(), room_port);
+        }
+        if (_cluster.get() != nullptr)
+        {
+            // 先启动RPC服务再通知其他节点，之后迁移日志中恢复的、所有者已经不是本节点的房间
+            if (_cluster->start() == false)
+                return;
+            _cluster->join(_seeds);
+            _rm.rebalance();
+            // 收到退出信号时主动离开集群，房间迁移给其他节点
+            std::shared_ptr<boost::asio::signal_set> signals(new boost::asio::signal_set(_wssrv.get_io_service(), SIGINT, SIGTERM));
+            signals->async_wait([this, signals](const boost::system::error_code &ec, int) {
+                if (!ec)
+                    leave_cluster();
+            });
+        }
         _wssrv.listen(port);
         _wssrv.start_accept();
+        _wssrv.set_timer(TW_TICK_MS, std::bind(&gobang_server::timer_tick, this, std::placeholders::_1));
         _wssrv.run();
     }
 };
\ No newline at end of file
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <unordered_map>
-
-#include <websocketpp/server.hpp>
-#include <websocketpp/config/asio_no_tls.hpp>
+#include <chrono>
 
 #include "log.hpp"
 #include "util.hpp"
+#include "wsconfig.hpp"
+#include "shard.hpp"
+#include "cluster.hpp"
 
 /*
 * 为用户的连接维护一个session
@@ -18,6 +19,15 @@
 * session管理模块
 * 增删查改session
 * 更改session生命周期/状态
+*
+* 多进程模式下会话同时登记在共享内存的会话表中：登录和长连接可能落在不同的worker上，
+* 本进程没有的会话从共享表中取出后缓存；存活时间以共享表为准，本地的定时器只负责清理缓存
+*
+* 集群模式下会话的所有者由ssid在一致性哈希环上的位置决定，会话只保存在所有者上（包括存活时间的定时器），
+* 其他节点创建、查询、设置存活时间都通过RPC交给所有者；成员变化后把所有者改变的会话交给新的所有者
+* 非所有者在本地缓存用到的会话（ssid -> uid），同一会话只在第一次用到时同步询问所有者，之后的消息不再阻塞网络io线程：
+* 本节点创建的会话异步交给所有者；缓存的截止时间跟随本节点发出的RPC_SESSION_EXPIRE，
+* 从所有者取来、本节点没有设置过存活时间的会话只缓存SESSION_CACHE_MS
 */
 
 
@@ -37,7 +47,7 @@ private:
     // 用户状态：未登录，已登录
     ss_statu _statu;
     // session关联的定时器
-    websocketpp::server<websocketpp::config::asio>::timer_ptr _tp; 
+    WSserver::timer_ptr _tp; 
 public:
     session(uint64_t ssid) : _ssid(ssid) { LOG(DEBUG, "SESSION %p 被创建！！", this); }
     ~session() { LOG(DEBUG, "SESSION %p 被释放！！", this); }
@@ -52,13 +62,15 @@ public:
 
     bool is_login() { return (_statu == LOGIN); } // 判断是否在线
 
-    void set_timer(const websocketpp::server<websocketpp::config::asio>::timer_ptr &tp) { _tp = tp; } // 初始化_tp
+    void set_timer(const WSserver::timer_ptr &tp) { _tp = tp; } // 初始化_tp
 
-    websocketpp::server<websocketpp::config::asio>::timer_ptr &get_timer() { return _tp; } // 获取tp指针
+    WSserver::timer_ptr &get_timer() { return _tp; } // 获取tp指针
 };
 
 #define SESSION_TIMEOUT 30000
 #define SESSION_FOREVER -1
+#define CLUSTER_SSID_SHIFT 40 // 集群模式下ssid的高位为节点号+1
+#define SESSION_CACHE_MS 1000 // 集群模式下从所有者取来的会话在本节点缓存的时间 ms
 using session_ptr = std::shared_ptr<session>;
 
 class session_manager
@@ -71,21 +83,82 @@ private:
     // uid ssid
     std::unordered_map<uint64_t, session_ptr> _session;
     // 定时器回指指针
-    websocketpp::server<websocketpp::config::asio> *_server;
+    WSserver *_server;
+    // 多进程模式下的共享会话表，单进程时为空
+    shard *_shard;
+    // 集群模式，单节点时为空
+    cluster *_cluster;
+    // 集群模式下其他节点上的会话的缓存 ssid -> (uid, 截止时间 ms，0表示永久)
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> _remote;
+
+private:
+    static uint64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t deadline(int ms) { return ms == SESSION_FOREVER ? 0 : now_ms() + ms; }
+
+    // 集群模式：查找缓存的其他节点上的会话，过期的缓存丢弃，调用方持有锁
+    bool cached_remote(uint64_t ssid, uint64_t &uid)
+    {
+        auto it = _remote.find(ssid);
+        if (it == _remote.end())
+            return false;
+        if (it->second.second != 0 && it->second.second <= now_ms())
+        {
+            _remote.erase(it);
+            return false;
+        }
+        uid = it->second.first;
+        return true;
+    }
+
+    // 集群模式下其他节点上的会话，由缓存构造，只用于本次请求
+    session_ptr remote_session(uint64_t ssid, uint64_t uid)
+    {
+        session_ptr ssp(new session(ssid));
+        ssp->set_statu(LOGIN);
+        ssp->set_user(uid);
+        return ssp;
+    }
+
+    bool is_remote(uint64_t ssid) { return _cluster != nullptr && _cluster->is_local(ssid) == false; }
 
 public:
-    session_manager(websocketpp::server<websocketpp::config::asio> *srv) : _next_ssid(1), _server(srv) { LOG(DEBUG, "session管理器初始化完毕！"); }
+    session_manager(WSserver *srv, shard *sd = nullptr, cluster *cl = nullptr) : _next_ssid(1), _server(srv), _shard(sd), _cluster(cl)
+    {
+        if (_cluster != nullptr)
+            _next_ssid = ((uint64_t)_cluster->self() + 1) << CLUSTER_SSID_SHIFT | 1;
+        LOG(DEBUG, "session管理器初始化完毕！");
+    }
     ~session_manager() { LOG(DEBUG, "session管理器即将销毁！"); }
 
     // 创建session
     session_ptr create_session(uint64_t uid, ss_statu statu)
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        session_ptr ssp(new session(_next_ssid));
+        uint64_t ssid = _next_ssid++;
+        if (_shard != nullptr)
+        {
+            // ssid由共享表分配，各个worker之间不会重复
+            ssid = _shard->session_create(uid, SESSION_TIMEOUT);
+            if (ssid == 0)
+                return session_ptr();
+        }
+        else if (is_remote(ssid))
+        {
+            // 会话异步交给所有者保存，之后设置存活时间的消息经由同一个mailbox按顺序发出
+            _remote[ssid] = std::make_pair(uid, deadline(SESSION_TIMEOUT));
+            std::string req;
+            rpc_writer(req).put<uint64_t>(ssid).put<uint64_t>(uid).put<int32_t>(SESSION_TIMEOUT);
+            _cluster->send(_cluster->owner(ssid), RPC_SESSION_PUT, req);
+            return remote_session(ssid, uid);
+        }
+        session_ptr ssp(new session(ssid));
         ssp->set_statu(statu);
         ssp->set_user(uid);
-        _session.insert(std::make_pair(_next_ssid, ssp));
-        _next_ssid++;
+        _session.insert(std::make_pair(ssid, ssp));
         return ssp;
     }
 
@@ -99,13 +172,51 @@ public:
     // 通过ssid获取session_ptr
     session_ptr get_session_by_ssid(uint64_t ssid)
     {
+        if (is_remote(ssid))
+        {
+            uint64_t uid;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (cached_remote(ssid, uid))
+                    return remote_session(ssid, uid);
+            }
+            std::string req, resp;
+            rpc_writer(req).put<uint64_t>(ssid);
+            if (_cluster->call(_cluster->owner(ssid), RPC_SESSION_GET, req, resp) == false)
+                return session_ptr();
+            rpc_reader r(resp);
+            uid = r.get<uint64_t>();
+            if (r.good() == false)
+                return session_ptr();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _remote.insert(std::make_pair(ssid, std::make_pair(uid, deadline(SESSION_CACHE_MS))));
+            return remote_session(ssid, uid);
+        }
         std::unique_lock<std::mutex> lock(_mutex);
         auto it = _session.find(ssid);
-        if (it == _session.end())
+        if (_shard == nullptr)
+        {
+            if (it == _session.end())
+            {
+                return session_ptr();
+            }
+            return it->second;
+        }
+        // 多进程模式：以共享表为准，过期的缓存丢弃，其他worker创建的会话取来缓存
+        uint64_t uid;
+        if (_shard->session_get(ssid, uid) == false)
         {
+            if (it != _session.end())
+                _session.erase(it);
             return session_ptr();
         }
-        return it->second;
+        if (it != _session.end())
+            return it->second;
+        session_ptr ssp(new session(ssid));
+        ssp->set_statu(LOGIN);
+        ssp->set_user(uid);
+        _session.insert(std::make_pair(ssid, ssp));
+        return ssp;
     }
 
     // 移除session
@@ -124,19 +235,33 @@ public:
         //  登录之后，创建session，session需要在指定时间无通信后删除
         //  但是进入游戏大厅，或者游戏房间，这个session就应该永久存在
         //  等到退出游戏大厅，或者游戏房间，这个session应该被重新设置为临时，在长时间无通信后被删除
+        if (is_remote(ssid)) // 集群模式：由所有者设置，同一节点的消息按顺序发出，本地的缓存按同样的时间过期
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _remote.find(ssid);
+                if (it != _remote.end())
+                    it->second.second = deadline(ms);
+            }
+            std::string req;
+            rpc_writer(req).put<uint64_t>(ssid).put<int32_t>(ms);
+            return _cluster->send(_cluster->owner(ssid), RPC_SESSION_EXPIRE, req);
+        }
         session_ptr ssp = get_session_by_ssid(ssid);
         if (ssp.get() == nullptr)
         {
             return;
         }
-        websocketpp::server<websocketpp::config::asio>::timer_ptr tp = ssp->get_timer();
+        if (_shard != nullptr)
+            _shard->session_expire(ssid, ms);
+        WSserver::timer_ptr tp = ssp->get_timer();
         if (tp.get() == nullptr && ms == SESSION_FOREVER) // 1. 在session永久存在的情况下，设置永久存在
         {
             return;
         }
         else if (tp.get() == nullptr && ms != SESSION_FOREVER) // 2. 在session永久存在的情况下，设置指定时间之后被删除的定时任务
         {
-            websocketpp::server<websocketpp::config::asio>::timer_ptr tmp_tp = _server->set_timer(ms, std::bind(&session_manager::remove_session, this, ssid));
+            WSserver::timer_ptr tmp_tp = _server->set_timer(ms, std::bind(&session_manager::remove_session, this, ssid));
             ssp->set_timer(tmp_tp);
         }
         else if (tp.get() != nullptr && ms == SESSION_FOREVER) // 3. 在session设置了定时删除的情况下，将session设置为永久存在
@@ -144,20 +269,65 @@ public:
             // 删除定时任务--- stready_timer删除定时任务会导致任务直接被执行
             tp->cancel(); // 因为这个取消定时任务并不是立即取消的
             // 因此重新给session管理器中，添加一个session信息, 且添加的时候需要使用定时器，而不是立即添加
-            ssp->set_timer(websocketpp::server<websocketpp::config::asio>::timer_ptr()); // 将session关联的定时器设置为空
+            ssp->set_timer(WSserver::timer_ptr()); // 将session关联的定时器设置为空
             _server->set_timer(0, std::bind(&session_manager::append_session, this, ssp));
         }
         else if (tp.get() != nullptr && ms != SESSION_FOREVER) // 4. 在session设置了定时删除的情况下，将session重置删除时间
         {
             tp->cancel();
             // 将session重新添加回去
-            ssp->set_timer(websocketpp::server<websocketpp::config::asio>::timer_ptr()); // 将session关联的定时器设置为空
+            ssp->set_timer(WSserver::timer_ptr()); // 将session关联的定时器设置为空
             _server->set_timer(0, std::bind(&session_manager::append_session, this, ssp));
 
             // 重新给session添加定时销毁任务
-            websocketpp::server<websocketpp::config::asio>::timer_ptr tmp_tp = _server->set_timer(ms, std::bind(&session_manager::remove_session, this, ssp->ssid()));
+            WSserver::timer_ptr tmp_tp = _server->set_timer(ms, std::bind(&session_manager::remove_session, this, ssp->ssid()));
             // 重新设置session关联的定时器
             ssp->set_timer(tmp_tp);
         }
     }
+
+    // 集群模式：保存其他节点创建或迁移来的会话，之后由调用方设置存活时间
+    void put_session(uint64_t ssid, uint64_t uid)
+    {
+        session_ptr ssp(new session(ssid));
+        ssp->set_statu(LOGIN);
+        ssp->set_user(uid);
+        append_session(ssp);
+    }
+
+    // 集群模式：成员变化后把所有者不再是本节点的会话交给新的所有者，返回迁移的数量
+    // 交出的会话留在本地的缓存中，连接在本节点上的玩家不需要再询问新的所有者
+    size_t rebalance()
+    {
+        std::vector<session_ptr> moving;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (auto &it : _session)
+            {
+                if (is_remote(it.first))
+                    moving.push_back(it.second);
+            }
+            // 所有者变成本节点的会话由原来的所有者交来，不再使用缓存
+            for (auto it = _remote.begin(); it != _remote.end();)
+            {
+                if (is_remote(it->first))
+                    ++it;
+                else
+                    it = _remote.erase(it);
+            }
+        }
+        for (session_ptr &ssp : moving)
+        {
+            // 有定时器的会话按重新计时交出，否则永久存在
+            int ms = ssp->get_timer().get() != nullptr ? SESSION_TIMEOUT : SESSION_FOREVER;
+            std::string req, resp;
+            rpc_writer(req).put<uint64_t>(ssp->ssid()).put<uint64_t>(ssp->get_user()).put<int32_t>(ms);
+            if (_cluster->call(_cluster->owner(ssp->ssid()), RPC_SESSION_PUT, req, resp) == false)
+                continue; // 留在本节点，下次成员变化时再迁移
+            std::unique_lock<std::mutex> lock(_mutex);
+            _session.erase(ssp->ssid());
+            _remote[ssp->ssid()] = std::make_pair(ssp->get_user(), deadline(ms));
+        }
+        return moving.size();
+    }
 };
\ No newline at end of file
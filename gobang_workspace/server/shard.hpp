@@ -0,0 +1,384 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <vector>
+#include <functional>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "log.hpp"
+
+/*
+* 多进程分片模块
+* 主进程创建共享内存段后fork出多个worker进程，所有worker用SO_REUSEPORT监听同一个端口，由内核把连接分给各个worker；
+* 每个worker另外监听自己的房间端口（监听端口+1+worker编号），房间长连接直接连到房间所在的worker
+*
+* 共享内存段中保存：
+*   会话表：任意worker上登录创建的会话，其他worker都能通过cookie中的ssid找到
+*   匹配队列：每个分段的每种规则和棋盘一个队列，不同worker上的玩家可以互相匹配
+*   每个worker的通知队列：房间由执行匹配的worker创建，玩家在其他worker上时通过通知队列告诉玩家所在的worker
+*
+* 共享内存中的锁是进程间共享的robust互斥锁，持锁的worker崩溃后其他进程仍然可以加锁；
+* 主进程负责在worker退出后以相同的编号重新拉起，新的worker先清理匹配队列中属于旧进程的玩家
+*/
+
+#define SHARD_MAX_WORKERS 64
+#define SHARD_QUEUES 27          // 匹配队列数：3个分段 x 3种规则 x 3种棋盘
+#define SHARD_QUEUE_MAX 4096     // 每个匹配队列最多容纳的玩家
+#define SHARD_SESSIONS (1 << 16) // 会话表的条目数，2的幂
+#define SHARD_INBOX 1024         // 每个worker的通知队列长度
+#define SHARD_MAGIC 0x676f6273
+
+// 进程间共享的锁，持锁进程退出后恢复锁的一致性
+class shard_guard
+{
+private:
+    pthread_mutex_t *_mutex;
+
+public:
+    shard_guard(pthread_mutex_t *mutex) : _mutex(mutex)
+    {
+        if (pthread_mutex_lock(_mutex) == EOWNERDEAD)
+        {
+            LOG(ERROR, "共享内存的锁的持有者已退出，恢复锁的状态");
+            pthread_mutex_consistent(_mutex);
+        }
+    }
+    ~shard_guard() { pthread_mutex_unlock(_mutex); }
+};
+
+// 匹配队列中的玩家及其所在的worker
+struct shard_player
+{
+    uint64_t uid;
+    uint32_t worker;
+};
+
+struct shard_queue
+{
+    pthread_mutex_t mutex;
+    uint32_t count;
+    uint64_t seq; // 入队的次数
+    shard_player players[SHARD_QUEUE_MAX];
+};
+
+struct shard_session
+{
+    uint64_t ssid; // 0表示空条目
+    uint64_t uid;
+    uint64_t expire_ms; // 过期时间，UINT64_MAX表示永久存在
+};
+
+// 匹配成功的通知：玩家uid的房间在worker上
+struct shard_notice
+{
+    uint64_t uid;
+    uint32_t worker;
+};
+
+struct shard_inbox
+{
+    pthread_mutex_t mutex;
+    uint32_t head;
+    uint32_t count;
+    shard_notice notices[SHARD_INBOX];
+};
+
+struct shard_worker
+{
+    pid_t pid;
+    uint16_t room_port;
+};
+
+struct shard_segment
+{
+    uint32_t magic;
+    uint32_t workers;
+    pthread_mutex_t session_mutex;
+    uint64_t next_ssid;
+    shard_session sessions[SHARD_SESSIONS];
+    shard_queue queues[SHARD_QUEUES];
+    shard_inbox inboxes[SHARD_MAX_WORKERS];
+    shard_worker info[SHARD_MAX_WORKERS];
+};
+
+class shard
+{
+private:
+    shard_segment *_seg;
+    uint32_t _worker;
+
+private:
+    static void init_mutex(pthread_mutex_t *mutex)
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    // 单调时钟，同一台机器上的进程之间可以比较
+    static uint64_t now_ms()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static uint64_t expire_of(int ms) { return ms < 0 ? UINT64_MAX : now_ms() + ms; }
+
+    shard_session &session_slot(uint64_t ssid) { return _seg->sessions[ssid & (SHARD_SESSIONS - 1)]; }
+
+public:
+    // 创建匿名的共享内存段，在fork之前调用，子进程继承映射
+    static shard_segment *create(uint32_t workers)
+    {
+        if (workers == 0 || workers > SHARD_MAX_WORKERS)
+        {
+            LOG(ERROR, "worker数量%u超出范围", workers);
+            return nullptr;
+        }
+        void *p = mmap(nullptr, sizeof(shard_segment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            LOG(ERROR, "创建共享内存失败: %s", strerror(errno));
+            return nullptr;
+        }
+        shard_segment *seg = (shard_segment *)p; // 匿名映射的内容全部为0
+        seg->magic = SHARD_MAGIC;
+        seg->workers = workers;
+        seg->next_ssid = 1;
+        init_mutex(&seg->session_mutex);
+        for (int i = 0; i < SHARD_QUEUES; ++i)
+            init_mutex(&seg->queues[i].mutex);
+        for (uint32_t i = 0; i < SHARD_MAX_WORKERS; ++i)
+            init_mutex(&seg->inboxes[i].mutex);
+        return seg;
+    }
+
+    static void destroy(shard_segment *seg) { munmap(seg, sizeof(shard_segment)); }
+
+    // 主进程：fork出workers个子进程执行run(worker编号)，子进程退出后以相同的编号重新拉起
+    // 收到SIGINT/SIGTERM时结束所有子进程后返回
+    static void run_workers(shard_segment *seg, const std::function<void(uint32_t)> &run)
+    {
+        static volatile sig_atomic_t stopping = 0;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = [](int) { stopping = 1; };
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+
+        auto spawn = [seg, &run](uint32_t w) {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                run(w);
+                _exit(0);
+            }
+            seg->info[w].pid = pid;
+            LOG(INFO, "worker %u 启动，pid: %d", w, pid);
+        };
+        for (uint32_t w = 0; w < seg->workers; ++w)
+            spawn(w);
+        while (stopping == 0)
+        {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0)
+                continue; // 被信号打断
+            for (uint32_t w = 0; w < seg->workers; ++w)
+            {
+                if (seg->info[w].pid == pid && stopping == 0)
+                {
+                    LOG(ERROR, "worker %u (pid: %d) 退出，重新启动", w, pid);
+                    spawn(w);
+                }
+            }
+        }
+        for (uint32_t w = 0; w < seg->workers; ++w)
+            kill(seg->info[w].pid, SIGTERM);
+        while (waitpid(-1, nullptr, 0) > 0)
+            ;
+    }
+
+    shard(shard_segment *seg, uint32_t worker) : _seg(seg), _worker(worker) {}
+
+    uint32_t worker() const { return _worker; }
+    uint32_t workers() const { return _seg->workers; }
+
+    // worker启动：登记房间端口，清理旧进程（上次崩溃的同编号worker）留在匹配队列中的玩家
+    void attach(uint16_t room_port)
+    {
+        _seg->info[_worker].room_port = room_port;
+        for (int t = 0; t < SHARD_QUEUES; ++t)
+        {
+            shard_queue &q = _seg->queues[t];
+            shard_guard guard(&q.mutex);
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < q.count; ++i)
+            {
+                if (q.players[i].worker != _worker)
+                    q.players[n++] = q.players[i];
+            }
+            q.count = n;
+        }
+        shard_inbox &box = _seg->inboxes[_worker];
+        shard_guard guard(&box.mutex);
+        box.head = box.count = 0;
+    }
+
+    uint16_t room_port(uint32_t worker) const { return _seg->info[worker].room_port; }
+
+    ///////////////////////////// 会话
+
+    // 创建会话，返回ssid；跳过仍然有效的条目，不会覆盖别人的会话
+    uint64_t session_create(uint64_t uid, int ms)
+    {
+        shard_guard guard(&_seg->session_mutex);
+        uint64_t now = now_ms();
+        for (int i = 0; i < SHARD_SESSIONS; ++i)
+        {
+            uint64_t ssid = _seg->next_ssid++;
+            shard_session &s = session_slot(ssid);
+            if (s.ssid != 0 && s.expire_ms > now)
+                continue;
+            s.ssid = ssid;
+            s.uid = uid;
+            s.expire_ms = expire_of(ms);
+            return ssid;
+        }
+        LOG(ERROR, "共享会话表已满");
+        return 0;
+    }
+
+    // 查找未过期的会话
+    bool session_get(uint64_t ssid, uint64_t &uid)
+    {
+        shard_guard guard(&_seg->session_mutex);
+        shard_session &s = session_slot(ssid);
+        if (s.ssid != ssid || s.expire_ms <= now_ms())
+            return false;
+        uid = s.uid;
+        return true;
+    }
+
+    // 设置会话的存活时间，ms小于0表示永久存在
+    void session_expire(uint64_t ssid, int ms)
+    {
+        shard_guard guard(&_seg->session_mutex);
+        shard_session &s = session_slot(ssid);
+        if (s.ssid == ssid)
+            s.expire_ms = expire_of(ms);
+    }
+
+    ///////////////////////////// 匹配队列
+
+    // 玩家入队，worker为玩家所在的worker
+    bool queue_push(int index, uint64_t uid, uint32_t worker)
+    {
+        shard_queue &q = _seg->queues[index];
+        shard_guard guard(&q.mutex);
+        if (q.count == SHARD_QUEUE_MAX)
+        {
+            LOG(ERROR, "匹配队列已满，玩家%lu入队失败", uid);
+            return false;
+        }
+        q.players[q.count++] = shard_player{uid, worker};
+        q.seq++;
+        return true;
+    }
+
+    bool queue_push(int index, uint64_t uid) { return queue_push(index, uid, _worker); }
+
+    // 移除玩家，玩家不在队列中时返回false
+    bool queue_remove(int index, uint64_t uid)
+    {
+        shard_queue &q = _seg->queues[index];
+        shard_guard guard(&q.mutex);
+        for (uint32_t i = 0; i < q.count; ++i)
+        {
+            if (q.players[i].uid == uid)
+            {
+                memmove(&q.players[i], &q.players[i + 1], (q.count - i - 1) * sizeof(shard_player));
+                q.count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 取出队首的两个玩家，不足两个时返回false
+    bool queue_pop_pair(int index, shard_player &a, shard_player &b)
+    {
+        shard_queue &q = _seg->queues[index];
+        shard_guard guard(&q.mutex);
+        if (q.count < 2)
+            return false;
+        a = q.players[0];
+        b = q.players[1];
+        memmove(&q.players[0], &q.players[2], (q.count - 2) * sizeof(shard_player));
+        q.count -= 2;
+        return true;
+    }
+
+    // 队列中只有一个玩家且入队次数仍为seq时将其取出（等待期间没有新玩家入队）
+    bool queue_pop_single(int index, uint64_t seq, shard_player &p)
+    {
+        shard_queue &q = _seg->queues[index];
+        shard_guard guard(&q.mutex);
+        if (q.count != 1 || q.seq != seq)
+            return false;
+        p = q.players[0];
+        q.count = 0;
+        return true;
+    }
+
+    void queue_state(int index, uint32_t &count, uint64_t &seq)
+    {
+        shard_queue &q = _seg->queues[index];
+        shard_guard guard(&q.mutex);
+        count = q.count;
+        seq = q.seq;
+    }
+
+    ///////////////////////////// 通知队列
+
+    // 通知worker：玩家uid的房间在当前worker上
+    bool notify(uint32_t worker, uint64_t uid)
+    {
+        shard_inbox &box = _seg->inboxes[worker];
+        shard_guard guard(&box.mutex);
+        if (box.count == SHARD_INBOX)
+        {
+            LOG(ERROR, "worker %u 的通知队列已满，丢弃玩家%lu的匹配通知", worker, uid);
+            return false;
+        }
+        box.notices[(box.head + box.count) % SHARD_INBOX] = shard_notice{uid, _worker};
+        box.count++;
+        return true;
+    }
+
+    // 取出发给当前worker的所有通知
+    size_t drain(std::vector<shard_notice> &out)
+    {
+        shard_inbox &box = _seg->inboxes[_worker];
+        shard_guard guard(&box.mutex);
+        for (uint32_t i = 0; i < box.count; ++i)
+            out.push_back(box.notices[(box.head + i) % SHARD_INBOX]);
+        size_t n = box.count;
+        box.head = (box.head + box.count) % SHARD_INBOX;
+        box.count = 0;
+        return n;
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#include "log.hpp"
+
+/*
+* 线程池模块
+* 固定数量的工作线程从任务队列中取出任务执行
+*
+* 用于把耗时的计算（如人机对战的搜索）从网络io线程中剥离出来，
+* 避免阻塞websocket的收发
+* 可以给每个工作线程设置启动和退出时的回调（如数据库线程各自建立和关闭连接），启动失败的线程不执行任务
+*/
+
+class thread_pool
+{
+private:
+    // 任务队列
+    std::queue<std::function<void()>> _tasks;
+    // 工作线程
+    std::vector<std::thread> _threads;
+    // 保护任务队列
+    std::mutex _mutex;
+    // 队列为空时阻塞工作线程
+    std::condition_variable _cond;
+    // 线程池是否停止
+    bool _stop;
+    // 工作线程启动时调用，返回false时线程直接退出
+    std::function<bool()> _init;
+    // 工作线程退出前调用
+    std::function<void()> _fini;
+
+private:
+    // 工作线程入口：循环取出任务并执行
+    void worker_entry()
+    {
+        if (_init && _init() == false)
+        {
+            return;
+        }
+        while (1)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (_stop == false && _tasks.empty())
+                {
+                    _cond.wait(lock);
+                }
+                // 停止且任务已经处理完毕，则退出线程
+                if (_stop && _tasks.empty())
+                {
+                    break;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop();
+            }
+            task();
+        }
+        if (_fini)
+        {
+            _fini();
+        }
+    }
+
+public:
+    thread_pool(int thread_num, const std::function<bool()> &init = std::function<bool()>(),
+                const std::function<void()> &fini = std::function<void()>())
+        : _stop(false), _init(init), _fini(fini)
+    {
+        for (int i = 0; i < thread_num; ++i)
+        {
+            _threads.push_back(std::thread(&thread_pool::worker_entry, this));
+        }
+        LOG(DEBUG, "线程池初始化完毕，线程数量：%d", thread_num);
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_all();
+        for (auto &th : _threads)
+        {
+            th.join();
+        }
+    }
+
+    // 获取工作线程数量
+    int size() { return _threads.size(); }
+
+    // 获取等待执行的任务数量
+    int pending()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _tasks.size();
+    }
+
+    // 投递任务，并唤醒一个工作线程
+    void push(const std::function<void()> &task)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _tasks.push(task);
+        }
+        _cond.notify_one();
+    }
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+/*
+* 定时器模块
+* 所有房间共用一个分层时间轮，由服务器的一个周期定时器推动，不再为每个房间单独创建asio定时器
+*
+* 第0层有256个槽，每个槽一个刻度（TW_TICK_MS毫秒）；往上每层64个槽，每个槽覆盖下一层转一圈的时间，
+* 四层共覆盖约7.7天，更远的任务先挂在最高层，转到时重新放置。
+* 定时任务按剩余时间挂在能容纳它的最低一层，第0层每转完一圈，把上一层当前槽中的任务重新分配到下层（级联），
+* 到期的任务最终都落到第0层的当前槽中。
+* 添加和取消都是O(1)，每个刻度只处理一个槽，空闲时推进的开销与定时任务的数量无关；
+* 刻度细到可以做棋钟的超时，远的任务（如断线宽限期）也不会在第0层中反复空转
+* 到期的回调在释放锁之后执行，回调中可以再添加或取消定时任务
+*/
+
+#define TW_TICK_MS 10   // 时间轮的刻度
+#define TW_ROOT_BITS 8  // 第0层 256个槽
+#define TW_LEVEL_BITS 6 // 上面每层 64个槽
+#define TW_LEVELS 4
+#define TW_NIL 0xffffffffu
+
+class timer_wheel
+{
+private:
+    // 节点放在数组中复用，槽内用下标串成双向链表，添加和取消都不需要分配内存和查哈希表
+    struct timer_node
+    {
+        uint64_t expire; // 到期的刻度
+        uint32_t prev;
+        uint32_t next;
+        uint32_t gen;    // 节点每次复用加1，与下标一起组成定时任务id，防止取消到复用后的节点
+        int32_t bucket;  // 所在的槽，-1表示空闲
+        std::function<void()> cb;
+    };
+
+    std::mutex _mutex;
+    std::vector<timer_node> _nodes;
+    std::vector<uint32_t> _free;
+    // 所有层的槽依次排列，每个槽保存链表头节点的下标
+    std::vector<uint32_t> _buckets;
+    size_t _count;
+    uint64_t _tick; // 下一个要处理的刻度
+    std::chrono::steady_clock::time_point _start;
+
+private:
+    // 第level层的一个槽覆盖的刻度数的位数
+    static int shift(int level) { return level == 0 ? 0 : TW_ROOT_BITS + (level - 1) * TW_LEVEL_BITS; }
+    static uint64_t mask(int level) { return level == 0 ? (1 << TW_ROOT_BITS) - 1 : (1 << TW_LEVEL_BITS) - 1; }
+    static int offset(int level) { return level == 0 ? 0 : (1 << TW_ROOT_BITS) + (level - 1) * (1 << TW_LEVEL_BITS); }
+
+    void link(uint32_t idx, int bucket)
+    {
+        timer_node &node = _nodes[idx];
+        node.bucket = bucket;
+        node.prev = TW_NIL;
+        node.next = _buckets[bucket];
+        if (node.next != TW_NIL)
+            _nodes[node.next].prev = idx;
+        _buckets[bucket] = idx;
+    }
+
+    void unlink(uint32_t idx)
+    {
+        timer_node &node = _nodes[idx];
+        if (node.prev != TW_NIL)
+            _nodes[node.prev].next = node.next;
+        else
+            _buckets[node.bucket] = node.next;
+        if (node.next != TW_NIL)
+            _nodes[node.next].prev = node.prev;
+        node.bucket = -1;
+    }
+
+    void release(uint32_t idx)
+    {
+        _nodes[idx].cb = nullptr;
+        _nodes[idx].gen++;
+        _nodes[idx].bucket = -1;
+        _free.push_back(idx);
+        _count--;
+    }
+
+    // 按剩余时间把节点挂到对应的层和槽
+    void place(uint32_t idx)
+    {
+        uint64_t expire = _nodes[idx].expire < _tick ? _tick : _nodes[idx].expire;
+        uint64_t delta = expire - _tick;
+        int level = 0;
+        while (level < TW_LEVELS - 1 && delta >= ((uint64_t)1 << shift(level + 1)))
+            level++;
+        // 超出最高层范围的任务先挂在最高层最远的槽中
+        uint64_t limit = (uint64_t)1 << (shift(TW_LEVELS - 1) + TW_LEVEL_BITS);
+        if (delta >= limit)
+            expire = _tick + limit - 1;
+        link(idx, offset(level) + ((expire >> shift(level)) & mask(level)));
+    }
+
+    // 把第level层的一个槽中的任务重新分配到下层，返回该槽的下标
+    int cascade(int level)
+    {
+        int slot = (_tick >> shift(level)) & mask(level);
+        uint32_t idx = _buckets[offset(level) + slot];
+        _buckets[offset(level) + slot] = TW_NIL;
+        while (idx != TW_NIL)
+        {
+            uint32_t next = _nodes[idx].next;
+            place(idx);
+            idx = next;
+        }
+        return slot;
+    }
+
+public:
+    timer_wheel() : _buckets(offset(TW_LEVELS), TW_NIL), _count(0), _tick(0), _start(std::chrono::steady_clock::now()) {}
+
+    // 当前时间，从时间轮创建开始计算的毫秒数
+    uint64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    // 添加ms毫秒后执行的定时任务，返回定时任务id（不为0）
+    uint64_t add(uint64_t ms, const std::function<void()> &cb)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        uint32_t idx;
+        if (_free.empty())
+        {
+            idx = _nodes.size();
+            _nodes.push_back(timer_node{0, TW_NIL, TW_NIL, 1, -1, nullptr});
+        }
+        else
+        {
+            idx = _free.back();
+            _free.pop_back();
+        }
+        // 当前刻度还没有处理完，从下一个刻度开始向上取整，保证不会提前到期，最多推迟一个刻度
+        _nodes[idx].expire = _tick + (ms + TW_TICK_MS - 1) / TW_TICK_MS;
+        _nodes[idx].cb = cb;
+        place(idx);
+        _count++;
+        return ((uint64_t)_nodes[idx].gen << 32) | idx;
+    }
+
+    // 取消定时任务，已经到期或不存在时返回false
+    bool cancel(uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        uint32_t idx = id & 0xffffffff;
+        if (idx >= _nodes.size() || _nodes[idx].gen != (id >> 32) || _nodes[idx].bucket < 0)
+            return false;
+        unlink(idx);
+        release(idx);
+        return true;
+    }
+
+    // 推进到指定时间，执行期间到期的定时任务
+    void advance_to(uint64_t ms)
+    {
+        uint64_t target = ms / TW_TICK_MS;
+        std::vector<std::function<void()>> expired;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_tick <= target)
+            {
+                int slot = _tick & mask(0);
+                // 第0层转完一圈，逐层级联
+                for (int level = 1; slot == 0 && level < TW_LEVELS; ++level)
+                    slot = cascade(level);
+                int bucket = _tick & mask(0);
+                uint32_t idx = _buckets[bucket];
+                _buckets[bucket] = TW_NIL;
+                while (idx != TW_NIL)
+                {
+                    uint32_t next = _nodes[idx].next;
+                    expired.push_back(std::move(_nodes[idx].cb));
+                    release(idx);
+                    idx = next;
+                }
+                _tick++;
+            }
+        }
+        for (auto &cb : expired)
+            cb();
+    }
+
+    // 推进到当前时间，由服务器的周期定时器调用
+    void advance() { advance_to(now_ms()); }
+
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _count;
+    }
+};
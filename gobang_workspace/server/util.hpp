@@ -147,6 +147,25 @@ public:
         }
         return res.size();
     }
+
+    // url解码：%XX还原为字节，+还原为空格
+    static std::string url_decode(const std::string &src)
+    {
+        std::string res;
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            if (src[i] == '%' && i + 2 < src.size() && isxdigit((unsigned char)src[i + 1]) && isxdigit((unsigned char)src[i + 2]))
+            {
+                res += (char)std::stoi(src.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            }
+            else if (src[i] == '+')
+                res += ' ';
+            else
+                res += src[i];
+        }
+        return res;
+    }
 };
 
 
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <websocketpp/frame.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+
+/*
+* websocket服务器配置模块
+* 默认的websocketpp::config::asio面向通用场景：每个连接16KB的读缓冲区、每条消息单独new/delete、
+* 所有日志通道都编译进来、32MB的消息上限。本项目的连接上几乎只有几十字节的走棋和聊天消息，
+* 因此提供一个精简的配置：
+*   1. 连接读缓冲区缩小到WS_READ_BUFFER字节（读缓冲区直接内嵌在连接对象中）
+*   2. 消息对象从全局消息池中取出，释放时归还，负载的内存随消息对象一起复用
+*   3. 编译期只保留错误日志通道，访问日志全部去掉
+*   4. 握手、pong的超时时间和消息大小上限按对局场景收紧
+*   5. /hall和/room上协商permessage-deflate压缩：大厅和房间的消息字段高度重复，
+*      保留压缩上下文（context takeover）时后续消息只需要引用之前出现过的字段名；
+*      滑动窗口位数可配置，小于WS_DEFLATE_THRESHOLD字节的消息不压缩，省去压缩的cpu开销
+*   6. 发给大量连接的同一条消息（大厅状态推送）预先生成帧头，所有连接共用同一个消息对象，
+*      websocketpp对已经准备好的消息直接排队发送，不再为每个连接复制负载
+*
+* 编译时定义WS_STOCK_CONFIG则使用默认配置，便于性能对比
+*/
+
+#define WS_READ_BUFFER 1024           // 连接读缓冲区大小，默认16384
+#define WS_MAX_MESSAGE 65536          // 单条消息上限，默认32MB
+#define WS_OPEN_HANDSHAKE_TIMEOUT 3000 // 握手超时 ms，默认5000
+#define WS_CLOSE_HANDSHAKE_TIMEOUT 1000
+#define WS_PONG_TIMEOUT 3000
+#define WS_POOL_SIZE 4096             // 消息池中最多缓存的空闲消息数量
+#define WS_POOL_PAYLOAD 4096          // 负载容量超过该值的消息不回收，避免池中积累大块内存
+#define WS_DEFLATE_CONTEXT_TAKEOVER 1 // 服务器端是否在消息之间保留压缩上下文
+#define WS_DEFLATE_WINDOW_BITS 11     // 服务器端压缩的滑动窗口位数 8~15，每个连接的压缩状态约为 2^(bits+2) 字节
+#define WS_DEFLATE_THRESHOLD 64       // 小于该字节数的消息不压缩
+
+// 全局的空闲消息池，所有连接共用
+template <typename message>
+class ws_message_pool
+{
+private:
+    std::mutex _mutex;
+    std::vector<message *> _free;
+
+    ws_message_pool() { _free.reserve(WS_POOL_SIZE); }
+    ~ws_message_pool()
+    {
+        for (message *msg : _free)
+            delete msg;
+    }
+
+public:
+    static ws_message_pool &instance()
+    {
+        static ws_message_pool pool;
+        return pool;
+    }
+
+    // 取出一个空闲消息，没有则返回nullptr
+    message *acquire()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_free.empty())
+            return nullptr;
+        message *msg = _free.back();
+        _free.pop_back();
+        return msg;
+    }
+
+    // 归还消息，池满或负载过大时直接释放
+    void release(message *msg)
+    {
+        if (msg->get_raw_payload().capacity() <= WS_POOL_PAYLOAD)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_free.size() < WS_POOL_SIZE)
+            {
+                _free.push_back(msg);
+                return;
+            }
+        }
+        delete msg;
+    }
+};
+
+// 连接的消息管理器，与websocketpp::message_buffer::alloc::con_msg_manager接口一致
+// 消息通过自定义删除器归还到全局消息池，而不是交给websocketpp的recycle（库中未使用）
+template <typename message>
+class pooled_msg_manager : public websocketpp::lib::enable_shared_from_this<pooled_msg_manager<message>>
+{
+public:
+    typedef pooled_msg_manager<message> type;
+    typedef websocketpp::lib::shared_ptr<pooled_msg_manager> ptr;
+    typedef websocketpp::lib::weak_ptr<pooled_msg_manager> weak_ptr;
+    typedef typename message::ptr message_ptr;
+
+private:
+    static void release(message *msg) { ws_message_pool<message>::instance().release(msg); }
+
+public:
+    message_ptr get_message()
+    {
+        return get_message(websocketpp::frame::opcode::text, 0);
+    }
+
+    message_ptr get_message(websocketpp::frame::opcode::value op, size_t size)
+    {
+        message *msg = ws_message_pool<message>::instance().acquire();
+        if (msg == nullptr)
+            return message_ptr(new message(this->shared_from_this(), op, size), &pooled_msg_manager::release);
+        // 复用的消息恢复为新建时的状态，保留负载的容量
+        msg->set_opcode(op);
+        msg->set_prepared(false);
+        msg->set_fin(true);
+        msg->set_terminal(false);
+        msg->set_compressed(false);
+        msg->set_header(std::string());
+        msg->get_raw_payload().clear();
+        msg->get_raw_payload().reserve(size);
+        return message_ptr(msg, &pooled_msg_manager::release);
+    }
+
+    bool recycle(message *) { return false; }
+};
+
+// 按上面的配置调整的permessage-deflate扩展，每个连接的协议处理器创建时生效
+template <typename config>
+class tuned_deflate : public websocketpp::extensions::permessage_deflate::enabled<config>
+{
+public:
+    tuned_deflate()
+    {
+        if (WS_DEFLATE_CONTEXT_TAKEOVER == 0)
+            this->enable_server_no_context_takeover();
+        // 客户端要求更小的窗口时以客户端为准
+        this->set_server_max_window_bits(WS_DEFLATE_WINDOW_BITS, websocketpp::extensions::permessage_deflate::mode::smallest);
+    }
+};
+
+struct lean_config : public websocketpp::config::asio
+{
+    typedef lean_config type;
+    typedef websocketpp::config::asio base;
+
+    typedef base::concurrency_type concurrency_type;
+    typedef base::request_type request_type;
+    typedef base::response_type response_type;
+    typedef base::alog_type alog_type;
+    typedef base::elog_type elog_type;
+    typedef base::rng_type rng_type;
+    typedef base::transport_type transport_type;
+
+    typedef websocketpp::message_buffer::message<pooled_msg_manager> message_type;
+    typedef pooled_msg_manager<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type> endpoint_msg_manager_type;
+
+    static const size_t connection_read_buffer_size = WS_READ_BUFFER;
+    static const size_t max_message_size = WS_MAX_MESSAGE;
+    static const size_t max_http_body_size = WS_MAX_MESSAGE;
+
+    static const long timeout_open_handshake = WS_OPEN_HANDSHAKE_TIMEOUT;
+    static const long timeout_close_handshake = WS_CLOSE_HANDSHAKE_TIMEOUT;
+    static const long timeout_pong = WS_PONG_TIMEOUT;
+
+    static const websocketpp::log::level alog_level = websocketpp::log::alevel::none;
+    static const websocketpp::log::level elog_level = websocketpp::log::elevel::rerror | websocketpp::log::elevel::fatal;
+
+    struct permessage_deflate_config
+    {
+    };
+    typedef tuned_deflate<permessage_deflate_config> permessage_deflate_type;
+};
+
+#ifdef WS_STOCK_CONFIG
+typedef websocketpp::config::asio ws_config;
+#else
+typedef lean_config ws_config;
+#endif
+
+using WSserver = websocketpp::server<ws_config>;
+
+// 发送文本消息，只有达到WS_DEFLATE_THRESHOLD字节且连接协商了压缩时才压缩
+inline void ws_send(const WSserver::connection_ptr &conn, const std::string &body)
+{
+    WSserver::message_ptr msg = conn->get_message(websocketpp::frame::opcode::text, body.size());
+    msg->append_payload(body);
+    msg->set_compressed(body.size() >= WS_DEFLATE_THRESHOLD);
+    conn->send(msg);
+}
+
+// 生成一个可以发给多个连接的文本帧：服务器发出的帧不加掩码，帧头与连接无关，只生成一次
+// 压缩上下文是每个连接各自的，共用的帧不压缩；conn只用来取得消息对象
+inline WSserver::message_ptr ws_shared_frame(const WSserver::connection_ptr &conn, const std::string &body)
+{
+    WSserver::message_ptr msg = conn->get_message(websocketpp::frame::opcode::text, body.size());
+    msg->append_payload(body);
+    websocketpp::frame::basic_header header(websocketpp::frame::opcode::text, body.size(), true, false);
+    websocketpp::frame::extended_header ext(body.size());
+    msg->set_header(websocketpp::frame::prepare_header(header, ext));
+    msg->set_prepared(true);
+    return msg;
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+* 长连接消息解析模块
+* 客户端发来的消息都是一层的json对象，字段固定：optype room_id uid row col message rule board
+* 不构造Json::Value，直接扫描消息填入定长的结构体，解析过程中不分配内存：
+*   optype在解析时就转换成枚举，之后按枚举分发，不再反复比较字符串
+*   聊天内容解码转义后放在结构体内的缓冲区中，超出长度的消息直接拒绝
+*   其他字段跳过，但仍然要求是合法的json
+* 解析前先校验整条消息是合法的UTF-8：每次检查16个字节，全是ASCII时直接跳过，遇到多字节字符再逐个校验
+*/
+
+#define WS_CHAT_MAX 1024 // 聊天内容的最大字节数
+
+typedef enum
+{
+    WS_OP_UNKNOWN,
+    WS_OP_MATCH_START,
+    WS_OP_MATCH_STOP,
+    WS_OP_PUT_CHESS,
+    WS_OP_CHAT,
+    WS_OP_CHALLENGE, // 向uid发起挑战
+    WS_OP_ACCEPT,    // 接受uid的挑战
+    WS_OP_DECLINE    // 拒绝uid的挑战
+} ws_optype;
+
+// 消息中出现过的字段
+#define WS_FIELD_OPTYPE 0x01
+#define WS_FIELD_ROOM_ID 0x02
+#define WS_FIELD_UID 0x04
+#define WS_FIELD_ROW 0x08
+#define WS_FIELD_COL 0x10
+#define WS_FIELD_MESSAGE 0x20
+#define WS_FIELD_RULE 0x40
+#define WS_FIELD_BOARD 0x80
+
+struct ws_request
+{
+    ws_optype optype;
+    uint64_t room_id;
+    uint64_t uid;
+    int row;
+    int col;
+    size_t message_len;
+    char message[WS_CHAT_MAX];
+    int rule;  // 匹配和挑战选择的规则，没有该字段时使用默认规则
+    int board; // 匹配和挑战选择的棋盘类型，没有该字段时使用标准棋盘
+    int fields;
+};
+
+// 枚举对应的optype字符串，用于回复
+inline const char *ws_optype_name(ws_optype op)
+{
+    switch (op)
+    {
+    case WS_OP_MATCH_START:
+        return "match_start";
+    case WS_OP_MATCH_STOP:
+        return "match_stop";
+    case WS_OP_PUT_CHESS:
+        return "put_chess";
+    case WS_OP_CHAT:
+        return "chat";
+    case WS_OP_CHALLENGE:
+        return "challenge";
+    case WS_OP_ACCEPT:
+        return "accept";
+    case WS_OP_DECLINE:
+        return "decline";
+    default:
+        return "unknown";
+    }
+}
+
+// 校验从p开始的非ASCII字符，返回字符的字节数，不合法返回0
+inline size_t utf8_char(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char c = p[0];
+    size_t n;
+    uint32_t cp;
+    if (c >= 0xC2 && c <= 0xDF)
+        n = 2, cp = c & 0x1F;
+    else if (c >= 0xE0 && c <= 0xEF)
+        n = 3, cp = c & 0x0F;
+    else if (c >= 0xF0 && c <= 0xF4)
+        n = 4, cp = c & 0x07;
+    else
+        return 0; // 单独的后续字节、0xC0 0xC1（超长编码）、0xF5以上
+    if ((size_t)(end - p) < n)
+        return 0;
+    for (size_t i = 1; i < n; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+        cp = cp << 6 | (p[i] & 0x3F);
+    }
+    // 超长编码、代理区、超出范围
+    if ((n == 3 && cp < 0x800) || (n == 4 && (cp < 0x10000 || cp > 0x10FFFF)) || (cp >= 0xD800 && cp <= 0xDFFF))
+        return 0;
+    return n;
+}
+
+// 校验整段数据是否是合法的UTF-8
+inline bool utf8_valid(const char *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    while (p < end)
+    {
+#ifdef __SSE2__
+        // 16个字节的最高位都是0则全是ASCII
+        if (end - p >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            int mask = _mm_movemask_epi8(chunk);
+            if (mask == 0)
+            {
+                p += 16;
+                continue;
+            }
+            // 跳过前面的ASCII，从第一个非ASCII字节开始逐个校验
+            p += __builtin_ctz(mask);
+        }
+#endif
+        if (*p < 0x80)
+        {
+            p++;
+            continue;
+        }
+        size_t n = utf8_char(p, end);
+        if (n == 0)
+            return false;
+        p += n;
+    }
+    return true;
+}
+
+class ws_parser
+{
+private:
+    const char *_p;
+    const char *_end;
+
+private:
+    void skip_ws()
+    {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+            _p++;
+    }
+
+    bool expect(char c)
+    {
+        skip_ws();
+        if (_p >= _end || *_p != c)
+            return false;
+        _p++;
+        return true;
+    }
+
+    static int hex(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    bool read_hex4(uint32_t &v)
+    {
+        if (_end - _p < 4)
+            return false;
+        v = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            int h = hex(_p[i]);
+            if (h < 0)
+                return false;
+            v = v << 4 | h;
+        }
+        _p += 4;
+        return true;
+    }
+
+    // 读取一个字符串，解码转义后写入out（out为空时只校验并跳过）
+    // 不需要解码时返回原文的位置，不拷贝
+    bool read_string(char *out, size_t cap, size_t &len, const char **raw = nullptr, size_t *raw_len = nullptr)
+    {
+        if (expect('"') == false)
+            return false;
+        const char *start = _p;
+        bool escaped = false;
+        len = 0;
+        while (_p < _end && *_p != '"')
+        {
+            unsigned char c = *_p;
+            if (c < 0x20)
+                return false;
+            if (c != '\\')
+            {
+                if (out != nullptr)
+                {
+                    if (len >= cap)
+                        return false;
+                    out[len] = c;
+                }
+                len++;
+                _p++;
+                continue;
+            }
+            escaped = true;
+            if (++_p >= _end)
+                return false;
+            uint32_t cp;
+            switch (*_p++)
+            {
+            case '"': cp = '"'; break;
+            case '\\': cp = '\\'; break;
+            case '/': cp = '/'; break;
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u':
+                if (read_hex4(cp) == false)
+                    return false;
+                // 代理对
+                if (cp >= 0xD800 && cp <= 0xDBFF)
+                {
+                    uint32_t lo;
+                    if (_end - _p < 2 || _p[0] != '\\' || _p[1] != 'u')
+                        return false;
+                    _p += 2;
+                    if (read_hex4(lo) == false || lo < 0xDC00 || lo > 0xDFFF)
+                        return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                else if (cp >= 0xDC00 && cp <= 0xDFFF)
+                    return false;
+                break;
+            default:
+                return false;
+            }
+            // 编码成UTF-8
+            char buf[4];
+            size_t n;
+            if (cp < 0x80)
+                buf[0] = cp, n = 1;
+            else if (cp < 0x800)
+                buf[0] = 0xC0 | cp >> 6, buf[1] = 0x80 | (cp & 0x3F), n = 2;
+            else if (cp < 0x10000)
+                buf[0] = 0xE0 | cp >> 12, buf[1] = 0x80 | (cp >> 6 & 0x3F), buf[2] = 0x80 | (cp & 0x3F), n = 3;
+            else
+                buf[0] = 0xF0 | cp >> 18, buf[1] = 0x80 | (cp >> 12 & 0x3F), buf[2] = 0x80 | (cp >> 6 & 0x3F), buf[3] = 0x80 | (cp & 0x3F), n = 4;
+            if (out != nullptr)
+            {
+                if (len + n > cap)
+                    return false;
+                memcpy(out + len, buf, n);
+            }
+            len += n;
+        }
+        if (_p >= _end)
+            return false;
+        if (raw != nullptr)
+        {
+            *raw = escaped ? nullptr : start;
+            *raw_len = _p - start;
+        }
+        _p++;
+        return true;
+    }
+
+    // 读取一个整数，不接受小数和指数
+    bool read_int(int64_t &v)
+    {
+        skip_ws();
+        bool neg = false;
+        if (_p < _end && *_p == '-')
+            neg = true, _p++;
+        if (_p >= _end || *_p < '0' || *_p > '9')
+            return false;
+        uint64_t u = 0;
+        int digits = 0;
+        while (_p < _end && *_p >= '0' && *_p <= '9')
+        {
+            u = u * 10 + (*_p++ - '0');
+            if (++digits > 18)
+                return false;
+        }
+        if (_p < _end && (*_p == '.' || *_p == 'e' || *_p == 'E'))
+            return false;
+        v = neg ? -(int64_t)u : (int64_t)u;
+        return true;
+    }
+
+    bool read_literal(const char *lit)
+    {
+        size_t n = strlen(lit);
+        if ((size_t)(_end - _p) < n || memcmp(_p, lit, n) != 0)
+            return false;
+        _p += n;
+        return true;
+    }
+
+    // 跳过任意一个json值，depth限制嵌套层数
+    bool skip_value(int depth = 0)
+    {
+        if (depth > 16)
+            return false;
+        skip_ws();
+        if (_p >= _end)
+            return false;
+        size_t len;
+        switch (*_p)
+        {
+        case '"':
+            return read_string(nullptr, 0, len);
+        case 't':
+            return read_literal("true");
+        case 'f':
+            return read_literal("false");
+        case 'n':
+            return read_literal("null");
+        case '{':
+        case '[':
+        {
+            char close = *_p == '{' ? '}' : ']';
+            bool object = *_p == '{';
+            _p++;
+            skip_ws();
+            if (_p < _end && *_p == close)
+                return ++_p, true;
+            while (1)
+            {
+                if (object && (read_string(nullptr, 0, len) == false || expect(':') == false))
+                    return false;
+                if (skip_value(depth + 1) == false)
+                    return false;
+                skip_ws();
+                if (_p < _end && *_p == ',')
+                {
+                    _p++;
+                    continue;
+                }
+                return expect(close);
+            }
+        }
+        default:
+        {
+            // 数字：整数部分、小数、指数
+            if (*_p == '-')
+                _p++;
+            const char *start = _p;
+            while (_p < _end && ((*_p >= '0' && *_p <= '9') || *_p == '.' || *_p == 'e' || *_p == 'E' || *_p == '+' || *_p == '-'))
+                _p++;
+            return _p > start;
+        }
+        }
+    }
+
+    static ws_optype intern(const char *s, size_t n)
+    {
+        if (n == 9 && memcmp(s, "put_chess", 9) == 0)
+            return WS_OP_PUT_CHESS;
+        if (n == 4 && memcmp(s, "chat", 4) == 0)
+            return WS_OP_CHAT;
+        if (n == 11 && memcmp(s, "match_start", 11) == 0)
+            return WS_OP_MATCH_START;
+        if (n == 10 && memcmp(s, "match_stop", 10) == 0)
+            return WS_OP_MATCH_STOP;
+        if (n == 9 && memcmp(s, "challenge", 9) == 0)
+            return WS_OP_CHALLENGE;
+        if (n == 6 && memcmp(s, "accept", 6) == 0)
+            return WS_OP_ACCEPT;
+        if (n == 7 && memcmp(s, "decline", 7) == 0)
+            return WS_OP_DECLINE;
+        return WS_OP_UNKNOWN;
+    }
+
+    static bool key_is(const char *k, size_t n, const char *name)
+    {
+        return strlen(name) == n && memcmp(k, name, n) == 0;
+    }
+
+    // 读取一个字段的值
+    bool read_field(const char *k, size_t n, ws_request &req)
+    {
+        int64_t v;
+        size_t len;
+        if (key_is(k, n, "optype"))
+        {
+            // 带转义的optype不是已知的类型
+            const char *raw;
+            size_t raw_len;
+            if (read_string(nullptr, 0, len, &raw, &raw_len) == false)
+                return false;
+            req.optype = raw == nullptr ? WS_OP_UNKNOWN : intern(raw, raw_len);
+            req.fields |= WS_FIELD_OPTYPE;
+            return true;
+        }
+        if (key_is(k, n, "message"))
+        {
+            if (read_string(req.message, WS_CHAT_MAX, req.message_len) == false)
+                return false;
+            req.fields |= WS_FIELD_MESSAGE;
+            return true;
+        }
+        if (key_is(k, n, "room_id") || key_is(k, n, "uid"))
+        {
+            if (read_int(v) == false || v < 0)
+                return false;
+            if (n == 3)
+                req.uid = v, req.fields |= WS_FIELD_UID;
+            else
+                req.room_id = v, req.fields |= WS_FIELD_ROOM_ID;
+            return true;
+        }
+        if (key_is(k, n, "rule") || key_is(k, n, "board"))
+        {
+            if (read_int(v) == false || v < INT32_MIN || v > INT32_MAX)
+                return false;
+            if (k[0] == 'r')
+                req.rule = v, req.fields |= WS_FIELD_RULE;
+            else
+                req.board = v, req.fields |= WS_FIELD_BOARD;
+            return true;
+        }
+        if (key_is(k, n, "row") || key_is(k, n, "col"))
+        {
+            if (read_int(v) == false || v < INT32_MIN || v > INT32_MAX)
+                return false;
+            if (k[0] == 'r')
+                req.row = v, req.fields |= WS_FIELD_ROW;
+            else
+                req.col = v, req.fields |= WS_FIELD_COL;
+            return true;
+        }
+        return skip_value();
+    }
+
+public:
+    // 解析一条消息，消息不是合法的UTF-8、不是json对象或字段类型不对时返回false
+    bool parse(const char *data, size_t len, ws_request &req)
+    {
+        req.optype = WS_OP_UNKNOWN;
+        req.room_id = req.uid = 0;
+        req.row = req.col = 0;
+        req.rule = req.board = 0;
+        req.message_len = 0;
+        req.fields = 0;
+        if (utf8_valid(data, len) == false)
+            return false;
+        _p = data;
+        _end = data + len;
+        if (expect('{') == false)
+            return false;
+        skip_ws();
+        if (_p < _end && *_p == '}')
+            _p++;
+        else
+        {
+            while (1)
+            {
+                // 键名中不会有转义，有转义的键名不是我们的字段
+                size_t n;
+                const char *raw;
+                size_t raw_len;
+                if (read_string(nullptr, 0, n, &raw, &raw_len) == false || expect(':') == false)
+                    return false;
+                if (raw == nullptr)
+                {
+                    if (skip_value() == false)
+                        return false;
+                }
+                else if (read_field(raw, raw_len, req) == false)
+                    return false;
+                skip_ws();
+                if (_p < _end && *_p == ',')
+                {
+                    _p++;
+                    continue;
+                }
+                if (expect('}') == false)
+                    return false;
+                break;
+            }
+        }
+        skip_ws();
+        return _p == _end;
+    }
+
+    // 消息类型需要的字段是否齐全
+    static bool complete(const ws_request &req)
+    {
+        switch (req.optype)
+        {
+        case WS_OP_PUT_CHESS:
+            return (req.fields & (WS_FIELD_ROOM_ID | WS_FIELD_UID | WS_FIELD_ROW | WS_FIELD_COL)) ==
+                   (WS_FIELD_ROOM_ID | WS_FIELD_UID | WS_FIELD_ROW | WS_FIELD_COL);
+        case WS_OP_CHAT:
+            return (req.fields & (WS_FIELD_ROOM_ID | WS_FIELD_UID | WS_FIELD_MESSAGE)) ==
+                   (WS_FIELD_ROOM_ID | WS_FIELD_UID | WS_FIELD_MESSAGE);
+        case WS_OP_CHALLENGE:
+        case WS_OP_ACCEPT:
+        case WS_OP_DECLINE:
+            return (req.fields & WS_FIELD_UID) != 0;
+        default:
+            return true;
+        }
+    }
+};